@@ -0,0 +1,287 @@
+#!/usr/bin/env python3
+# UPMC -- licence informatique
+# (C) 2009-2011 Equipe enseignante
+# LI223: Initiation à la Compilation et aux Machines Virtuelles
+#
+# Redistribution possible sous licence GPL v2.0 ou ultérieure
+
+"""Suite de mesures de performances de la machine virtuelle.
+
+Chaque programme de la suite (fichiers `.sasm` de ce répertoire) est
+exécuté plusieurs fois ; pour chaque mesure, le script affiche la médiane
+et son intervalle de confiance, calculé sans hypothèse sur la distribution
+(statistiques d'ordre, loi binomiale) :
+
+ - le temps écoulé (wall time) ;
+ - les instructions exécutées par seconde (compteur de la VM, cf.
+   vm_stats.h, lu dans le fichier écrit par `--metrics`) ;
+ - la mémoire résidente maximale (getrusage du processus fils) ;
+ - le temps passé dans les récupérations mémoire (même fichier).
+
+Avec `--save=FILE`, les mesures sont enregistrées (JSON) ; avec
+`--baseline=FILE`, elles sont comparées à une mesure enregistrée : une
+différence n'est signalée comme significative que si les intervalles de
+confiance des deux médianes sont disjoints.
+
+Usage (depuis src/, cf. `make bench` et `make bench-baseline`) :
+  python3 ../bench/bench.py --svm=./svm --save=../bench/baseline.json
+  (modification de la VM, make)
+  python3 ../bench/bench.py --svm=./svm --baseline=../bench/baseline.json
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# Les programmes de la suite : nom, fichier.
+BENCHMARKS = [
+    ("fib", "fib.sasm"),
+    ("tak", "tak.sasm"),
+    ("ackermann", "ackermann.sasm"),
+    ("closures", "closures.sasm"),
+    ("lists", "lists.sasm"),
+    ("assoc", "assoc.sasm"),
+    ("gc-stress", "gc-stress.sasm"),
+    ("deep-recursion", "deep-recursion.sasm"),
+    ("output", "output.sasm"),
+]
+
+# Les mesures : clé, libellé, unité d'affichage, facteur d'échelle et sens
+# (True si une valeur plus grande est meilleure).
+METRICS = [
+    ("wall", "wall time", "s", 1.0, False),
+    ("ips", "instr/sec", "M", 1e-6, True),
+    ("rss", "peak RSS", "MiB", 1.0 / 1024.0, False),
+    ("gc", "GC time", "s", 1.0, False),
+]
+
+FORMAT_VERSION = 1
+
+
+def read_metrics(filename):
+    """Lecture du fichier des métriques (format texte de Prometheus)."""
+    values = {}
+    with open(filename) as f:
+        for line in f:
+            if line.startswith("#"):
+                continue
+            fields = line.split()
+            if len(fields) == 2:
+                values[fields[0]] = float(fields[1])
+    return values
+
+
+def run_once(svm, program, extra_args, tmpdir):
+    """Une exécution du programme : retourne les mesures et le nombre
+    d'instructions exécutées."""
+    metrics = os.path.join(tmpdir, "metrics.prom")
+    errors = os.path.join(tmpdir, "stderr")
+    # une seule écriture des métriques, en fin d'exécution
+    args = [svm, "--metrics=" + metrics, "--metrics-period=2147483647"]
+    args += extra_args + [program]
+
+    with open(errors, "w") as err:
+        start = time.perf_counter()
+        proc = subprocess.Popen(args, stdout=subprocess.DEVNULL, stderr=err)
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+
+    if proc.returncode != 0:
+        with open(errors) as err:
+            sys.stderr.write(err.read())
+        sys.exit("bench: %s failed (exit status %d)"
+                 % (" ".join(args), proc.returncode))
+
+    values = read_metrics(metrics)
+    instructions = int(values["svm_instructions_total"])
+    sample = {
+        "wall": wall,
+        "ips": instructions / wall,
+        # ru_maxrss est en kio sous Linux
+        "rss": float(usage.ru_maxrss),
+        "gc": values["svm_gc_pause_seconds_total"],
+    }
+    return sample, instructions
+
+
+def binomial_cdf(k, n):
+    """P(X <= k) pour X de loi binomiale B(n, 1/2)."""
+    return sum(math.comb(n, i) for i in range(k + 1)) / 2.0 ** n
+
+
+def median_ci(samples, confidence):
+    """Médiane et intervalle de confiance de la médiane.
+    L'intervalle [x(j), x(n-j+1)] (statistiques d'ordre) contient la
+    médiane avec une probabilité 1 - 2 P(X <= j-1), X de loi B(n, 1/2) ;
+    on prend le plus petit qui atteint le niveau demandé (ou [min, max]
+    s'il y a trop peu d'exécutions)."""
+    xs = sorted(samples)
+    n = len(xs)
+    if n % 2 == 1:
+        median = xs[n // 2]
+    else:
+        median = (xs[n // 2 - 1] + xs[n // 2]) / 2.0
+    j = 1
+    while j < n // 2 and 2 * binomial_cdf(j, n) <= 1.0 - confidence:
+        j = j + 1
+    return median, xs[j - 1], xs[n - j]
+
+
+def summarize(samples, confidence):
+    """Médianes et intervalles de confiance de toutes les mesures."""
+    summary = {}
+    for key, _, _, _, _ in METRICS:
+        median, low, high = median_ci(samples[key], confidence)
+        summary[key] = {"median": median, "low": low, "high": high}
+    return summary
+
+
+def compare(current, baseline, higher_is_better):
+    """Comparaison de deux médianes : variation relative et verdict."""
+    if baseline["median"] == 0:
+        return "", ""
+    change = (current["median"] - baseline["median"]) / baseline["median"]
+    if current["low"] > baseline["high"]:
+        verdict = "better" if higher_is_better else "worse"
+    elif current["high"] < baseline["low"]:
+        verdict = "worse" if higher_is_better else "better"
+    else:
+        verdict = "~"
+    return "%+6.1f%%" % (100.0 * change), verdict
+
+
+def print_result(name, result, baseline):
+    """Affichage des mesures d'un programme."""
+    line = "%s (%d runs, %d instructions" % (
+        name, len(result["samples"]["wall"]), result["instructions"])
+    if baseline is not None and \
+       baseline["instructions"] != result["instructions"]:
+        line += ", baseline %d" % baseline["instructions"]
+    print(line + ")")
+
+    for key, label, unit, scale, higher_is_better in METRICS:
+        s = result["summary"][key]
+        interval = "[%.4f, %.4f]" % (s["low"] * scale, s["high"] * scale)
+        text = "  %-10s %10.4f %-3s %-22s" % (
+            label, s["median"] * scale, unit, interval)
+        if baseline is not None:
+            b = baseline["summary"][key]
+            change, verdict = compare(s, b, higher_is_better)
+            text += "   baseline %10.4f %s %s" % (
+                b["median"] * scale, change, verdict)
+        print(text)
+
+
+def load_baseline(filename, confidence):
+    """Lecture d'une mesure enregistrée (les intervalles de confiance sont
+    recalculés au niveau demandé)."""
+    with open(filename) as f:
+        data = json.load(f)
+    if data.get("version") != FORMAT_VERSION:
+        sys.exit("bench: %s: unsupported baseline format" % filename)
+    for result in data["benchmarks"].values():
+        result["summary"] = summarize(result["samples"], confidence)
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run the SVM benchmark suite.")
+    parser.add_argument("--svm", default="./svm",
+                        help="the VM executable (default: ./svm)")
+    parser.add_argument("--runs", type=int, default=10,
+                        help="measured runs per benchmark (default: 10)")
+    parser.add_argument("--warmup", type=int, default=1,
+                        help="unmeasured runs per benchmark (default: 1)")
+    parser.add_argument("--confidence", type=float, default=0.95,
+                        help="confidence level of the median intervals "
+                        "(default: 0.95)")
+    parser.add_argument("--baseline", metavar="FILE",
+                        help="compare with the results saved in FILE")
+    parser.add_argument("--save", metavar="FILE",
+                        help="save the results to FILE (JSON)")
+    parser.add_argument("--filter", metavar="REGEX", default="",
+                        help="only run the benchmarks matching REGEX")
+    parser.add_argument("svm_args", nargs="*", metavar="SVM_ARG",
+                        help="extra VM options (after --), "
+                        "e.g. -- --engine=reg")
+    options = parser.parse_args()
+
+    if options.runs < 1:
+        parser.error("--runs must be positive")
+
+    baseline = None
+    if options.baseline is not None:
+        if os.path.exists(options.baseline):
+            baseline = load_baseline(options.baseline, options.confidence)
+            if baseline["svm_args"] != options.svm_args:
+                print("warning: baseline measured with VM options: %s"
+                      % (" ".join(baseline["svm_args"]) or "(none)"))
+        else:
+            print("no baseline (%s): run `make bench-baseline` first"
+                  % options.baseline)
+
+    benchmarks = [(name, filename) for name, filename in BENCHMARKS
+                  if re.search(options.filter, name)]
+    results = {}
+    wall_ratios = []
+
+    with tempfile.TemporaryDirectory(prefix="svm-bench-") as tmpdir:
+        for name, filename in benchmarks:
+            program = os.path.join(BENCH_DIR, filename)
+            samples = {key: [] for key, _, _, _, _ in METRICS}
+            instructions = 0
+
+            for _ in range(options.warmup):
+                run_once(options.svm, program, options.svm_args, tmpdir)
+            for _ in range(options.runs):
+                sample, instructions = run_once(
+                    options.svm, program, options.svm_args, tmpdir)
+                for key in samples:
+                    samples[key].append(sample[key])
+
+            result = {"instructions": instructions, "samples": samples,
+                      "summary": summarize(samples, options.confidence)}
+            results[name] = result
+
+            base = None
+            if baseline is not None:
+                base = baseline["benchmarks"].get(name)
+            print_result(name, result, base)
+            if base is not None:
+                wall_ratios.append(result["summary"]["wall"]["median"] /
+                                   base["summary"]["wall"]["median"])
+
+    if wall_ratios:
+        geomean = math.exp(sum(map(math.log, wall_ratios)) / len(wall_ratios))
+        print("wall time vs baseline (geometric mean of medians): %+.1f%%"
+              % (100.0 * (geomean - 1.0)))
+
+    if options.save is not None:
+        data = {
+            "version": FORMAT_VERSION,
+            "svm_args": options.svm_args,
+            "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+            "benchmarks": {
+                name: {"instructions": r["instructions"],
+                       "samples": r["samples"]}
+                for name, r in results.items()
+            },
+        }
+        with open(options.save, "w") as f:
+            json.dump(data, f, indent=1)
+            f.write("\n")
+        print("results saved to %s" % options.save)
+
+
+if __name__ == "__main__":
+    main()
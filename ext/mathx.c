@@ -0,0 +1,137 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+/** \file mathx.c
+ * Exemple de module de primitives natives (cf. extension.h).
+ *
+ * Compilation (depuis src/) : make ext
+ * Utilisation : ./svm --load-prims=../ext/mathx.so prog.sasm
+ *
+ * Primitives :
+ * - (gcd a b) : le plus grand diviseur commun;
+ * - (isqrt n) : la racine carrée entière (n >= 0);
+ * - (iota n) : la liste (0 1 ... n-1);
+ * - (fold-range f init n) : (f n-1 (... (f 1 (f 0 init)))).
+ ******/
+
+#include "extension.h"
+
+/** Calcul du pgcd. */
+static int mathx_gcd(int a, int b) {
+  if (a < 0) a = -a;
+  if (b < 0) b = -b;
+  while (b != 0) {
+    int r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/** Calcul de la racine carrée entière (méthode de Newton). */
+static int mathx_isqrt(int n) {
+  long x = n, y = (x + 1) / 2;
+  while (y < x) {
+    x = y;
+    y = (x + n / x) / 2;
+  }
+  return (int)x;
+}
+
+/** Point d'entrée rapide de gcd. */
+static int gcd2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  if (!value_is_int(a) || !value_is_int(b)) return 0;
+  value_fill_int(res, mathx_gcd(value_int_get(a), value_int_get(b)));
+  return 1;
+}
+
+/** (gcd a b) */
+static void do_gcd(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t res;
+  int a = svm_check_int("gcd", svm_arg(stack, 0));
+  int b = svm_check_int("gcd", svm_arg(stack, 1));
+  value_fill_int(&res, mathx_gcd(a, b));
+  svm_return(stack, n, &res);
+}
+
+/** Point d'entrée rapide de isqrt. */
+static int isqrt1(vm_t *vm, value_t *a, value_t *res) {
+  if (!value_is_int(a) || value_int_get(a) < 0) return 0;
+  value_fill_int(res, mathx_isqrt(value_int_get(a)));
+  return 1;
+}
+
+/** (isqrt n) */
+static void do_isqrt(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t res;
+  int k = svm_check_int("isqrt", svm_arg(stack, 0));
+  if (k < 0) svm_error("isqrt", "negative argument");
+  value_fill_int(&res, mathx_isqrt(k));
+  svm_return(stack, n, &res);
+}
+
+/** (iota n)
+ * Les allocations ne déclenchent pas le GC : la liste en construction n'a
+ * pas besoin d'être enracinée.
+ */
+static void do_iota(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t list, elem;
+  int k = svm_check_int("iota", svm_arg(stack, 0));
+
+  value_fill_nil(&list);
+  while (k > 0) {
+    k = k - 1;
+    value_fill_int(&elem, k);
+    svm_make_pair(vm, &list, &elem, &list);
+  }
+  svm_return(stack, n, &list);
+}
+
+/** (fold-range f init n)
+ * Les appels de f peuvent déclencher le GC : l'accumulateur et la
+ * fonction restent sur la pile (arguments de la primitive). Les indices
+ * de svm_arg sont comptés depuis le sommet, y compris les valeurs
+ * enracinées.
+ */
+static void do_fold_range(vm_t *vm, varray_t *stack, int prim, int n) {
+  int count = svm_check_int("fold-range", svm_arg(stack, 2));
+  int i;
+
+  for (i = 0; i < count; i++) {
+    value_t index;
+    // pile : [f acc count ...] -> [f i acc f acc count ...]
+    value_fill_int(&index, i);
+    svm_root(stack, svm_arg(stack, 1));
+    svm_root(stack, &index);
+    svm_root(stack, svm_rooted(stack, 2));
+    svm_apply(vm, 2);
+    // le résultat devient le nouvel accumulateur : pile [r f acc count ...],
+    // l'argument 1 (acc) est à distance 2 du sommet (cf. svm_arg)
+    *svm_arg(stack, 2) = *svm_rooted(stack, 0);
+    svm_unroot(stack, 1);
+  }
+  svm_return(stack, n, svm_arg(stack, 1));
+}
+
+/** Descripteurs des primitives du module (numéros attribués au
+ * chargement). */
+static const prim_desc_t mathx_prims[] = {
+    {0, "gcd", 2, 2, PRIM_PURE | PRIM_FOLDABLE, NULL, gcd2, do_gcd},
+    {0, "isqrt", 1, 1, PRIM_PURE | PRIM_FOLDABLE, isqrt1, NULL, do_isqrt},
+    {0, "iota", 1, 1, 0, NULL, NULL, do_iota},
+    {0, "fold-range", 3, 3, 0, NULL, NULL, do_fold_range},
+};
+
+/** Initialisation du module. */
+int svm_module_init(int version) {
+  unsigned int i;
+  if (version != SVM_EXT_VERSION) return 1;
+  for (i = 0; i < sizeof(mathx_prims) / sizeof(mathx_prims[0]); i++) {
+    svm_register_prim(&mathx_prims[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "alloc_profile.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/** \file alloc_profile.c
+ * Échantillonnage des allocations et rapport de fin d'exécution.
+ ******/
+
+/** Le nombre de sites affichés dans chaque classement du rapport. */
+#define ALLOC_PROFILE_TOP_SITES 20
+
+/** Entrée d'un classement des sites. */
+typedef struct {
+  unsigned int pc;          /*!< le pc de l'instruction du site */
+  unsigned long long count; /*!< le critère du classement */
+} alloc_entry_t;
+
+/** Création d'un profileur des allocations.
+ * \param[in] vm la VM à profiler (son programme est chargé).
+ * \param rate le pas d'échantillonnage en octets (1 pour toutes les
+ * allocations).
+ * \return le profileur (sans échantillon).
+ */
+alloc_profile_t *alloc_profile_create(vm_t *vm, unsigned long rate) {
+  alloc_profile_t *profile =
+      (alloc_profile_t *)malloc(sizeof(alloc_profile_t));
+  assert(profile != NULL);
+  assert(rate > 0);
+
+  profile->vm = vm;
+  profile->sites = (alloc_site_t *)calloc(vm->program->size,
+                                          sizeof(alloc_site_t));
+  assert(profile->sites != NULL);
+  profile->rate = rate;
+  profile->countdown = rate;
+  profile->total_samples = 0;
+  profile->total_bytes = 0;
+
+  return profile;
+}
+
+/** Libération d'un profileur des allocations. */
+void alloc_profile_destroy(alloc_profile_t *profile) {
+  free(profile->sites);
+  free(profile);
+}
+
+/** Comptage d'une allocation (appelé par le GC pour chaque cellule).
+ * \param[in,out] profile le profileur.
+ * \param[in,out] cell la cellule allouée (son site est renseigné si
+ * l'allocation est échantillonnée).
+ * \param size la taille de la cellule (en octets).
+ */
+void alloc_profile_record(alloc_profile_t *profile, gc_cell_t *cell,
+                          size_t size) {
+  unsigned long long weight = 0;
+  frame_t *frame = profile->vm->frame;
+  unsigned int pc;
+
+  profile->countdown = profile->countdown - (long)size;
+  if (profile->countdown > 0) return;
+
+  // l'échantillon représente tous les pas franchis par l'allocation
+  while (profile->countdown <= 0) {
+    profile->countdown = profile->countdown + (long)profile->rate;
+    weight = weight + 1;
+  }
+
+  // le pc a déjà dépassé l'opcode de l'instruction en cours
+  pc = (frame->pc > 0) ? frame->pc - 1 : 0;
+  if (pc >= profile->vm->program->size) return;
+
+  cell->alloc_site = pc;
+  profile->sites[pc].samples = profile->sites[pc].samples + 1;
+  profile->sites[pc].bytes = profile->sites[pc].bytes + weight * profile->rate;
+  profile->sites[pc].fun_pc = frame->fun_pc;
+  profile->total_samples = profile->total_samples + 1;
+  profile->total_bytes = profile->total_bytes + weight * profile->rate;
+}
+
+/** Comptage d'un objet échantillonné qui survit à une récupération.
+ * \param[in,out] profile le profileur.
+ * \param[in] cell la cellule conservée (avec un site).
+ */
+void alloc_profile_survive(alloc_profile_t *profile, gc_cell_t *cell) {
+  alloc_site_t *site = &profile->sites[cell->alloc_site];
+  site->survivals = site->survivals + 1;
+}
+
+/** Comparaison des entrées d'un classement (par critère décroissant). */
+static int alloc_profile_compare(const void *a, const void *b) {
+  const alloc_entry_t *ea = (const alloc_entry_t *)a;
+  const alloc_entry_t *eb = (const alloc_entry_t *)b;
+  if (ea->count != eb->count) {
+    return (ea->count > eb->count) ? -1 : 1;
+  }
+  return (ea->pc > eb->pc) - (ea->pc < eb->pc);
+}
+
+/** Affichage d'un classement des sites.
+ * \param[in] profile le profileur (sites regroupés par instruction).
+ * \param[in] lives les objets échantillonnés vivants, par site.
+ * \param[in,out] entries le classement (trié ici).
+ * \param nb_entries le nombre d'entrées.
+ */
+static void alloc_profile_print(alloc_profile_t *profile, unsigned long *lives,
+                                alloc_entry_t *entries, int nb_entries) {
+  int i;
+
+  qsort(entries, nb_entries, sizeof(alloc_entry_t), alloc_profile_compare);
+  printf("%12s %14s %6s %12s %10s  %-10s %s\n", "samples", "bytes", "%",
+         "survivals", "live", "function", "pc: instruction");
+  for (i = 0; i < nb_entries && i < ALLOC_PROFILE_TOP_SITES; i++) {
+    alloc_site_t *site = &profile->sites[entries[i].pc];
+    double percent;
+    if (entries[i].count == 0) break;
+    percent = (profile->total_bytes == 0)
+                  ? 0.0
+                  : 100.0 * site->bytes / profile->total_bytes;
+    printf("%12llu %14llu %5.1f%% %12llu %10lu  ", site->samples, site->bytes,
+           percent, site->survivals, lives[entries[i].pc]);
+    if (site->fun_pc == 0) {
+      printf("%-10s ", "<toplevel>");
+    } else {
+      printf("fun@%-6u ", site->fun_pc);
+    }
+    printf("%u: ", entries[i].pc);
+    bytecode_print_instr(profile->vm->program, entries[i].pc);
+  }
+}
+
+/** Rapport du profileur des allocations (sur la sortie standard).
+ * Les objets échantillonnés encore vivants sont comptés sur le tas du GC.
+ * \param[in,out] profile le profileur (les sites sont regroupés par
+ * instruction).
+ */
+void alloc_profile_report(alloc_profile_t *profile) {
+  program_t *program = profile->vm->program;
+  unsigned long *lives =
+      (unsigned long *)calloc(program->size, sizeof(unsigned long));
+  alloc_entry_t *entries =
+      (alloc_entry_t *)malloc(sizeof(alloc_entry_t) * (program->size + 1));
+  gc_cell_t *cell;
+  unsigned int pc, next, k;
+  int nb_entries = 0;
+
+  assert(lives != NULL && entries != NULL);
+
+  for (cell = profile->vm->gc->heap.next; cell != NULL; cell = cell->next) {
+    if (cell->alloc_site >= 0) {
+      lives[cell->alloc_site] = lives[cell->alloc_site] + 1;
+    }
+  }
+
+  // regroupement des compteurs sur le pc de début de chaque instruction
+  for (pc = 0; pc < program->size; pc = next) {
+    alloc_site_t *site = &profile->sites[pc];
+    next = pc + bytecode_instr_size(program, pc);
+    for (k = pc + 1; k < next && k < program->size; k++) {
+      if (profile->sites[k].samples > 0) {
+        site->fun_pc = profile->sites[k].fun_pc;
+      }
+      site->samples = site->samples + profile->sites[k].samples;
+      site->bytes = site->bytes + profile->sites[k].bytes;
+      site->survivals = site->survivals + profile->sites[k].survivals;
+      lives[pc] = lives[pc] + lives[k];
+    }
+    if (site->samples > 0) {
+      entries[nb_entries].pc = pc;
+      nb_entries = nb_entries + 1;
+    }
+  }
+
+  printf("=== Allocation profile: %llu samples (every %lu bytes), "
+         "%llu bytes allocated\n",
+         profile->total_samples, profile->rate, profile->total_bytes);
+
+  for (k = 0; k < (unsigned int)nb_entries; k++) {
+    entries[k].count = profile->sites[entries[k].pc].bytes;
+  }
+  printf("--- Allocation sites (by bytes)\n");
+  alloc_profile_print(profile, lives, entries, nb_entries);
+
+  for (k = 0; k < (unsigned int)nb_entries; k++) {
+    entries[k].count = profile->sites[entries[k].pc].survivals;
+  }
+  printf("--- Retained sites (by collections survived)\n");
+  alloc_profile_print(profile, lives, entries, nb_entries);
+  printf("===================\n");
+
+  free(entries);
+  free(lives);
+}
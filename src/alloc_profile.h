@@ -0,0 +1,59 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _ALLOC_PROFILE_H_
+#define _ALLOC_PROFILE_H_
+
+/** \file alloc_profile.h
+ * Profileur des allocations (option `--alloc-profile`).
+ *
+ * Les allocations du GC (paires, environnements, vecteurs, ...) sont
+ * échantillonnées : une allocation est retenue chaque fois que le total
+ * alloué franchit un multiple du pas d'échantillonnage (en octets, cf.
+ * `--alloc-rate`), et elle représente alors ce nombre d'octets. Le site
+ * d'une allocation est l'instruction en cours (pc du cadre courant) : il
+ * est conservé dans la cellule du GC (champ alloc_site), ce qui permet de
+ * compter à chaque récupération les objets échantillonnés qui survivent.
+ *
+ * En fin d'exécution, le rapport donne les sites qui allouent le plus,
+ * puis ceux dont les objets survivent le plus aux récupérations.
+ */
+
+#include <stddef.h>
+
+#include "vm.h"
+
+/** Pas d'échantillonnage par défaut (en octets alloués). */
+#define ALLOC_PROFILE_DEFAULT_RATE 4096
+
+/** Compteurs d'un site d'allocation. */
+typedef struct {
+  unsigned long long samples;   /*!< les allocations échantillonnées */
+  unsigned long long bytes;     /*!< les octets alloués (estimation) */
+  unsigned long long survivals; /*!< les récupérations survécues */
+  unsigned int fun_pc;          /*!< la fonction du site (pc d'entrée) */
+} alloc_site_t;
+
+/** État du profileur des allocations. */
+typedef struct _alloc_profile {
+  vm_t *vm;                /*!< la VM profilée */
+  alloc_site_t *sites;     /*!< les sites, par pc */
+  unsigned long rate;      /*!< le pas d'échantillonnage (octets) */
+  long countdown;          /*!< les octets avant le prochain échantillon */
+  unsigned long long total_samples; /*!< le nombre d'échantillons */
+  unsigned long long total_bytes; /*!< les octets alloués (estimation) */
+} alloc_profile_t;
+
+alloc_profile_t *alloc_profile_create(vm_t *vm, unsigned long rate);
+void alloc_profile_destroy(alloc_profile_t *profile);
+
+void alloc_profile_record(alloc_profile_t *profile, gc_cell_t *cell,
+                          size_t size);
+void alloc_profile_survive(alloc_profile_t *profile, gc_cell_t *cell);
+void alloc_profile_report(alloc_profile_t *profile);
+
+#endif
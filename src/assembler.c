@@ -0,0 +1,341 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "assembler.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "symtab.h"
+
+/** \file assembler.c
+ * Implémentation de l'assembleur (cf. assembler.h).
+ *
+ * Le texte est lu en deux passes : la première calcule l'adresse des
+ * étiquettes, la seconde produit le code.
+ ******/
+
+/** Taille maximale d'une ligne. */
+#define ASM_LINE_MAX 1024
+
+/** Nombre maximal de mots sur une ligne. */
+#define ASM_TOKENS_MAX 4
+
+/* Sortes d'opérandes des instructions */
+#define ASM_NONE 0   /*!< pas d'opérande */
+#define ASM_INT 1    /*!< un entier */
+#define ASM_TARGET 2 /*!< une adresse (entier ou étiquette) */
+
+/** Les instructions (hors PUSH) et leur opérande. */
+static const struct {
+  const char *name; /*!< le mnémonique */
+  int opcode;       /*!< le code de l'instruction */
+  int operand;      /*!< la sorte d'opérande (ASM_xxx) */
+} asm_instrs[] = {
+    {"GALLOC", I_GALLOC, ASM_NONE}, {"GSTORE", I_GSTORE, ASM_INT},
+    {"GFETCH", I_GFETCH, ASM_INT},  {"ALLOC", I_ALLOC, ASM_INT},
+    {"DELETE", I_DELETE, ASM_INT},  {"STORE", I_STORE, ASM_INT},
+    {"FETCH", I_FETCH, ASM_INT},    {"POP", I_POP, ASM_NONE},
+    {"CALL", I_CALL, ASM_INT},      {"RETURN", I_RETURN, ASM_NONE},
+    {"ERROR", I_ERROR, ASM_NONE},   {"JUMP", I_JUMP, ASM_TARGET},
+    {"JFALSE", I_JFALSE, ASM_TARGET},
+};
+
+/** Une étiquette. */
+typedef struct {
+  char *name; /*!< le nom de l'étiquette */
+  int pc;     /*!< son adresse */
+} asm_label_t;
+
+/** État de l'assembleur. */
+typedef struct {
+  const char *filename; /*!< le fichier assemblé */
+  int line;             /*!< le numéro de la ligne courante */
+  int pass;             /*!< la passe courante (1 ou 2) */
+  asm_label_t *labels;  /*!< les étiquettes */
+  unsigned int nb_labels;  /*!< le nombre d'étiquettes */
+  string_t **strings;      /*!< la table des chaînes */
+  unsigned int nb_strings; /*!< le nombre de chaînes */
+  int *code;               /*!< le code produit */
+  unsigned int size;       /*!< la taille du code */
+  unsigned int capacity;   /*!< la taille allouée pour le code */
+} assembler_t;
+
+/** Erreur d'assemblage (avec la position dans le fichier). */
+static void asm_error(assembler_t *as, const char *message, const char *token) {
+  fprintf(stderr, "%s:%d: %s '%s'\n", as->filename, as->line, message, token);
+  exit(EXIT_FAILURE);
+}
+
+/** Ajout d'un entier au code produit. */
+static void asm_emit(assembler_t *as, int value) {
+  if (as->size == as->capacity) {
+    as->capacity = (as->capacity == 0) ? 256 : 2 * as->capacity;
+    as->code = (int *)realloc(as->code, sizeof(int) * as->capacity);
+    assert(as->code != NULL);
+  }
+  as->code[as->size] = value;
+  as->size = as->size + 1;
+}
+
+/** Lecture d'un entier (éventuellement négatif). */
+static int asm_int(assembler_t *as, const char *token) {
+  char *end;
+  long value = strtol(token, &end, 10);
+  if (*token == '\0' || *end != '\0') {
+    asm_error(as, "integer expected instead of", token);
+  }
+  return (int)value;
+}
+
+/** Lecture d'une adresse : un entier ou une étiquette (inconnue en
+ * première passe). */
+static int asm_target(assembler_t *as, const char *token) {
+  unsigned int i;
+  if ((token[0] >= '0' && token[0] <= '9') || token[0] == '-') {
+    return asm_int(as, token);
+  }
+  for (i = 0; i < as->nb_labels; i++) {
+    if (strcmp(as->labels[i].name, token) == 0) {
+      return as->labels[i].pc;
+    }
+  }
+  if (as->pass == 2) {
+    asm_error(as, "unknown label", token);
+  }
+  return 0;
+}
+
+/** Définition d'une étiquette (en première passe). */
+static void asm_label(assembler_t *as, const char *name) {
+  unsigned int i;
+  if (as->pass == 2) return;
+  for (i = 0; i < as->nb_labels; i++) {
+    if (strcmp(as->labels[i].name, name) == 0) {
+      asm_error(as, "duplicate label", name);
+    }
+  }
+  as->labels = (asm_label_t *)realloc(
+      as->labels, sizeof(asm_label_t) * (as->nb_labels + 1));
+  assert(as->labels != NULL);
+  as->labels[as->nb_labels].name = strdup(name);
+  as->labels[as->nb_labels].pc = as->size;
+  as->nb_labels = as->nb_labels + 1;
+}
+
+/** Numéro d'une chaîne dans la table (ajoutée si besoin). */
+static int asm_string(assembler_t *as, const char *chars) {
+  unsigned int i, length = strlen(chars);
+  for (i = 0; i < as->nb_strings; i++) {
+    if (as->strings[i]->length == length &&
+        memcmp(as->strings[i]->chars, chars, length) == 0) {
+      return i;
+    }
+  }
+  as->strings = (string_t **)realloc(
+      as->strings, sizeof(string_t *) * (as->nb_strings + 1));
+  assert(as->strings != NULL);
+  as->strings[as->nb_strings] = string_make(chars, length);
+  as->nb_strings = as->nb_strings + 1;
+  return as->nb_strings - 1;
+}
+
+/** Découpage d'une ligne en mots (modifiée sur place).
+ * Les chaînes entre guillemets forment un seul mot (les échappements \n,
+ * \" et \\ sont décodés) et le reste de la ligne après un `;` est ignoré.
+ * \param[in,out] as l'assembleur.
+ * \param[in,out] line la ligne.
+ * \param[out] tokens les mots.
+ * \param[out] quoted pour chaque mot, 1 s'il était entre guillemets.
+ * \return le nombre de mots.
+ */
+static int asm_tokenize(assembler_t *as, char *line, char *tokens[],
+                        int quoted[]) {
+  int nb = 0;
+  char *p = line;
+
+  while (1) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    if (*p == '\0' || *p == ';') return nb;
+    if (nb == ASM_TOKENS_MAX) asm_error(as, "too many words at", p);
+
+    if (*p == '"') {
+      char *out = p;
+      tokens[nb] = out;
+      quoted[nb] = 1;
+      for (p = p + 1; *p != '"'; p++) {
+        if (*p == '\0') asm_error(as, "unterminated string", tokens[nb]);
+        if (*p == '\\' && p[1] != '\0') {
+          p++;
+          *out++ = (*p == 'n') ? '\n' : *p;
+        } else {
+          *out++ = *p;
+        }
+      }
+      p++;
+      *out = '\0';
+    } else {
+      tokens[nb] = p;
+      quoted[nb] = 0;
+      while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n' &&
+             *p != '\r' && *p != ';') {
+        p++;
+      }
+      if (*p == ';') {
+        *p = '\0';
+        return nb + 1;
+      }
+      if (*p != '\0') *p++ = '\0';
+    }
+    nb = nb + 1;
+  }
+}
+
+/** Assemblage d'une instruction PUSH. */
+static void asm_push(assembler_t *as, char *tokens[], int quoted[], int nb) {
+  const char *type = (nb > 1) ? tokens[1] : "";
+
+  asm_emit(as, I_PUSH);
+  if (strcmp(type, "UNIT") == 0) {
+    if (nb != 2) asm_error(as, "unexpected operand after", type);
+    asm_emit(as, T_UNIT);
+    return;
+  }
+  if (nb != 3) asm_error(as, "PUSH expects a type and a value, got", type);
+
+  if (strcmp(type, "INT") == 0) {
+    asm_emit(as, T_INT);
+    asm_emit(as, asm_int(as, tokens[2]));
+  } else if (strcmp(type, "BOOL") == 0) {
+    asm_emit(as, T_BOOL);
+    if (strcmp(tokens[2], "TRUE") == 0 || strcmp(tokens[2], "#t") == 0) {
+      asm_emit(as, 1);
+    } else if (strcmp(tokens[2], "FALSE") == 0 ||
+               strcmp(tokens[2], "#f") == 0) {
+      asm_emit(as, 0);
+    } else {
+      asm_error(as, "incorrect boolean", tokens[2]);
+    }
+  } else if (strcmp(type, "PRIM") == 0) {
+    if (isdigit((unsigned char)tokens[2][0])) {
+      asm_emit(as, T_PRIM);
+      asm_emit(as, asm_int(as, tokens[2]));
+    } else {
+      // désignée par son nom : résolue à l'édition des liens
+      asm_emit(as, T_PRIM_NAME);
+      asm_emit(as, asm_string(as, tokens[2]));
+    }
+  } else if (strcmp(type, "FUN") == 0) {
+    asm_emit(as, T_FUN);
+    asm_emit(as, asm_target(as, tokens[2]));
+  } else if (strcmp(type, "STRING") == 0) {
+    if (!quoted[2]) asm_error(as, "string literal expected instead of",
+                              tokens[2]);
+    asm_emit(as, T_STRING);
+    asm_emit(as, asm_string(as, tokens[2]));
+  } else if (strcmp(type, "SYMBOL") == 0) {
+    asm_emit(as, T_SYMBOL);
+    asm_emit(as, asm_string(as, tokens[2]));
+  } else {
+    asm_error(as, "unknown type for PUSH", type);
+  }
+}
+
+/** Assemblage d'une ligne. */
+static void asm_line(assembler_t *as, char *line) {
+  char *tokens[ASM_TOKENS_MAX];
+  int quoted[ASM_TOKENS_MAX];
+  int nb = asm_tokenize(as, line, tokens, quoted);
+  unsigned int i;
+
+  if (nb > 0 && !quoted[0] && tokens[0][strlen(tokens[0]) - 1] == ':') {
+    tokens[0][strlen(tokens[0]) - 1] = '\0';
+    asm_label(as, tokens[0]);
+    memmove(tokens, tokens + 1, sizeof(char *) * (nb - 1));
+    memmove(quoted, quoted + 1, sizeof(int) * (nb - 1));
+    nb = nb - 1;
+  }
+  if (nb == 0) return;
+
+  if (strcmp(tokens[0], "PUSH") == 0) {
+    asm_push(as, tokens, quoted, nb);
+    return;
+  }
+  for (i = 0; i < sizeof(asm_instrs) / sizeof(asm_instrs[0]); i++) {
+    if (strcmp(asm_instrs[i].name, tokens[0]) == 0) {
+      if (nb != ((asm_instrs[i].operand == ASM_NONE) ? 1 : 2)) {
+        asm_error(as, "incorrect number of operands for", tokens[0]);
+      }
+      asm_emit(as, asm_instrs[i].opcode);
+      if (asm_instrs[i].operand == ASM_INT) {
+        asm_emit(as, asm_int(as, tokens[1]));
+      } else if (asm_instrs[i].operand == ASM_TARGET) {
+        asm_emit(as, asm_target(as, tokens[1]));
+      }
+      return;
+    }
+  }
+  asm_error(as, "unknown instruction", tokens[0]);
+}
+
+/** Assemblage d'un fichier au format texte.
+ * \param[in,out] program le segment de code à charger.
+ * \param[in] filename le nom du fichier `.sasm`.
+ */
+void bytecode_assemble(program_t *program, const char *filename) {
+  assembler_t as = {filename, 0, 1, NULL, 0, NULL, 0, NULL, 0, 0};
+  char line[ASM_LINE_MAX];
+  unsigned int i;
+  FILE *f = fopen(filename, "r");
+
+  if (f == NULL) {
+    fprintf(stderr, "cannot open assembler file: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  for (as.pass = 1; as.pass <= 2; as.pass++) {
+    rewind(f);
+    as.line = 0;
+    as.size = 0;
+    while (fgets(line, ASM_LINE_MAX, f) != NULL) {
+      as.line = as.line + 1;
+      if (strchr(line, '\n') == NULL && !feof(f)) {
+        asm_error(&as, "line too long", "");
+      }
+      asm_line(&as, line);
+    }
+  }
+  fclose(f);
+
+  if (as.size == 0) {
+    fprintf(stderr, "empty assembler file: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  bytecode_init(program, as.size);
+  memcpy(program->bytecode, as.code, sizeof(int) * as.size);
+  program->strings = (value_t *)calloc(as.nb_strings + 1, sizeof(value_t));
+  program->symbols = (value_t *)calloc(as.nb_strings + 1, sizeof(value_t));
+  assert(program->strings != NULL && program->symbols != NULL);
+  program->nb_strings = as.nb_strings;
+  for (i = 0; i < as.nb_strings; i++) {
+    value_fill_string(&program->strings[i], as.strings[i]);
+    value_fill_unit(&program->symbols[i]);
+  }
+  bytecode_link_strings(program, filename);
+
+  for (i = 0; i < as.nb_labels; i++) {
+    free(as.labels[i].name);
+  }
+  free(as.labels);
+  free(as.strings);
+  free(as.code);
+}
@@ -0,0 +1,33 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _ASSEMBLER_H_
+#define _ASSEMBLER_H_
+
+/** \file assembler.h
+ * Assembleur pour le format texte du bytecode (fichiers `.sasm`).
+ *
+ * Le format reprend celui de l'affichage du bytecode (cf. bytecode_print),
+ * à raison d'une instruction par ligne, avec en plus :
+ * - des étiquettes `nom:` en début de ligne, utilisables comme cible de
+ * JUMP, JFALSE et PUSH FUN;
+ * - des commentaires, du `;` à la fin de la ligne;
+ * - les primitives désignées par leur nom (`PUSH PRIM car`), y compris
+ * celles des modules d'extension (cf. `PUSH PRIM_NAME` dans bytecode.h);
+ * - les chaînes littérales (`PUSH STRING "abc"`) et les symboles par leur
+ * nom (`PUSH SYMBOL foo`), rangés dans la table des chaînes;
+ * - les entiers négatifs.
+ *
+ * Ce format permet d'écrire à la main des programmes de test ou de mesure
+ * de performances sans passer par le compilateur.
+ */
+
+#include "bytecode.h"
+
+void bytecode_assemble(program_t *program, const char *filename);
+
+#endif
@@ -10,8 +10,12 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "assembler.h"
 #include "constants.h"
+#include "prim.h"
+#include "symtab.h"
 
 /** Lecture d'un entier dans le fichier de bytecode.
  * \param[in,out] f  le fichier de bytecode
@@ -27,8 +31,8 @@ int read_int(FILE *f) {
     if (ch == EOF) {
       return EOF;
     }
-    if (ch == (int)' ') {  // sauter l'espace terminal
-      break;               // puis on sort de la boucle
+    if (ch == (int)' ' || ch == (int)'\n') {  // sauter l'espace terminal
+      break;  // puis on sort de la boucle
     } else if ((ch >= (int)'0') && (ch <= (int)'9')) {
       // récupérer un chiffre
       buf[pos] = (char)ch;
@@ -58,12 +62,302 @@ int read_int(FILE *f) {
   return val;
 }
 
+/** Lecture de la table des chaînes (optionnelle) qui suit le code.
+ * \param[in,out] program le segment de code en cours de chargement.
+ * \param[in,out] f le fichier de bytecode.
+ * \param[in] filename le nom du fichier (pour les messages d'erreur).
+ */
+static void bytecode_read_strings(program_t *program, FILE *f,
+                                  const char *filename) {
+  int nb_strings = read_int(f);
+  unsigned int i;
+  char *buf = NULL;
+
+  if (nb_strings == EOF) {
+    nb_strings = 0;  // pas de chaînes
+  }
+
+  program->strings = (value_t *)calloc(nb_strings + 1, sizeof(value_t));
+  program->symbols = (value_t *)calloc(nb_strings + 1, sizeof(value_t));
+  assert(program->strings != NULL && program->symbols != NULL);
+  program->nb_strings = nb_strings;
+
+  for (i = 0; i < program->nb_strings; i++) {
+    int length = read_int(f), j;
+    if (length == EOF) {
+      fprintf(stderr, "unexpected EOF in bytecode file: %s\n", filename);
+      exit(EXIT_FAILURE);
+    }
+    buf = (char *)realloc(buf, length + 1);
+    assert(buf != NULL);
+    for (j = 0; j < length; j++) {
+      int ch = read_int(f);
+      if (ch == EOF || ch > 255) {
+        fprintf(stderr, "incorrect string in bytecode file: %s\n", filename);
+        exit(EXIT_FAILURE);
+      }
+      buf[j] = (char)ch;
+    }
+    value_fill_string(&program->strings[i], string_make(buf, length));
+    value_fill_unit(&program->symbols[i]);
+  }
+  free(buf);
+
+  bytecode_link_strings(program, filename);
+}
+
+/** Recherche de la primitive nommée par une chaîne du programme.
+ * \param[in] program le programme (table des chaînes remplie).
+ * \param k le numéro de la chaîne.
+ * \param[in] filename le nom du fichier (pour les messages d'erreur).
+ * \return le numéro de la primitive.
+ */
+static int bytecode_prim_name(program_t *program, unsigned int k,
+                              const char *filename) {
+  int prim;
+  if (k >= program->nb_strings) {
+    fprintf(stderr, "incorrect string reference %u in bytecode file: %s\n",
+            k, filename);
+    exit(EXIT_FAILURE);
+  }
+  prim = prim_lookup(program->strings[k].data.as_string->chars);
+  if (prim < 0) {
+    fprintf(stderr, "unknown primitive `%s` in bytecode file: %s\n",
+            program->strings[k].data.as_string->chars, filename);
+    exit(EXIT_FAILURE);
+  }
+  return prim;
+}
+
+/** Vérification des références à la table des chaînes.
+ * Les symboles utilisés par les instructions `PUSH SYMBOL k` sont
+ * internés une fois pour toutes, et les instructions `PUSH PRIM_NAME k`
+ * sont résolues en `PUSH PRIM n`.
+ * \param[in,out] program le programme (table des chaînes remplie).
+ * \param[in] filename le nom du fichier (pour les messages d'erreur).
+ */
+void bytecode_link_strings(program_t *program, const char *filename) {
+  unsigned int pc;
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    if (program->bytecode[pc] == I_PUSH &&
+        program->bytecode[pc + 1] == T_PRIM_NAME) {
+      program->bytecode[pc + 2] =
+          bytecode_prim_name(program, program->bytecode[pc + 2], filename);
+      program->bytecode[pc + 1] = T_PRIM;
+    } else if (program->bytecode[pc] == I_PUSH &&
+               (program->bytecode[pc + 1] == T_STRING ||
+                program->bytecode[pc + 1] == T_SYMBOL)) {
+      unsigned int k = program->bytecode[pc + 2];
+      string_t *name;
+      if (k >= program->nb_strings) {
+        fprintf(stderr, "incorrect string reference %u in bytecode file: %s\n",
+                k, filename);
+        exit(EXIT_FAILURE);
+      }
+      name = program->strings[k].data.as_string;
+      if (program->bytecode[pc + 1] == T_SYMBOL) {
+        value_fill_symbol(&program->symbols[k],
+                          symtab_intern(name->chars, name->length));
+      }
+    }
+  }
+}
+
+/** Zone des constantes immortelles : une suite de blocs alloués une fois
+ * pour toutes au chargement (hors du tas du GC) et libérés avec le
+ * programme. */
+typedef struct _region {
+  struct _region *next; /*!< le bloc suivant */
+  unsigned int used;     /*!< le nombre d'octets utilisés */
+  unsigned int capacity; /*!< le nombre d'octets disponibles */
+  char *data;            /*!< les données (alignées) */
+} region_t;
+
+#define REGION_CHUNK 4096
+
+/** Allocation dans la zone des constantes du programme.
+ * \param[in,out] program le programme.
+ * \param size la taille demandée (en octets).
+ * \return la zone allouée (alignée sur 16 octets).
+ */
+static void *region_alloc(program_t *program, unsigned int size) {
+  region_t *chunk = program->region;
+  void *ptr;
+
+  size = (size + 15) & ~15u;
+  if (chunk == NULL || chunk->used + size > chunk->capacity) {
+    unsigned int capacity = (size > REGION_CHUNK) ? size : REGION_CHUNK;
+    chunk = (region_t *)malloc(sizeof(region_t));
+    assert(chunk != NULL);
+    chunk->data = (char *)aligned_alloc(16, capacity);
+    assert(chunk->data != NULL);
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->next = program->region;
+    program->region = chunk;
+  }
+  ptr = chunk->data + chunk->used;
+  chunk->used = chunk->used + size;
+  return ptr;
+}
+
+/** Lecture d'un entier (obligatoire) de la table des constantes. */
+static int read_const_int(FILE *f, const char *filename) {
+  int val = read_int(f);
+  if (val == EOF) {
+    fprintf(stderr, "unexpected EOF in bytecode file: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  return val;
+}
+
+/** Lecture (et construction) d'une constante de la table.
+ * \param[in,out] program le segment de code en cours de chargement.
+ * \param[in,out] f le fichier de bytecode.
+ * \param[in] filename le nom du fichier (pour les messages d'erreur).
+ * \param[out] value la constante construite (dans la zone immortelle).
+ */
+static void bytecode_read_datum(program_t *program, FILE *f,
+                                const char *filename, value_t *value) {
+  int type = read_const_int(f, filename);
+  unsigned int i, n;
+
+  switch (type) {
+    case T_INT:
+      value_fill_int(value, read_const_int(f, filename));
+      return;
+    case T_BOOL:
+      value_fill_bool(value, read_const_int(f, filename));
+      return;
+    case T_PRIM:
+      value_fill_prim(value, read_const_int(f, filename));
+      return;
+    case T_PRIM_NAME:
+      value_fill_prim(value, bytecode_prim_name(
+                                 program, read_const_int(f, filename),
+                                 filename));
+      return;
+    case T_UNIT:
+      value_fill_unit(value);
+      return;
+    case T_STRING:
+    case T_SYMBOL: {
+      unsigned int k = read_const_int(f, filename);
+      string_t *name;
+      if (k >= program->nb_strings) break;
+      name = program->strings[k].data.as_string;
+      if (type == T_STRING) {
+        *value = program->strings[k];
+      } else {
+        value_fill_symbol(value, symtab_intern(name->chars, name->length));
+      }
+      return;
+    }
+    case T_PAIR: {
+      clist_t *block;
+      n = read_const_int(f, filename);
+      value_fill_nil(value);
+      if (n == 0) return;
+      // la liste est construite dans un unique bloc compact
+      block = (clist_t *)region_alloc(
+          program, sizeof(clist_t) + n * sizeof(value_t) + n);
+      block->gc_mark = GC_IMMORTAL;
+      block->length = n;
+      block->codes = (unsigned char *)&block->cars[n];
+      for (i = 0; i < n; i++) {
+        bytecode_read_datum(program, f, filename, &block->cars[i]);
+        block->codes[i] = CDR_NEXT;
+      }
+      bytecode_read_datum(program, f, filename, &block->tail);
+      value_fill_clist(value, block, 0);
+      return;
+    }
+    case T_VECTOR: {
+      vector_t *vector;
+      n = read_const_int(f, filename);
+      vector = (vector_t *)region_alloc(program,
+                                        sizeof(vector_t) + n * sizeof(value_t));
+      vector->gc_mark = GC_IMMORTAL;
+      vector->size = n;
+      for (i = 0; i < n; i++) {
+        bytecode_read_datum(program, f, filename, &vector->content[i]);
+      }
+      value_fill_vector(value, vector);
+      return;
+    }
+    case T_CONST: {
+      unsigned int k = read_const_int(f, filename);
+      if (k >= program->nb_consts) break;
+      *value = program->consts[k];
+      return;
+    }
+    default:
+      break;
+  }
+  fprintf(stderr, "incorrect constant in bytecode file: %s\n", filename);
+  exit(EXIT_FAILURE);
+}
+
+/** Lecture de la table des constantes (optionnelle) qui suit celle des
+ * chaînes. Les constantes sont matérialisées une fois pour toutes dans la
+ * zone immortelle du programme.
+ * \param[in,out] program le segment de code en cours de chargement.
+ * \param[in,out] f le fichier de bytecode.
+ * \param[in] filename le nom du fichier (pour les messages d'erreur).
+ */
+static void bytecode_read_consts(program_t *program, FILE *f,
+                                 const char *filename) {
+  int nb_consts = read_int(f);
+  unsigned int pc;
+  int i;
+
+  for (i = 0; i < nb_consts; i++) {
+    value_t value;
+    bytecode_read_datum(program, f, filename, &value);
+    bytecode_add_const(program, &value);
+  }
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    if (program->bytecode[pc] == I_PUSH &&
+        program->bytecode[pc + 1] == T_CONST &&
+        (unsigned int)program->bytecode[pc + 2] >= program->nb_consts) {
+      fprintf(stderr, "incorrect constant reference %d in bytecode file: %s\n",
+              program->bytecode[pc + 2], filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/** Initialisation d'un segment de code vide.
+ * \param[out] program le segment de code.
+ * \param size la taille du code (à remplir).
+ */
+void bytecode_init(program_t *program, unsigned int size) {
+  program->bytecode = (int *)malloc(sizeof(int) * size);
+  assert(program->bytecode != NULL);
+  program->size = size;
+  program->consts = NULL;
+  program->nb_consts = 0;
+  program->strings = NULL;
+  program->symbols = NULL;
+  program->nb_strings = 0;
+  program->region = NULL;
+}
+
 /** Lecture d'un fichier de byte-code.
+ * Les fichiers d'extension `.sasm` sont au format texte (cf. assembler.h).
  * \param[in,out] program le segment de code à charger
  * \param[in] filename le nom du fichier contenant le byte-code.
  * \return le tableau de bytecode
  */
 void bytecode_read(program_t *program, const char *filename) {
+  size_t length = strlen(filename);
+  if (length > 5 && strcmp(filename + length - 5, ".sasm") == 0) {
+    bytecode_assemble(program, filename);
+    return;
+  }
+
   // ouverture du fichier
   FILE *f = fopen(filename, "r");  // open the file
   if (f == NULL) {
@@ -85,9 +379,7 @@ void bytecode_read(program_t *program, const char *filename) {
     exit(EXIT_FAILURE);
   }
 
-  program->bytecode = (int *)malloc(sizeof(int) * size);
-  assert(program->bytecode != NULL);
-  program->size = size;
+  bytecode_init(program, size);
 
   int count;
   for (count = 0; count < size; count++) {
@@ -98,11 +390,44 @@ void bytecode_read(program_t *program, const char *filename) {
     }
     program->bytecode[count] = next;
   }
+
+  bytecode_read_strings(program, f, filename);
+  bytecode_read_consts(program, f, filename);
+  fclose(f);
 }
 
 /** Désallocation du segment de code.
  * \param[in,out] program le segment de code à désallouer. */
-void bytecode_destroy(program_t *program) { free(program->bytecode); }
+void bytecode_destroy(program_t *program) {
+  free(program->bytecode);
+  unsigned int i;
+  free(program->consts);
+  for (i = 0; i < program->nb_strings; i++) {
+    free(program->strings[i].data.as_string);
+  }
+  free(program->strings);
+  free(program->symbols);
+  while (program->region != NULL) {
+    region_t *next = program->region->next;
+    free(program->region->data);
+    free(program->region);
+    program->region = next;
+  }
+}
+
+/** Ajout d'une valeur dans la table des constantes du programme.
+ * \param[in,out] program le programme concerné.
+ * \param[in] value la valeur à ajouter (recopiée).
+ * \return l'index de la constante dans la table.
+ */
+int bytecode_add_const(program_t *program, value_t *value) {
+  program->consts = (value_t *)realloc(
+      program->consts, sizeof(value_t) * (program->nb_consts + 1));
+  assert(program->consts != NULL);
+  program->consts[program->nb_consts] = *value;
+  program->nb_consts = program->nb_consts + 1;
+  return program->nb_consts - 1;
+}
 
 /** Affichage d'une instruction de bytecode au format assembleur.
  * \param[in] program le programme à afficher.
@@ -170,6 +495,21 @@ int bytecode_print_instr(program_t *program, unsigned int pc) {
         case T_FUN:
           printf("FUN %d\n", program->bytecode[pc + 2]);
           return pc + 3;
+        case T_STRING:
+          printf("STRING %d ; ", program->bytecode[pc + 2]);
+          value_print(&program->strings[program->bytecode[pc + 2]]);
+          printf("\n");
+          return pc + 3;
+        case T_SYMBOL:
+          printf("SYMBOL %d ; ", program->bytecode[pc + 2]);
+          value_print(&program->symbols[program->bytecode[pc + 2]]);
+          printf("\n");
+          return pc + 3;
+        case T_CONST:
+          printf("CONST %d ; ", program->bytecode[pc + 2]);
+          value_print(&program->consts[program->bytecode[pc + 2]]);
+          printf("\n");
+          return pc + 3;
         default:
           fprintf(stderr, "Error: unknown type '%d' for PUSH\n",
                   program->bytecode[pc + 1]);
@@ -201,12 +541,146 @@ int bytecode_print_instr(program_t *program, unsigned int pc) {
       printf("JFALSE %d\n", program->bytecode[pc + 1]);
       return pc + 2;
     }
+    case I_CONST: {
+      printf("CONST %d ; ", program->bytecode[pc + 1]);
+      value_print(&program->consts[program->bytecode[pc + 1]]);
+      printf("\n");
+      return pc + 2;
+    }
+    case I_SFETCH: {
+      printf("SFETCH %d\n", program->bytecode[pc + 1]);
+      return pc + 2;
+    }
+    case I_SSTORE: {
+      printf("SSTORE %d\n", program->bytecode[pc + 1]);
+      return pc + 2;
+    }
+    case I_SLIDE: {
+      printf("SLIDE %d\n", program->bytecode[pc + 1]);
+      return pc + 2;
+    }
     default:
       fprintf(stderr, "Error: unknown opcode '%d'\n", opcode);
       exit(EXIT_FAILURE);
   }
 }
 
+/** Nom d'une instruction (tel qu'affiché par bytecode_print_instr).
+ * \param opcode le code de l'instruction.
+ * \return le nom, ou "?" si l'instruction est inconnue.
+ */
+const char *bytecode_instr_name(int opcode) {
+  switch (opcode) {
+    case I_GALLOC:
+      return "GALLOC";
+    case I_GSTORE:
+      return "GSTORE";
+    case I_GFETCH:
+      return "GFETCH";
+    case I_ALLOC:
+      return "ALLOC";
+    case I_DELETE:
+      return "DELETE";
+    case I_STORE:
+      return "STORE";
+    case I_FETCH:
+      return "FETCH";
+    case I_PUSH:
+      return "PUSH";
+    case I_POP:
+      return "POP";
+    case I_CALL:
+      return "CALL";
+    case I_RETURN:
+      return "RETURN";
+    case I_ERROR:
+      return "ERROR";
+    case I_JUMP:
+      return "JUMP";
+    case I_JFALSE:
+      return "JFALSE";
+    case I_CONST:
+      return "CONST";
+    case I_SFETCH:
+      return "SFETCH";
+    case I_SSTORE:
+      return "SSTORE";
+    case I_SLIDE:
+      return "SLIDE";
+    default:
+      return "?";
+  }
+}
+
+/** Taille (en nombre d'entiers) d'une instruction de bytecode.
+ * \param[in] program le programme concerné.
+ * \param[in] pc le compteur de programme de l'instruction.
+ * \return la taille de l'instruction, opérandes compris.
+ */
+int bytecode_instr_size(program_t *program, unsigned int pc) {
+  switch (program->bytecode[pc]) {
+    case I_GALLOC:
+    case I_POP:
+    case I_RETURN:
+    case I_ERROR:
+      return 1;
+    case I_GSTORE:
+    case I_GFETCH:
+    case I_ALLOC:
+    case I_DELETE:
+    case I_STORE:
+    case I_FETCH:
+    case I_CALL:
+    case I_JUMP:
+    case I_JFALSE:
+    case I_CONST:
+    case I_SFETCH:
+    case I_SSTORE:
+    case I_SLIDE:
+      return 2;
+    case I_PUSH:
+      // seule la valeur unit n'a pas d'opérande
+      return (program->bytecode[pc + 1] == T_UNIT) ? 2 : 3;
+    default:
+      fprintf(stderr, "Error: unknown opcode '%d'\n", program->bytecode[pc]);
+      exit(EXIT_FAILURE);
+  }
+}
+
+/** Calcul des successeurs d'une instruction dans le flot de contrôle.
+ * Remarque : le corps d'une fermeture (PUSH FUN) n'est pas un successeur.
+ * \param[in] program le programme concerné.
+ * \param pc le compteur de programme de l'instruction.
+ * \param[out] succ les successeurs (au plus 2).
+ * \return le nombre de successeurs.
+ */
+int bytecode_successors(program_t *program, unsigned int pc, int succ[2]) {
+  int next = pc + bytecode_instr_size(program, pc);
+  int nb = 0;
+  switch (program->bytecode[pc]) {
+    case I_RETURN:
+    case I_ERROR:
+      return 0;
+    case I_JUMP:
+      // un saut en fin de programme termine l'exécution
+      if (program->bytecode[pc + 1] < program->size) {
+        succ[nb++] = program->bytecode[pc + 1];
+      }
+      return nb;
+    case I_JFALSE:
+      if (program->bytecode[pc + 1] < program->size) {
+        succ[nb++] = program->bytecode[pc + 1];
+      }
+      break;
+    default:
+      break;
+  }
+  if (next < program->size) {
+    succ[nb++] = next;
+  }
+  return nb;
+}
+
 /** Affichage d'un segment de code (pour déboguage)
  * \param[in] program le segment de code
  */
@@ -31,20 +31,95 @@
  * - JUMP pc : saut inconditionnel vers pc.
  * - JFALSE pc : saut vers pc à condition que le sommet de pile soit faux (et
  * dépiler).
+ *
+ * Les types T_STRING et T_SYMBOL (internes à la VM, cf. value.h) sont
+ * également acceptés par PUSH : `PUSH STRING k` et `PUSH SYMBOL k` font
+ * référence à la k-ième chaîne de la table des chaînes du programme. Cette
+ * table est optionnelle et suit le code dans le fichier : le nombre de
+ * chaînes puis, pour chaque chaîne, sa longueur suivie des codes de ses
+ * caractères.
+ *
+ * `PUSH PRIM_NAME k` désigne la primitive dont le nom est la k-ième chaîne
+ * de cette table : elle est résolue au chargement (cf. prim_lookup) et
+ * devient `PUSH PRIM n`. C'est ainsi que le bytecode fait référence aux
+ * primitives des modules d'extension (cf. extension.h), dont les numéros ne
+ * sont connus qu'à l'exécution.
+ *
+ * Vient ensuite la table des constantes (optionnelle elle aussi), utilisée
+ * par `PUSH CONST k` : le nombre de constantes puis chaque constante, en
+ * notation préfixe :
+ * - `T_INT n`, `T_BOOL b`, `T_PRIM n`, `T_UNIT` : une valeur immédiate;
+ * - `T_STRING k`, `T_SYMBOL k` : la k-ième chaîne (ou le symbole de ce nom);
+ * - `T_PRIM_NAME k` : la primitive dont le nom est la k-ième chaîne;
+ * - `T_PAIR 0` : la liste vide;
+ * - `T_PAIR n c1 ... cn t` (n > 0) : la liste des constantes c1 ... cn
+ * terminée par t (`T_PAIR 0` pour une liste propre);
+ * - `T_VECTOR n c1 ... cn` : un vecteur;
+ * - `T_CONST k` : la k-ième constante de la table (déjà lue), partagée.
+ *
+ * Les constantes sont construites une fois pour toutes au chargement dans
+ * une zone immortelle (cf. GC_IMMORTAL) : elles ne sont ni parcourues ni
+ * récupérées par le GC, et ne peuvent pas être modifiées.
+ *
+ * Le chargeur (cf. loader.h) peut de plus réécrire le code avec des
+ * instructions internes, qui n'apparaissent jamais dans les fichiers :
+ * - CONST k : placer en sommet de pile la k-ième valeur de la table des
+ * constantes du programme.
+ * - SFETCH n : placer en sommet de pile une copie de la valeur située à
+ * distance n du sommet.
+ * - SSTORE n : dépiler le sommet de pile et le placer à distance n du
+ * (nouveau) sommet.
+ * - SLIDE n : retirer les n valeurs situées sous le sommet de pile.
+ *
+ * Les trois dernières servent aux corps de fonctions "inlinés" dont les
+ * arguments restent sur la pile de l'appelant.
  */
 
+#include "value.h"
+
+/** Instructions internes au chargeur.
+ * Remarque : elles sont numérotées en dehors des opcodes générés
+ * dans constants.h (comme T_ENV pour les types). */
+#define I_CONST 1001
+#define I_SFETCH 1002
+#define I_SSTORE 1003
+#define I_SLIDE 1004
+
+/** Type (interne) des instructions `PUSH CONST k`, qui placent en sommet de
+ * pile la k-ième constante de la table du fichier (les constantes du
+ * fichier sont les premières de la table des constantes du programme). */
+#define T_CONST 1006
+
+/** Type (interne) des instructions `PUSH PRIM_NAME k`, résolues au
+ * chargement en `PUSH PRIM n`. */
+#define T_PRIM_NAME 1007
+
+struct _region;
+
 /** Structure du segment de byte-code.
  */
 typedef struct program_s {
   int *bytecode;     /*!< le contenu du segment de byte-code. */
   unsigned int size; /*!< la taille segment. */
+  value_t *consts;   /*!< la table des constantes (construite au chargement) */
+  unsigned int nb_consts; /*!< le nombre de constantes. */
+  value_t *strings; /*!< la table des chaînes (valeurs de type T_STRING) */
+  value_t *symbols; /*!< les symboles correspondants (pour PUSH SYMBOL) */
+  unsigned int nb_strings; /*!< le nombre de chaînes. */
+  struct _region *region; /*!< la zone des constantes immortelles */
 } program_t;
 
 /* Fonction de manipulations du bytecode */
 
+void bytecode_init(program_t *program, unsigned int size);
 void bytecode_read(program_t *program, const char *filename);
+void bytecode_link_strings(program_t *program, const char *filename);
 void bytecode_destroy(program_t *program);
 void bytecode_print(program_t *program);
 int bytecode_print_instr(program_t *program, unsigned int pc);
+const char *bytecode_instr_name(int opcode);
+int bytecode_instr_size(program_t *program, unsigned int pc);
+int bytecode_successors(program_t *program, unsigned int pc, int succ[2]);
+int bytecode_add_const(program_t *program, value_t *value);
 
 #endif
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 
 #include "gc.h"
+#include "output.h"
 
 value_t *env_search(env_t *env, unsigned int pos) {
   while (env) {  // tant qu'il reste un environnement dans la chaîne
@@ -49,11 +50,11 @@ void env_store(env_t *env, unsigned int pos, value_t *nvalue) {
 
 /** Affichage des environnements (pour déboguage). */
 void env_print(env_t *env) {
-  printf("<");
+  output_char('<');
   while (env) {
     varray_print(env->content);
     env = env->next;
-    if (env) printf("=>");
+    if (env) output_string("=>");
   }
-  printf(">");
+  output_char('>');
 }
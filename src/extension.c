@@ -0,0 +1,221 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "extension.h"
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc.h"
+#include "varray.h"
+#include "vm.h"
+
+/** \file extension.c
+ * Chargement des modules de primitives et interface des modules.
+ *
+ * Les fonctions svm_xxx sont appelées depuis les modules : l'exécutable
+ * doit donc exporter ses symboles (édition des liens avec -rdynamic).
+ ******/
+
+/** Les modules chargés (pour les décharger à la fin). */
+static void **modules = NULL;
+
+/** Le nombre de modules chargés. */
+static int nb_modules = 0;
+
+/** Le prochain numéro de primitive d'extension. */
+static int next_prim = P_EXTENSION_BASE;
+
+/** Chargement d'un module de primitives.
+ * Les primitives doivent être initialisées (cf. prim_init).
+ * \param[in] filename le chemin de la bibliothèque partagée.
+ */
+void extension_load(const char *filename) {
+  void *handle = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+  svm_module_init_t init;
+
+  if (handle == NULL) {
+    fprintf(stderr, "cannot load primitives module: %s\n", dlerror());
+    exit(EXIT_FAILURE);
+  }
+  init = (svm_module_init_t)dlsym(handle, "svm_module_init");
+  if (init == NULL) {
+    fprintf(stderr, "missing svm_module_init in primitives module: %s\n",
+            filename);
+    exit(EXIT_FAILURE);
+  }
+  if (init(SVM_EXT_VERSION) != 0) {
+    fprintf(stderr, "cannot initialize primitives module: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  modules = (void **)realloc(modules, sizeof(void *) * (nb_modules + 1));
+  assert(modules != NULL);
+  modules[nb_modules] = handle;
+  nb_modules = nb_modules + 1;
+}
+
+/** Déchargement des modules.
+ * Les noms des primitives appartiennent aux modules : la table des
+ * primitives doit avoir été libérée (cf. prim_destroy).
+ */
+void extension_destroy(void) {
+  int i;
+  for (i = 0; i < nb_modules; i++) {
+    dlclose(modules[i]);
+  }
+  free(modules);
+  modules = NULL;
+  nb_modules = 0;
+}
+
+/** Enregistrement d'une primitive d'extension.
+ * Le numéro du descripteur est ignoré : la primitive reçoit le prochain
+ * numéro libre.
+ * \param[in] desc le descripteur de la primitive (cf. prim_desc_t).
+ * \return le numéro attribué à la primitive.
+ */
+int svm_register_prim(const prim_desc_t *desc) {
+  prim_desc_t copy = *desc;
+
+  if (prim_lookup(desc->name) >= 0) {
+    fprintf(stderr, "Primitive `%s` already registered\n", desc->name);
+    exit(EXIT_FAILURE);
+  }
+  copy.number = next_prim;
+  prim_register(&copy);
+  next_prim = next_prim + 1;
+  return copy.number;
+}
+
+/** Argument d'une primitive.
+ * \param[in] stack la zone de pile.
+ * \param i la distance au sommet de la pile : le numéro de l'argument (0
+ * pour le premier) plus le nombre de valeurs encore enracinées (cf.
+ * svm_root).
+ * \return l'argument (pointeur invalidé par svm_root et svm_apply).
+ */
+value_t *svm_arg(varray_t *stack, int i) {
+  return varray_top_at(stack, i);
+}
+
+/** Remplacement des arguments d'une primitive par son résultat.
+ * \param[in,out] stack la zone de pile.
+ * \param n le nombre d'arguments.
+ * \param[in] result le résultat.
+ */
+void svm_return(varray_t *stack, int n, value_t *result) {
+  value_t value = *result;  // le résultat peut être un argument
+  if (n == 0) {
+    varray_push(stack, &value);
+  } else {
+    varray_popn(stack, n - 1);
+    varray_set_top(stack, &value);
+  }
+}
+
+/** Erreur à l'exécution d'une primitive (arrêt de la VM).
+ * \param[in] name le nom de la primitive.
+ * \param[in] message le message d'erreur.
+ */
+void svm_error(const char *name, const char *message) {
+  printf("Unable to apply `%s`: %s\n", name, message);
+  abort();
+}
+
+/** Vérification du type entier d'un argument.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
+ * \return l'entier.
+ */
+int svm_check_int(const char *name, value_t *value) {
+  if (!value_is_int(value)) {
+    printf("Unable to apply `%s` with type: %d\n", name, value->type);
+    abort();
+  }
+  return value_int_get(value);
+}
+
+/** Construction d'une paire.
+ * \param[in,out] vm l'état de la machine.
+ * \param[out] result la paire construite.
+ * \param[in] car le premier élément.
+ * \param[in] cdr le second élément.
+ */
+void svm_make_pair(vm_t *vm, value_t *result, value_t *car, value_t *cdr) {
+  value_t pair;
+  value_fill_nil(&pair);
+  value_set_car(vm, &pair, car);
+  value_set_cdr(vm, &pair, cdr);
+  *result = pair;
+}
+
+/** Construction d'un vecteur.
+ * \param[in,out] vm l'état de la machine.
+ * \param[out] result le vecteur construit.
+ * \param size le nombre d'éléments.
+ * \param[in] fill la valeur initiale des éléments.
+ */
+void svm_make_vector(vm_t *vm, value_t *result, unsigned int size,
+                     value_t *fill) {
+  value_fill_vector(result, gc_alloc_vector(vm, size, fill));
+}
+
+/** Construction d'une chaîne.
+ * \param[in,out] vm l'état de la machine.
+ * \param[out] result la chaîne construite.
+ * \param[in] chars les caractères.
+ * \param length le nombre de caractères.
+ */
+void svm_make_string(vm_t *vm, value_t *result, const char *chars,
+                     unsigned int length) {
+  string_t *string = gc_alloc_string(vm, length);
+  memcpy(string->chars, chars, length);
+  value_fill_string(result, string);
+}
+
+/** Enracinement d'une valeur (empilée, donc visible du GC).
+ * \param[in,out] stack la zone de pile.
+ * \param[in] value la valeur (qui peut être dans la pile elle-même : elle
+ * est recopiée avant que la pile ne soit éventuellement réallouée).
+ */
+void svm_root(varray_t *stack, value_t *value) {
+  value_t copy = *value;
+  varray_push(stack, &copy);
+}
+
+/** Valeur enracinée.
+ * \param[in] stack la zone de pile.
+ * \param i la distance au sommet (0 pour la dernière valeur enracinée).
+ * \return la valeur (mise à jour par le GC ; pointeur invalidé par svm_root
+ * et svm_apply).
+ */
+value_t *svm_rooted(varray_t *stack, int i) {
+  return varray_top_at(stack, i);
+}
+
+/** Retrait des n dernières valeurs enracinées.
+ * \param[in,out] stack la zone de pile.
+ * \param n le nombre de valeurs.
+ */
+void svm_unroot(varray_t *stack, int n) {
+  varray_popn(stack, n);
+}
+
+/** Appel d'une fonction (fermeture ou primitive) depuis une primitive.
+ * La fonction doit être au sommet de la pile, ses n arguments en-dessous
+ * (premier argument juste sous la fonction); le résultat les remplace.
+ * L'appel peut déclencher le GC.
+ * \param[in,out] vm l'état de la machine.
+ * \param n le nombre d'arguments.
+ */
+void svm_apply(vm_t *vm, int n) {
+  vm_apply(vm, n);
+}
@@ -0,0 +1,82 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _EXTENSION_H_
+#define _EXTENSION_H_
+
+/** \file extension.h
+ * Interface des modules de primitives natives (extensions écrites en C).
+ *
+ * Un module est une bibliothèque partagée chargée au démarrage de la VM
+ * (option `--load-prims=module.so`). Il définit la fonction
+ * d'initialisation :
+ *
+ *     int svm_module_init(int version);
+ *
+ * qui vérifie que la version de l'interface est SVM_EXT_VERSION, enregistre
+ * ses primitives avec svm_register_prim et retourne 0 en cas de succès.
+ *
+ * Les primitives d'extension sont numérotées au chargement (à partir de
+ * P_EXTENSION_BASE) : le bytecode y fait référence par leur nom
+ * (`PUSH PRIM_NAME k`, cf. bytecode.h), ce qui évite tout conflit avec la
+ * numérotation de constants.h.
+ *
+ * Une primitive reçoit ses arguments sur la pile (cf. prim_desc_t) : elle
+ * les lit avec svm_arg et les remplace par son résultat avec svm_return.
+ * svm_arg compte depuis le sommet de la pile : après k enracinements
+ * (svm_root, sans svm_unroot), l'argument i est svm_arg(stack, i + k).
+ * Les valeurs se construisent et s'inspectent avec les fonctions de
+ * value.h, et les données du tas s'allouent avec svm_make_xxx.
+ *
+ * Le GC ne se déclenche qu'entre deux instructions : une primitive peut
+ * donc allouer librement tant qu'elle n'appelle pas de fonction Scheme.
+ * Pendant un appel (svm_apply), les valeurs du tas dont elle a encore
+ * besoin doivent être enracinées sur la pile (svm_root).
+ *
+ * Les pointeurs retournés par svm_arg et svm_rooted désignent des cases de
+ * la pile : svm_root et svm_apply peuvent la réallouer, ce qui les
+ * invalide. Il faut les redemander après chacun de ces appels (la valeur
+ * passée à svm_root peut, elle, être une case de la pile).
+ */
+
+#include <stddef.h>
+
+#include "prim.h"
+#include "value.h"
+
+/** Version de l'interface des modules. */
+#define SVM_EXT_VERSION 1
+
+/** Type de la fonction d'initialisation d'un module. */
+typedef int (*svm_module_init_t)(int version);
+
+/* Chargement des modules (VM) */
+
+void extension_load(const char *filename);
+void extension_destroy(void);
+
+/* Interface des modules */
+
+int svm_register_prim(const prim_desc_t *desc);
+
+value_t *svm_arg(varray_t *stack, int i);
+void svm_return(varray_t *stack, int n, value_t *result);
+void svm_error(const char *name, const char *message);
+int svm_check_int(const char *name, value_t *value);
+
+void svm_make_pair(vm_t *vm, value_t *result, value_t *car, value_t *cdr);
+void svm_make_vector(vm_t *vm, value_t *result, unsigned int size,
+                     value_t *fill);
+void svm_make_string(vm_t *vm, value_t *result, const char *chars,
+                     unsigned int length);
+
+void svm_root(varray_t *stack, value_t *value);
+value_t *svm_rooted(varray_t *stack, int i);
+void svm_unroot(varray_t *stack, int n);
+void svm_apply(vm_t *vm, int n);
+
+#endif
@@ -13,16 +13,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/** Les cadres dépilés, réutilisés par frame_push (chaînés par leur champ
+ * caller_frame). Les cadres ne sont pas rendus à malloc pendant
+ * l'exécution : un cadre lu par le profileur par échantillonnage (cf.
+ * sampler.h), même s'il vient d'être dépilé, reste un cadre valide. */
+static frame_t *free_frames = NULL;
+
 /** Allocation d'un cadre d'appel de fonction.
  */
 frame_t *frame_push(frame_t *frame, env_t *env, unsigned int sp,
                     unsigned int pc) {
-  frame_t *res = (frame_t *)malloc(sizeof(frame_t));
-  assert(res != NULL);
+  frame_t *res = free_frames;
+  if (res != NULL) {
+    free_frames = res->caller_frame;
+  } else {
+    res = (frame_t *)malloc(sizeof(frame_t));
+    assert(res != NULL);
+  }
 
   res->sp = sp;
   res->env = env;
   res->pc = pc;
+  res->fun_pc = (frame != NULL) ? frame->fun_pc : 0;
+  res->depth = (frame != NULL) ? frame->depth + 1 : 0;
   res->caller_frame = frame;
 
   return res;
@@ -33,11 +46,22 @@ frame_t *frame_push(frame_t *frame, env_t *env, unsigned int sp,
 frame_t *frame_pop(frame_t *frame) {
   frame_t *caller_frame = frame->caller_frame;
 
-  free(frame);  // puis détruire le cadre de pile
+  // puis recycler le cadre de pile
+  frame->caller_frame = free_frames;
+  free_frames = frame;
 
   return caller_frame;
 }
 
+/** Libération des cadres recyclés (en fin d'exécution). */
+void frame_pool_destroy(void) {
+  while (free_frames != NULL) {
+    frame_t *next = free_frames->caller_frame;
+    free(free_frames);
+    free_frames = next;
+  }
+}
+
 /** Affichage d'un cadre d'appel de fonction (pour déboguage). */
 void frame_print(frame_t *frame) {
   if (frame) {
@@ -33,6 +33,8 @@ typedef struct _frame {
   env_t *env;      /*!< l'environnement lexical du cadre d'appel. */
   unsigned int sp; /*!< le pointeur de pile */
   unsigned int pc; /*!< le PC de l'appelant pour le retour de fonction */
+  unsigned int fun_pc; /*!< le PC d'entrée de la fonction (0 au top-niveau) */
+  unsigned int depth;  /*!< la profondeur du cadre (0 au top-niveau) */
   struct _frame
       *caller_frame; /*!< le cadre d'appel de l'appelant (ou cadre parent) */
 } frame_t;
@@ -43,6 +45,7 @@ frame_t *frame_push(frame_t *caller_frame, env_t *env, unsigned int sp,
                     unsigned int pc);
 
 frame_t *frame_pop(frame_t *frame);
+void frame_pool_destroy(void);
 
 void frame_print(frame_t *frame);
 
@@ -2,7 +2,10 @@
  * Gestion mémoire: allocation désallocation automatique (GC)
  *   implantation
  *
- * Les valeurs allouées par la VM sont les fermetures et les paires.
+ * Les valeurs allouées par la VM sont les fermetures, les paires (et les
+ * blocs de listes compactes), les
+ * vecteurs (de valeurs ou d'entiers), les tables de hachage et les chaînes
+ * construites à l'exécution.
  * Chaque valeur allouée est munie d'un entête exploité par le mécanisme
  * de récupération de la mémoire. L'algorithme de récupération de la
  * mémoire est "mark and sweep". Il repose sur le principe suivant:
@@ -30,8 +33,16 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h> /* calloc */
-
+#include <string.h>
+
+#include "alloc_profile.h"
+#include "gc_stats.h"
+#include "hashtable.h"
+#include "heap_snapshot.h"
+#include "i32vector.h"
+#include "probes.h"
 #include "vm.h"
+#include "vm_stats.h"
 
 /** Affichage du tas par le GC (déboguage). */
 void print_gc_list(char *msg, gc_cell_t *head) {
@@ -44,6 +55,8 @@ void print_gc_list(char *msg, gc_cell_t *head) {
 }
 
 static void gc_delete_pair(pair_t *pair);
+static void gc_delete_vector(vector_t *vector);
+static void gc_delete_i32vector(i32vector_t *vector);
 static void gc_delete_env(env_t *env);
 
 /** Désallocation d'une cellule mémoire par le GC.
@@ -52,6 +65,17 @@ static void gc_delete_env(env_t *env);
 static void gc_delete(gc_cell_t *cell) {
   if (cell->type == T_PAIR) {
     gc_delete_pair((pair_t *)cell->content.as_pair);
+  } else if (cell->type == T_CLIST) {
+    free(cell->content.as_clist);
+  } else if (cell->type == T_VECTOR) {
+    gc_delete_vector(cell->content.as_vector);
+  } else if (cell->type == T_I32VECTOR) {
+    gc_delete_i32vector(cell->content.as_i32vector);
+  } else if (cell->type == T_STRING) {
+    free(cell->content.as_string);
+  } else if (cell->type == T_HASHTABLE) {
+    hashtable_free(cell->content.as_hashtable);
+    free(cell->content.as_hashtable);
   } else if (cell->type == T_ENV) {
     gc_delete_env((env_t *)cell->content.as_env);
   } else {
@@ -69,6 +93,16 @@ static void gc_delete(gc_cell_t *cell) {
 int gc_cell_mark(gc_cell_t *cell) {
   if (cell->type == T_PAIR) {
     return cell->content.as_pair->gc_mark;
+  } else if (cell->type == T_CLIST) {
+    return cell->content.as_clist->gc_mark;
+  } else if (cell->type == T_VECTOR) {
+    return cell->content.as_vector->gc_mark;
+  } else if (cell->type == T_I32VECTOR) {
+    return cell->content.as_i32vector->gc_mark;
+  } else if (cell->type == T_STRING) {
+    return cell->content.as_string->gc_mark;
+  } else if (cell->type == T_HASHTABLE) {
+    return cell->content.as_hashtable->gc_mark;
   } else if (cell->type == T_ENV) {
     return cell->content.as_env->gc_mark;
   } else {
@@ -77,8 +111,43 @@ int gc_cell_mark(gc_cell_t *cell) {
   }
 }
 
-/** Phase de balayage (sweep) de l'algorithme de GC. */
-static void gc_sweep(gc_t *gc) {
+/** Taille en mémoire d'une cellule (entête du GC et objet géré).
+ * \param cell la cellule.
+ * \return le nombre d'octets demandés à malloc pour la cellule.
+ */
+size_t gc_cell_size(gc_cell_t *cell) {
+  size_t size = sizeof(gc_cell_t);
+  if (cell->type == T_PAIR) {
+    size = size + sizeof(pair_t);
+  } else if (cell->type == T_CLIST) {
+    size = size + sizeof(clist_t) +
+           cell->content.as_clist->length * (sizeof(value_t) + 1);
+  } else if (cell->type == T_VECTOR) {
+    size = size + sizeof(vector_t) +
+           cell->content.as_vector->size * sizeof(value_t);
+  } else if (cell->type == T_I32VECTOR) {
+    size = size + sizeof(i32vector_t) +
+           cell->content.as_i32vector->size * sizeof(int);
+  } else if (cell->type == T_STRING) {
+    size = size + sizeof(string_t) + cell->content.as_string->length + 1;
+  } else if (cell->type == T_HASHTABLE) {
+    hashtable_t *table = cell->content.as_hashtable;
+    size = size + sizeof(hashtable_t) +
+           (table->area.capacity + table->old.capacity) *
+               (sizeof(unsigned int) + 2 * sizeof(value_t));
+  } else if (cell->type == T_ENV) {
+    size = size + sizeof(env_t) + sizeof(varray_t) +
+           cell->content.as_env->content->capacity * sizeof(value_t);
+  }
+  return size;
+}
+
+/** Phase de balayage (sweep) de l'algorithme de GC.
+ * \param[in,out] gc le GC.
+ * \param[out] event les comptages du balayage (cf. gc_stats.h), ou NULL
+ * pour ne rien compter.
+ */
+static void gc_sweep(gc_t *gc, gc_event_t *event) {
   if (gc->debug_gc) {
     printf("[GC]   Sweep phase started\n");
   }
@@ -87,31 +156,86 @@ static void gc_sweep(gc_t *gc) {
   // the old mark
   gc_cell_t *prev;
   gc_cell_t *cell;
+  unsigned long long live_bytes = 0;
 
   // the first object is "empty": pass it
   prev = &(gc->heap);
   cell = prev->next;
   // while the end of heap is not reached
   while (cell != NULL) {
+    if (event != NULL) {
+      event->heap_before = event->heap_before + gc_cell_size(cell);
+    }
     // tester la marque
     if (gc_cell_mark(cell) != gc->current_mark) {
       // si la cellule n'a pas été marquée, on la récupère
       if (gc->debug_gc) {
         printf("[GC]    free cell %p\n", (void *)cell);
       }
+      if (event != NULL) {
+        event->freed_objects = event->freed_objects + 1;
+        event->freed_bytes = event->freed_bytes + gc_cell_size(cell);
+      }
       prev->next = cell->next;
       gc_delete(cell);
       cell = prev->next;
     } else {
+      gc->nb_allocated = gc->nb_allocated + 1;
+      live_bytes = live_bytes + gc_cell_size(cell);
+      if (cell->alloc_site >= 0) {
+        alloc_profile_survive(gc->alloc_profile, cell);
+      }
+      if (event != NULL) {
+        event->live_objects = event->live_objects + 1;
+        if (cell->type == T_PAIR) {
+          event->live_pairs = event->live_pairs + 1;
+        } else if (cell->type == T_CLIST) {
+          event->live_pairs =
+              event->live_pairs + cell->content.as_clist->length;
+        } else if (cell->type == T_ENV) {
+          event->live_envs = event->live_envs + 1;
+        }
+      }
       prev = cell;
       cell = cell->next;
     }
   }
+  gc->vm_stats->heap_bytes = live_bytes;
+  if (event != NULL) {
+    event->heap_after = event->heap_before - event->freed_bytes;
+  }
 }
 
 /** Algorithme de récupération automatique de mémoire (Garbage Colletion).
+ * Avec le journal des récupérations (gc->stats), les deux phases sont
+ * chronométrées et le balayage compte les objets et les octets.
+ *
+ * Les récupérations sont déclenchées toutes les collection_frequency
+ * instructions : les compteurs de la VM (cf. vm_stats.h) comptent ici ces
+ * instructions et relèvent les profondeurs de la pile et des appels.
  */
 void gc_collect(vm_t *vm) {
+  vm_stats_t *vm_stats = vm->gc->vm_stats;
+  unsigned long long start = gc_stats_now();
+  gc_event_t event;
+  unsigned long long mark_end = 0;
+
+  vm_stats->instructions =
+      vm_stats->instructions + vm->gc->collection_frequency;
+  if (vm->stack->top > vm_stats->max_stack_depth) {
+    vm_stats->max_stack_depth = vm->stack->top;
+  }
+  if (vm->frame->depth > vm_stats->max_frame_depth) {
+    vm_stats->max_frame_depth = vm->frame->depth;
+  }
+
+  if (vm->gc->stats != NULL) {
+    memset(&event, 0, sizeof(event));
+    event.trigger = GC_TRIGGER_FREQUENCY;
+    event.start_ns = start;
+  }
+
+  SVM_PROBE_GC_START(vm->gc->nb_allocated);
   if (vm->gc->debug_gc) {
     printf("[GC] Collector started\n");
   }
@@ -132,11 +256,28 @@ void gc_collect(vm_t *vm) {
   mark_and_trace_roots(vm);
 
   // Phase 2 : sweep
-  gc_sweep(vm->gc);
+  if (vm->gc->stats != NULL) {
+    mark_end = gc_stats_now();
+    gc_sweep(vm->gc, &event);
+    event.mark_ns = mark_end - event.start_ns;
+    event.sweep_ns = gc_stats_now() - mark_end;
+    event.mark_stack_max = vm->gc->mark_max;
+    gc_stats_record(vm->gc->stats, &event);
+  } else {
+    gc_sweep(vm->gc, NULL);
+  }
 
+  SVM_PROBE_GC_DONE(vm->gc->nb_allocated);
   if (vm->gc->debug_gc) {
     printf("[GC] Collector finished\n");
   }
+
+  vm_stats->gc_cycles = vm_stats->gc_cycles + 1;
+  vm_stats->gc_pause_ns = vm_stats->gc_pause_ns + (gc_stats_now() - start);
+  vm_stats_poll(vm_stats);
+
+  // instantané du tas demandé par SIGUSR1 (cf. heap_snapshot.h)
+  heap_snapshot_poll(vm);
 }
 
 /** Allocation d'une cellule pour le GC et chaînage dans le tas.
@@ -146,12 +287,29 @@ void gc_collect(vm_t *vm) {
 static gc_cell_t *gc_alloc_cell(gc_t *gc) {
   gc_cell_t *cell = (gc_cell_t *)malloc(sizeof(gc_cell_t));
   assert(cell != NULL);
+  cell->alloc_site = -1;
+  gc->nb_allocated = gc->nb_allocated + 1;
   cell->next = gc->heap.next;
   gc->heap.next = cell;
 
   return cell;
 }
 
+/** Comptage d'une cellule allouée (compteurs de la VM et profileur des
+ * allocations).
+ * \param[in,out] gc le garbage collector.
+ * \param[in,out] cell la cellule allouée (et initialisée).
+ * \param type le type d'objet compté (VM_STATS_xxx).
+ */
+static void gc_alloc_track(gc_t *gc, gc_cell_t *cell, int type) {
+  size_t size = gc_cell_size(cell);
+  gc->vm_stats->allocations[type] = gc->vm_stats->allocations[type] + 1;
+  gc->vm_stats->heap_bytes = gc->vm_stats->heap_bytes + size;
+  if (gc->alloc_profile != NULL) {
+    alloc_profile_record(gc->alloc_profile, cell, size);
+  }
+}
+
 /** Allocation d'une paire gérée par le GC.
  * \param[in,out] vm l'état global de la VM.
  * \return un pointeur sur une paire allouée vide.
@@ -166,11 +324,137 @@ pair_t *gc_alloc_pair(vm_t *vm) {
   gc_cell_t *cell = gc_alloc_cell(vm->gc);
   cell->type = T_PAIR;
   cell->content.as_pair = pair;
+  gc_alloc_track(vm->gc, cell, VM_STATS_PAIR);
+  SVM_PROBE_ALLOC(T_PAIR, sizeof(pair_t));
   return pair;
 }
 
 static void gc_delete_pair(pair_t *pair) { free(pair); }
 
+/** Allocation d'un bloc de liste compact géré par le GC.
+ * Les car (initialisés à unit) et les codes cdr (CDR_NEXT) sont alloués
+ * dans le même bloc que l'entête ; le cdr du dernier élément est la liste
+ * vide.
+ * \param[in,out] vm l'état global de la VM.
+ * \param length le nombre d'éléments (>0).
+ * \return un pointeur sur le bloc alloué.
+ */
+clist_t *gc_alloc_clist(vm_t *vm, unsigned int length) {
+  unsigned int i;
+  clist_t *block = (clist_t *)malloc(sizeof(clist_t) +
+                                     length * (sizeof(value_t) + 1));
+  assert(block != NULL);
+  block->length = length;
+  block->codes = (unsigned char *)&block->cars[length];
+  for (i = 0; i < length; i++) {
+    value_fill_unit(&block->cars[i]);
+    block->codes[i] = CDR_NEXT;
+  }
+  value_fill_nil(&block->tail);
+  block->gc_mark = vm->gc->current_mark;  // bloc non-marqué initialement
+
+  gc_cell_t *cell = gc_alloc_cell(vm->gc);
+  cell->type = T_CLIST;
+  cell->content.as_clist = block;
+  gc_alloc_track(vm->gc, cell, VM_STATS_CLIST);
+  return block;
+}
+
+/** Allocation d'un vecteur géré par le GC.
+ * Les éléments sont alloués dans le même bloc que l'entête du vecteur.
+ * \param[in,out] vm l'état global de la VM.
+ * \param size le nombre d'éléments.
+ * \param[in] fill la valeur initiale des éléments.
+ * \return un pointeur sur le vecteur alloué.
+ */
+vector_t *gc_alloc_vector(vm_t *vm, unsigned int size, value_t *fill) {
+  unsigned int i;
+  vector_t *vector =
+      (vector_t *)malloc(sizeof(vector_t) + size * sizeof(value_t));
+  assert(vector != NULL);
+  vector->size = size;
+  for (i = 0; i < size; i++) {
+    vector->content[i] = *fill;
+  }
+  vector->gc_mark = vm->gc->current_mark;  // vecteur non-marqué initialement
+
+  gc_cell_t *cell = gc_alloc_cell(vm->gc);
+  cell->type = T_VECTOR;
+  cell->content.as_vector = vector;
+  gc_alloc_track(vm->gc, cell, VM_STATS_VECTOR);
+  return vector;
+}
+
+static void gc_delete_vector(vector_t *vector) { free(vector); }
+
+/** Allocation d'un vecteur d'entiers géré par le GC.
+ * Le tampon des éléments est aligné pour les noyaux SIMD.
+ * \param[in,out] vm l'état global de la VM.
+ * \param size le nombre d'éléments.
+ * \param fill la valeur initiale des éléments.
+ * \return un pointeur sur le vecteur alloué.
+ */
+i32vector_t *gc_alloc_i32vector(vm_t *vm, unsigned int size, int fill) {
+  unsigned int i;
+  i32vector_t *vector = (i32vector_t *)malloc(sizeof(i32vector_t));
+  assert(vector != NULL);
+  vector->size = size;
+  vector->data = i32vector_alloc_data(size);
+  for (i = 0; i < size; i++) {
+    vector->data[i] = fill;
+  }
+  vector->gc_mark = vm->gc->current_mark;  // vecteur non-marqué initialement
+
+  gc_cell_t *cell = gc_alloc_cell(vm->gc);
+  cell->type = T_I32VECTOR;
+  cell->content.as_i32vector = vector;
+  gc_alloc_track(vm->gc, cell, VM_STATS_I32VECTOR);
+  return vector;
+}
+
+static void gc_delete_i32vector(i32vector_t *vector) {
+  free(vector->data);
+  free(vector);
+}
+
+/** Allocation d'une chaîne gérée par le GC.
+ * Les caractères (non initialisés) suivent l'entête dans le même bloc.
+ * \param[in,out] vm l'état global de la VM.
+ * \param length le nombre de caractères.
+ * \return un pointeur sur la chaîne allouée.
+ */
+string_t *gc_alloc_string(vm_t *vm, unsigned int length) {
+  string_t *string = (string_t *)malloc(sizeof(string_t) + length + 1);
+  assert(string != NULL);
+  string->length = length;
+  string->chars[length] = '\0';
+  string->gc_mark = vm->gc->current_mark;  // chaîne non-marquée initialement
+
+  gc_cell_t *cell = gc_alloc_cell(vm->gc);
+  cell->type = T_STRING;
+  cell->content.as_string = string;
+  gc_alloc_track(vm->gc, cell, VM_STATS_STRING);
+  return string;
+}
+
+/** Allocation d'une table de hachage (vide) gérée par le GC.
+ * \param[in,out] vm l'état global de la VM.
+ * \param capacity le nombre d'éléments prévus.
+ * \return un pointeur sur la table allouée.
+ */
+hashtable_t *gc_alloc_hashtable(vm_t *vm, unsigned int capacity) {
+  hashtable_t *table = (hashtable_t *)malloc(sizeof(hashtable_t));
+  assert(table != NULL);
+  hashtable_init(table, capacity);
+  table->gc_mark = vm->gc->current_mark;  // table non-marquée initialement
+
+  gc_cell_t *cell = gc_alloc_cell(vm->gc);
+  cell->type = T_HASHTABLE;
+  cell->content.as_hashtable = table;
+  gc_alloc_track(vm->gc, cell, VM_STATS_HASHTABLE);
+  return table;
+}
+
 /** Allocation d'un environnement local gérée par le GC.
  * \param[in,out] gc le garbage collector.
  * \param[in] capacity la taille allouée pour l'environnement.
@@ -197,6 +481,8 @@ env_t *gc_alloc_env(gc_t *gc, unsigned int capacity, env_t *next) {
     gc_cell_t *cell = gc_alloc_cell(gc);
     cell->type = T_ENV;
     cell->content.as_env = env;
+    gc_alloc_track(gc, cell, VM_STATS_ENV);
+    SVM_PROBE_ALLOC(T_ENV, sizeof(env_t) + capacity * sizeof(value_t));
 
     return env;
   }
@@ -225,6 +511,13 @@ gc_t *init_gc(int debug_gc, int collection_frequency) {
   gc->heap.next = NULL;
   gc->nb_allocated = 0;
   gc->collection_frequency = collection_frequency;
+  gc->mark_stack = NULL;
+  gc->mark_top = 0;
+  gc->mark_capacity = 0;
+  gc->mark_max = 0;
+  gc->stats = NULL;
+  gc->alloc_profile = NULL;
+  gc->vm_stats = NULL;
 
   if (gc->debug_gc) {
     printf("[GC] Initialized with frequency = %d\n", collection_frequency);
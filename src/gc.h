@@ -8,6 +8,8 @@
 #ifndef _GC_H_
 #define _GC_H_
 
+#include <stddef.h>
+
 #include "env.h"
 #include "value.h"
 #include "varray.h"
@@ -17,21 +19,40 @@
  */
 
 struct _vm;
+struct _gc_stats;
+struct _alloc_profile;
+struct _vm_stats;
 
 /** Structure pour les objets mémoire gérés par le GC.
  */
 typedef struct _gc_cell {
-  /** type de l'objet géré (T_PAIR ou T_ENV) */
+  /** type de l'objet géré (T_PAIR, T_CLIST, T_VECTOR, T_I32VECTOR, T_STRING,
+   * T_HASHTABLE ou T_ENV) */
   int type;
+  /** le site de l'allocation si elle est échantillonnée (cf.
+   * alloc_profile.h), -1 sinon */
+  int alloc_site;
   /** l'objet géré par le GC */
   union _gc_content {
     pair_t *as_pair; /*!< l'objet est une paire. */
+    clist_t *as_clist; /*!< l'objet est un bloc de liste compact. */
+    vector_t *as_vector; /*!< l'objet est un vecteur. */
+    i32vector_t *as_i32vector; /*!< l'objet est un vecteur d'entiers. */
+    string_t *as_string;       /*!< l'objet est une chaîne. */
+    struct _hashtable *as_hashtable; /*!< l'objet est une table de hachage. */
     env_t *as_env;   /*!< l'objet est un environnement. */
   } content;
   /** le successeur dans la liste des objets gérés par le GC. */
   struct _gc_cell *next;
 } gc_cell_t;
 
+/** Objet marqué dont le contenu reste à tracer (cf. gc_mark.c).
+ */
+typedef struct {
+  int type;     /*!< le type de l'objet (T_PAIR, T_CLIST, T_VECTOR, ...) */
+  void *object; /*!< l'objet */
+} gc_mark_entry_t;
+
 /** Structure décrivant l'état du GC.
  */
 typedef struct _gc {
@@ -41,6 +62,16 @@ typedef struct _gc {
   int nb_allocated; /*!< le nombre d'objets alloués. */
   int collection_frequency; /*!< la fréquence de la récupération (0 pour pas de
                                récupération avant manque de mémoire). */
+  gc_mark_entry_t *mark_stack; /*!< la pile de marquage */
+  unsigned int mark_top;       /*!< la hauteur de la pile de marquage */
+  unsigned int mark_capacity;  /*!< la taille de la pile de marquage */
+  unsigned int mark_max; /*!< la hauteur maximale de la pile de marquage
+                            pendant la dernière récupération */
+  struct _gc_stats *stats; /*!< le journal des récupérations (cf.
+                              gc_stats.h), ou NULL */
+  struct _alloc_profile *alloc_profile; /*!< le profileur des allocations
+                                           (cf. alloc_profile.h), ou NULL */
+  struct _vm_stats *vm_stats; /*!< les compteurs de la VM (cf. vm_stats.h) */
 } gc_t;
 
 /* Initialisation */
@@ -50,8 +81,15 @@ gc_t *init_gc(int debug_gc, int collection_frequency);
 /* Allocations */
 
 pair_t *gc_alloc_pair(struct _vm *vm);
+clist_t *gc_alloc_clist(struct _vm *vm, unsigned int length);
+vector_t *gc_alloc_vector(struct _vm *vm, unsigned int size, value_t *fill);
+i32vector_t *gc_alloc_i32vector(struct _vm *vm, unsigned int size, int fill);
+string_t *gc_alloc_string(struct _vm *vm, unsigned int length);
+struct _hashtable *gc_alloc_hashtable(struct _vm *vm, unsigned int capacity);
 env_t *gc_alloc_env(gc_t *gc, unsigned int capacity, env_t *next);
 
+size_t gc_cell_size(gc_cell_t *cell);
+
 /* Marquage/Traçage (cf. gc_mark.c) */
 
 void mark_and_trace_roots(struct _vm *vm);
@@ -5,110 +5,232 @@
  * Redistribution possible sous licence GPL v2.0 ou ultérieure
  */
 
+#include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "hashtable.h"
 #include "vm.h"
 
 /** \file gc_mark.c
  * Implémentation de l'algorithme de marquage par le GC.
+ *
+ * Le marquage n'est pas récursif : un objet est marqué dès qu'il est
+ * atteint, puis empilé sur la pile de marquage du GC (gc->mark_stack) ;
+ * son contenu est tracé lorsqu'il est dépilé. La profondeur de la pile C
+ * ne dépend donc pas de la forme des données (longues listes chaînées,
+ * longues chaînes d'environnements).
  */
 
-static void pair_mark_and_trace(gc_t *gc, pair_t *pair);
-static void closure_mark_and_trace(gc_t *gc, closure_t *closure);
+/** Taille initiale de la pile de marquage. */
+#define GC_MARK_STACK_SIZE 256
 
-/** Marquage des valeurs simples.
- * Remarque : les valeurs ne sont marquées explicitement
- * que s'il s'agit de paires ou de fermetures. Ce sont
- * les deux seuls cas qui nécessitent l'emploi du GC
- * dans cette version de la VM.
+/** Empilement d'un objet marqué (dont le contenu reste à tracer).
+ * \param[in,out] gc le GC.
+ * \param type le type de l'objet (T_PAIR, T_CLIST, T_VECTOR, T_HASHTABLE ou
+ * T_ENV).
+ * \param[in] object l'objet.
  */
-static void value_mark_and_trace(gc_t *gc, value_t *value) {
-  if (value_is_pair(value)) {
-    // marquer la paire
-    pair_mark_and_trace(gc, value->data.as_pair);
-  } else if (value_is_closure(value)) {
-    // marquer la fermeture.
-    closure_mark_and_trace(gc, &(value->data.as_closure));
-  }  // les autres types de valeur ne sont pas gérés par le GC
+static void gc_mark_push(gc_t *gc, int type, void *object) {
+  if (gc->mark_top == gc->mark_capacity) {
+    gc->mark_capacity = (gc->mark_capacity == 0) ? GC_MARK_STACK_SIZE
+                                                 : 2 * gc->mark_capacity;
+    gc->mark_stack = (gc_mark_entry_t *)realloc(
+        gc->mark_stack, sizeof(gc_mark_entry_t) * gc->mark_capacity);
+    assert(gc->mark_stack != NULL);
+  }
+  gc->mark_stack[gc->mark_top].type = type;
+  gc->mark_stack[gc->mark_top].object = object;
+  gc->mark_top = gc->mark_top + 1;
+  if (gc->mark_top > gc->mark_max) {
+    gc->mark_max = gc->mark_top;
+  }
 }
 
-/** Traçage et marquage du contenu d'une paire */
-static void pair_mark_and_trace(gc_t *gc, pair_t *pair) {
-  if (pair != NULL) {  // Remarque : la paire vide est NULL
-    if (pair->gc_mark != gc->current_mark) {
-      // la paire n'est pas encore marquée
+static void env_mark(gc_t *gc, env_t *env);
+
+/** Marquage des valeurs simples.
+ * Remarque : les valeurs ne sont marquées explicitement
+ * que s'il s'agit de paires, de vecteurs, de tables de hachage, de
+ * chaînes ou de fermetures (les symboles ne sont jamais récupérés).
+ * Ce sont les seuls cas qui nécessitent l'emploi du GC
+ * dans cette version de la VM. Les données immortelles (GC_IMMORTAL) ne
+ * sont ni marquées ni tracées : elles ne référencent que des données
+ * immortelles.
+ */
+static void value_mark(gc_t *gc, value_t *value) {
+  if (value->type == T_PAIR) {
+    pair_t *pair = value->data.as_pair;
+    // Remarque : la paire vide est NULL
+    if (pair != NULL && pair->gc_mark != gc->current_mark &&
+        pair->gc_mark != GC_IMMORTAL) {
       if (gc->debug_gc) {
         printf("[GC]       ==> 1 pair marked\n");
       }
       pair->gc_mark = gc->current_mark;
-      // marquer/tracer le car
-      value_mark_and_trace(gc, &(pair->car));
-      // marquer/tracer le cdr  (qui n'est pas forcément une paire !)
-      value_mark_and_trace(gc, &(pair->cdr));
-    }  // sinon rien à faire
+      gc_mark_push(gc, T_PAIR, pair);
+    }
+  } else if (value->type == T_CLIST) {
+    // marquer tout le bloc de liste
+    clist_t *block = value->data.as_clist.block;
+    if (block->gc_mark != gc->current_mark && block->gc_mark != GC_IMMORTAL) {
+      if (gc->debug_gc) {
+        printf("[GC]       ==> 1 list block marked\n");
+      }
+      block->gc_mark = gc->current_mark;
+      gc_mark_push(gc, T_CLIST, block);
+    }
+  } else if (value_is_vector(value)) {
+    vector_t *vector = value->data.as_vector;
+    if (vector->gc_mark != gc->current_mark &&
+        vector->gc_mark != GC_IMMORTAL) {
+      if (gc->debug_gc) {
+        printf("[GC]       ==> 1 vector marked\n");
+      }
+      vector->gc_mark = gc->current_mark;
+      gc_mark_push(gc, T_VECTOR, vector);
+    }
+  } else if (value_is_i32vector(value)) {
+    // marquer le vecteur d'entiers (rien à tracer)
+    if (gc->debug_gc &&
+        value->data.as_i32vector->gc_mark != gc->current_mark) {
+      printf("[GC]       ==> 1 i32vector marked\n");
+    }
+    value->data.as_i32vector->gc_mark = gc->current_mark;
+  } else if (value_is_string(value)) {
+    // marquer la chaîne (sauf les chaînes constantes, hors du tas)
+    if (value->data.as_string->gc_mark != GC_IMMORTAL) {
+      value->data.as_string->gc_mark = gc->current_mark;
+    }
+  } else if (value->type == T_HASHTABLE) {
+    hashtable_t *table = value->data.as_hashtable;
+    if (table->gc_mark != gc->current_mark) {
+      if (gc->debug_gc) {
+        printf("[GC]       ==> 1 hashtable marked\n");
+      }
+      table->gc_mark = gc->current_mark;
+      gc_mark_push(gc, T_HASHTABLE, table);
+    }
+  } else if (value_is_closure(value)) {
+    // marquer l'environnement de la fermeture.
+    env_mark(gc, value->data.as_closure.env);
+  }  // les autres types de valeur ne sont pas gérés par le GC
+}
+
+/** Marquage d'un environnement (et, à son traçage, de ses parents). */
+static void env_mark(gc_t *gc, env_t *env) {
+  if (env != NULL && env->gc_mark != gc->current_mark) {
+    if (gc->debug_gc) {
+      printf("[GC]       ==> 1 env marked\n");
+    }
+    env->gc_mark = gc->current_mark;
+    gc_mark_push(gc, T_ENV, env);
   }
 }
 
 /** Marquage d'un tableau de valeurs.
  */
-void varray_mark_and_trace(gc_t *gc, varray_t *varray) {
-  int i;
-  // Le procédé consiste à marquer (et tracer) individuellement les valeurs.
+static void varray_mark(gc_t *gc, varray_t *varray) {
+  unsigned int i;
+  // Le procédé consiste à marquer individuellement les valeurs.
   for (i = 0; i < varray->top; i++) {
-    value_mark_and_trace(gc, &varray->content[i]);
+    value_mark(gc, &varray->content[i]);
   }
 }
 
-void env_mark_and_trace(gc_t *gc, env_t *env) {
-  if (env) {
-    if (env->gc_mark != gc->current_mark) {
-      if (gc->debug_gc) {
-        printf("[GC]       ==> 1 env marked\n");
-      }
-      env->gc_mark = gc->current_mark;
-      varray_mark_and_trace(gc, env->content);
-      env_mark_and_trace(gc, env->next);
+/** Marquage des éléments d'une zone de table de hachage */
+static void hashtable_area_mark(gc_t *gc, hashtable_area_t *area) {
+  unsigned int i;
+  for (i = 0; i < area->capacity; i++) {
+    if (area->hashes[i] != 0) {
+      value_mark(gc, &(area->keys[i]));
+      value_mark(gc, &(area->values[i]));
     }
   }
 }
 
-/** Traçage et marquage d'une fermeture */
-void closure_mark_and_trace(gc_t *gc, closure_t *closure) {
-  env_mark_and_trace(gc, closure->env);
+/** Traçage des objets de la pile de marquage, jusqu'à la vider.
+ * Les car d'un bloc de liste compact sont tracés comme un tableau (ceux des
+ * éléments remplacés contiennent la paire de remplacement), puis le cdr du
+ * dernier élément.
+ */
+static void gc_mark_drain(gc_t *gc) {
+  unsigned int i;
+
+  while (gc->mark_top > 0) {
+    gc_mark_entry_t entry;
+    gc->mark_top = gc->mark_top - 1;
+    entry = gc->mark_stack[gc->mark_top];
+
+    if (entry.type == T_PAIR) {
+      pair_t *pair = (pair_t *)entry.object;
+      value_mark(gc, &(pair->car));
+      // le cdr n'est pas forcément une paire !
+      value_mark(gc, &(pair->cdr));
+    } else if (entry.type == T_CLIST) {
+      clist_t *block = (clist_t *)entry.object;
+      for (i = 0; i < block->length; i++) {
+        value_mark(gc, &(block->cars[i]));
+      }
+      value_mark(gc, &(block->tail));
+    } else if (entry.type == T_VECTOR) {
+      vector_t *vector = (vector_t *)entry.object;
+      for (i = 0; i < vector->size; i++) {
+        value_mark(gc, &(vector->content[i]));
+      }
+    } else if (entry.type == T_HASHTABLE) {
+      hashtable_t *table = (hashtable_t *)entry.object;
+      hashtable_area_mark(gc, &table->area);
+      hashtable_area_mark(gc, &table->old);
+    } else {
+      env_t *env = (env_t *)entry.object;
+      assert(entry.type == T_ENV);
+      varray_mark(gc, env->content);
+      env_mark(gc, env->next);
+    }
+  }
 }
 
-/** Marquer et tracer un cadre d'appel de fonction. */
-static void frame_mark_and_trace(gc_t *gc, frame_t *frame) {
+/** Marquer les environnements des cadres d'appel de fonction. */
+static void frame_mark(gc_t *gc, frame_t *frame) {
   frame_t *traced_frame = frame;
   int frame_num = 0;              // pour compter les frames (debuggage)
-  while (traced_frame != NULL) {  // on s'arrête récursivement en NULL (ou 0)
+  while (traced_frame != NULL) {  // on s'arrête en NULL (ou 0)
     frame_num++;
     if (gc->debug_gc) {
       printf("[GC]        Tracing frame #%d\n", frame_num);
     }
-    // marquer/tracer l'environnement local
-    env_mark_and_trace(gc, traced_frame->env);
-    // et finalement marquer/tracer le cadre appelant
+    // marquer l'environnement local
+    env_mark(gc, traced_frame->env);
+    // et finalement passer au cadre appelant
     traced_frame = traced_frame->caller_frame;
   }
 }
 
 /** Marquage/traçage depuis les racines de la machine virtuelle.
  * Il s'agit du point d'entrée pour la phase de marquage de l'algorithme de GC.
+ * La hauteur maximale atteinte par la pile de marquage est conservée dans
+ * gc->mark_max.
  */
 void mark_and_trace_roots(vm_t *vm) {
-  if (vm->gc->debug_gc) {
+  gc_t *gc = vm->gc;
+
+  gc->mark_max = 0;
+  if (gc->debug_gc) {
     printf("[GC]    Tracing roots\n");
     printf("[GC]      Tracing globals\n");
   }
-  varray_mark_and_trace(vm->gc, vm->globs);
-  if (vm->gc->debug_gc) {
+  varray_mark(gc, vm->globs);
+  gc_mark_drain(gc);
+  if (gc->debug_gc) {
     printf("[GC]      Tracing stack\n");
   }
-  varray_mark_and_trace(vm->gc, vm->stack);
+  varray_mark(gc, vm->stack);
+  gc_mark_drain(gc);
 
-  if (vm->gc->debug_gc) {
+  if (gc->debug_gc) {
     printf("[GC]      Tracing call frames\n");
   }
-  frame_mark_and_trace(vm->gc, vm->frame);
+  frame_mark(gc, vm->frame);
+  gc_mark_drain(gc);
 }
@@ -0,0 +1,132 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "gc_stats.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** \file gc_stats.c
+ * Écriture du journal des récupérations et résumé des pauses.
+ ******/
+
+/** Date courante (horloge monotone, en nanosecondes). */
+unsigned long long gc_stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull +
+         (unsigned long long)ts.tv_nsec;
+}
+
+/** Création du journal des récupérations.
+ * \param[in] filename le fichier à écrire.
+ * \return le journal (vide).
+ */
+gc_stats_t *gc_stats_create(const char *filename) {
+  gc_stats_t *stats = (gc_stats_t *)malloc(sizeof(gc_stats_t));
+  assert(stats != NULL);
+
+  stats->file = fopen(filename, "w");
+  if (stats->file == NULL) {
+    fprintf(stderr, "cannot write GC statistics: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  stats->filename = filename;
+  stats->start_ns = gc_stats_now();
+  stats->capacity = 64;
+  stats->pauses = (unsigned long long *)malloc(sizeof(unsigned long long) *
+                                               stats->capacity);
+  assert(stats->pauses != NULL);
+  stats->nb_collections = 0;
+
+  return stats;
+}
+
+/** Fermeture et libération du journal. */
+void gc_stats_destroy(gc_stats_t *stats) {
+  fclose(stats->file);
+  free(stats->pauses);
+  free(stats);
+}
+
+/** Enregistrement d'une récupération (une ligne JSON).
+ * \param[in,out] stats le journal.
+ * \param[in] event les mesures de la récupération.
+ */
+void gc_stats_record(gc_stats_t *stats, gc_event_t *event) {
+  unsigned long long pause = event->mark_ns + event->sweep_ns;
+
+  if (stats->nb_collections == stats->capacity) {
+    stats->capacity = 2 * stats->capacity;
+    stats->pauses = (unsigned long long *)realloc(
+        stats->pauses, sizeof(unsigned long long) * stats->capacity);
+    assert(stats->pauses != NULL);
+  }
+  stats->pauses[stats->nb_collections] = pause;
+  stats->nb_collections = stats->nb_collections + 1;
+
+  fprintf(stats->file,
+          "{\"gc\":%lu,\"trigger\":\"%s\",\"time_ns\":%llu,"
+          "\"pause_ns\":%llu,\"mark_ns\":%llu,\"sweep_ns\":%llu,"
+          "\"live_objects\":%lu,\"live_pairs\":%lu,\"live_envs\":%lu,"
+          "\"freed_objects\":%lu,\"freed_bytes\":%zu,"
+          "\"heap_before\":%zu,\"heap_after\":%zu,"
+          "\"mark_stack_max\":%u}\n",
+          stats->nb_collections, event->trigger,
+          event->start_ns - stats->start_ns, pause, event->mark_ns,
+          event->sweep_ns, event->live_objects, event->live_pairs,
+          event->live_envs, event->freed_objects, event->freed_bytes,
+          event->heap_before, event->heap_after, event->mark_stack_max);
+}
+
+/** Comparaison de deux durées (ordre croissant). */
+static int gc_stats_compare(const void *a, const void *b) {
+  unsigned long long da = *(const unsigned long long *)a;
+  unsigned long long db = *(const unsigned long long *)b;
+  return (da > db) - (da < db);
+}
+
+/** Centile d'un tableau trié (rang le plus proche).
+ * \param[in] sorted les durées triées.
+ * \param count le nombre de durées (>0).
+ * \param percent le centile voulu (entre 1 et 100).
+ */
+static unsigned long long gc_stats_percentile(unsigned long long *sorted,
+                                              unsigned long count,
+                                              unsigned int percent) {
+  unsigned long rank = (count * percent + 99) / 100;  // arrondi supérieur
+  return sorted[(rank == 0) ? 0 : rank - 1];
+}
+
+/** Résumé des pauses (sur la sortie standard).
+ * \param[in,out] stats le journal (les pauses sont triées).
+ */
+void gc_stats_report(gc_stats_t *stats) {
+  unsigned long long total = 0;
+  unsigned long i;
+
+  fflush(stats->file);
+  if (stats->nb_collections == 0) {
+    printf("GC: no collection, log written to %s\n", stats->filename);
+    return;
+  }
+
+  for (i = 0; i < stats->nb_collections; i++) {
+    total = total + stats->pauses[i];
+  }
+  qsort(stats->pauses, stats->nb_collections, sizeof(unsigned long long),
+        gc_stats_compare);
+
+  printf("GC: %lu collections, total pause %.3f ms, log written to %s\n",
+         stats->nb_collections, total / 1e6, stats->filename);
+  printf("GC pauses (us): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+         gc_stats_percentile(stats->pauses, stats->nb_collections, 50) / 1e3,
+         gc_stats_percentile(stats->pauses, stats->nb_collections, 90) / 1e3,
+         gc_stats_percentile(stats->pauses, stats->nb_collections, 99) / 1e3,
+         stats->pauses[stats->nb_collections - 1] / 1e3);
+}
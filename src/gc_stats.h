@@ -0,0 +1,64 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _GC_STATS_H_
+#define _GC_STATS_H_
+
+/** \file gc_stats.h
+ * Journal des récupérations mémoire (option `--gcstats=FILE`).
+ *
+ * Chaque récupération est écrite comme un objet JSON sur une ligne
+ * (format "JSON lines") : cause du déclenchement, durées de marquage et
+ * de balayage, objets vivants, objets et octets libérés, taille du tas
+ * avant et après, hauteur maximale de la pile de marquage. Les tailles
+ * sont celles des blocs demandés à malloc, entêtes du GC compris.
+ *
+ * En fin d'exécution, un résumé des pauses (médiane, p90, p99, maximum)
+ * est affiché sur la sortie standard.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+/** Cause de déclenchement : nombre d'instructions (cf. --gcfreq). */
+#define GC_TRIGGER_FREQUENCY "frequency"
+
+/** Mesures d'une récupération. */
+typedef struct {
+  const char *trigger;           /*!< la cause du déclenchement */
+  unsigned long long start_ns;   /*!< la date du début (cf. gc_stats_now) */
+  unsigned long long mark_ns;    /*!< la durée du marquage (ns) */
+  unsigned long long sweep_ns;   /*!< la durée du balayage (ns) */
+  unsigned long live_objects;    /*!< les objets conservés */
+  unsigned long live_pairs; /*!< les paires conservées (éléments des
+                               listes compactes compris) */
+  unsigned long live_envs;       /*!< les environnements conservés */
+  unsigned long freed_objects;   /*!< les objets libérés */
+  size_t freed_bytes;            /*!< les octets libérés */
+  size_t heap_before;            /*!< la taille du tas avant (octets) */
+  size_t heap_after;             /*!< la taille du tas après (octets) */
+  unsigned int mark_stack_max;   /*!< la hauteur de la pile de marquage */
+} gc_event_t;
+
+/** État du journal. */
+typedef struct _gc_stats {
+  FILE *file;                   /*!< le fichier du journal */
+  const char *filename;         /*!< son nom */
+  unsigned long long start_ns;  /*!< la date de création du journal */
+  unsigned long long *pauses;   /*!< les durées des pauses (ns) */
+  unsigned long nb_collections; /*!< le nombre de récupérations */
+  unsigned long capacity;       /*!< la taille du tableau des pauses */
+} gc_stats_t;
+
+gc_stats_t *gc_stats_create(const char *filename);
+void gc_stats_destroy(gc_stats_t *stats);
+
+unsigned long long gc_stats_now(void);
+void gc_stats_record(gc_stats_t *stats, gc_event_t *event);
+void gc_stats_report(gc_stats_t *stats);
+
+#endif
@@ -0,0 +1,343 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "hashtable.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "symtab.h"
+
+/** \file hashtable.c
+ * Tables de hachage natives (implantation).
+ *
+ * Dans une zone, la distance d'un élément à sa case d'origine se déduit de
+ * son code de hachage : on ne la stocke pas. Le bit de poids fort des codes
+ * est toujours à 1, ce qui réserve le code 0 aux cases vides.
+ ******/
+
+/** La capacité minimale d'une zone. */
+#define HASHTABLE_MIN_CAPACITY 8
+
+/** Le nombre de cases de l'ancienne zone migrées à chaque opération. */
+#define HASHTABLE_MIGRATE_STEP 16
+
+/** Mélange des bits d'un entier (finaliseur de MurmurHash3). */
+static unsigned int hash_mix(unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+/** Calcul du code de hachage d'une clé.
+ * \param[in] key la clé.
+ * \param[out] hash le code de hachage (jamais nul).
+ * \return 1 si la valeur peut servir de clé, 0 sinon.
+ */
+int hashtable_hash(value_t *key, unsigned int *hash) {
+  unsigned int h;
+  switch (key->type) {
+    case T_INT:
+    case T_BOOL:
+    case T_UNIT:
+      h = hash_mix((unsigned int)key->data.as_int ^ (unsigned int)key->type);
+      break;
+    case T_STRING: {
+      unsigned int i;
+      h = 2166136261u;  // FNV-1a
+      for (i = 0; i < key->data.as_string->length; i++) {
+        h = (h ^ (unsigned char)key->data.as_string->chars[i]) * 16777619u;
+      }
+    } break;
+    case T_SYMBOL:
+      h = hash_mix(key->data.as_symbol->hash);
+      break;
+    case T_CLIST:
+      // identité d'un élément de bloc : le bloc et le numéro (stable même
+      // si l'élément est remplacé par une vraie paire, cf. value.h)
+      h = hash_mix((unsigned int)((size_t)key->data.as_clist.block >> 3) ^
+                   (key->data.as_clist.index * 0x9e3779b9u));
+      break;
+    case T_PAIR:
+    case T_VECTOR:
+    case T_I32VECTOR:
+    case T_HASHTABLE:
+      // comparaison par identité : on hache l'adresse
+      h = hash_mix((unsigned int)((size_t)key->data.as_pair >> 3));
+      break;
+    default:
+      return 0;
+  }
+  *hash = h | 0x80000000u;
+  return 1;
+}
+
+/** Égalité de deux clés (cf. hashtable.h). */
+static int hashtable_key_equal(value_t *a, value_t *b) {
+  if (a->type != b->type) return 0;
+  switch (a->type) {
+    case T_INT:
+    case T_BOOL:
+    case T_UNIT:
+      return a->data.as_int == b->data.as_int;
+    case T_STRING:
+      return a->data.as_string->length == b->data.as_string->length &&
+             memcmp(a->data.as_string->chars, b->data.as_string->chars,
+                    a->data.as_string->length) == 0;
+    case T_CLIST:
+      return a->data.as_clist.block == b->data.as_clist.block &&
+             a->data.as_clist.index == b->data.as_clist.index;
+    default:
+      return a->data.as_pair == b->data.as_pair;
+  }
+}
+
+/** Allocation des tableaux d'une zone. */
+static void area_init(hashtable_area_t *area, unsigned int capacity) {
+  area->capacity = capacity;
+  area->count = 0;
+  if (capacity == 0) {
+    area->hashes = NULL;
+    area->keys = NULL;
+    area->values = NULL;
+  } else {
+    area->hashes = (unsigned int *)calloc(capacity, sizeof(unsigned int));
+    area->keys = (value_t *)malloc(capacity * sizeof(value_t));
+    area->values = (value_t *)malloc(capacity * sizeof(value_t));
+    assert(area->hashes != NULL && area->keys != NULL && area->values != NULL);
+  }
+}
+
+/** Libération des tableaux d'une zone. */
+static void area_free(hashtable_area_t *area) {
+  free(area->hashes);
+  free(area->keys);
+  free(area->values);
+  area_init(area, 0);
+}
+
+/** Distance entre une case et la case d'origine du code hash. */
+static unsigned int area_dist(hashtable_area_t *area, unsigned int hash,
+                              unsigned int pos) {
+  return (pos - hash) & (area->capacity - 1);
+}
+
+/** Recherche d'une clé dans une zone.
+ * \return la case de la clé, ou -1 si elle est absente.
+ */
+static int area_find(hashtable_area_t *area, value_t *key, unsigned int hash) {
+  unsigned int pos, dist;
+  if (area->count == 0) return -1;
+
+  pos = hash & (area->capacity - 1);
+  for (dist = 0;; dist++) {
+    unsigned int h = area->hashes[pos];
+    // Robin Hood : on s'arrête dès qu'un élément est plus proche de son
+    // origine que la clé cherchée ne le serait
+    if (h == 0 || area_dist(area, h, pos) < dist) return -1;
+    if (h == hash && hashtable_key_equal(&area->keys[pos], key)) return pos;
+    pos = (pos + 1) & (area->capacity - 1);
+  }
+}
+
+/** Insertion d'une clé absente dans une zone (qui n'est pas pleine). */
+static void area_insert(hashtable_area_t *area, value_t *key,
+                        unsigned int hash, value_t *value) {
+  unsigned int pos = hash & (area->capacity - 1), dist = 0;
+  value_t k = *key, v = *value;
+
+  while (area->hashes[pos] != 0) {
+    unsigned int d = area_dist(area, area->hashes[pos], pos);
+    if (d < dist) {
+      // on prend la place du "riche" et on continue avec lui
+      unsigned int th = area->hashes[pos];
+      value_t tk = area->keys[pos], tv = area->values[pos];
+      area->hashes[pos] = hash;
+      area->keys[pos] = k;
+      area->values[pos] = v;
+      hash = th;
+      k = tk;
+      v = tv;
+      dist = d;
+    }
+    pos = (pos + 1) & (area->capacity - 1);
+    dist = dist + 1;
+  }
+
+  area->hashes[pos] = hash;
+  area->keys[pos] = k;
+  area->values[pos] = v;
+  area->count = area->count + 1;
+}
+
+/** Suppression de la case pos d'une zone (décalage arrière). */
+static void area_delete(hashtable_area_t *area, unsigned int pos) {
+  unsigned int next = (pos + 1) & (area->capacity - 1);
+
+  while (area->hashes[next] != 0 &&
+         area_dist(area, area->hashes[next], next) > 0) {
+    area->hashes[pos] = area->hashes[next];
+    area->keys[pos] = area->keys[next];
+    area->values[pos] = area->values[next];
+    pos = next;
+    next = (next + 1) & (area->capacity - 1);
+  }
+  area->hashes[pos] = 0;
+  area->count = area->count - 1;
+}
+
+/** Migration de quelques cases de l'ancienne zone vers la zone courante.
+ * \param[in,out] table la table.
+ * \param steps le nombre maximal de cases à examiner.
+ */
+static void hashtable_migrate(hashtable_t *table, unsigned int steps) {
+  hashtable_area_t *old = &table->old;
+
+  while (old->count > 0 && steps > 0) {
+    unsigned int pos = table->migrate_pos;
+    if (old->hashes[pos] != 0) {
+      area_insert(&table->area, &old->keys[pos], old->hashes[pos],
+                  &old->values[pos]);
+      // le décalage arrière peut ramener un élément dans cette case : on
+      // ne la quitte que lorsqu'elle est vide
+      area_delete(old, pos);
+    } else {
+      table->migrate_pos = (pos + 1) & (old->capacity - 1);
+    }
+    steps = steps - 1;
+  }
+
+  if (old->count == 0 && old->capacity > 0) {
+    area_free(old);
+  }
+}
+
+/** Initialisation d'une table vide.
+ * \param[in,out] table la table à initialiser.
+ * \param capacity la capacité souhaitée (nombre d'éléments).
+ */
+void hashtable_init(hashtable_t *table, unsigned int capacity) {
+  unsigned int size = HASHTABLE_MIN_CAPACITY;
+  // facteur de charge maximal : 3/4
+  while (size * 3 < capacity * 4) size = size * 2;
+  area_init(&table->area, size);
+  area_init(&table->old, 0);
+  table->migrate_pos = 0;
+}
+
+/** Libération des tableaux d'une table (pas de la structure elle-même). */
+void hashtable_free(hashtable_t *table) {
+  area_free(&table->area);
+  area_free(&table->old);
+}
+
+/** Le nombre d'éléments de la table. */
+unsigned int hashtable_count(hashtable_t *table) {
+  return table->area.count + table->old.count;
+}
+
+/** Recherche d'une clé.
+ * \param[in] table la table.
+ * \param[in] key la clé.
+ * \param hash le code de hachage de la clé (cf. hashtable_hash).
+ * \return un pointeur sur la valeur associée, ou NULL si la clé est
+ * absente (valide jusqu'à la prochaine modification).
+ */
+value_t *hashtable_ref(hashtable_t *table, value_t *key, unsigned int hash) {
+  int pos = area_find(&table->area, key, hash);
+  if (pos >= 0) return &table->area.values[pos];
+  pos = area_find(&table->old, key, hash);
+  if (pos >= 0) return &table->old.values[pos];
+  return NULL;
+}
+
+/** Association d'une valeur à une clé (ajout ou remplacement).
+ * \param[in,out] table la table.
+ * \param[in] key la clé.
+ * \param hash le code de hachage de la clé (cf. hashtable_hash).
+ * \param[in] value la valeur.
+ */
+void hashtable_set(hashtable_t *table, value_t *key, unsigned int hash,
+                   value_t *value) {
+  value_t *slot;
+
+  hashtable_migrate(table, HASHTABLE_MIGRATE_STEP);
+
+  slot = hashtable_ref(table, key, hash);
+  if (slot != NULL) {
+    *slot = *value;
+    return;
+  }
+
+  if ((table->area.count + 1) * 4 > table->area.capacity * 3) {
+    // la zone courante est trop remplie : on termine la migration en
+    // cours (cas rare : elle avance plus vite que les insertions) et on
+    // démarre la suivante
+    hashtable_migrate(table, ~0u);
+    table->old = table->area;
+    table->migrate_pos = 0;
+    area_init(&table->area, table->old.capacity * 2);
+  }
+
+  area_insert(&table->area, key, hash, value);
+}
+
+/** Suppression d'une clé.
+ * \return 1 si la clé était présente, 0 sinon.
+ */
+int hashtable_remove(hashtable_t *table, value_t *key, unsigned int hash) {
+  int pos;
+
+  hashtable_migrate(table, HASHTABLE_MIGRATE_STEP);
+
+  pos = area_find(&table->area, key, hash);
+  if (pos >= 0) {
+    area_delete(&table->area, pos);
+    return 1;
+  }
+  pos = area_find(&table->old, key, hash);
+  if (pos >= 0) {
+    area_delete(&table->old, pos);
+    if (table->old.count == 0) area_free(&table->old);
+    return 1;
+  }
+  return 0;
+}
+
+/** Parcours des éléments de la table.
+ * Si la table est modifiée pendant le parcours, des éléments peuvent être
+ * omis ou vus plusieurs fois (mais le parcours termine).
+ * \param[in] table la table.
+ * \param[in,out] pos la position du parcours (0 au départ).
+ * \param[out] key la clé de l'élément suivant.
+ * \param[out] value la valeur de l'élément suivant.
+ * \return 1 si un élément a été trouvé, 0 à la fin du parcours.
+ */
+int hashtable_next(hashtable_t *table, unsigned int *pos, value_t *key,
+                   value_t *value) {
+  // les positions de l'ancienne zone précèdent celles de la zone courante
+  while (*pos < table->old.capacity + table->area.capacity) {
+    hashtable_area_t *area = &table->old;
+    unsigned int i = *pos;
+    if (i >= table->old.capacity) {
+      area = &table->area;
+      i = i - table->old.capacity;
+    }
+    *pos = *pos + 1;
+    if (area->hashes[i] != 0) {
+      *key = area->keys[i];
+      *value = area->values[i];
+      return 1;
+    }
+  }
+  return 0;
+}
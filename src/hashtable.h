@@ -0,0 +1,64 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _HASHTABLE_H_
+#define _HASHTABLE_H_
+
+#include "value.h"
+
+/** \file hashtable.h
+ * Tables de hachage natives.
+ *
+ * Une table est à adressage ouvert avec sondage "Robin Hood" : lors d'une
+ * insertion, un élément plus éloigné de sa case d'origine prend la place
+ * d'un élément plus proche de la sienne, ce qui garde les sondages courts
+ * et permet la suppression par décalage arrière (sans marque de case
+ * supprimée). Les codes de hachage, les clés et les valeurs sont rangés
+ * dans trois tableaux contigus ; le GC trace directement les tableaux de
+ * clés et de valeurs.
+ *
+ * L'agrandissement est incrémental : une nouvelle zone, deux fois plus
+ * grande, est allouée et l'ancienne est vidée progressivement (quelques
+ * cases à chaque opération). Pendant la migration, une clé peut se trouver
+ * dans l'une ou l'autre zone.
+ *
+ * Les clés sont comparées par valeur pour les entiers, les booléens et les
+ * chaînes, par identité pour les symboles (internés), les paires et les
+ * autres objets. Les fermetures et les primitives ne peuvent pas servir de
+ * clé.
+ */
+
+/** Une zone de stockage (tableaux contigus). */
+typedef struct {
+  unsigned int capacity; /*!< le nombre de cases (puissance de 2, ou 0) */
+  unsigned int count;    /*!< le nombre de cases occupées */
+  unsigned int *hashes;  /*!< les codes de hachage (0 pour une case vide) */
+  value_t *keys;         /*!< les clés */
+  value_t *values;       /*!< les valeurs */
+} hashtable_area_t;
+
+/** Représentation des tables de hachage (gérées par le GC). */
+typedef struct _hashtable {
+  int gc_mark;                /*!< la valeur de la marque (0 ou 1). */
+  hashtable_area_t area;      /*!< la zone courante */
+  hashtable_area_t old;       /*!< l'ancienne zone (en cours de migration) */
+  unsigned int migrate_pos;   /*!< la prochaine case à migrer */
+} hashtable_t;
+
+int hashtable_hash(value_t *key, unsigned int *hash);
+
+void hashtable_init(hashtable_t *table, unsigned int capacity);
+void hashtable_free(hashtable_t *table);
+unsigned int hashtable_count(hashtable_t *table);
+value_t *hashtable_ref(hashtable_t *table, value_t *key, unsigned int hash);
+void hashtable_set(hashtable_t *table, value_t *key, unsigned int hash,
+                   value_t *value);
+int hashtable_remove(hashtable_t *table, value_t *key, unsigned int hash);
+int hashtable_next(hashtable_t *table, unsigned int *pos, value_t *key,
+                   value_t *value);
+
+#endif
@@ -0,0 +1,354 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "heap_snapshot.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtable.h"
+#include "vm.h"
+
+/** \file heap_snapshot.c
+ * Écriture des instantanés du tas.
+ *
+ * Les objets sont numérotés dans l'ordre de la liste du GC ; une table
+ * (adressage ouvert) associe à chaque objet son numéro pour traduire les
+ * références. Sur SIGUSR1, le gestionnaire ne fait que noter la demande :
+ * l'instantané est écrit à la récupération mémoire suivante (cf.
+ * gc_collect), lorsque toutes les racines sont à jour.
+ ******/
+
+/** Table des numéros des objets. */
+typedef struct {
+  const void **objects; /*!< les objets (NULL pour une case libre) */
+  uint32_t *ids;        /*!< leurs numéros */
+  unsigned int mask;    /*!< la taille de la table moins 1 */
+} heap_ids_t;
+
+/** Le préfixe des instantanés demandés par SIGUSR1 (NULL si inactif). */
+static const char *signal_prefix = NULL;
+
+/** Le nombre d'instantanés écrits sur demande de SIGUSR1. */
+static unsigned int signal_count = 0;
+
+/** Demande d'instantané (positionnée par le gestionnaire de SIGUSR1). */
+static volatile sig_atomic_t signal_pending = 0;
+
+/** Objet géré par une cellule du GC. */
+static const void *heap_cell_object(gc_cell_t *cell) {
+  switch (cell->type) {
+    case T_PAIR:
+      return cell->content.as_pair;
+    case T_CLIST:
+      return cell->content.as_clist;
+    case T_VECTOR:
+      return cell->content.as_vector;
+    case T_I32VECTOR:
+      return cell->content.as_i32vector;
+    case T_STRING:
+      return cell->content.as_string;
+    case T_HASHTABLE:
+      return cell->content.as_hashtable;
+    default:
+      return cell->content.as_env;
+  }
+}
+
+/** Type d'une cellule dans le format des instantanés. */
+static int heap_cell_type(gc_cell_t *cell) {
+  switch (cell->type) {
+    case T_PAIR:
+      return HEAP_PAIR;
+    case T_CLIST:
+      return HEAP_CLIST;
+    case T_VECTOR:
+      return HEAP_VECTOR;
+    case T_I32VECTOR:
+      return HEAP_I32VECTOR;
+    case T_STRING:
+      return HEAP_STRING;
+    case T_HASHTABLE:
+      return HEAP_HASHTABLE;
+    default:
+      return HEAP_ENV;
+  }
+}
+
+/** Objet désigné par une valeur (ou NULL pour une valeur immédiate). */
+static const void *heap_value_object(value_t *value) {
+  if (value->type == T_PAIR) {
+    return value->data.as_pair;
+  } else if (value->type == T_CLIST) {
+    return value->data.as_clist.block;
+  } else if (value_is_vector(value)) {
+    return value->data.as_vector;
+  } else if (value_is_i32vector(value)) {
+    return value->data.as_i32vector;
+  } else if (value_is_string(value)) {
+    return value->data.as_string;
+  } else if (value->type == T_HASHTABLE) {
+    return value->data.as_hashtable;
+  } else if (value_is_closure(value)) {
+    return value->data.as_closure.env;
+  }
+  return NULL;
+}
+
+/** Case d'un objet dans la table des numéros. */
+static unsigned int heap_ids_slot(heap_ids_t *table, const void *object) {
+  unsigned int slot = (unsigned int)(((uintptr_t)object >> 4) * 2654435761u);
+  slot = slot & table->mask;
+  while (table->objects[slot] != NULL && table->objects[slot] != object) {
+    slot = (slot + 1) & table->mask;
+  }
+  return slot;
+}
+
+/** Numéro d'un objet.
+ * \return 1 si l'objet est dans le tas (son numéro est écrit dans id), 0
+ * sinon (objet immortel ou valeur immédiate).
+ */
+static int heap_ids_get(heap_ids_t *table, const void *object, uint32_t *id) {
+  unsigned int slot;
+  if (object == NULL) return 0;
+  slot = heap_ids_slot(table, object);
+  if (table->objects[slot] == NULL) return 0;
+  *id = table->ids[slot];
+  return 1;
+}
+
+/** Écriture d'un entier (u32, petit-boutiste). */
+static void heap_put_u32(FILE *file, uint32_t n) {
+  unsigned char bytes[4];
+  bytes[0] = n & 0xff;
+  bytes[1] = (n >> 8) & 0xff;
+  bytes[2] = (n >> 16) & 0xff;
+  bytes[3] = (n >> 24) & 0xff;
+  fwrite(bytes, 1, 4, file);
+}
+
+/** Tableau des références sortantes d'un objet (en cours d'écriture). */
+typedef struct {
+  uint32_t *ids;         /*!< les numéros des objets référencés */
+  unsigned int count;    /*!< le nombre de références */
+  unsigned int capacity; /*!< la taille du tableau */
+} heap_refs_t;
+
+/** Ajout d'une référence à un objet (s'il est dans le tas). */
+static void heap_refs_add(heap_refs_t *refs, heap_ids_t *table,
+                          const void *object) {
+  uint32_t id;
+  if (!heap_ids_get(table, object, &id)) return;
+  if (refs->count == refs->capacity) {
+    refs->capacity = 2 * refs->capacity;
+    refs->ids =
+        (uint32_t *)realloc(refs->ids, sizeof(uint32_t) * refs->capacity);
+    assert(refs->ids != NULL);
+  }
+  refs->ids[refs->count] = id;
+  refs->count = refs->count + 1;
+}
+
+/** Ajout de la référence contenue dans une valeur. */
+static void heap_refs_add_value(heap_refs_t *refs, heap_ids_t *table,
+                                value_t *value) {
+  heap_refs_add(refs, table, heap_value_object(value));
+}
+
+/** Ajout des références d'une zone de table de hachage. */
+static void heap_refs_add_area(heap_refs_t *refs, heap_ids_t *table,
+                               hashtable_area_t *area) {
+  unsigned int i;
+  for (i = 0; i < area->capacity; i++) {
+    if (area->hashes[i] != 0) {
+      heap_refs_add_value(refs, table, &area->keys[i]);
+      heap_refs_add_value(refs, table, &area->values[i]);
+    }
+  }
+}
+
+/** Écriture d'un objet et de ses références. */
+static void heap_write_object(FILE *file, heap_ids_t *table,
+                              heap_refs_t *refs, gc_cell_t *cell) {
+  unsigned int i;
+
+  refs->count = 0;
+  if (cell->type == T_PAIR) {
+    heap_refs_add_value(refs, table, &cell->content.as_pair->car);
+    heap_refs_add_value(refs, table, &cell->content.as_pair->cdr);
+  } else if (cell->type == T_CLIST) {
+    clist_t *block = cell->content.as_clist;
+    for (i = 0; i < block->length; i++) {
+      heap_refs_add_value(refs, table, &block->cars[i]);
+    }
+    heap_refs_add_value(refs, table, &block->tail);
+  } else if (cell->type == T_VECTOR) {
+    vector_t *vector = cell->content.as_vector;
+    for (i = 0; i < vector->size; i++) {
+      heap_refs_add_value(refs, table, &vector->content[i]);
+    }
+  } else if (cell->type == T_HASHTABLE) {
+    heap_refs_add_area(refs, table, &cell->content.as_hashtable->area);
+    heap_refs_add_area(refs, table, &cell->content.as_hashtable->old);
+  } else if (cell->type == T_ENV) {
+    env_t *env = cell->content.as_env;
+    for (i = 0; i < env->content->top; i++) {
+      heap_refs_add_value(refs, table, &env->content->content[i]);
+    }
+    heap_refs_add(refs, table, env->next);
+  }
+
+  fputc(heap_cell_type(cell), file);
+  heap_put_u32(file, (uint32_t)gc_cell_size(cell));
+  heap_put_u32(file, refs->count);
+  for (i = 0; i < refs->count; i++) {
+    heap_put_u32(file, refs->ids[i]);
+  }
+}
+
+/** Écriture d'une racine (si elle désigne un objet du tas).
+ * \param[in,out] file le fichier, ou NULL pour compter seulement.
+ * \return 1 si la racine désigne un objet du tas, 0 sinon.
+ */
+static int heap_write_root(FILE *file, heap_ids_t *table, int kind,
+                           unsigned int index, const void *object) {
+  uint32_t id;
+  if (!heap_ids_get(table, object, &id)) return 0;
+  if (file != NULL) {
+    fputc(kind, file);
+    heap_put_u32(file, index);
+    heap_put_u32(file, id);
+  }
+  return 1;
+}
+
+/** Parcours des racines de la VM (écriture, ou comptage si file vaut
+ * NULL).
+ * \return le nombre de racines.
+ */
+static uint32_t heap_write_roots(FILE *file, heap_ids_t *table, vm_t *vm) {
+  uint32_t count = 0;
+  unsigned int i, depth = 0;
+  frame_t *frame;
+
+  for (i = 0; i < vm->globs->top; i++) {
+    count += heap_write_root(file, table, HEAP_ROOT_GLOBAL, i,
+                             heap_value_object(&vm->globs->content[i]));
+  }
+  for (i = 0; i < vm->stack->top; i++) {
+    count += heap_write_root(file, table, HEAP_ROOT_STACK, i,
+                             heap_value_object(&vm->stack->content[i]));
+  }
+  for (frame = vm->frame; frame != NULL; frame = frame->caller_frame) {
+    count += heap_write_root(file, table, HEAP_ROOT_FRAME, depth, frame->env);
+    depth = depth + 1;
+  }
+  return count;
+}
+
+/** Écriture d'un instantané du tas.
+ * Les objets non accessibles qui n'ont pas encore été récupérés sont
+ * écrits aussi (l'analyseur les signale comme tels).
+ * \param[in] vm la VM (racines à jour).
+ * \param[in] filename le fichier à écrire.
+ * \return le nombre d'objets écrits.
+ */
+unsigned int heap_snapshot_write(vm_t *vm, const char *filename) {
+  heap_ids_t table;
+  heap_refs_t refs;
+  gc_cell_t *cell;
+  uint32_t nb_objects = 0, id = 0;
+  unsigned int capacity = 16;
+  FILE *file;
+
+  for (cell = vm->gc->heap.next; cell != NULL; cell = cell->next) {
+    nb_objects = nb_objects + 1;
+  }
+  while (capacity < 2 * nb_objects) {
+    capacity = 2 * capacity;
+  }
+  table.objects = (const void **)calloc(capacity, sizeof(const void *));
+  table.ids = (uint32_t *)malloc(sizeof(uint32_t) * capacity);
+  assert(table.objects != NULL && table.ids != NULL);
+  table.mask = capacity - 1;
+  for (cell = vm->gc->heap.next; cell != NULL; cell = cell->next) {
+    const void *object = heap_cell_object(cell);
+    unsigned int slot = heap_ids_slot(&table, object);
+    table.objects[slot] = object;
+    table.ids[slot] = id;
+    id = id + 1;
+  }
+
+  file = fopen(filename, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "cannot write heap snapshot: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  fwrite(HEAP_SNAPSHOT_MAGIC, 1, sizeof(HEAP_SNAPSHOT_MAGIC), file);
+  heap_put_u32(file, HEAP_SNAPSHOT_VERSION);
+  heap_put_u32(file, nb_objects);
+  heap_put_u32(file, heap_write_roots(NULL, &table, vm));
+
+  refs.capacity = 64;
+  refs.ids = (uint32_t *)malloc(sizeof(uint32_t) * refs.capacity);
+  assert(refs.ids != NULL);
+  for (cell = vm->gc->heap.next; cell != NULL; cell = cell->next) {
+    heap_write_object(file, &table, &refs, cell);
+  }
+  heap_write_roots(file, &table, vm);
+  fclose(file);
+
+  free(refs.ids);
+  free(table.objects);
+  free(table.ids);
+  return nb_objects;
+}
+
+/** Gestionnaire de SIGUSR1 : note la demande d'instantané. */
+static void heap_snapshot_handler(int sig) { signal_pending = 1; }
+
+/** Activation des instantanés sur SIGUSR1.
+ * Les fichiers sont nommés PREFIX.N.heap (N = 1, 2, ...).
+ * \param[in] prefix le préfixe des fichiers.
+ */
+void heap_snapshot_on_signal(const char *prefix) {
+  struct sigaction action;
+
+  signal_prefix = prefix;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = heap_snapshot_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGUSR1, &action, NULL) != 0) {
+    perror("sigaction");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/** Écriture de l'instantané demandé par SIGUSR1, s'il y en a un (appelé
+ * à la fin de chaque récupération mémoire).
+ * \param[in] vm la VM.
+ */
+void heap_snapshot_poll(vm_t *vm) {
+  char filename[1024];
+  unsigned int nb_objects;
+
+  if (!signal_pending) return;
+  signal_pending = 0;
+
+  signal_count = signal_count + 1;
+  snprintf(filename, sizeof(filename), "%s.%u.heap", signal_prefix,
+           signal_count);
+  nb_objects = heap_snapshot_write(vm, filename);
+  fprintf(stderr, "heap snapshot: %u objects written to %s\n", nb_objects,
+          filename);
+}
@@ -0,0 +1,60 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _HEAP_SNAPSHOT_H_
+#define _HEAP_SNAPSHOT_H_
+
+/** \file heap_snapshot.h
+ * Instantanés du tas (primitive `heap-snapshot`, signal SIGUSR1 avec
+ * l'option `--heap-snapshot=PREFIX`), analysés hors ligne par `svm-heap`.
+ *
+ * Un instantané contient tous les objets du GC avec leurs références
+ * sortantes, puis les racines qui les désignent (variables globales, cases
+ * de la pile, environnements des cadres d'appel). Les fermetures ne sont
+ * pas des objets du tas : une référence à une fermeture est une référence
+ * à son environnement. Les données immortelles (constantes du programme)
+ * n'y figurent pas.
+ *
+ * Format binaire (entiers non signés, petit-boutiste) :
+ *  - l'entête : HEAP_SNAPSHOT_MAGIC (8 octets), la version (u32), le
+ *    nombre d'objets (u32) et le nombre de racines (u32) ;
+ *  - chaque objet, numérotés à partir de 0 : son type (u8, HEAP_xxx), sa
+ *    taille en octets (u32), son nombre de références (u32) puis les
+ *    numéros des objets référencés (u32 chacun) ;
+ *  - chaque racine : sa sorte (u8, HEAP_ROOT_xxx), son indice (u32 : la
+ *    variable globale, la case de pile ou la profondeur du cadre, 0 pour
+ *    le cadre courant) et le numéro de l'objet désigné (u32).
+ */
+
+/** Signature d'un instantané. */
+#define HEAP_SNAPSHOT_MAGIC "SVMHEAP"
+
+/** Version du format. */
+#define HEAP_SNAPSHOT_VERSION 1
+
+/* Types des objets. */
+#define HEAP_PAIR 1      /*!< paire */
+#define HEAP_CLIST 2     /*!< bloc de liste compact */
+#define HEAP_VECTOR 3    /*!< vecteur */
+#define HEAP_I32VECTOR 4 /*!< vecteur d'entiers */
+#define HEAP_STRING 5    /*!< chaîne */
+#define HEAP_HASHTABLE 6 /*!< table de hachage */
+#define HEAP_ENV 7       /*!< environnement */
+
+/* Sortes de racines. */
+#define HEAP_ROOT_GLOBAL 0 /*!< variable globale */
+#define HEAP_ROOT_STACK 1  /*!< case de la pile */
+#define HEAP_ROOT_FRAME 2  /*!< environnement d'un cadre d'appel */
+
+struct _vm;
+
+unsigned int heap_snapshot_write(struct _vm *vm, const char *filename);
+
+void heap_snapshot_on_signal(const char *prefix);
+void heap_snapshot_poll(struct _vm *vm);
+
+#endif
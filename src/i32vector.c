@@ -0,0 +1,256 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "i32vector.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define I32_SIMD 1
+#include <immintrin.h>
+#else
+#define I32_SIMD 0
+#endif
+
+/** \file i32vector.c
+ * Noyaux de calcul en masse sur les vecteurs d'entiers.
+ *
+ * Les versions SIMD sont compilées avec l'attribut `target` de GCC : le
+ * reste de la VM n'a pas besoin d'être compilé pour AVX2, et le choix se
+ * fait à l'exécution (__builtin_cpu_supports). Les calculs se font en
+ * arithmétique non-signée pour que les débordements soient définis.
+ ******/
+
+/** Allocation d'un tampon aligné de size entiers.
+ * \return le tampon (à libérer avec free).
+ */
+int *i32vector_alloc_data(unsigned int size) {
+  // la taille doit être un multiple de l'alignement (et non nulle)
+  size_t bytes = ((size_t)size * sizeof(int) + I32VECTOR_ALIGN) &
+                 ~(size_t)(I32VECTOR_ALIGN - 1);
+  int *data = (int *)aligned_alloc(I32VECTOR_ALIGN, bytes);
+  assert(data != NULL);
+  return data;
+}
+
+/*
+ * Versions scalaires
+ */
+
+static int scalar_sum(const int *a, unsigned int n) {
+  unsigned int i, r = 0;
+  for (i = 0; i < n; i++) r += (unsigned int)a[i];
+  return (int)r;
+}
+
+static int scalar_dot(const int *a, const int *b, unsigned int n) {
+  unsigned int i, r = 0;
+  for (i = 0; i < n; i++) r += (unsigned int)a[i] * (unsigned int)b[i];
+  return (int)r;
+}
+
+static void scalar_add(int *a, const int *b, unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < n; i++) a[i] = (int)((unsigned int)a[i] + (unsigned int)b[i]);
+}
+
+static void scalar_scale(int *a, int k, unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < n; i++) a[i] = (int)((unsigned int)a[i] * (unsigned int)k);
+}
+
+static int scalar_min(const int *a, unsigned int n) {
+  unsigned int i;
+  int r = a[0];
+  for (i = 1; i < n; i++) {
+    if (a[i] < r) r = a[i];
+  }
+  return r;
+}
+
+static const i32_kernels_t scalar_kernels = {
+    "scalar", scalar_sum, scalar_dot, scalar_add, scalar_scale, scalar_min};
+
+#if I32_SIMD
+
+/*
+ * Versions SSE4.1 (4 entiers par opération)
+ */
+
+#define SSE __attribute__((target("sse4.1")))
+
+/** Somme horizontale des 4 entiers d'un registre SSE. */
+SSE static int sse_hsum(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+/** Minimum horizontal des 4 entiers d'un registre SSE. */
+SSE static int sse_hmin(__m128i v) {
+  v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+SSE static int sse_sum(const int *a, unsigned int n) {
+  unsigned int i = 0;
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm_add_epi32(acc, _mm_load_si128((const __m128i *)(a + i)));
+  }
+  return (int)((unsigned int)sse_hsum(acc) +
+               (unsigned int)scalar_sum(a + i, n - i));
+}
+
+SSE static int sse_dot(const int *a, const int *b, unsigned int n) {
+  unsigned int i = 0;
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_load_si128((const __m128i *)(a + i));
+    __m128i y = _mm_load_si128((const __m128i *)(b + i));
+    acc = _mm_add_epi32(acc, _mm_mullo_epi32(x, y));
+  }
+  return (int)((unsigned int)sse_hsum(acc) +
+               (unsigned int)scalar_dot(a + i, b + i, n - i));
+}
+
+SSE static void sse_add(int *a, const int *b, unsigned int n) {
+  unsigned int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_load_si128((const __m128i *)(a + i));
+    __m128i y = _mm_load_si128((const __m128i *)(b + i));
+    _mm_store_si128((__m128i *)(a + i), _mm_add_epi32(x, y));
+  }
+  scalar_add(a + i, b + i, n - i);
+}
+
+SSE static void sse_scale(int *a, int k, unsigned int n) {
+  unsigned int i = 0;
+  __m128i vk = _mm_set1_epi32(k);
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_load_si128((const __m128i *)(a + i));
+    _mm_store_si128((__m128i *)(a + i), _mm_mullo_epi32(x, vk));
+  }
+  scalar_scale(a + i, k, n - i);
+}
+
+SSE static int sse_min(const int *a, unsigned int n) {
+  unsigned int i = 0;
+  int r;
+  __m128i acc = _mm_set1_epi32(a[0]);
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm_min_epi32(acc, _mm_load_si128((const __m128i *)(a + i)));
+  }
+  r = sse_hmin(acc);
+  for (; i < n; i++) {
+    if (a[i] < r) r = a[i];
+  }
+  return r;
+}
+
+static const i32_kernels_t sse_kernels = {"sse4.1", sse_sum, sse_dot,
+                                          sse_add,  sse_scale, sse_min};
+
+/*
+ * Versions AVX2 (8 entiers par opération)
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+/** Réduction d'un registre AVX2 vers un registre SSE (addition). */
+AVX2 static __m128i avx2_fold_add(__m256i v) {
+  return _mm_add_epi32(_mm256_castsi256_si128(v),
+                       _mm256_extracti128_si256(v, 1));
+}
+
+AVX2 static int avx2_sum(const int *a, unsigned int n) {
+  unsigned int i = 0;
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_add_epi32(acc, _mm256_load_si256((const __m256i *)(a + i)));
+  }
+  return (int)((unsigned int)sse_hsum(avx2_fold_add(acc)) +
+               (unsigned int)scalar_sum(a + i, n - i));
+}
+
+AVX2 static int avx2_dot(const int *a, const int *b, unsigned int n) {
+  unsigned int i = 0;
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_load_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_load_si256((const __m256i *)(b + i));
+    acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+  }
+  return (int)((unsigned int)sse_hsum(avx2_fold_add(acc)) +
+               (unsigned int)scalar_dot(a + i, b + i, n - i));
+}
+
+AVX2 static void avx2_add(int *a, const int *b, unsigned int n) {
+  unsigned int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_load_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_load_si256((const __m256i *)(b + i));
+    _mm256_store_si256((__m256i *)(a + i), _mm256_add_epi32(x, y));
+  }
+  scalar_add(a + i, b + i, n - i);
+}
+
+AVX2 static void avx2_scale(int *a, int k, unsigned int n) {
+  unsigned int i = 0;
+  __m256i vk = _mm256_set1_epi32(k);
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_load_si256((const __m256i *)(a + i));
+    _mm256_store_si256((__m256i *)(a + i), _mm256_mullo_epi32(x, vk));
+  }
+  scalar_scale(a + i, k, n - i);
+}
+
+AVX2 static int avx2_min(const int *a, unsigned int n) {
+  unsigned int i = 0;
+  int r;
+  __m256i acc = _mm256_set1_epi32(a[0]);
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_min_epi32(acc, _mm256_load_si256((const __m256i *)(a + i)));
+  }
+  r = sse_hmin(_mm_min_epi32(_mm256_castsi256_si128(acc),
+                             _mm256_extracti128_si256(acc, 1)));
+  for (; i < n; i++) {
+    if (a[i] < r) r = a[i];
+  }
+  return r;
+}
+
+static const i32_kernels_t avx2_kernels = {"avx2",   avx2_sum,   avx2_dot,
+                                           avx2_add, avx2_scale, avx2_min};
+
+#endif
+
+/** Choix des noyaux de calcul selon le processeur.
+ * La variable d'environnement SVM_NO_SIMD force la version scalaire.
+ * \return la table des noyaux à utiliser.
+ */
+const i32_kernels_t *i32vector_kernels(void) {
+  static const i32_kernels_t *kernels = NULL;
+
+  if (kernels == NULL) {
+    kernels = &scalar_kernels;
+#if I32_SIMD
+    if (getenv("SVM_NO_SIMD") == NULL) {
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) {
+        kernels = &avx2_kernels;
+      } else if (__builtin_cpu_supports("sse4.1")) {
+        kernels = &sse_kernels;
+      }
+    }
+#endif
+  }
+
+  return kernels;
+}
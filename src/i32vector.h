@@ -0,0 +1,43 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _I32VECTOR_H_
+#define _I32VECTOR_H_
+
+/** \file i32vector.h
+ * Noyaux de calcul en masse sur les vecteurs d'entiers (i32vector).
+ *
+ * Chaque opération existe en version scalaire, SSE4.1 et AVX2. La version
+ * utilisée est choisie une fois pour toutes à l'exécution selon les
+ * capacités du processeur (cf. i32vector_kernels).
+ *
+ * L'arithmétique est celle des entiers de la VM : les débordements
+ * "bouclent" (modulo 2^32).
+ */
+
+/** L'alignement (en octets) des tampons d'éléments. */
+#define I32VECTOR_ALIGN 32
+
+/** Table des noyaux de calcul. */
+typedef struct {
+  const char *name; /*!< le jeu d'instructions utilisé */
+  /** somme des éléments */
+  int (*sum)(const int *a, unsigned int n);
+  /** produit scalaire */
+  int (*dot)(const int *a, const int *b, unsigned int n);
+  /** a[i] <- a[i] + b[i] */
+  void (*add)(int *a, const int *b, unsigned int n);
+  /** a[i] <- a[i] * k */
+  void (*scale)(int *a, int k, unsigned int n);
+  /** minimum des éléments (n > 0) */
+  int (*min)(const int *a, unsigned int n);
+} i32_kernels_t;
+
+int *i32vector_alloc_data(unsigned int size);
+const i32_kernels_t *i32vector_kernels(void);
+
+#endif
@@ -0,0 +1,825 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "loader.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "prim.h"
+
+/** \file loader.c
+ * Implémentation des passes d'optimisation au chargement.
+ *
+ * L'analyse commune à toutes les passes décode le programme instruction
+ * par instruction puis calcule :
+ *  - les cibles de sauts et les points d'entrée des fonctions (PUSH FUN);
+ *  - le code atteignable depuis le top-niveau (pc 0), en suivant les
+ *    sauts mais sans entrer dans les corps de fonctions;
+ *  - le code atteignable depuis les points d'entrée des fonctions;
+ *  - la profondeur de l'environnement local au top-niveau (ALLOC/DELETE).
+ *
+ * Les passes qui changent la taille du code (inlining, pliage des appels
+ * de primitives) reconstruisent un nouveau segment de bytecode et relogent
+ * les adresses (sauts, PUSH FUN et fermetures de la table des constantes).
+ ******/
+
+#define F_INSTR 1     /*!< début d'une instruction */
+#define F_TARGET 2    /*!< cible de saut ou point d'entrée de fonction */
+#define F_TOPLEVEL 4  /*!< atteignable depuis le top-niveau */
+#define F_FUNCTION 8  /*!< atteignable depuis un corps de fonction */
+#define F_VISITED 16  /*!< marque temporaire des parcours */
+
+/** Taille maximale (en entiers) d'un corps de fonction "inlinable". */
+#define INLINE_MAX_BODY 32
+
+/** Taille maximale du programme après inlining (facteur de croissance). */
+#define INLINE_MAX_GROWTH 2
+
+/** Le résultat de l'analyse d'un programme. */
+typedef struct {
+  program_t *program;   /*!< le programme analysé */
+  unsigned char *flags; /*!< les informations (F_xxx) pour chaque pc */
+  int *prev;            /*!< le pc de l'instruction précédente (ou -1) */
+  int *env_depth; /*!< profondeur d'environnement au top-niveau (ou -1) */
+  int env_depth_ok; /*!< 1 si les profondeurs sont cohérentes, 0 sinon */
+  int *worklist;    /*!< pile de travail pour les parcours */
+} loader_t;
+
+/** Parcours du flot de contrôle.
+ * \param[in,out] ld l'analyse en cours.
+ * \param from le pc de départ.
+ * \param avoid un pc à ne pas traverser (ou -1).
+ * \param flag la marque à poser sur les instructions atteintes.
+ */
+static void loader_reach(loader_t *ld, int from, int avoid, int flag) {
+  int top = 0;
+  int succ[2];
+
+  if (from == avoid || (ld->flags[from] & flag)) return;
+  ld->flags[from] |= flag;
+  ld->worklist[top++] = from;
+
+  while (top > 0) {
+    int pc = ld->worklist[--top];
+    int nb = bytecode_successors(ld->program, pc, succ);
+    int i;
+    for (i = 0; i < nb; i++) {
+      if (succ[i] != avoid && !(ld->flags[succ[i]] & flag)) {
+        ld->flags[succ[i]] |= flag;
+        ld->worklist[top++] = succ[i];
+      }
+    }
+  }
+}
+
+/** Calcul de la profondeur d'environnement au top-niveau.
+ * Chaque ALLOC non vide ajoute un environnement en tête de chaîne et
+ * chaque DELETE en retire un.
+ */
+static void loader_env_depth(loader_t *ld) {
+  program_t *program = ld->program;
+  int top = 0;
+  int succ[2];
+
+  ld->env_depth_ok = 1;
+  ld->env_depth[0] = 0;
+  ld->worklist[top++] = 0;
+
+  while (top > 0) {
+    int pc = ld->worklist[--top];
+    int depth = ld->env_depth[pc];
+    int nb, i;
+
+    if (program->bytecode[pc] == I_ALLOC && program->bytecode[pc + 1] > 0) {
+      depth = depth + 1;
+    } else if (program->bytecode[pc] == I_DELETE) {
+      depth = depth - 1;
+    }
+
+    nb = bytecode_successors(program, pc, succ);
+    for (i = 0; i < nb; i++) {
+      if (ld->env_depth[succ[i]] == -1) {
+        ld->env_depth[succ[i]] = depth;
+        ld->worklist[top++] = succ[i];
+      } else if (ld->env_depth[succ[i]] != depth) {
+        ld->env_depth_ok = 0;
+      }
+    }
+  }
+}
+
+/** Analyse d'un programme (cf. l'en-tête du fichier).
+ * \param[in] program le programme à analyser.
+ * \return l'analyse allouée.
+ */
+static loader_t *loader_analyze(program_t *program) {
+  loader_t *ld = (loader_t *)malloc(sizeof(loader_t));
+  unsigned int pc;
+  int prev = -1;
+
+  assert(ld != NULL);
+  ld->program = program;
+  ld->flags = (unsigned char *)calloc(program->size, sizeof(unsigned char));
+  ld->prev = (int *)malloc(sizeof(int) * program->size);
+  ld->env_depth = (int *)malloc(sizeof(int) * program->size);
+  ld->worklist = (int *)malloc(sizeof(int) * program->size);
+  assert(ld->flags != NULL && ld->prev != NULL && ld->env_depth != NULL &&
+         ld->worklist != NULL);
+
+  // décodage linéaire : débuts d'instructions, cibles de sauts
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    int op = program->bytecode[pc];
+    ld->flags[pc] |= F_INSTR;
+    ld->prev[pc] = prev;
+    ld->env_depth[pc] = -1;
+    prev = pc;
+    if ((op == I_JUMP || op == I_JFALSE) &&
+        program->bytecode[pc + 1] < program->size) {
+      ld->flags[program->bytecode[pc + 1]] |= F_TARGET;
+    } else if (op == I_PUSH && program->bytecode[pc + 1] == T_FUN) {
+      ld->flags[program->bytecode[pc + 2]] |= F_TARGET;
+    }
+  }
+
+  // code atteignable depuis le top-niveau puis depuis les fonctions
+  loader_reach(ld, 0, -1, F_TOPLEVEL);
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    if (program->bytecode[pc] == I_PUSH &&
+        program->bytecode[pc + 1] == T_FUN) {
+      loader_reach(ld, program->bytecode[pc + 2], -1, F_FUNCTION);
+    }
+  }
+
+  loader_env_depth(ld);
+
+  return ld;
+}
+
+/** Libération d'une analyse. */
+static void loader_free(loader_t *ld) {
+  free(ld->flags);
+  free(ld->prev);
+  free(ld->env_depth);
+  free(ld->worklist);
+  free(ld);
+}
+
+/** Effacer une marque sur tout le programme. */
+static void loader_clear(loader_t *ld, int flag) {
+  unsigned int pc;
+  for (pc = 0; pc < ld->program->size; pc++) {
+    ld->flags[pc] &= ~flag;
+  }
+}
+
+/** Calcul de la valeur (constante) empilée par une instruction.
+ * \param[in] ld l'analyse du programme.
+ * \param pc le pc de l'instruction.
+ * \param[out] value la valeur empilée.
+ * \return 1 si la valeur est connue au chargement, 0 sinon.
+ */
+static int loader_const_value(loader_t *ld, int pc, value_t *value) {
+  program_t *program = ld->program;
+
+  if (program->bytecode[pc] == I_CONST) {
+    *value = program->consts[program->bytecode[pc + 1]];
+    return 1;
+  }
+  if (program->bytecode[pc] != I_PUSH) return 0;
+
+  switch (program->bytecode[pc + 1]) {
+    case T_INT:
+      value_fill_int(value, program->bytecode[pc + 2]);
+      return 1;
+    case T_BOOL:
+      value_fill_bool(value, program->bytecode[pc + 2]);
+      return 1;
+    case T_UNIT:
+      value_fill_unit(value);
+      return 1;
+    case T_PRIM:
+      value_fill_prim(value, program->bytecode[pc + 2]);
+      return 1;
+    case T_STRING:
+      *value = program->strings[program->bytecode[pc + 2]];
+      return 1;
+    case T_SYMBOL:
+      *value = program->symbols[program->bytecode[pc + 2]];
+      return 1;
+    case T_CONST:
+      *value = program->consts[program->bytecode[pc + 2]];
+      return 1;
+    case T_FUN: {
+      // la fermeture capture l'environnement courant : il n'est connu
+      // que s'il est vide (aucun ALLOC en cours au top-niveau).
+      closure_t closure;
+      if (!ld->env_depth_ok || ld->env_depth[pc] != 0) return 0;
+      closure.pc = program->bytecode[pc + 2];
+      closure.env = NULL;
+      value_fill_closure(value, closure);
+      return 1;
+    }
+    default:
+      return 0;
+  }
+}
+
+/** Spécialisation des variables globales écrites une seule fois.
+ *
+ * Une variable globale est spécialisée si :
+ *  - elle n'est écrite que par un seul GSTORE, situé au top-niveau;
+ *  - la valeur écrite est une constante empilée par l'instruction
+ *    précédente (qui n'est pas une cible de saut).
+ *
+ * Une lecture (GFETCH) au top-niveau est alors remplacée par CONST si
+ * elle ne peut être atteinte sans passer par l'écriture. Une lecture
+ * dans un corps de fonction est remplacée si aucun appel (CALL) ne peut
+ * avoir lieu au top-niveau avant l'écriture.
+ *
+ * \param[in,out] ld l'analyse du programme.
+ * \return le nombre de lectures réécrites.
+ */
+static int loader_specialize_globals(loader_t *ld) {
+  program_t *program = ld->program;
+  int nb_globs = 0;
+  int *nb_stores;
+  int *store_pc;
+  unsigned int pc;
+  int g, changed, count = 0;
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    int op = program->bytecode[pc];
+    if ((op == I_GSTORE || op == I_GFETCH) &&
+        program->bytecode[pc + 1] >= nb_globs) {
+      nb_globs = program->bytecode[pc + 1] + 1;
+    }
+  }
+
+  nb_stores = (int *)calloc(nb_globs + 1, sizeof(int));
+  store_pc = (int *)malloc(sizeof(int) * (nb_globs + 1));
+  assert(nb_stores != NULL && store_pc != NULL);
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    if (program->bytecode[pc] == I_GSTORE) {
+      g = program->bytecode[pc + 1];
+      nb_stores[g] = nb_stores[g] + 1;
+      store_pc[g] = pc;
+    }
+  }
+
+  // une spécialisation peut en permettre d'autres, par exemple
+  // (define a 1) (define b a), d'où l'itération jusqu'au point fixe.
+  do {
+    changed = 0;
+    for (g = 0; g < nb_globs; g++) {
+      int s = store_pc[g];
+      int call_before = 0;
+      int k = -1;
+      value_t value;
+
+      if (nb_stores[g] != 1) continue;
+      if (!(ld->flags[s] & F_TOPLEVEL) || (ld->flags[s] & F_FUNCTION) ||
+          (ld->flags[s] & F_TARGET) || ld->prev[s] < 0) {
+        continue;
+      }
+      if (!loader_const_value(ld, ld->prev[s], &value)) continue;
+      nb_stores[g] = -1;  // variable traitée
+
+      // le code du top-niveau exécutable avant l'écriture
+      loader_clear(ld, F_VISITED);
+      loader_reach(ld, 0, s, F_VISITED);
+      for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+        if ((ld->flags[pc] & F_VISITED) && program->bytecode[pc] == I_CALL) {
+          call_before = 1;
+        }
+      }
+
+      for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+        if (program->bytecode[pc] != I_GFETCH ||
+            program->bytecode[pc + 1] != g) {
+          continue;
+        }
+        if (!(ld->flags[pc] & (F_TOPLEVEL | F_FUNCTION))) continue;
+        if ((ld->flags[pc] & F_TOPLEVEL) && (ld->flags[pc] & F_VISITED)) {
+          continue;
+        }
+        if ((ld->flags[pc] & F_FUNCTION) && call_before) continue;
+
+        if (k < 0) {
+          k = bytecode_add_const(program, &value);
+        }
+        program->bytecode[pc] = I_CONST;
+        program->bytecode[pc + 1] = k;
+        count = count + 1;
+        changed = 1;
+      }
+    }
+  } while (changed);
+
+  free(nb_stores);
+  free(store_pc);
+  return count;
+}
+
+/** Segment de code en cours de construction. */
+typedef struct {
+  int *code;             /*!< le contenu */
+  unsigned int size;     /*!< la taille utilisée */
+  unsigned int capacity; /*!< la taille allouée */
+} code_buf_t;
+
+/** Ajout d'un entier en fin de segment.
+ * \return la position de l'entier ajouté.
+ */
+static int code_emit(code_buf_t *buf, int word) {
+  if (buf->size == buf->capacity) {
+    buf->capacity = (buf->capacity == 0) ? 64 : buf->capacity * 2;
+    buf->code = (int *)realloc(buf->code, sizeof(int) * buf->capacity);
+    assert(buf->code != NULL);
+  }
+  buf->code[buf->size] = word;
+  buf->size = buf->size + 1;
+  return buf->size - 1;
+}
+
+/** Remplacement du code d'un programme par un segment reconstruit.
+ * \param[in,out] program le programme.
+ * \param[in] buf le nouveau segment (le programme en devient propriétaire).
+ * \param[in] new_pc le nouveau pc de chaque ancienne instruction.
+ * \param[in] fixups les positions des adresses à reloger dans le segment.
+ * \param nb_fixups le nombre d'adresses à reloger.
+ */
+static void loader_relocate(program_t *program, code_buf_t *buf, int *new_pc,
+                            int *fixups, int nb_fixups) {
+  int i;
+  unsigned int k;
+
+  for (i = 0; i < nb_fixups; i++) {
+    buf->code[fixups[i]] = new_pc[buf->code[fixups[i]]];
+  }
+  for (k = 0; k < program->nb_consts; k++) {
+    if (value_is_closure(&program->consts[k])) {
+      program->consts[k].data.as_closure.pc =
+          new_pc[program->consts[k].data.as_closure.pc];
+    }
+  }
+  free(program->bytecode);
+  program->bytecode = buf->code;
+  program->size = buf->size;
+}
+
+/** Recherche d'une fonction appelée de façon statique.
+ * Le site d'appel est une instruction qui empile une fermeture connue
+ * (CONST d'une fermeture ou PUSH FUN), immédiatement suivie de CALL.
+ * \param[in] ld l'analyse du programme.
+ * \param pc le pc de l'instruction qui empile la fermeture.
+ * \param[out] entry le pc du corps de la fonction.
+ * \param[out] local 1 si la fermeture capture l'environnement courant
+ * (PUSH FUN), 0 si son environnement est vide (CONST).
+ * \return 1 s'il s'agit d'un site d'appel statique, 0 sinon.
+ */
+static int loader_call_site(loader_t *ld, unsigned int pc, int *entry,
+                            int *local) {
+  program_t *program = ld->program;
+  unsigned int call = pc + bytecode_instr_size(program, pc);
+
+  if (!(ld->flags[pc] & (F_TOPLEVEL | F_FUNCTION))) return 0;
+  if (call >= program->size || program->bytecode[call] != I_CALL ||
+      (ld->flags[call] & F_TARGET)) {
+    return 0;
+  }
+
+  if (program->bytecode[pc] == I_CONST) {
+    value_t *value = &program->consts[program->bytecode[pc + 1]];
+    if (!value_is_closure(value) || value->data.as_closure.env != NULL) {
+      return 0;
+    }
+    *entry = value->data.as_closure.pc;
+    *local = 0;
+    return 1;
+  }
+  if (program->bytecode[pc] == I_PUSH && program->bytecode[pc + 1] == T_FUN) {
+    *entry = program->bytecode[pc + 2];
+    *local = 1;
+    return 1;
+  }
+  return 0;
+}
+
+/** Vérification qu'un corps de fonction peut être "inliné".
+ *
+ * Le corps doit être contigu, petit (INLINE_MAX_BODY), non récursif, sans
+ * création de fermeture, sans ALLOC/DELETE/GALLOC ni POP, et la hauteur de
+ * pile doit y être connue en tout point, avec exactement le résultat sur
+ * la pile à chaque RETURN. Si la fermeture a un environnement vide, le
+ * corps ne doit accéder qu'à ses arguments.
+ *
+ * \param[in,out] ld l'analyse du programme (marque F_VISITED sur le corps).
+ * \param entry le pc du corps de la fonction.
+ * \param nb_args le nombre d'arguments au site d'appel.
+ * \param local la fermeture capture l'environnement courant (1) ou non (0).
+ * \param[out] depth la hauteur de pile (relative) avant chaque instruction.
+ * \param[out] end le pc qui suit la dernière instruction du corps.
+ * \return 1 si le corps est "inlinable", 0 sinon.
+ */
+static int loader_inlinable(loader_t *ld, int entry, int nb_args, int local,
+                            int *depth, int *end) {
+  program_t *program = ld->program;
+  int pc, top = 0, last = entry;
+  int succ[2];
+
+  if (entry >= program->size || !(ld->flags[entry] & F_INSTR)) return 0;
+
+  loader_clear(ld, F_VISITED);
+  loader_reach(ld, entry, -1, F_VISITED);
+
+  // le corps est contigu et de petite taille
+  for (pc = entry; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    if (ld->flags[pc] & F_VISITED) last = pc;
+  }
+  *end = last + bytecode_instr_size(program, last);
+  if (*end - entry > INLINE_MAX_BODY) return 0;
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    int in_body = (pc >= entry && pc < *end);
+    if (in_body != ((ld->flags[pc] & F_VISITED) != 0)) return 0;
+    if (in_body) depth[pc] = -1;
+  }
+
+  // instructions autorisées et hauteurs de pile
+  depth[entry] = 0;
+  ld->worklist[top++] = entry;
+  while (top > 0) {
+    int d, nb, i;
+    pc = ld->worklist[--top];
+    d = depth[pc];
+
+    switch (program->bytecode[pc]) {
+      case I_PUSH:
+        if (program->bytecode[pc + 1] == T_FUN) return 0;
+        d = d + 1;
+        break;
+      case I_CONST: {
+        value_t *value = &program->consts[program->bytecode[pc + 1]];
+        if (value_is_closure(value) && value->data.as_closure.pc == entry) {
+          return 0;  // appel récursif
+        }
+        d = d + 1;
+      } break;
+      case I_GFETCH:
+        d = d + 1;
+        break;
+      case I_FETCH:
+        if (!local && program->bytecode[pc + 1] >= nb_args) return 0;
+        d = d + 1;
+        break;
+      case I_STORE:
+        if (!local && program->bytecode[pc + 1] >= nb_args) return 0;
+        // fall through
+      case I_GSTORE:
+      case I_JFALSE:
+      case I_ERROR:
+        if (d < 1) return 0;
+        d = d - 1;
+        break;
+      case I_CALL:
+        if (d < program->bytecode[pc + 1] + 1) return 0;
+        d = d - program->bytecode[pc + 1];
+        break;
+      case I_RETURN:
+        if (d != 1) return 0;
+        break;
+      case I_JUMP:
+        break;
+      default:
+        return 0;
+    }
+
+    nb = bytecode_successors(program, pc, succ);
+    for (i = 0; i < nb; i++) {
+      if (depth[succ[i]] == -1) {
+        depth[succ[i]] = d;
+        ld->worklist[top++] = succ[i];
+      } else if (depth[succ[i]] != d) {
+        return 0;
+      }
+    }
+  }
+
+  // toutes les sorties du corps sont des RETURN (ou ERROR)
+  for (pc = entry; pc < *end; pc += bytecode_instr_size(program, pc)) {
+    int op = program->bytecode[pc];
+    int next = pc + bytecode_instr_size(program, pc);
+    if (next == *end && op != I_RETURN && op != I_JUMP && op != I_ERROR) {
+      return 0;
+    }
+    if ((op == I_JUMP || op == I_JFALSE) &&
+        (program->bytecode[pc + 1] < entry ||
+         program->bytecode[pc + 1] >= *end)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/** Recopie d'un corps de fonction au site d'appel.
+ *
+ * Les arguments restent sur la pile de l'appelant (au lieu d'être
+ * recopiés dans un nouvel environnement) : les accès FETCH/STORE aux
+ * arguments deviennent des accès SFETCH/SSTORE relatifs au sommet de
+ * pile, les autres sont décalés dans l'environnement de l'appelant, et
+ * chaque RETURN devient SLIDE (suivi d'un saut en fin de corps).
+ *
+ * \param[in] ld l'analyse du programme.
+ * \param[in,out] buf le segment en construction.
+ * \param entry le pc du corps de la fonction.
+ * \param end le pc qui suit le corps.
+ * \param nb_args le nombre d'arguments.
+ * \param[in] depth la hauteur de pile avant chaque instruction du corps.
+ * \param[in,out] body_pc table de travail (nouveau pc de chaque instruction).
+ */
+static void loader_inline_body(loader_t *ld, code_buf_t *buf, int entry,
+                               int end, int nb_args, int *depth,
+                               int *body_pc) {
+  program_t *program = ld->program;
+  int *fixups = (int *)malloc(sizeof(int) * (end - entry) * 2);
+  int nb_fixups = 0;
+  int nb_exits = 0;
+  int pc, i;
+
+  assert(fixups != NULL);
+
+  for (pc = entry; pc < end; pc += bytecode_instr_size(program, pc)) {
+    int op = program->bytecode[pc];
+    int arg = program->bytecode[pc + 1];
+    int next = pc + bytecode_instr_size(program, pc);
+    body_pc[pc - entry] = buf->size;
+
+    switch (op) {
+      case I_FETCH:
+        if (arg < nb_args) {
+          code_emit(buf, I_SFETCH);
+          code_emit(buf, depth[pc] + arg);
+        } else {
+          code_emit(buf, I_FETCH);
+          code_emit(buf, arg - nb_args);
+        }
+        break;
+      case I_STORE:
+        if (arg < nb_args) {
+          code_emit(buf, I_SSTORE);
+          code_emit(buf, depth[pc] - 1 + arg);
+        } else {
+          code_emit(buf, I_STORE);
+          code_emit(buf, arg - nb_args);
+        }
+        break;
+      case I_RETURN:
+        if (nb_args > 0) {
+          code_emit(buf, I_SLIDE);
+          code_emit(buf, nb_args);
+        }
+        if (next < end) {
+          code_emit(buf, I_JUMP);
+          // saut vers la fin du corps (cible notée -1)
+          fixups[nb_fixups++] = code_emit(buf, -1);
+          nb_exits = nb_exits + 1;
+        }
+        break;
+      case I_JUMP:
+      case I_JFALSE:
+        code_emit(buf, op);
+        fixups[nb_fixups++] = code_emit(buf, arg);
+        break;
+      default:
+        for (i = pc; i < next; i++) {
+          code_emit(buf, program->bytecode[i]);
+        }
+    }
+  }
+
+  // relogement des sauts internes au corps
+  for (i = 0; i < nb_fixups; i++) {
+    int target = buf->code[fixups[i]];
+    buf->code[fixups[i]] =
+        (target == -1) ? (int)buf->size : body_pc[target - entry];
+  }
+
+  free(fixups);
+}
+
+/** Inlining des petites fonctions non récursives connues statiquement.
+ * \param[in,out] ld l'analyse du programme (le programme est réécrit).
+ * \return le nombre de sites d'appel "inlinés".
+ */
+static int loader_inline(loader_t *ld) {
+  program_t *program = ld->program;
+  code_buf_t buf = {NULL, 0, 0};
+  int *new_pc = (int *)malloc(sizeof(int) * (program->size + 1));
+  int *depth = (int *)malloc(sizeof(int) * program->size);
+  int *body_pc = (int *)malloc(sizeof(int) * INLINE_MAX_BODY);
+  int *fixups = (int *)malloc(sizeof(int) * program->size);
+  int nb_fixups = 0;
+  int count = 0;
+  unsigned int pc, i;
+
+  assert(new_pc != NULL && depth != NULL && body_pc != NULL &&
+         fixups != NULL);
+
+  pc = 0;
+  while (pc < program->size) {
+    int op = program->bytecode[pc];
+    int size = bytecode_instr_size(program, pc);
+    int entry, local, end;
+
+    new_pc[pc] = buf.size;
+
+    if (loader_call_site(ld, pc, &entry, &local) &&
+        buf.size + INLINE_MAX_BODY < program->size * INLINE_MAX_GROWTH) {
+      int call = pc + size;
+      int nb_args = program->bytecode[call + 1];
+      if (loader_inlinable(ld, entry, nb_args, local, depth, &end)) {
+        new_pc[call] = buf.size;
+        loader_inline_body(ld, &buf, entry, end, nb_args, depth, body_pc);
+        count = count + 1;
+        pc = call + bytecode_instr_size(program, call);
+        continue;
+      }
+    }
+
+    // recopie de l'instruction, en notant les adresses à reloger
+    for (i = pc; i < pc + size; i++) {
+      code_emit(&buf, program->bytecode[i]);
+    }
+    if (op == I_JUMP || op == I_JFALSE) {
+      fixups[nb_fixups++] = buf.size - 1;
+    } else if (op == I_PUSH && program->bytecode[pc + 1] == T_FUN) {
+      fixups[nb_fixups++] = buf.size - 1;
+    }
+    pc = pc + size;
+  }
+  new_pc[program->size] = buf.size;
+
+  if (count > 0) {
+    loader_relocate(program, &buf, new_pc, fixups, nb_fixups);
+  } else {
+    free(buf.code);
+  }
+
+  free(new_pc);
+  free(depth);
+  free(body_pc);
+  free(fixups);
+  return count;
+}
+
+/** Instruction déjà émise par le pliage des constantes. */
+typedef struct {
+  int pos;       /*!< la position de l'instruction dans le segment */
+  int is_const;  /*!< 1 si elle empile une constante, 0 sinon */
+  value_t value; /*!< la constante empilée */
+} folded_t;
+
+/** Pliage des appels de primitives sur des arguments constants.
+ *
+ * Un appel (CALL n) est calculé au chargement si les n + 1 instructions
+ * qui le précèdent empilent des constantes (les arguments puis la
+ * primitive), si la primitive est "pliable" (PRIM_FOLDABLE, cf. prim.h)
+ * et si son point d'entrée rapide à n arguments donne un résultat. Seule
+ * la première de ces instructions peut être une cible de saut. La suite
+ * est remplacée par CONST, ce qui permet de plier les appels imbriqués
+ * comme (+ (* 2 3) 1).
+ *
+ * \param[in,out] ld l'analyse du programme (le programme est réécrit).
+ * \return le nombre d'appels pliés.
+ */
+static int loader_fold_prims(loader_t *ld) {
+  program_t *program = ld->program;
+  code_buf_t buf = {NULL, 0, 0};
+  int *new_pc = (int *)malloc(sizeof(int) * (program->size + 1));
+  int *fixups = (int *)malloc(sizeof(int) * program->size);
+  folded_t *emitted = (folded_t *)malloc(sizeof(folded_t) * program->size);
+  int nb_fixups = 0, nb_emitted = 0;
+  int run = 0;  // instructions émises en ligne droite (la première
+                // pouvant être une cible de saut)
+  int count = 0;
+  unsigned int pc, i;
+
+  assert(new_pc != NULL && fixups != NULL && emitted != NULL);
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    int op = program->bytecode[pc];
+    int size = bytecode_instr_size(program, pc);
+    folded_t *e;
+
+    new_pc[pc] = buf.size;
+
+    if (op == I_CALL && !(ld->flags[pc] & F_TARGET) &&
+        run >= program->bytecode[pc + 1] + 1) {
+      int n = program->bytecode[pc + 1];
+      folded_t *fun = &emitted[nb_emitted - 1];
+      const prim_desc_t *desc = NULL;
+      value_t res;
+      int done = 0, k;
+
+      for (k = 0; k <= n; k++) {
+        if (!emitted[nb_emitted - 1 - k].is_const) break;
+      }
+      if (k > n && value_is_prim(&fun->value)) {
+        desc = prim_get(value_prim_get(&fun->value));
+      }
+      if (desc != NULL && (desc->flags & PRIM_FOLDABLE)) {
+        // le premier argument est empilé juste avant la primitive
+        if (n == 1 && desc->prim1 != NULL) {
+          done = desc->prim1(NULL, &fun[-1].value, &res);
+        } else if (n == 2 && desc->prim2 != NULL) {
+          done = desc->prim2(NULL, &fun[-1].value, &fun[-2].value, &res);
+        }
+      }
+
+      if (done) {
+        // on retire les instructions pliées (et leurs adresses à reloger)
+        nb_emitted = nb_emitted - (n + 1);
+        buf.size = emitted[nb_emitted].pos;
+        while (nb_fixups > 0 && fixups[nb_fixups - 1] >= (int)buf.size) {
+          nb_fixups = nb_fixups - 1;
+        }
+        run = run - (n + 1);
+
+        e = &emitted[nb_emitted++];
+        e->pos = code_emit(&buf, I_CONST);
+        code_emit(&buf, bytecode_add_const(program, &res));
+        e->is_const = 1;
+        e->value = res;
+        run = run + 1;
+        count = count + 1;
+        continue;
+      }
+    }
+
+    // recopie de l'instruction, en notant les adresses à reloger
+    e = &emitted[nb_emitted++];
+    e->pos = buf.size;
+    e->is_const = loader_const_value(ld, pc, &e->value);
+    for (i = pc; i < pc + size; i++) {
+      code_emit(&buf, program->bytecode[i]);
+    }
+    if (op == I_JUMP || op == I_JFALSE) {
+      fixups[nb_fixups++] = buf.size - 1;
+    } else if (op == I_PUSH && program->bytecode[pc + 1] == T_FUN) {
+      fixups[nb_fixups++] = buf.size - 1;
+    }
+    run = (ld->flags[pc] & F_TARGET) ? 1 : run + 1;
+  }
+  new_pc[program->size] = buf.size;
+
+  if (count > 0) {
+    loader_relocate(program, &buf, new_pc, fixups, nb_fixups);
+  } else {
+    free(buf.code);
+  }
+
+  free(new_pc);
+  free(fixups);
+  free(emitted);
+  return count;
+}
+
+/** Optimisation d'un programme au chargement.
+ * \param[in,out] program le programme à optimiser.
+ * \param debug affichage des informations de débogage (1) ou non (0).
+ */
+void loader_optimize(program_t *program, int debug) {
+  loader_t *ld = loader_analyze(program);
+  int nb;
+
+  nb = loader_specialize_globals(ld);
+  if (debug) {
+    printf("[LOADER] %d global reads specialized\n", nb);
+  }
+
+  nb = loader_inline(ld);
+  if (debug) {
+    printf("[LOADER] %d call sites inlined\n", nb);
+  }
+
+  // l'inlining a reconstruit le code : on refait l'analyse
+  if (nb > 0) {
+    loader_free(ld);
+    ld = loader_analyze(program);
+  }
+
+  nb = loader_fold_prims(ld);
+  if (debug) {
+    printf("[LOADER] %d primitive calls folded\n", nb);
+  }
+
+  loader_free(ld);
+}
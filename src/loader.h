@@ -0,0 +1,29 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+/** \file loader.h
+ * Passes d'optimisation effectuées au chargement du bytecode.
+ *
+ * Le chargeur analyse le programme (flot de contrôle du top-niveau et
+ * des corps de fonctions) puis réécrit certaines instructions avec des
+ * instructions internes (cf. bytecode.h) :
+ * - les variables globales écrites une seule fois (typiquement les
+ * `define` de fonctions et de constantes au top-niveau) sont lues
+ * directement dans la table des constantes du programme (CONST) au lieu
+ * de passer par GFETCH.
+ * - les appels de primitives "pliables" sur des arguments constants
+ * (cf. prim.h) sont calculés au chargement et remplacés par CONST.
+ */
+
+#include "bytecode.h"
+
+void loader_optimize(program_t *program, int debug);
+
+#endif
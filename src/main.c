@@ -27,24 +27,88 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "alloc_profile.h"
+#include "extension.h"
+#include "gc_stats.h"
+#include "heap_snapshot.h"
+#include "loader.h"
+#include "output.h"
+#include "perfctr.h"
+#include "prim.h"
+#include "profile.h"
+#include "regvm.h"
+#include "sampler.h"
+#include "symtab.h"
 #include "vm.h"
+#include "vm_stats.h"
 
 /** Petit mode d'emploi */
 static void vm_help() {
   printf(
       "Usage: svm [--help] [-d] [--vmdebug] [--gcdebug] [--gcfreq=FF] "
-      "prog.bc\n");
-  printf("   ==> run SVM with compiled program\n");
+      "[--gcstats=FILE] "
+      "[--noopt] [--engine=NAME] [--load-prims=LIB] [--output-buffer=SIZE] "
+      "[--output-fd=FD] [--print-depth=N] [--print-length=N] "
+      "[--print-shared] [--profile] [--alloc-profile] [--alloc-rate=BYTES] "
+      "[--sample=FILE] [--sample-hz=N] [--heap-snapshot=PREFIX] "
+      "[--perf-counters] [--metrics=FILE] [--metrics-period=MS] prog.bc\n");
+  printf("   ==> run SVM with compiled program (or assembler file .sasm)\n");
   printf("Options:\n");
   printf("   -h, --help    : print this help and exit\n");
   printf("   -d, --vmdebug : start the VM in debug mode\n");
   printf(
       "   --gcdebug     : start the VM with Garbage Collector in debug mode\n");
   printf("   --gcfreq=FF   : GC frequency set to FF (positive integer)\n");
+  printf(
+      "   --gcstats=FILE : log collections to FILE (JSON lines), print pause "
+      "percentiles\n");
+  printf("   --noopt       : disable load-time bytecode optimizations\n");
+  printf(
+      "   --engine=NAME : execution engine, NAME is stack (default), tos or "
+      "reg\n");
+  printf(
+      "   --load-prims=LIB : load native primitives from the shared library "
+      "LIB\n");
+  printf(
+      "   --output-buffer=SIZE : program output buffer size in bytes "
+      "(0: unbuffered)\n");
+  printf("   --output-fd=FD : write program output to file descriptor FD\n");
+  printf("   --print-depth=N : print values nested at most N levels deep\n");
+  printf("   --print-length=N : print at most N elements per list/vector\n");
+  printf("   --print-shared : print shared and cyclic data with #n= labels\n");
+  printf(
+      "   --profile     : count instructions and calls, print a report at "
+      "exit\n");
+  printf(
+      "   --alloc-profile : sample allocations by site, print a report at "
+      "exit\n");
+  printf(
+      "   --alloc-rate=BYTES : allocation sampling interval (default: %d, "
+      "1: all)\n",
+      ALLOC_PROFILE_DEFAULT_RATE);
+  printf(
+      "   --sample=FILE : sample call stacks (SIGPROF), write folded stacks "
+      "to FILE\n");
+  printf("   --sample-hz=N : sampling frequency (default: %d Hz of CPU time)\n",
+         SAMPLER_DEFAULT_HZ);
+  printf(
+      "   --heap-snapshot=PREFIX : on SIGUSR1, write a heap snapshot to "
+      "PREFIX.N.heap\n");
+  printf(
+      "   --perf-counters : sample hardware counters (perf_event_open), print "
+      "costs per opcode at exit\n");
+  printf(
+      "   --metrics=FILE : write runtime counters to FILE (Prometheus text "
+      "format)\n");
+  printf(
+      "   --metrics-period=MS : metrics file update period (default: %d ms)\n",
+      VM_STATS_DEFAULT_PERIOD);
   printf("\n");
 }
 
@@ -52,6 +116,24 @@ static void vm_help() {
 int parse_debug_vm(int index, char *argv[]);
 int parse_debug_gc(int index, char *argv[]);
 int parse_gc_freq(int index, char *argv[]);
+const char *parse_gc_stats(int index, char *argv[]);
+int parse_noopt(int index, char *argv[]);
+int parse_engine(int index, char *argv[]);
+const char *parse_load_prims(int index, char *argv[]);
+int parse_output_buffer(int index, char *argv[]);
+int parse_output_fd(int index, char *argv[]);
+int parse_print_depth(int index, char *argv[]);
+int parse_print_length(int index, char *argv[]);
+int parse_print_shared(int index, char *argv[]);
+int parse_profile(int index, char *argv[]);
+int parse_alloc_profile(int index, char *argv[]);
+int parse_alloc_rate(int index, char *argv[]);
+const char *parse_sample(int index, char *argv[]);
+int parse_sample_hz(int index, char *argv[]);
+const char *parse_heap_snapshot(int index, char *argv[]);
+int parse_perf_counters(int index, char *argv[]);
+const char *parse_metrics(int index, char *argv[]);
+int parse_metrics_period(int index, char *argv[]);
 
 /** Point d'entrée de la machine virtuelle native.
  * \param[in] argc le nombre d'arguments sur la ligne de commande
@@ -61,6 +143,23 @@ int main(int argc, char *argv[]) {
   int debug_vm = 0;
   int debug_gc = 0;
   int gc_freq = 0;
+  const char *gc_stats_file = NULL;
+  int noopt = 0;
+  int engine = -1;
+  int output_size = -1;
+  int output_fd = STDOUT_FILENO;
+  int print_depth = 0;
+  int print_length = 0;
+  int print_shared = 0;
+  int profile = 0;
+  int alloc_profile = 0;
+  int alloc_rate = ALLOC_PROFILE_DEFAULT_RATE;
+  const char *sample_file = NULL;
+  int sample_hz = SAMPLER_DEFAULT_HZ;
+  const char *heap_snapshot_prefix = NULL;
+  int perf_counters = 0;
+  const char *metrics_file = NULL;
+  int metrics_period = VM_STATS_DEFAULT_PERIOD;
   char freq[10];
   char *filename = NULL;
   int i;
@@ -79,6 +178,10 @@ int main(int argc, char *argv[]) {
     exit(EXIT_SUCCESS);
   }
 
+  // les primitives doivent être connues des modules d'extension, de
+  // l'assembleur et du chargeur
+  prim_init();
+
   /* On commence par analyser la ligne de commande */
   for (i = 1; i < argc; i++) {
     if (parse_debug_vm(i, argv)) {
@@ -95,6 +198,51 @@ int main(int argc, char *argv[]) {
       } else {
         debug_gc = 1;
       }
+    } else if (parse_gc_stats(i, argv) != NULL) {
+      gc_stats_file = parse_gc_stats(i, argv);
+    } else if (parse_noopt(i, argv)) {
+      noopt = 1;
+    } else if (parse_engine(i, argv) >= 0) {
+      engine = parse_engine(i, argv);
+    } else if (parse_load_prims(i, argv) != NULL) {
+      printf("loading primitives module: %s\n", parse_load_prims(i, argv));
+      extension_load(parse_load_prims(i, argv));
+    } else if (parse_output_buffer(i, argv) >= 0) {
+      output_size = parse_output_buffer(i, argv);
+    } else if (parse_output_fd(i, argv) >= 0) {
+      output_fd = parse_output_fd(i, argv);
+    } else if (parse_print_depth(i, argv) >= 0) {
+      print_depth = parse_print_depth(i, argv);
+    } else if (parse_print_length(i, argv) >= 0) {
+      print_length = parse_print_length(i, argv);
+    } else if (parse_print_shared(i, argv)) {
+      print_shared = 1;
+    } else if (parse_profile(i, argv)) {
+      profile = 1;
+    } else if (parse_alloc_profile(i, argv)) {
+      alloc_profile = 1;
+    } else if (parse_perf_counters(i, argv)) {
+      perf_counters = 1;
+    } else if (parse_alloc_rate(i, argv) >= 0) {
+      alloc_rate = parse_alloc_rate(i, argv);
+      if (alloc_rate == 0) {
+        fprintf(stderr, "Allocation sampling interval should be positive\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (parse_sample(i, argv) != NULL) {
+      sample_file = parse_sample(i, argv);
+    } else if (parse_sample_hz(i, argv) >= 0) {
+      sample_hz = parse_sample_hz(i, argv);
+      if (sample_hz == 0) {
+        fprintf(stderr, "Sampling frequency should be positive\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (parse_heap_snapshot(i, argv) != NULL) {
+      heap_snapshot_prefix = parse_heap_snapshot(i, argv);
+    } else if (parse_metrics(i, argv) != NULL) {
+      metrics_file = parse_metrics(i, argv);
+    } else if (parse_metrics_period(i, argv) >= 0) {
+      metrics_period = parse_metrics_period(i, argv);
     } else {
       int freq = parse_gc_freq(i, argv);
       if (freq == 0) {
@@ -124,6 +272,14 @@ int main(int argc, char *argv[]) {
     gc_freq = DEFAULT_GC_FREQUENCY;
   }
 
+  // en mode débogage, la sortie du programme n'est pas tamponnée pour
+  // rester mêlée aux traces
+  if (output_size < 0) {
+    output_size = (debug_vm || debug_gc) ? 0 : OUTPUT_DEFAULT_SIZE;
+  }
+  output_init(output_size, output_fd);
+  value_print_limits(print_depth, print_length, print_shared);
+
   /* et maintenant on charge le bytecode */
 
   printf("loading bytecode file: %s\n", filename);
@@ -132,6 +288,12 @@ int main(int argc, char *argv[]) {
 
   // on lit tout d'abord le fichier de bytecode
   bytecode_read(&program, filename);
+
+  // optimisations au chargement (cf. loader.h)
+  if (!noopt) {
+    loader_optimize(&program, debug_vm);
+  }
+
   if (debug_vm) {
     printf("=== Loaded program:\n");
     bytecode_print(&program);
@@ -144,16 +306,113 @@ int main(int argc, char *argv[]) {
     printf("Initializing VM with GC frequency=%d\n", gc_freq);
   }
   vm_t *vm = init_vm(&program, debug_vm, debug_gc, gc_freq);
+  if (engine >= 0) {
+    vm->engine = engine;
+  }
+  if (gc_stats_file != NULL) {
+    vm->gc->stats = gc_stats_create(gc_stats_file);
+  }
+  if (metrics_file != NULL) {
+    vm_stats_set_metrics(&vm->stats, metrics_file, metrics_period);
+  }
+
+  // les profileurs instrumentent le moteur standard (le profileur des
+  // allocations y lit le pc de l'instruction en cours)
+  if (profile || alloc_profile) {
+    if (vm->engine != VM_ENGINE_STACK) {
+      fprintf(stderr, "profiling uses the stack engine\n");
+      vm->engine = VM_ENGINE_STACK;
+    }
+  }
+  if (profile) {
+    vm->profile = profile_create(&program);
+  }
+  if (alloc_profile) {
+    vm->gc->alloc_profile = alloc_profile_create(vm, alloc_rate);
+  }
+  // les compteurs matériels mesurent n'importe quel moteur (le moteur
+  // standard les attribue aux opcodes), mais pas le profileur
+  if (perf_counters) {
+    if (profile) {
+      fprintf(stderr, "--perf-counters cannot be used with --profile\n");
+      exit(EXIT_FAILURE);
+    }
+    vm->perfctr = perfctr_create();
+  }
+
+  // traduction en code registre
+  if (vm->engine == VM_ENGINE_REG) {
+    vm->rprogram = regvm_translate(&program);
+    if (vm->rprogram == NULL) {
+      fprintf(stderr,
+              "register translation failed, falling back to stack engine\n");
+      vm->engine = VM_ENGINE_STACK;
+    } else if (debug_vm) {
+      printf("=== Register code (%d bytecode instructions):\n",
+             vm->rprogram->nb_stack_instrs);
+      regvm_print(vm->rprogram);
+      printf("===================\n");
+    }
+  }
 
   // puis on l'exécute
   printf("-------------------\n");
   if (debug_vm) {
     printf("=== Begin execution ====\n");
   }
+  output_flush();
+  if (heap_snapshot_prefix != NULL) {
+    heap_snapshot_on_signal(heap_snapshot_prefix);
+  }
+  if (sample_file != NULL) {
+    sampler_start(vm, sample_hz);
+  }
+  if (vm->perfctr != NULL) {
+    perfctr_start(vm->perfctr);
+  }
   vm_execute(vm);
+  if (vm->perfctr != NULL) {
+    perfctr_stop(vm->perfctr);
+  }
+  if (metrics_file != NULL) {
+    vm_stats_write(&vm->stats, metrics_file);
+  }
+  if (sample_file != NULL) {
+    sampler_stop();
+  }
+  output_destroy();
+
+  if (vm->profile != NULL) {
+    profile_report(vm->profile);
+    profile_destroy(vm->profile);
+  }
+  if (vm->gc->alloc_profile != NULL) {
+    alloc_profile_report(vm->gc->alloc_profile);
+    alloc_profile_destroy(vm->gc->alloc_profile);
+    vm->gc->alloc_profile = NULL;
+  }
+  if (vm->perfctr != NULL) {
+    perfctr_report(vm->perfctr);
+    perfctr_destroy(vm->perfctr);
+    vm->perfctr = NULL;
+  }
+  if (sample_file != NULL) {
+    sampler_write(sample_file);
+  }
+  if (vm->gc->stats != NULL) {
+    gc_stats_report(vm->gc->stats);
+    gc_stats_destroy(vm->gc->stats);
+  }
 
   // et finalement on récupère la mémoire du bytecode
+  if (vm->rprogram != NULL) {
+    regvm_destroy(vm->rprogram);
+  }
   bytecode_destroy(&program);
+  symtab_destroy();
+  prim_destroy();
+  extension_destroy();
+  frame_pool_destroy();
 
   if (debug_vm) {
     printf("=== Finish execution ====\n");
@@ -184,6 +443,191 @@ int parse_debug_gc(int index, char *argv[]) {
   }
 }
 
+/** Analyse de la ligne de commande (option --noopt) */
+int parse_noopt(int index, char *argv[]) {
+  if (strcmp(argv[index], "--noopt") == 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/** Analyse de la ligne de commande (option --engine)
+ * \return le moteur choisi, ou -1 si ce n'est pas l'option --engine.
+ */
+int parse_engine(int index, char *argv[]) {
+  if (strncmp(argv[index], "--engine=", 9) != 0) {
+    return -1;
+  }
+  if (strcmp(&(argv[index][9]), "stack") == 0) {
+    return VM_ENGINE_STACK;
+  } else if (strcmp(&(argv[index][9]), "tos") == 0) {
+    return VM_ENGINE_TOS;
+  } else if (strcmp(&(argv[index][9]), "reg") == 0) {
+    return VM_ENGINE_REG;
+  }
+  fprintf(stderr, "Unknown engine: %s\n", &(argv[index][9]));
+  exit(EXIT_FAILURE);
+}
+
+/** Analyse de la ligne de commande (option --load-prims)
+ * \return le chemin du module, ou NULL si ce n'est pas l'option
+ * --load-prims.
+ */
+const char *parse_load_prims(int index, char *argv[]) {
+  if (strncmp(argv[index], "--load-prims=", 13) != 0) {
+    return NULL;
+  }
+  return &(argv[index][13]);
+}
+
+/** Analyse d'une option numérique positive ou nulle --name=N
+ * \return la valeur, ou -1 si ce n'est pas l'option.
+ */
+static int parse_count(int index, char *argv[], const char *option) {
+  size_t length = strlen(option);
+  char *end;
+  long val;
+
+  if (strncmp(argv[index], option, length) != 0) {
+    return -1;
+  }
+  errno = 0;
+  val = strtol(&(argv[index][length]), &end, 10);
+  if (end == &(argv[index][length]) || *end != '\0' || errno != 0 ||
+      val < 0 || val > INT_MAX) {
+    fprintf(stderr, "Incorrect value for %s%s\n", option,
+            &(argv[index][length]));
+    exit(EXIT_FAILURE);
+  }
+  return (int)val;
+}
+
+/** Analyse de la ligne de commande (option --output-buffer)
+ * \return la taille du tampon, ou -1 si ce n'est pas l'option.
+ */
+int parse_output_buffer(int index, char *argv[]) {
+  return parse_count(index, argv, "--output-buffer=");
+}
+
+/** Analyse de la ligne de commande (option --output-fd)
+ * \return le descripteur de fichier, ou -1 si ce n'est pas l'option.
+ */
+int parse_output_fd(int index, char *argv[]) {
+  return parse_count(index, argv, "--output-fd=");
+}
+
+/** Analyse de la ligne de commande (option --print-depth)
+ * \return la profondeur maximale, ou -1 si ce n'est pas l'option.
+ */
+int parse_print_depth(int index, char *argv[]) {
+  return parse_count(index, argv, "--print-depth=");
+}
+
+/** Analyse de la ligne de commande (option --print-length)
+ * \return le nombre maximal d'éléments, ou -1 si ce n'est pas l'option.
+ */
+int parse_print_length(int index, char *argv[]) {
+  return parse_count(index, argv, "--print-length=");
+}
+
+/** Analyse de la ligne de commande (option --print-shared) */
+int parse_print_shared(int index, char *argv[]) {
+  if (strcmp(argv[index], "--print-shared") == 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/** Analyse de la ligne de commande (option --profile) */
+int parse_profile(int index, char *argv[]) {
+  if (strcmp(argv[index], "--profile") == 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/** Analyse de la ligne de commande (option --alloc-profile) */
+int parse_alloc_profile(int index, char *argv[]) {
+  if (strcmp(argv[index], "--alloc-profile") == 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/** Analyse de la ligne de commande (option --perf-counters) */
+int parse_perf_counters(int index, char *argv[]) {
+  if (strcmp(argv[index], "--perf-counters") == 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/** Analyse de la ligne de commande (option --alloc-rate)
+ * \return le pas d'échantillonnage, ou -1 si ce n'est pas l'option.
+ */
+int parse_alloc_rate(int index, char *argv[]) {
+  return parse_count(index, argv, "--alloc-rate=");
+}
+
+/** Analyse de la ligne de commande (option --sample)
+ * \return le fichier des piles, ou NULL si ce n'est pas l'option.
+ */
+const char *parse_sample(int index, char *argv[]) {
+  if (strncmp(argv[index], "--sample=", 9) != 0) {
+    return NULL;
+  }
+  return &(argv[index][9]);
+}
+
+/** Analyse de la ligne de commande (option --sample-hz)
+ * \return la fréquence, ou -1 si ce n'est pas l'option.
+ */
+int parse_sample_hz(int index, char *argv[]) {
+  return parse_count(index, argv, "--sample-hz=");
+}
+
+/** Analyse de la ligne de commande (option --gcstats)
+ * \return le fichier du journal, ou NULL si ce n'est pas l'option.
+ */
+const char *parse_gc_stats(int index, char *argv[]) {
+  if (strncmp(argv[index], "--gcstats=", 10) != 0) {
+    return NULL;
+  }
+  return &(argv[index][10]);
+}
+
+/** Analyse de la ligne de commande (option --metrics)
+ * \return le fichier des métriques, ou NULL si ce n'est pas l'option.
+ */
+const char *parse_metrics(int index, char *argv[]) {
+  if (strncmp(argv[index], "--metrics=", 10) != 0) {
+    return NULL;
+  }
+  return &(argv[index][10]);
+}
+
+/** Analyse de la ligne de commande (option --metrics-period)
+ * \return la période (en ms), ou -1 si ce n'est pas l'option.
+ */
+int parse_metrics_period(int index, char *argv[]) {
+  return parse_count(index, argv, "--metrics-period=");
+}
+
+/** Analyse de la ligne de commande (option --heap-snapshot)
+ * \return le préfixe des instantanés, ou NULL si ce n'est pas l'option.
+ */
+const char *parse_heap_snapshot(int index, char *argv[]) {
+  if (strncmp(argv[index], "--heap-snapshot=", 16) != 0) {
+    return NULL;
+  }
+  return &(argv[index][16]);
+}
+
 /** Analyse de la ligne de commande (option --gc-freq) */
 int parse_gc_freq(int index, char *argv[]) {
   char buf[11];
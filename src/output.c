@@ -0,0 +1,180 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "output.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** \file output.c
+ * Tampon de sortie des programmes.
+ ******/
+
+/** Le tampon (NULL si la sortie n'est pas tamponnée). */
+static char *buffer = NULL;
+
+/** La taille du tampon. */
+static size_t capacity = 0;
+
+/** Le nombre d'octets en attente dans le tampon. */
+static size_t pending = 0;
+
+/** Le descripteur de fichier de la sortie. */
+static int output_fd = STDOUT_FILENO;
+
+/** Si 1 (true) le tampon est vidé à chaque fin de ligne (terminal). */
+static int line_mode = 0;
+
+/** Écriture directe sur le descripteur de sortie. */
+static void output_write(const char *chars, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(output_fd, chars, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "cannot write program output: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    chars = chars + written;
+    length = length - (size_t)written;
+  }
+}
+
+/** Vidage du tampon à l'arrêt sur erreur d'une primitive (abort).
+ * La sortie en attente précède le message d'erreur, encore dans le tampon
+ * de stdio. abort n'est appelé que depuis la VM elle-même, jamais de
+ * façon asynchrone.
+ */
+static void output_on_abort(int sig) {
+  if (pending > 0) {
+    output_write(buffer, pending);
+    pending = 0;
+  }
+  fflush(stdout);
+}
+
+/** Vidage du tampon à l'arrêt par exit (erreurs à l'exécution) : comme
+ * pour abort, la sortie en attente précède le message d'erreur. */
+static void output_on_exit(void) { output_on_abort(0); }
+
+/** Vidage du tampon de sortie.
+ * Les messages de la VM déjà envoyés à stdio sont écrits avant.
+ */
+void output_flush(void) {
+  if (output_fd == STDOUT_FILENO) {
+    fflush(stdout);
+  }
+  if (pending > 0) {
+    output_write(buffer, pending);
+    pending = 0;
+  }
+}
+
+/** Initialisation de la sortie.
+ * La sortie est en mode ligne si le descripteur est un terminal.
+ * \param size la taille du tampon (0 pour une sortie non tamponnée).
+ * \param fd le descripteur de fichier de la sortie.
+ */
+void output_init(size_t size, int fd) {
+  static int exit_hook = 0;
+
+  output_destroy();
+  if (!exit_hook) {
+    atexit(output_on_exit);
+    exit_hook = 1;
+  }
+  output_fd = fd;
+  line_mode = isatty(fd);
+  if (size > 0) {
+    buffer = (char *)malloc(size);
+    assert(buffer != NULL);
+    capacity = size;
+    signal(SIGABRT, output_on_abort);
+  }
+}
+
+/** Libération du tampon (après l'avoir vidé). */
+void output_destroy(void) {
+  output_flush();
+  free(buffer);
+  buffer = NULL;
+  capacity = 0;
+}
+
+/** Écriture d'une suite de caractères.
+ * \param[in] chars les caractères.
+ * \param length le nombre de caractères.
+ */
+void output_chars(const char *chars, size_t length) {
+  if (capacity == 0) {
+    // sortie non tamponnée
+    if (output_fd == STDOUT_FILENO) {
+      fwrite(chars, 1, length, stdout);
+    } else {
+      output_write(chars, length);
+    }
+    return;
+  }
+
+  if (length > capacity - pending) {
+    output_flush();
+    if (length > capacity) {
+      // trop grand pour le tampon : écrit directement
+      output_write(chars, length);
+      return;
+    }
+  }
+  memcpy(buffer + pending, chars, length);
+  pending = pending + length;
+  if (line_mode && memchr(chars, '\n', length) != NULL) {
+    output_flush();
+  }
+}
+
+/** Écriture d'une chaîne C.
+ * \param[in] string la chaîne (terminée par '\0').
+ */
+void output_string(const char *string) {
+  output_chars(string, strlen(string));
+}
+
+/** Écriture d'un caractère.
+ * \param ch le caractère.
+ */
+void output_char(char ch) {
+  if (pending < capacity && ch != '\n') {
+    buffer[pending] = ch;
+    pending = pending + 1;
+  } else {
+    output_chars(&ch, 1);
+  }
+}
+
+/** Écriture d'un entier en décimal (sans printf).
+ * \param value l'entier.
+ */
+void output_int(int value) {
+  char digits[12];  // signe et 10 chiffres au plus
+  char *p = digits + sizeof(digits);
+  // en non signé pour traiter INT_MIN
+  unsigned int u = (value < 0) ? 0u - (unsigned int)value : (unsigned int)value;
+
+  do {
+    p = p - 1;
+    *p = (char)('0' + u % 10);
+    u = u / 10;
+  } while (u != 0);
+  if (value < 0) {
+    p = p - 1;
+    *p = '-';
+  }
+  output_chars(p, (size_t)(digits + sizeof(digits) - p));
+}
@@ -0,0 +1,39 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stddef.h>
+
+/** \file output.h
+ * Sortie des programmes (display, newline, affichage des valeurs dépilées
+ * au top-niveau).
+ *
+ * La sortie est accumulée dans un tampon propre à la VM et écrite en un
+ * seul appel système lorsque le tampon est plein, à la fin du programme
+ * (output_flush), avant l'arrêt sur erreur et, en mode ligne, à chaque
+ * fin de ligne. Les entiers sont formatés sans passer par printf.
+ *
+ * Avec un tampon de taille nulle, la sortie standard passe par stdio
+ * comme le reste des messages de la VM : c'est le mode utilisé pour le
+ * débogage, où l'affichage des valeurs est mêlé aux traces.
+ */
+
+/** Taille par défaut du tampon de sortie (en octets). */
+#define OUTPUT_DEFAULT_SIZE 65536
+
+void output_init(size_t size, int fd);
+void output_destroy(void);
+void output_flush(void);
+
+void output_chars(const char *chars, size_t length);
+void output_string(const char *string);
+void output_char(char ch);
+void output_int(int value);
+
+#endif
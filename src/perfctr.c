@@ -0,0 +1,420 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+// F_SETSIG (signal de débordement des compteurs, cf. fcntl(2))
+#define _GNU_SOURCE
+
+#include "perfctr.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/** \file perfctr.c
+ * Ouverture des compteurs, gestionnaire de débordement et rapport.
+ *
+ * Un compteur ouvert sans tampon circulaire ne signale que la fin de son
+ * quota de débordements (POLL_HUP, cf. PERF_EVENT_IOC_REFRESH) : le quota
+ * est d'un débordement, renouvelé par le gestionnaire. Le compteur est
+ * arrêté entre le débordement et son renouvellement, ce qui exclut le coût
+ * du gestionnaire des mesures.
+ ******/
+
+/* Les compteurs. */
+#define PERFCTR_TASK_CLOCK 0    /*!< temps CPU (ns) */
+#define PERFCTR_CYCLES 1        /*!< cycles */
+#define PERFCTR_INSTRUCTIONS 2  /*!< instructions (du processeur) */
+#define PERFCTR_BRANCH_MISSES 3 /*!< mauvaises prédictions de branchement */
+#define PERFCTR_L1D_MISSES 4    /*!< défauts de cache L1D (lectures) */
+#define PERFCTR_LLC_MISSES 5    /*!< défauts du cache de dernier niveau */
+
+#ifdef __linux__
+/** Le signal de débordement des compteurs. Un signal temps réel est mis en
+ * file (avec son si_fd) : si deux compteurs débordent ensemble, aucun
+ * signal n'est perdu, donc aucun compteur ne reste désarmé (SIGIO, lui,
+ * n'est délivré qu'une fois tant qu'il est en attente). */
+#define PERFCTR_SIGNAL SIGRTMIN
+#endif
+
+/** Les noms des compteurs. */
+static const char *perfctr_names[PERFCTR_NB_COUNTERS] = {
+    "task-clock",    "cycles",     "instructions",
+    "branch-misses", "L1D-misses", "LLC-misses"};
+
+/** Les périodes d'échantillonnage (en événements, premières pour ne pas
+ * suivre le rythme d'une boucle du programme). */
+static const unsigned long perfctr_periods[PERFCTR_NB_COUNTERS] = {
+    100003, 1000003, 1000003, 10007, 10007, 1009};
+
+/** Les compteurs échantillonnés. */
+static perfctr_t *perfctr_current = NULL;
+
+/** Les facteurs de correction du multiplexage des compteurs (temps
+ * d'activation sur temps de comptage). */
+static double perfctr_scales[PERFCTR_NB_COUNTERS];
+
+#ifdef __linux__
+
+/** Gestionnaire du signal de débordement : comptage d'un échantillon pour
+ * l'opcode en cours. Pas d'allocation, pas d'appel à stdio.
+ */
+static void perfctr_handler(int sig, siginfo_t *info, void *context) {
+  perfctr_t *perfctr = perfctr_current;
+  int opcode = perfctr->opcode;
+  int i;
+
+  (void)sig;
+  (void)context;
+  for (i = 0; i < PERFCTR_NB_COUNTERS && perfctr->fds[i] != info->si_fd; i++) {
+  }
+  if (i == PERFCTR_NB_COUNTERS) return;
+
+  if (opcode >= 0 && opcode <= PERFCTR_MAX_OPCODE) {
+    perfctr->samples[i][opcode] = perfctr->samples[i][opcode] + 1;
+  } else {
+    perfctr->others[i] = perfctr->others[i] + 1;
+  }
+  ioctl(info->si_fd, PERF_EVENT_IOC_REFRESH, 1);
+}
+
+/** Ouverture d'un compteur (arrêté).
+ * \param counter le compteur (PERFCTR_xxx).
+ * \return le descripteur du compteur, ou -1 (errno) s'il est indisponible.
+ */
+static int perfctr_open(int counter) {
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  switch (counter) {
+    case PERFCTR_TASK_CLOCK:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_TASK_CLOCK;
+      break;
+    case PERFCTR_CYCLES:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PERFCTR_INSTRUCTIONS:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PERFCTR_BRANCH_MISSES:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    case PERFCTR_L1D_MISSES:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    default:
+      // le plus souvent, les défauts du cache de dernier niveau
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+  }
+  attr.sample_period = perfctr_periods[counter];
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd < 0) return -1;
+
+  // débordements signalés par PERFCTR_SIGNAL (descripteur dans si_fd)
+  if (fcntl(fd, F_SETFL, O_ASYNC) != 0 ||
+      fcntl(fd, F_SETSIG, PERFCTR_SIGNAL) != 0 ||
+      fcntl(fd, F_SETOWN, getpid()) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+#else
+
+static int perfctr_open(int counter) {
+  (void)counter;
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
+
+/** Création des compteurs (arrêtés).
+ * Les compteurs indisponibles sont signalés sur la sortie d'erreur.
+ * \return les compteurs.
+ */
+perfctr_t *perfctr_create(void) {
+  perfctr_t *perfctr = (perfctr_t *)malloc(sizeof(perfctr_t));
+  int i;
+
+  assert(perfctr != NULL);
+  perfctr->opcode = PERFCTR_NONE;
+  perfctr->executions = (unsigned long long *)calloc(
+      PERFCTR_MAX_OPCODE + 1, sizeof(unsigned long long));
+  assert(perfctr->executions != NULL);
+
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    perfctr->samples[i] = (unsigned long long *)calloc(
+        PERFCTR_MAX_OPCODE + 1, sizeof(unsigned long long));
+    assert(perfctr->samples[i] != NULL);
+    perfctr->totals[i] = 0;
+    perfctr->others[i] = 0;
+    perfctr_scales[i] = 1.0;
+    perfctr->fds[i] = perfctr_open(i);
+    if (perfctr->fds[i] < 0) {
+      fprintf(stderr, "perf counter unavailable: %s (%s)\n", perfctr_names[i],
+              strerror(errno));
+    }
+  }
+  return perfctr;
+}
+
+/** Libération des compteurs. */
+void perfctr_destroy(perfctr_t *perfctr) {
+  int i;
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    if (perfctr->fds[i] >= 0) {
+      close(perfctr->fds[i]);
+    }
+    free(perfctr->samples[i]);
+  }
+  free(perfctr->executions);
+  free(perfctr);
+}
+
+/** Démarrage des compteurs.
+ * \param[in,out] perfctr les compteurs.
+ */
+void perfctr_start(perfctr_t *perfctr) {
+#ifdef __linux__
+  struct sigaction action;
+  int i;
+
+  perfctr_current = perfctr;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = perfctr_handler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(PERFCTR_SIGNAL, &action, NULL) != 0) {
+    perror("sigaction");
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    if (perfctr->fds[i] >= 0) {
+      ioctl(perfctr->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(perfctr->fds[i], PERF_EVENT_IOC_REFRESH, 1);
+    }
+  }
+#else
+  perfctr_current = perfctr;
+#endif
+}
+
+/** Arrêt des compteurs et lecture des totaux (avant le rapport).
+ * \param[in,out] perfctr les compteurs.
+ */
+void perfctr_stop(perfctr_t *perfctr) {
+#ifdef __linux__
+  // la valeur, puis les temps d'activation et de comptage
+  unsigned long long values[3];
+  int i;
+
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    if (perfctr->fds[i] >= 0) {
+      ioctl(perfctr->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+  // les signaux encore en file sont ignorés (l'action par défaut d'un
+  // signal temps réel termine le processus)
+  signal(PERFCTR_SIGNAL, SIG_IGN);
+
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    if (perfctr->fds[i] < 0) continue;
+    if (read(perfctr->fds[i], values, sizeof(values)) != sizeof(values)) {
+      perror("read (perf counter)");
+      continue;
+    }
+    if (values[2] > 0 && values[2] < values[1]) {
+      perfctr_scales[i] = (double)values[1] / (double)values[2];
+    }
+    perfctr->totals[i] =
+        (unsigned long long)((double)values[0] * perfctr_scales[i]);
+  }
+#endif
+  perfctr_current = NULL;
+}
+
+/** Estimation d'un compteur pour un opcode (échantillons).
+ * \param[in] perfctr les compteurs.
+ * \param counter le compteur.
+ * \param opcode l'opcode (ou PERFCTR_GC).
+ */
+static double perfctr_estimate(perfctr_t *perfctr, int counter, int opcode) {
+  return (double)perfctr->samples[counter][opcode] *
+         (double)perfctr_periods[counter] * perfctr_scales[counter];
+}
+
+/** Affichage d'un coût par exécution (ou `-` s'il n'est pas mesuré). */
+static void perfctr_print_ratio(int width, double value, double count,
+                                int available) {
+  if (!available || count <= 0.0) {
+    printf(" %*s", width, "-");
+  } else {
+    printf(" %*.2f", width, value / count);
+  }
+}
+
+/** Entrée du classement des opcodes. */
+typedef struct {
+  int opcode;               /*!< l'opcode (ou PERFCTR_GC) */
+  unsigned long long count; /*!< les échantillons du compteur principal */
+} perfctr_entry_t;
+
+/** Comparaison des entrées (par échantillons décroissants). */
+static int perfctr_compare(const void *a, const void *b) {
+  const perfctr_entry_t *ea = (const perfctr_entry_t *)a;
+  const perfctr_entry_t *eb = (const perfctr_entry_t *)b;
+  if (ea->count != eb->count) {
+    return (ea->count > eb->count) ? -1 : 1;
+  }
+  return ea->opcode - eb->opcode;
+}
+
+/** Rapport des compteurs (sur la sortie standard).
+ * \param[in] perfctr les compteurs (arrêtés).
+ */
+void perfctr_report(perfctr_t *perfctr) {
+  perfctr_entry_t *entries = (perfctr_entry_t *)malloc(
+      sizeof(perfctr_entry_t) * (PERFCTR_MAX_OPCODE + 1));
+  unsigned long long executions = 0, primary_samples = 0;
+  int available[PERFCTR_NB_COUNTERS];
+  int primary = -1, nb_entries = 0, opcode, i;
+
+  assert(entries != NULL);
+  for (opcode = 0; opcode <= PERFCTR_MAX_OPCODE; opcode++) {
+    executions = executions + perfctr->executions[opcode];
+  }
+  // le compteur principal (classement, pourcentages) : les cycles, sinon
+  // le temps CPU
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    available[i] = (perfctr->fds[i] >= 0);
+  }
+  if (available[PERFCTR_CYCLES]) {
+    primary = PERFCTR_CYCLES;
+  } else if (available[PERFCTR_TASK_CLOCK]) {
+    primary = PERFCTR_TASK_CLOCK;
+  }
+
+  printf("=== Perf counters: %llu VM instructions\n", executions);
+  printf("%-14s %16s %12s %10s %12s\n", "counter", "total", "samples",
+         "period", "per-instr");
+  for (i = 0; i < PERFCTR_NB_COUNTERS; i++) {
+    unsigned long long samples = perfctr->others[i];
+    if (!available[i]) {
+      printf("%-14s %16s\n", perfctr_names[i], "unavailable");
+      continue;
+    }
+    for (opcode = 0; opcode <= PERFCTR_MAX_OPCODE; opcode++) {
+      samples = samples + perfctr->samples[i][opcode];
+    }
+    printf("%-14s %16llu %12llu %10lu", perfctr_names[i], perfctr->totals[i],
+           samples, perfctr_periods[i]);
+    perfctr_print_ratio(12, (double)perfctr->totals[i], (double)executions, 1);
+    printf("\n");
+    if (i == primary) {
+      primary_samples = samples;
+    }
+  }
+  if (available[PERFCTR_CYCLES] && available[PERFCTR_INSTRUCTIONS] &&
+      perfctr->totals[PERFCTR_CYCLES] > 0) {
+    printf("IPC: %.2f\n", (double)perfctr->totals[PERFCTR_INSTRUCTIONS] /
+                              (double)perfctr->totals[PERFCTR_CYCLES]);
+  }
+
+  if (executions == 0) {
+    printf("(per-opcode attribution requires the stack engine)\n");
+  } else if (primary >= 0) {
+    for (opcode = 0; opcode <= PERFCTR_MAX_OPCODE; opcode++) {
+      if (perfctr->executions[opcode] == 0 &&
+          perfctr->samples[primary][opcode] == 0) {
+        continue;
+      }
+      entries[nb_entries].opcode = opcode;
+      entries[nb_entries].count = perfctr->samples[primary][opcode];
+      nb_entries = nb_entries + 1;
+    }
+    qsort(entries, nb_entries, sizeof(perfctr_entry_t), perfctr_compare);
+
+    printf("--- Opcodes (estimated from %s samples)\n", perfctr_names[primary]);
+    printf("%14s %6s %8s %10s %6s %11s %11s %11s  %s\n", "executions", "%",
+           "ns/op", "cycles/op", "IPC", "br-miss/op", "L1D-miss/op",
+           "LLC-miss/op", "opcode");
+    for (i = 0; i < nb_entries; i++) {
+      double count;
+      opcode = entries[i].opcode;
+      count = (double)perfctr->executions[opcode];
+      if (opcode == PERFCTR_GC) {
+        printf("%14s", "-");
+      } else {
+        printf("%14llu", perfctr->executions[opcode]);
+      }
+      printf(" %5.1f%%", primary_samples == 0
+                             ? 0.0
+                             : 100.0 * (double)entries[i].count /
+                                   (double)primary_samples);
+      perfctr_print_ratio(8, perfctr_estimate(perfctr, PERFCTR_TASK_CLOCK,
+                                              opcode),
+                          count, available[PERFCTR_TASK_CLOCK]);
+      perfctr_print_ratio(10, perfctr_estimate(perfctr, PERFCTR_CYCLES, opcode),
+                          count, available[PERFCTR_CYCLES]);
+      // IPC : instructions par cycle (les deux estimations)
+      perfctr_print_ratio(
+          6, perfctr_estimate(perfctr, PERFCTR_INSTRUCTIONS, opcode),
+          perfctr_estimate(perfctr, PERFCTR_CYCLES, opcode),
+          available[PERFCTR_CYCLES] && available[PERFCTR_INSTRUCTIONS]);
+      perfctr_print_ratio(
+          11, perfctr_estimate(perfctr, PERFCTR_BRANCH_MISSES, opcode), count,
+          available[PERFCTR_BRANCH_MISSES]);
+      perfctr_print_ratio(11,
+                          perfctr_estimate(perfctr, PERFCTR_L1D_MISSES, opcode),
+                          count, available[PERFCTR_L1D_MISSES]);
+      perfctr_print_ratio(11,
+                          perfctr_estimate(perfctr, PERFCTR_LLC_MISSES, opcode),
+                          count, available[PERFCTR_LLC_MISSES]);
+      printf("  %s\n", opcode == PERFCTR_GC ? "<gc>"
+                                             : bytecode_instr_name(opcode));
+    }
+    if (perfctr->others[primary] > 0) {
+      printf("%14s %5.1f%%  <outside the VM loop>\n", "-",
+             primary_samples == 0 ? 0.0
+                                  : 100.0 * (double)perfctr->others[primary] /
+                                        (double)primary_samples);
+    }
+  }
+  printf("===================\n");
+
+  free(entries);
+}
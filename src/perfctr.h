@@ -0,0 +1,66 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _PERFCTR_H_
+#define _PERFCTR_H_
+
+/** \file perfctr.h
+ * Compteurs matériels par opcode (option `--perf-counters`, Linux).
+ *
+ * Chaque compteur (temps CPU, cycles, instructions, mauvaises prédictions
+ * de branchement, défauts de cache L1D et du dernier niveau) est ouvert par
+ * perf_event_open en mode échantillonnage : après `period` événements, le
+ * noyau envoie un signal dont le gestionnaire attribue l'échantillon à
+ * l'opcode en cours d'exécution. Le moteur standard publie cet opcode
+ * (champ opcode) et compte les exécutions de chaque opcode, ce qui donne
+ * des coûts par exécution (cycles, IPC, taux de défauts) ; les autres
+ * moteurs ne sont mesurés que globalement. Le noyau n'intervient pas entre
+ * deux instructions de la VM : les mesures ne sont pas perturbées par la
+ * lecture des compteurs.
+ *
+ * Les échantillons sont des estimations (un échantillon vaut `period`
+ * événements) et peuvent être attribués à l'instruction suivante quand le
+ * signal arrive en retard. Les compteurs indisponibles (machine virtuelle,
+ * /proc/sys/kernel/perf_event_paranoid) sont signalés et ignorés.
+ */
+
+#include "vm.h"
+
+/** Nombre de compteurs. */
+#define PERFCTR_NB_COUNTERS 6
+
+/** Nombre de cases par compteur : les opcodes (cf. bytecode.h, I_SLIDE)
+ * puis la case des récupérations mémoire. */
+#define PERFCTR_MAX_OPCODE 1024
+
+/** Pseudo-opcode des récupérations mémoire. */
+#define PERFCTR_GC PERFCTR_MAX_OPCODE
+
+/** Pseudo-opcode hors de la boucle instrumentée (autres moteurs,
+ * initialisation). */
+#define PERFCTR_NONE (-1)
+
+/** État des compteurs. */
+typedef struct _perfctr {
+  volatile int opcode; /*!< l'opcode en cours (ou PERFCTR_GC/NONE) */
+  unsigned long long *executions; /*!< les exécutions, par opcode */
+  int fds[PERFCTR_NB_COUNTERS];   /*!< les compteurs (-1 si indisponible) */
+  unsigned long long totals[PERFCTR_NB_COUNTERS]; /*!< les totaux */
+  /** les échantillons, par compteur et par opcode */
+  unsigned long long *samples[PERFCTR_NB_COUNTERS];
+  /** les échantillons hors de la boucle instrumentée */
+  unsigned long long others[PERFCTR_NB_COUNTERS];
+} perfctr_t;
+
+perfctr_t *perfctr_create(void);
+void perfctr_destroy(perfctr_t *perfctr);
+
+void perfctr_start(perfctr_t *perfctr);
+void perfctr_stop(perfctr_t *perfctr);
+void perfctr_report(perfctr_t *perfctr);
+
+#endif
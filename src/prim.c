@@ -8,10 +8,19 @@
 #include "prim.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "constants.h"
+#include "hashtable.h"
+#include "heap_snapshot.h"
+#include "i32vector.h"
+#include "output.h"
+#include "probes.h"
+#include "symtab.h"
 #include "value.h"
 #include "varray.h"
 #include "vm.h"
@@ -57,24 +66,24 @@ static int apply_arith_prim(int prim, int n1, int n2) {
 /** Application itérée d'un opérateur arithmétique binaire sur n opérandes
  * situés sur la zone de pile.
  * \param[in,out] stack la zone de pile concernée.
+ * \param prim l'opérateur (primitive) à appliquer.
  * \param n le nombre d'opérandes (>=1).
- * \param op l'opérateur (primitive) à appliquer.
  */
-void do_arith_prim(varray_t *stack, int n, int op) {
+void do_arith_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   int r;
   assert(n > 0);
   // cas spécifique à un seul argument
   // (- n) == -n
   // (/ n) == 1/n
   if (n == 1) {
-    r = apply_arith_prim(op, arith_neutral(op),
+    r = apply_arith_prim(prim, arith_neutral(prim),
                          value_int_get(varray_top(stack)));
   } else {  // au moins deux arguments
     int i;
     r = value_int_get(varray_top(stack));
 
     for (i = 1; i < n; i++) {
-      r = apply_arith_prim(op, r, value_int_get(varray_top_at(stack, i)));
+      r = apply_arith_prim(prim, r, value_int_get(varray_top_at(stack, i)));
     }
     varray_popn(stack, n - 1);
   }
@@ -83,14 +92,211 @@ void do_arith_prim(varray_t *stack, int n, int op) {
   value_fill_int(varray_top(stack), r);
 }
 
+/** Points d'entrée rapides des primitives arithmétiques : deux entiers.
+ * La division par zéro (et le débordement de INT_MIN / -1) est laissée
+ * au point d'entrée général.
+ */
+#define ARITH_PRIM2(fname, op)                                   \
+  static int fname(vm_t *vm, value_t *a, value_t *b, value_t *res) { \
+    if (a->type != T_INT || b->type != T_INT) return 0;          \
+    value_fill_int(res, a->data.as_int op b->data.as_int);       \
+    return 1;                                                    \
+  }
+
+ARITH_PRIM2(prim_add2, +)
+ARITH_PRIM2(prim_sub2, -)
+ARITH_PRIM2(prim_mul2, *)
+
+static int prim_div2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  if (a->type != T_INT || b->type != T_INT || b->data.as_int == 0 ||
+      (b->data.as_int == -1 && a->data.as_int == INT_MIN)) {
+    return 0;
+  }
+  value_fill_int(res, a->data.as_int / b->data.as_int);
+  return 1;
+}
+
+/** Égalité au sens de eqv? : valeur des entiers, booléens, primitives et
+ * symboles (internés), identité pour les autres valeurs.
+ */
+static int values_eqv(value_t *a, value_t *b) {
+  if (a->type != b->type) return 0;
+  switch (a->type) {
+    case T_UNIT:
+      return 1;
+    case T_INT:
+    case T_BOOL:
+    case T_PRIM:
+      return a->data.as_int == b->data.as_int;
+    case T_FUN:
+      return a->data.as_closure.pc == b->data.as_closure.pc &&
+             a->data.as_closure.env == b->data.as_closure.env;
+    case T_CLIST:
+      return a->data.as_clist.block == b->data.as_clist.block &&
+             a->data.as_clist.index == b->data.as_clist.index;
+    default:
+      return a->data.as_pair == b->data.as_pair;
+  }
+}
+
+/** Seuil (nombre de noeuds comparés) à partir duquel equal? mémorise les
+ * couples de noeuds déjà rencontrés, pour terminer sur les structures
+ * cycliques sans pénaliser les petites comparaisons. */
+#define EQUAL_VISITED_THRESHOLD 1024
+
+/** Couple de valeurs à comparer (pile explicite de equal?). */
+typedef struct {
+  value_t a; /*!< la première valeur */
+  value_t b; /*!< la seconde valeur */
+} equal_task_t;
+
+/** Couple de noeuds (paires ou vecteurs) déjà comparés. */
+typedef struct {
+  const void *a; /*!< le premier noeud */
+  const void *b; /*!< le second noeud */
+} equal_node_t;
+
+/** Ensemble des couples de noeuds déjà comparés (adressage ouvert). */
+typedef struct {
+  equal_node_t *nodes;   /*!< les cases (NULL si libre) */
+  unsigned int capacity; /*!< le nombre de cases (puissance de 2) */
+  unsigned int count;    /*!< le nombre de couples */
+} equal_visited_t;
+
+/** Ajout d'un couple de noeuds à l'ensemble.
+ * \return 1 si le couple est nouveau, 0 s'il a déjà été rencontré.
+ */
+static int equal_visit(equal_visited_t *visited, const void *a,
+                       const void *b) {
+  unsigned int i, mask;
+
+  if (2 * (visited->count + 1) > visited->capacity) {
+    equal_visited_t bigger;
+    bigger.capacity = (visited->capacity == 0) ? 256 : 2 * visited->capacity;
+    bigger.count = 0;
+    bigger.nodes =
+        (equal_node_t *)calloc(bigger.capacity, sizeof(equal_node_t));
+    assert(bigger.nodes != NULL);
+    for (i = 0; i < visited->capacity; i++) {
+      if (visited->nodes[i].a != NULL) {
+        equal_visit(&bigger, visited->nodes[i].a, visited->nodes[i].b);
+      }
+    }
+    free(visited->nodes);
+    *visited = bigger;
+  }
+
+  mask = visited->capacity - 1;
+  i = (unsigned int)(((uintptr_t)a >> 4) * 0x9e3779b9u ^
+                     ((uintptr_t)b >> 4)) & mask;
+  while (visited->nodes[i].a != NULL) {
+    if (visited->nodes[i].a == a && visited->nodes[i].b == b) return 0;
+    i = (i + 1) & mask;
+  }
+  visited->nodes[i].a = a;
+  visited->nodes[i].b = b;
+  visited->count = visited->count + 1;
+  return 1;
+}
+
+/** Égalité structurelle (equal?) : les paires et les vecteurs sont
+ * comparés élément par élément, les chaînes et les vecteurs d'entiers
+ * par contenu, les autres valeurs comme avec eqv?.
+ * Le parcours utilise une pile explicite (pas de récursion sur les
+ * longues listes) et s'arrête dès que deux valeurs sont identiques. Au-delà
+ * de EQUAL_VISITED_THRESHOLD noeuds, un couple de noeuds déjà rencontré
+ * est supposé égal, ce qui assure la terminaison sur les structures
+ * cycliques.
+ * Aucune allocation dans le tas : le GC ne peut pas se déclencher.
+ */
+static int values_equal(value_t *x, value_t *y) {
+  equal_task_t *tasks = NULL;
+  unsigned int nb_tasks = 0, capacity = 0, steps = 0, i;
+  equal_visited_t visited = {NULL, 0, 0};
+  int r = 1;
+
+#define EQUAL_PUSH(va, vb)                                                  \
+  do {                                                                      \
+    if (nb_tasks == capacity) {                                             \
+      capacity = (capacity == 0) ? 64 : 2 * capacity;                       \
+      tasks = (equal_task_t *)realloc(tasks, sizeof(equal_task_t) * capacity); \
+      assert(tasks != NULL);                                                \
+    }                                                                       \
+    tasks[nb_tasks].a = (va);                                               \
+    tasks[nb_tasks].b = (vb);                                               \
+    nb_tasks = nb_tasks + 1;                                                \
+  } while (0)
+
+  EQUAL_PUSH(*x, *y);
+  while (r && nb_tasks > 0) {
+    value_t a, b;
+    nb_tasks = nb_tasks - 1;
+    a = tasks[nb_tasks].a;
+    b = tasks[nb_tasks].b;
+
+    if (values_eqv(&a, &b)) continue;  // identité : rien à parcourir
+    steps = steps + 1;
+
+    if (value_is_pair(&a) && value_is_pair(&b)) {
+      if (value_is_nil(&a) || value_is_nil(&b)) {
+        r = 0;
+      } else if (steps < EQUAL_VISITED_THRESHOLD ||
+                 equal_visit(&visited, value_node(&a), value_node(&b))) {
+        // le car est comparé en premier, le cdr ensuite
+        EQUAL_PUSH(value_get_cdr(&a), value_get_cdr(&b));
+        EQUAL_PUSH(*value_get_car(&a), *value_get_car(&b));
+      }
+    } else if (a.type != b.type) {
+      r = 0;
+    } else {
+      switch (a.type) {
+        case T_VECTOR: {
+          vector_t *va = a.data.as_vector, *vb = b.data.as_vector;
+          if (va->size != vb->size) {
+            r = 0;
+          } else if (steps < EQUAL_VISITED_THRESHOLD ||
+                     equal_visit(&visited, va, vb)) {
+            for (i = va->size; i > 0; i--) {
+              EQUAL_PUSH(va->content[i - 1], vb->content[i - 1]);
+            }
+          }
+        } break;
+        case T_I32VECTOR:
+          r = a.data.as_i32vector->size == b.data.as_i32vector->size &&
+              memcmp(a.data.as_i32vector->data, b.data.as_i32vector->data,
+                     a.data.as_i32vector->size * sizeof(int)) == 0;
+          break;
+        case T_STRING:
+          r = a.data.as_string->length == b.data.as_string->length &&
+              memcmp(a.data.as_string->chars, b.data.as_string->chars,
+                     a.data.as_string->length) == 0;
+          break;
+        default:
+          r = 0;  // différentes au sens de eqv?
+      }
+    }
+  }
+
+#undef EQUAL_PUSH
+
+  free(tasks);
+  free(visited.nodes);
+  return r;
+}
+
 /** Primitive d'égalité
+ * Les entiers et les booléens sont comparés par valeur, les autres valeurs
+ * par identité (comme avec eq?).
  * \param[in,out] stack la zone de pile concernée.
  */
-void do_eq_prim(varray_t *stack) {
+void do_eq_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   int r = 0;  // par défaut le résultat est faux
 
-  // Tester si les types des arguments sont égaux
-  if (varray_top_at(stack, 0)->type == varray_top_at(stack, 1)->type) {
+  // Tester si les types des arguments sont égaux (les paires compactes
+  // sont des paires comme les autres)
+  if (varray_top_at(stack, 0)->type == varray_top_at(stack, 1)->type ||
+      (value_is_pair(varray_top_at(stack, 0)) &&
+       value_is_pair(varray_top_at(stack, 1)))) {
     switch (varray_top_at(stack, 0)->type) {
         // pour les booléens et les entiers, on compare la valeur
       case T_BOOL:
@@ -98,15 +304,15 @@ void do_eq_prim(varray_t *stack) {
         r = (value_int_get(varray_top_at(stack, 0)) ==
              value_int_get(varray_top_at(stack, 1)));
         break;
-      case T_PAIR:  // pour les paires ce n'est pas encore implémenté
-        printf("Implement me: compare two pair\n");
-        abort();
+        // les symboles sont internés : on compare les pointeurs
+      case T_SYMBOL:
+        r = (varray_top_at(stack, 0)->data.as_symbol ==
+             varray_top_at(stack, 1)->data.as_symbol);
         break;
-        // pour le reste on ne peut comparer par égalité (?)
+        // pour le reste (paires, fermetures, vecteurs, chaînes...) on
+        // compare l'identité
       default:
-        printf("Unable to apply eq with type: %d\n",
-               varray_top_at(stack, 0)->type);
-        abort();
+        r = values_eqv(varray_top_at(stack, 0), varray_top_at(stack, 1));
     }
 
     // on dépile tous les arguments (moins 1).
@@ -120,10 +326,45 @@ void do_eq_prim(varray_t *stack) {
   }
 }
 
+/** Point d'entrée rapide de l'égalité (entiers, booléens et symboles). */
+static int prim_eq2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  if (a->type != b->type) return 0;
+  if (a->type == T_INT || a->type == T_BOOL) {
+    value_fill_bool(res, a->data.as_int == b->data.as_int);
+  } else if (a->type == T_SYMBOL) {
+    value_fill_bool(res, a->data.as_symbol == b->data.as_symbol);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+/** Prédicats d'égalité eq? (identité) et equal? (égalité structurelle)
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_EQP ou P_EQUALP).
+ */
+void do_equality_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *a = varray_top_at(stack, 0), *b = varray_top_at(stack, 1);
+  int r = (prim == P_EQP) ? values_eqv(a, b) : values_equal(a, b);
+  varray_popn(stack, 1);
+  value_fill_bool(varray_top(stack), r);
+}
+
+/** Points d'entrée rapides de eq? et equal?. */
+static int prim_eqp2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  value_fill_bool(res, values_eqv(a, b));
+  return 1;
+}
+
+static int prim_equalp2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  value_fill_bool(res, values_equal(a, b));
+  return 1;
+}
+
 /** Primitive de test à zéro
  * \param[in,out] stack la zone de pile concernée.
  */
-void do_zerop_prim(varray_t *stack) {
+void do_zerop_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   int r = 0;  // par défaut le résultat est faux
 
   if (varray_top_at(stack, 0)->type == T_INT) {
@@ -138,23 +379,35 @@ void do_zerop_prim(varray_t *stack) {
   }
 }
 
+/** Point d'entrée rapide du test à zéro. */
+static int prim_zerop1(vm_t *vm, value_t *a, value_t *res) {
+  if (a->type != T_INT) return 0;
+  value_fill_bool(res, a->data.as_int == 0);
+  return 1;
+}
+
 /** Primitive de display
  * \param[in,out] stack la zone de pile concernée.
  */
-void do_display_prim(varray_t *stack) {
+void do_display_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   value_t *v = varray_top(stack);
   if (v->type == T_INT) {
-    printf("%d", value_int_get(v));
+    output_int(value_int_get(v));
   } else if (v->type == T_BOOL) {
-    printf("%s", value_is_true(v) ? "#t" : "#f");
+    output_string(value_is_true(v) ? "#t" : "#f");
+  } else if (v->type == T_VECTOR || v->type == T_I32VECTOR ||
+             v->type == T_STRING || v->type == T_SYMBOL) {
+    value_display(v);
   } else {
-    printf("<type: %d>", v->type);
+    output_string("<type: ");
+    output_int(v->type);
+    output_char('>');
   }
   value_fill_unit(v);
 }
 
-void do_newline_prim(varray_t *stack) {
-  printf("\n");
+void do_newline_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  output_char('\n');
   value_t value;
   value_fill_unit(&value);
   varray_push(stack, &value);
@@ -164,7 +417,7 @@ void do_newline_prim(varray_t *stack) {
  * \param[in,out] vm l'état de la machine.
  * \param[in,out] stack la zone de pile concernée.
  */
-void do_cons_prim(vm_t *vm, varray_t *stack) {
+void do_cons_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   // C'est facile mais il faut construire la paire
   // directement dans la zone de pile pour qu'elle soit
   // accessible à tout moment par le GC.
@@ -185,115 +438,1169 @@ void do_cons_prim(vm_t *vm, varray_t *stack) {
   varray_popn(stack, 2);
 }
 
+/** Point d'entrée rapide de la construction de paire.
+ * L'allocation ne déclenche pas le GC : les arguments n'ont pas besoin
+ * d'être sur la pile.
+ */
+static int prim_cons2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  value_t pair;
+  value_fill_nil(&pair);
+  value_set_car(vm, &pair, a);
+  value_set_cdr(vm, &pair, b);
+  *res = pair;
+  return 1;
+}
+
 /** Construction de liste
+ * La liste est allouée en un seul bloc compact (cf. clist_t).
  * \param[in,out] vm l'état de la machine.
  * \param[in,out] stack la zone de pile concernée.
- * \param n le nombre d'opérandes (>=1).
+ * \param n le nombre d'opérandes.
  */
-void do_list_prim(vm_t *vm, varray_t *stack, int n) {
+void do_list_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   int i;
+  clist_t *block;
+  value_t list;
 
-  // ici la pile contient les éléments
-  // de la liste avec le dernier élément au sommet [cadddXXXr .... cadddr caddr
-  // cadr car] on ajoute deux éléments au sommet
-  varray_expandn(stack, 2);
-  // le premier est le résultat
-  value_fill_nil(varray_top_at(stack, 0));
+  if (n == 0) {
+    value_fill_nil(&list);
+    varray_push(stack, &list);
+    return;
+  }
 
-  for (i = 0; i < n; i++) {  // on itère pour tous les éléments
-    // copier le résultat (au sommet) sur le second
-    varray_set_top_at(stack, 1, varray_top_at(stack, 0));
-    // on reconstruit une liste au sommet
-    value_fill_nil(varray_top(stack));
-    // on va chercher le car en  n-i-1+2  et on le met au sommet
-    value_set_car(vm, varray_top(stack), varray_top_at(stack, n - i + 1));
-    // et le cdr est le reste de la construction (le résultat)
-    value_set_cdr(vm, varray_top(stack), varray_top_at(stack, 1));
+  // ici la pile contient les éléments de la liste avec le premier élément
+  // au sommet [car cadr caddr ...] : on les recopie dans le bloc (l'allocation
+  // ne déclenche pas le GC).
+  block = gc_alloc_clist(vm, n);
+  for (i = 0; i < n; i++) {
+    block->cars[i] = *varray_top_at(stack, i);
   }
 
-  // on copie le résultat (au sommet) à l'index n - 1 + 2
-  varray_set_top_at(stack, n + 1, varray_top(stack));
+  // il ne reste sur la pile que le résultat [res]
+  value_fill_clist(&list, block, 0);
+  varray_popn(stack, n - 1);
+  varray_set_top(stack, &list);
+}
 
-  // on a donc sur la pile: [temp1 temp2 car cadr ....  res]   (temp1 en sommet
-  // de pile) on dépile les n-1+2 premiers éléments et il reste donc sur la
-  // pile: [res]
-  varray_popn(stack, n + 1);
+/** Longueur d'une liste (propre).
+ * Les listes circulaires (cf. set-cdr!) sont détectées par l'algorithme
+ * du lièvre et de la tortue : la tortue avance d'une paire quand le
+ * parcours en avance de deux, elle rattrape le parcours dans un cycle.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] list la liste.
+ * \return le nombre d'éléments.
+ */
+static unsigned int list_length(const char *name, value_t *list) {
+  unsigned int size = 0;
+  value_t cur = *list;
+  value_t slow = *list;
+
+  while (value_is_pair(&cur) && !value_is_nil(&cur)) {
+    size = size + 1;
+    cur = value_get_cdr(&cur);
+    if ((size & 1) == 0) {
+      slow = value_get_cdr(&slow);
+      if (values_eqv(&slow, &cur)) {
+        printf("Unable to apply `%s` on a circular list\n", name);
+        abort();
+      }
+    }
+  }
+  if (!value_is_pair(&cur)) {
+    printf("Unable to apply `%s` on an improper list\n", name);
+    abort();
+  }
+  return size;
 }
 
 /** Premier élément d'une paire.
  * \param[in,out] stack la zone de pile concernée.
  */
-void do_car_prim(varray_t *stack) {
+void do_car_prim(vm_t *vm, varray_t *stack, int prim, int n) {
   varray_set_top(stack, value_get_car(varray_top(stack)));
 }
 
 /** Second élément d'une paire.
  * \param[in,out] stack la zone de pile concernée.
  */
-void do_cdr_prim(varray_t *stack) {
-  varray_set_top(stack, value_get_cdr(varray_top(stack)));
+void do_cdr_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t cdr = value_get_cdr(varray_top(stack));
+  varray_set_top(stack, &cdr);
 }
 
-/** Exécution d'une primitive.
- * Les arguments sont sur la pile du cadre d'appel (frame) courant
- * (premier argument au sommet, etc.).
- * \param[in,out] stack la zone de pile.
- * \param prim le numéro de la primitive à invoquer.
- * \param n le nombre d'arguments à dépiler.
+/** Points d'entrée rapides de car et cdr (paires non vides). */
+static int prim_car1(vm_t *vm, value_t *a, value_t *res) {
+  if (!value_is_pair(a) || value_is_nil(a)) return 0;
+  *res = *value_get_car(a);
+  return 1;
+}
+
+static int prim_cdr1(vm_t *vm, value_t *a, value_t *res) {
+  if (!value_is_pair(a) || value_is_nil(a)) return 0;
+  *res = value_get_cdr(a);
+  return 1;
+}
+
+/** Vérification qu'un argument modifié n'est pas une constante du
+ * programme (cf. GC_IMMORTAL).
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
  */
-void execute_prim(vm_t *vm, varray_t *stack, int prim, int n) {
-  switch (prim) {
-      // Les fonctions arithmétiques sont traitées d'un coup.
-    case P_ADD:
-    case P_SUB:
-    case P_MUL:
-    case P_DIV:
-      do_arith_prim(stack, n, prim);
-      break;
+static void check_mutable(const char *name, value_t *value) {
+  if (value_is_immortal(value)) {
+    printf("Unable to apply `%s` on a constant\n", name);
+    abort();
+  }
+}
 
-      // égalité
-    case P_EQ:
-      do_eq_prim(stack);
-      break;
-      break;
+/** Modification d'une paire (set-car! et set-cdr!).
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_SET_CAR ou P_SET_CDR).
+ */
+void do_set_pair_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *pair = varray_top(stack);
+  value_t value = *varray_top_at(stack, 1);
+  value_t unit;
+
+  if (!value_is_pair(pair) || value_is_nil(pair)) {
+    printf("Unable to apply `%s` with type: %d\n",
+           prim == P_SET_CAR ? "set-car!" : "set-cdr!", pair->type);
+    abort();
+  }
+  check_mutable(prim == P_SET_CAR ? "set-car!" : "set-cdr!", pair);
+  if (prim == P_SET_CAR) {
+    value_set_car(vm, pair, &value);
+  } else {
+    value_set_cdr(vm, pair, &value);
+  }
+  varray_popn(stack, 1);
+  value_fill_unit(&unit);
+  varray_set_top(stack, &unit);
+}
+
+/** Vérification du nombre d'arguments d'une primitive.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param n le nombre d'arguments.
+ * \param min le nombre minimal d'arguments.
+ * \param max le nombre maximal d'arguments (ou PRIM_VARIADIC).
+ */
+static void check_arity(const char *name, int n, int min, int max) {
+  if (n < min || (max != PRIM_VARIADIC && n > max)) {
+    printf("Unable to apply `%s` with %d args\n", name, n);
+    abort();
+  }
+}
+
+/** Tests de type des listes (null? et pair?)
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_NULLP ou P_PAIRP).
+ */
+void do_list_pred_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *x = varray_top(stack);
+  int r = value_is_pair(x) && (value_is_nil(x) == (prim == P_NULLP));
+  value_fill_bool(x, r);
+}
+
+/** Points d'entrée rapides de null? et pair?. */
+static int prim_nullp1(vm_t *vm, value_t *a, value_t *res) {
+  value_fill_bool(res, value_is_nil(a));
+  return 1;
+}
+
+static int prim_pairp1(vm_t *vm, value_t *a, value_t *res) {
+  value_fill_bool(res, value_is_pair(a) && !value_is_nil(a));
+  return 1;
+}
+
+/** Longueur d'une liste
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_length_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t length;
+  value_fill_int(&length, list_length("length", varray_top(stack)));
+  varray_set_top(stack, &length);
+}
+
+/** Concaténation de listes.
+ * Les listes (sauf la dernière, partagée) sont recopiées dans un unique
+ * bloc compact.
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param n le nombre d'arguments.
+ */
+void do_append_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  unsigned int size = 0, i = 0;
+  value_t list, cur;
+  int k;
+
+  if (n == 0) {
+    value_fill_nil(&list);
+    varray_push(stack, &list);
+    return;
+  }
+
+  for (k = 0; k < n - 1; k++) {
+    size = size + list_length("append", varray_top_at(stack, k));
+  }
+  list = *varray_top_at(stack, n - 1);  // la dernière liste
+  if (size > 0) {
+    clist_t *block = gc_alloc_clist(vm, size);
+    for (k = 0; k < n - 1; k++) {
+      for (cur = *varray_top_at(stack, k); !value_is_nil(&cur);
+           cur = value_get_cdr(&cur)) {
+        block->cars[i++] = *value_get_car(&cur);
+      }
+    }
+    block->tail = list;
+    value_fill_clist(&list, block, 0);
+  }
+  varray_popn(stack, n - 1);
+  varray_set_top(stack, &list);
+}
+
+/** Renversement d'une liste (dans un unique bloc compact)
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_reverse_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *list = varray_top(stack);
+  unsigned int size = list_length("reverse", list), i;
+  value_t res, cur;
+
+  value_fill_nil(&res);
+  if (size > 0) {
+    clist_t *block = gc_alloc_clist(vm, size);
+    for (i = size, cur = *list; i > 0; cur = value_get_cdr(&cur)) {
+      block->cars[--i] = *value_get_car(&cur);
+    }
+    value_fill_clist(&res, block, 0);
+  }
+  varray_set_top(stack, &res);
+}
+
+/** Suffixe d'une liste (list-tail) ou k-ième élément (list-ref)
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_LIST_TAIL ou P_LIST_REF).
+ */
+void do_list_tail_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  const char *name = (prim == P_LIST_TAIL) ? "list-tail" : "list-ref";
+  value_t cur = *varray_top(stack);
+  value_t *k = varray_top_at(stack, 1);
+  int i;
+
+  if (k->type != T_INT || k->data.as_int < 0) {
+    printf("Unable to apply `%s` with index type: %d\n", name, k->type);
+    abort();
+  }
+  for (i = 0; i < k->data.as_int; i++) {
+    if (!value_is_pair(&cur) || value_is_nil(&cur)) break;
+    cur = value_get_cdr(&cur);
+  }
+  if (i < k->data.as_int ||
+      (prim == P_LIST_REF && (!value_is_pair(&cur) || value_is_nil(&cur)))) {
+    printf("Index out of range in `%s`: %d\n", name, k->data.as_int);
+    abort();
+  }
+  if (prim == P_LIST_REF) {
+    cur = *value_get_car(&cur);
+  }
+  varray_popn(stack, 1);
+  varray_set_top(stack, &cur);
+}
+
+/** Application d'une fonction aux éléments de listes (map et for-each).
+ * Le résultat de map est alloué d'un coup (bloc compact de la taille de
+ * la plus courte liste) puis rempli au fur et à mesure.
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param n le nombre d'arguments (la fonction puis les listes).
+ * \param prim la primitive (P_MAP ou P_FOR_EACH).
+ */
+void do_map_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  const char *name = (prim == P_MAP) ? "map" : "for-each";
+  unsigned int size = 0, i;
+  value_t res;
+  int k;
+
+  for (k = 1; k < n; k++) {
+    unsigned int length = list_length(name, varray_top_at(stack, k));
+    if (k == 1 || length < size) size = length;
+  }
+
+  value_fill_unit(&res);
+  if (prim == P_MAP) {
+    value_fill_nil(&res);
+    if (size > 0) value_fill_clist(&res, gc_alloc_clist(vm, size), 0);
+  }
+
+  // la pile contient [... l2 l1 f res] : les arguments servent de curseurs
+  // et tout reste sur la pile pendant les appels (qui peuvent déclencher
+  // le GC ou modifier les listes)
+  varray_push(stack, &res);
+  for (i = 0; i < size; i++) {
+    for (k = n - 1; k >= 1; k--) {
+      // la liste k est à distance k + 1, plus les n - 1 - k éléments déjà
+      // empilés
+      value_t *cur = varray_top_at(stack, n);
+      value_t car;
+      if (!value_is_pair(cur) || value_is_nil(cur)) {
+        printf("List modified during `%s`\n", name);
+        abort();
+      }
+      car = *value_get_car(cur);
+      varray_push(stack, &car);
+    }
+    res = *varray_top_at(stack, n);  // la fonction
+    varray_push(stack, &res);
+    vm_apply(vm, n - 1);
+
+    // [... l1 f res r]
+    if (prim == P_MAP) {
+      res = *varray_top_at(stack, 1);
+      res.data.as_clist.block->cars[i] = *varray_top(stack);
+    }
+    varray_popn(stack, 1);
+    for (k = 1; k < n; k++) {
+      value_t *cur = varray_top_at(stack, k + 1);
+      *cur = value_get_cdr(cur);
+    }
+  }
+
+  // il ne reste que le résultat [res]
+  res = *varray_top(stack);
+  varray_popn(stack, n);
+  varray_set_top(stack, &res);
+}
+
+/** Recherche dans une liste d'association (assq et assv).
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_ASSQ ou P_ASSV).
+ */
+void do_assoc_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  const char *name = (prim == P_ASSQ) ? "assq" : "assv";
+  value_t *obj = varray_top(stack);
+  value_t cur = *varray_top_at(stack, 1), res;
 
-      // Construire une nouvelle paire.
-    case P_CONS:
-      do_cons_prim(vm, stack);
+  value_fill_false(&res);
+  for (; value_is_pair(&cur) && !value_is_nil(&cur);
+       cur = value_get_cdr(&cur)) {
+    value_t *entry = value_get_car(&cur);
+    if (!value_is_pair(entry) || value_is_nil(entry)) {
+      printf("Unable to apply `%s` on a non-association list\n", name);
+      abort();
+    }
+    if (values_eqv(obj, value_get_car(entry))) {
+      res = *entry;
       break;
+    }
+  }
+  varray_popn(stack, 1);
+  varray_set_top(stack, &res);
+}
+
+/** Recherche d'un élément dans une liste (member, au sens de equal?).
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_member_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *obj = varray_top(stack);
+  value_t cur = *varray_top_at(stack, 1), res;
+
+  value_fill_false(&res);
+  for (; value_is_pair(&cur) && !value_is_nil(&cur);
+       cur = value_get_cdr(&cur)) {
+    if (values_equal(obj, value_get_car(&cur))) {
+      res = cur;
       break;
+    }
+  }
+  varray_popn(stack, 1);
+  varray_set_top(stack, &res);
+}
+
+/** Vérification du type vecteur d'un argument.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
+ * \return le vecteur.
+ */
+static vector_t *check_vector(const char *name, value_t *value) {
+  if (!value_is_vector(value)) {
+    printf("Unable to apply `%s` with type: %d\n", name, value->type);
+    abort();
+  }
+  return value_vector_get(value);
+}
+
+/** Vérification d'un indice de vecteur.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] vector le vecteur.
+ * \param[in] value l'indice.
+ * \return l'indice.
+ */
+static unsigned int check_index(const char *name, vector_t *vector,
+                                value_t *value) {
+  if (!value_is_int(value) || value->data.as_int < 0 ||
+      (unsigned int)value->data.as_int >= vector->size) {
+    printf("Unable to apply `%s`: index out of range\n", name);
+    abort();
+  }
+  return value->data.as_int;
+}
+
+/** Construction d'un vecteur
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param n le nombre d'opérandes (taille, et valeur initiale optionnelle).
+ */
+void do_make_vector_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t fill;
+  vector_t *vector;
+  value_t *size = varray_top(stack);
+
+  if (!value_is_int(size) || size->data.as_int < 0) {
+    printf("Unable to apply `make-vector`: bad size\n");
+    abort();
+  }
+  if (n > 1) {
+    fill = *varray_top_at(stack, 1);
+  } else {
+    value_fill_unit(&fill);
+  }
+
+  // l'allocation ne déclenche pas le GC : on peut construire
+  // le vecteur avant de le placer sur la pile.
+  vector = gc_alloc_vector(vm, size->data.as_int, &fill);
+  varray_popn(stack, n - 1);
+  value_fill_vector(varray_top(stack), vector);
+}
+
+/** Accès indexé dans un vecteur
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_vector_ref_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  vector_t *vector = check_vector("vector-ref", varray_top(stack));
+  unsigned int k = check_index("vector-ref", vector, varray_top_at(stack, 1));
+
+  varray_popn(stack, 1);
+  varray_set_top(stack, &vector->content[k]);
+}
+
+/** Modification d'un élément de vecteur
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_vector_set_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  vector_t *vector = check_vector("vector-set!", varray_top(stack));
+  unsigned int k = check_index("vector-set!", vector, varray_top_at(stack, 1));
+  check_mutable("vector-set!", varray_top(stack));
 
-      // On construit une liste, donc une suite de paires:
-    case P_LIST:
-      do_list_prim(vm, stack, n);
+  vector->content[k] = *varray_top_at(stack, 2);
+  varray_popn(stack, 2);
+  value_fill_unit(varray_top(stack));
+}
+
+/** Taille d'un vecteur
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_vector_length_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  vector_t *vector = check_vector("vector-length", varray_top(stack));
+  value_fill_int(varray_top(stack), vector->size);
+}
+
+/** Points d'entrée rapides de vector-ref et vector-length. */
+static int prim_vector_ref2(vm_t *vm, value_t *a, value_t *b, value_t *res) {
+  if (!value_is_vector(a) || !value_is_int(b) || b->data.as_int < 0 ||
+      (unsigned int)b->data.as_int >= a->data.as_vector->size) {
+    return 0;
+  }
+  *res = a->data.as_vector->content[b->data.as_int];
+  return 1;
+}
+
+static int prim_vector_length1(vm_t *vm, value_t *a, value_t *res) {
+  if (!value_is_vector(a)) return 0;
+  value_fill_int(res, a->data.as_vector->size);
+  return 1;
+}
+
+/** Conversion d'un vecteur en liste (compacte)
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_vector_to_list_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  vector_t *vector = check_vector("vector->list", varray_top(stack));
+  value_t list;
+
+  value_fill_nil(&list);
+  if (vector->size > 0) {
+    clist_t *block = gc_alloc_clist(vm, vector->size);
+    memcpy(block->cars, vector->content, vector->size * sizeof(value_t));
+    value_fill_clist(&list, block, 0);
+  }
+  varray_set_top(stack, &list);
+}
+
+/** Conversion d'une liste en vecteur
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_list_to_vector_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *list = varray_top(stack);
+  value_t unit, cur;
+  vector_t *vector;
+  unsigned int size = list_length("list->vector", list), i;
+
+  value_fill_unit(&unit);
+  vector = gc_alloc_vector(vm, size, &unit);
+  for (i = 0, cur = *list; i < size; i++, cur = value_get_cdr(&cur)) {
+    vector->content[i] = *value_get_car(&cur);
+  }
+  value_fill_vector(list, vector);
+}
+
+/** Vérification du type vecteur d'entiers d'un argument.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
+ * \return le vecteur d'entiers.
+ */
+static i32vector_t *check_i32vector(const char *name, value_t *value) {
+  if (!value_is_i32vector(value)) {
+    printf("Unable to apply `%s` with type: %d\n", name, value->type);
+    abort();
+  }
+  return value_i32vector_get(value);
+}
+
+/** Vérification du type entier d'un argument.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
+ * \return l'entier.
+ */
+static int check_int(const char *name, value_t *value) {
+  if (!value_is_int(value)) {
+    printf("Unable to apply `%s` with type: %d\n", name, value->type);
+    abort();
+  }
+  return value->data.as_int;
+}
+
+/** Vérification d'un indice de vecteur d'entiers.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] vector le vecteur.
+ * \param[in] value l'indice.
+ * \return l'indice.
+ */
+static unsigned int check_i32_index(const char *name, i32vector_t *vector,
+                                    value_t *value) {
+  int k = check_int(name, value);
+  if (k < 0 || (unsigned int)k >= vector->size) {
+    printf("Unable to apply `%s`: index out of range\n", name);
+    abort();
+  }
+  return k;
+}
+
+/** Construction d'un vecteur d'entiers
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param n le nombre d'opérandes (taille, et valeur initiale optionnelle).
+ */
+void do_make_i32vector_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  int size = check_int("make-i32vector", varray_top(stack));
+  int fill = (n > 1) ? check_int("make-i32vector", varray_top_at(stack, 1)) : 0;
+
+  if (size < 0) {
+    printf("Unable to apply `make-i32vector`: bad size\n");
+    abort();
+  }
+  varray_popn(stack, n - 1);
+  value_fill_i32vector(varray_top(stack), gc_alloc_i32vector(vm, size, fill));
+}
+
+/** Accès indexé dans un vecteur d'entiers
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_i32vector_ref_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  i32vector_t *vector = check_i32vector("i32vector-ref", varray_top(stack));
+  unsigned int k =
+      check_i32_index("i32vector-ref", vector, varray_top_at(stack, 1));
+
+  varray_popn(stack, 1);
+  value_fill_int(varray_top(stack), vector->data[k]);
+}
+
+/** Points d'entrée rapides de i32vector-ref et i32vector-length. */
+static int prim_i32vector_ref2(vm_t *vm, value_t *a, value_t *b,
+                               value_t *res) {
+  if (!value_is_i32vector(a) || !value_is_int(b) || b->data.as_int < 0 ||
+      (unsigned int)b->data.as_int >= a->data.as_i32vector->size) {
+    return 0;
+  }
+  value_fill_int(res, a->data.as_i32vector->data[b->data.as_int]);
+  return 1;
+}
+
+static int prim_i32vector_length1(vm_t *vm, value_t *a, value_t *res) {
+  if (!value_is_i32vector(a)) return 0;
+  value_fill_int(res, a->data.as_i32vector->size);
+  return 1;
+}
+
+/** Taille d'un vecteur d'entiers
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_i32vector_length_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  i32vector_t *vector = check_i32vector("i32vector-length", varray_top(stack));
+  value_fill_int(varray_top(stack), vector->size);
+}
+
+/** Modification d'un élément de vecteur d'entiers
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_i32vector_set_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  i32vector_t *vector = check_i32vector("i32vector-set!", varray_top(stack));
+  unsigned int k =
+      check_i32_index("i32vector-set!", vector, varray_top_at(stack, 1));
+
+  vector->data[k] = check_int("i32vector-set!", varray_top_at(stack, 2));
+  varray_popn(stack, 2);
+  value_fill_unit(varray_top(stack));
+}
+
+/** Conversion d'un vecteur d'entiers en liste (compacte)
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_i32vector_to_list_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  i32vector_t *vector = check_i32vector("i32vector->list", varray_top(stack));
+  unsigned int i;
+  value_t list;
+
+  value_fill_nil(&list);
+  if (vector->size > 0) {
+    clist_t *block = gc_alloc_clist(vm, vector->size);
+    for (i = 0; i < vector->size; i++) {
+      value_fill_int(&block->cars[i], vector->data[i]);
+    }
+    value_fill_clist(&list, block, 0);
+  }
+  varray_set_top(stack, &list);
+}
+
+/** Conversion d'une liste d'entiers en vecteur d'entiers
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_list_to_i32vector_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *list = varray_top(stack);
+  value_t cur;
+  i32vector_t *vector;
+  unsigned int size = list_length("list->i32vector", list), i;
+
+  vector = gc_alloc_i32vector(vm, size, 0);
+  for (i = 0, cur = *list; i < size; i++, cur = value_get_cdr(&cur)) {
+    vector->data[i] = check_int("list->i32vector", value_get_car(&cur));
+  }
+  value_fill_i32vector(list, vector);
+}
+
+/** Opérations en masse sur les vecteurs d'entiers (noyaux SIMD).
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_I32VECTOR_xxx).
+ */
+void do_i32vector_bulk_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  const i32_kernels_t *kernels = i32vector_kernels();
+  i32vector_t *v = check_i32vector("i32vector", varray_top(stack));
+
+  switch (prim) {
+    case P_I32VECTOR_SUM:
+      value_fill_int(varray_top(stack), kernels->sum(v->data, v->size));
       break;
 
-      // car
-    case P_CAR:
-      do_car_prim(stack);
+    case P_I32VECTOR_FOLD_MIN:
+      if (v->size == 0) {
+        printf("Unable to apply `i32vector-fold-min` on an empty vector\n");
+        abort();
+      }
+      value_fill_int(varray_top(stack), kernels->min(v->data, v->size));
       break;
 
-      // cdr
-    case P_CDR:
-      do_cdr_prim(stack);
+    case P_I32VECTOR_SCALE:
+      kernels->scale(v->data, check_int("i32vector-scale!",
+                                        varray_top_at(stack, 1)),
+                     v->size);
+      varray_popn(stack, 1);
+      value_fill_unit(varray_top(stack));
       break;
 
-    case P_ZEROP:
-      do_zerop_prim(stack);
+    case P_I32VECTOR_DOT:
+    case P_I32VECTOR_ADD: {
+      i32vector_t *w = check_i32vector("i32vector", varray_top_at(stack, 1));
+      if (v->size != w->size) {
+        printf("Unable to apply i32vector operation: sizes differ\n");
+        abort();
+      }
+      varray_popn(stack, 1);
+      if (prim == P_I32VECTOR_DOT) {
+        value_fill_int(varray_top(stack),
+                       kernels->dot(v->data, w->data, v->size));
+      } else {
+        kernels->add(v->data, w->data, v->size);
+        value_fill_unit(varray_top(stack));
+      }
+    } break;
+  }
+}
+
+/** Vérification du type chaîne d'un argument.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
+ * \return la chaîne.
+ */
+static string_t *check_string(const char *name, value_t *value) {
+  if (!value_is_string(value)) {
+    printf("Unable to apply `%s` with type: %d\n", name, value->type);
+    abort();
+  }
+  return value_string_get(value);
+}
+
+/** Longueur d'une chaîne
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_string_length_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  string_t *string = check_string("string-length", varray_top(stack));
+  value_fill_int(varray_top(stack), string->length);
+}
+
+/** Point d'entrée rapide de string-length. */
+static int prim_string_length1(vm_t *vm, value_t *a, value_t *res) {
+  if (!value_is_string(a)) return 0;
+  value_fill_int(res, a->data.as_string->length);
+  return 1;
+}
+
+/** Caractère d'une chaîne (sous forme de code entier).
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_string_ref_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  string_t *string = check_string("string-ref", varray_top(stack));
+  int k = check_int("string-ref", varray_top_at(stack, 1));
+
+  if (k < 0 || (unsigned int)k >= string->length) {
+    printf("Unable to apply `string-ref`: index out of range\n");
+    abort();
+  }
+  varray_popn(stack, 1);
+  value_fill_int(varray_top(stack), (unsigned char)string->chars[k]);
+}
+
+/** Concaténation de chaînes
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param n le nombre d'opérandes.
+ */
+void do_string_append_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  unsigned int length = 0, pos = 0;
+  string_t *result;
+  value_t value;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    length += check_string("string-append", varray_top_at(stack, i))->length;
+  }
+
+  // l'allocation ne déclenche pas le GC : les arguments restent accessibles
+  result = gc_alloc_string(vm, length);
+  for (i = 0; i < n; i++) {
+    string_t *string = varray_top_at(stack, i)->data.as_string;
+    memcpy(result->chars + pos, string->chars, string->length);
+    pos += string->length;
+  }
+
+  value_fill_string(&value, result);
+  if (n == 0) {
+    varray_push(stack, &value);
+  } else {
+    varray_popn(stack, n - 1);
+    varray_set_top(stack, &value);
+  }
+}
+
+/** Conversion entre chaînes et symboles
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_SYMBOL_TO_STRING ou P_STRING_TO_SYMBOL).
+ */
+void do_symbol_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t *v = varray_top(stack);
+
+  if (prim == P_SYMBOL_TO_STRING) {
+    if (!value_is_symbol(v)) {
+      printf("Unable to apply `symbol->string` with type: %d\n", v->type);
+      abort();
+    }
+    // le nom du symbole est une chaîne constante (immuable)
+    value_fill_string(v, v->data.as_symbol->name);
+  } else {
+    string_t *string = check_string("string->symbol", v);
+    value_fill_symbol(v, symtab_intern(string->chars, string->length));
+  }
+}
+
+/** Vérification du type table de hachage d'un argument.
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] value l'argument.
+ * \return la table.
+ */
+static hashtable_t *check_hashtable(const char *name, value_t *value) {
+  if (value->type != T_HASHTABLE) {
+    printf("Unable to apply `%s` with type: %d\n", name, value->type);
+    abort();
+  }
+  return value->data.as_hashtable;
+}
+
+/** Calcul du code de hachage d'une clé (avec vérification).
+ * \param[in] name le nom de la primitive (pour le message d'erreur).
+ * \param[in] key la clé.
+ * \return le code de hachage.
+ */
+static unsigned int check_key(const char *name, value_t *key) {
+  unsigned int hash;
+  if (!hashtable_hash(key, &hash)) {
+    printf("Unable to apply `%s` with key type: %d\n", name, key->type);
+    abort();
+  }
+  return hash;
+}
+
+/** Construction d'une table de hachage
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ * \param n le nombre d'opérandes (capacité optionnelle).
+ */
+void do_make_hash_table_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  value_t value;
+  int capacity = (n > 0) ? check_int("make-hash-table", varray_top(stack)) : 0;
+
+  value.type = T_HASHTABLE;
+  value.data.as_hashtable =
+      gc_alloc_hashtable(vm, (capacity > 0) ? capacity : 0);
+  if (n == 0) {
+    varray_push(stack, &value);
+  } else {
+    varray_popn(stack, n - 1);
+    varray_set_top(stack, &value);
+  }
+}
+
+/** Opérations élémentaires sur les tables de hachage
+ * \param[in,out] stack la zone de pile concernée.
+ * \param prim la primitive (P_HASH_xxx).
+ * \param n le nombre d'opérandes.
+ */
+void do_hash_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  hashtable_t *table;
+  value_t *key;
+  unsigned int hash;
+
+  switch (prim) {
+    case P_HASH_REF: {
+      value_t *found;
+      table = check_hashtable("hash-ref", varray_top(stack));
+      key = varray_top_at(stack, 1);
+      found = hashtable_ref(table, key, check_key("hash-ref", key));
+      if (found != NULL) {
+        varray_set_top_at(stack, n - 1, found);
+      } else if (n < 3) {
+        // pas de valeur par défaut : #f
+        value_fill_false(varray_top_at(stack, n - 1));
+      }  // sinon la valeur par défaut est déjà en place
+      varray_popn(stack, n - 1);
+    } break;
+
+    case P_HASH_SET:
+      table = check_hashtable("hash-set!", varray_top(stack));
+      key = varray_top_at(stack, 1);
+      hash = check_key("hash-set!", key);
+      hashtable_set(table, key, hash, varray_top_at(stack, 2));
+      varray_popn(stack, 2);
+      value_fill_unit(varray_top(stack));
       break;
 
-      // display
-    case P_DISPLAY:
-      do_display_prim(stack);
+    case P_HASH_REMOVE:
+      table = check_hashtable("hash-remove!", varray_top(stack));
+      key = varray_top_at(stack, 1);
+      hashtable_remove(table, key, check_key("hash-remove!", key));
+      varray_popn(stack, 1);
+      value_fill_unit(varray_top(stack));
       break;
 
-      // newline
-    case P_NEWLINE:
-      do_newline_prim(stack);
+    case P_HASH_COUNT:
+      table = check_hashtable("hash-count", varray_top(stack));
+      value_fill_int(varray_top(stack), hashtable_count(table));
       break;
+  }
+}
 
-    default:
-      printf("unknow primitive: %d with %d args\n", prim, n);
-      abort();
+/** Réduction d'une table de hachage : (f key value acc) pour chaque
+ * élément, acc valant initialement init.
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_hash_fold_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  unsigned int pos = 0;
+  value_t key, value;
+
+  // la pile contient [table f acc ...] : tout reste sur la pile pendant
+  // les appels, qui peuvent déclencher le GC (ou modifier la table)
+  check_hashtable("hash-fold", varray_top(stack));
+
+  while (hashtable_next(varray_top(stack)->data.as_hashtable, &pos, &key,
+                        &value)) {
+    value_t acc = *varray_top_at(stack, 2), f = *varray_top_at(stack, 1);
+    varray_push(stack, &acc);
+    varray_push(stack, &value);
+    varray_push(stack, &key);
+    varray_push(stack, &f);
+    vm_apply(vm, 3);
+    // le résultat devient le nouvel accumulateur
+    varray_set_top_at(stack, 3, varray_top(stack));
+    varray_popn(stack, 1);
+  }
+
+  // on garde l'accumulateur [acc]
+  varray_popn(stack, 2);
+}
+
+/** Instantané du tas (cf. heap_snapshot.h) : (heap-snapshot fichier)
+ * retourne le nombre d'objets écrits. Le GC n'est pas déclenché : les
+ * objets inaccessibles non encore récupérés figurent dans l'instantané.
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile concernée.
+ */
+void do_heap_snapshot_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  string_t *filename = check_string("heap-snapshot", varray_top(stack));
+  unsigned int nb_objects = heap_snapshot_write(vm, filename->chars);
+  value_fill_int(varray_top(stack), nb_objects);
+}
+
+
+/** Raccourcis pour la table des primitives. */
+#define V PRIM_VARIADIC
+#define F PRIM_FOLDABLE
+#define PF (PRIM_PURE | PRIM_FOLDABLE)
+
+/** Descripteurs des primitives de base (cf. prim_init).
+ * Les primitives d'extension sont ajoutées avec prim_register.
+ */
+static const prim_desc_t prim_descs[] = {
+    {P_ADD, "+", 1, V, PF, NULL, prim_add2, do_arith_prim},
+    {P_SUB, "-", 1, V, PF, NULL, prim_sub2, do_arith_prim},
+    {P_MUL, "*", 1, V, PF, NULL, prim_mul2, do_arith_prim},
+    {P_DIV, "/", 1, V, PF, NULL, prim_div2, do_arith_prim},
+    {P_EQ, "=", 2, 2, PF, NULL, prim_eq2, do_eq_prim},
+    {P_EQP, "eq?", 2, 2, PF, NULL, prim_eqp2, do_equality_prim},
+    {P_EQUALP, "equal?", 2, 2, F, NULL, prim_equalp2, do_equality_prim},
+    {P_ZEROP, "zero?", 1, 1, PF, prim_zerop1, NULL, do_zerop_prim},
+    {P_CONS, "cons", 2, 2, 0, NULL, prim_cons2, do_cons_prim},
+    {P_LIST, "list", 0, V, 0, NULL, NULL, do_list_prim},
+    {P_CAR, "car", 1, 1, F, prim_car1, NULL, do_car_prim},
+    {P_CDR, "cdr", 1, 1, F, prim_cdr1, NULL, do_cdr_prim},
+    {P_DISPLAY, "display", 1, 1, 0, NULL, NULL, do_display_prim},
+    {P_NEWLINE, "newline", 0, 0, 0, NULL, NULL, do_newline_prim},
+
+    // vecteurs
+    {P_MAKE_VECTOR, "make-vector", 1, 2, 0, NULL, NULL,
+     do_make_vector_prim},
+    {P_VECTOR_REF, "vector-ref", 2, 2, F, NULL, prim_vector_ref2,
+     do_vector_ref_prim},
+    {P_VECTOR_SET, "vector-set!", 3, 3, 0, NULL, NULL, do_vector_set_prim},
+    {P_VECTOR_LENGTH, "vector-length", 1, 1, PF, prim_vector_length1, NULL,
+     do_vector_length_prim},
+    {P_VECTOR_TO_LIST, "vector->list", 1, 1, 0, NULL, NULL,
+     do_vector_to_list_prim},
+    {P_LIST_TO_VECTOR, "list->vector", 1, 1, 0, NULL, NULL,
+     do_list_to_vector_prim},
+
+    // vecteurs d'entiers
+    {P_MAKE_I32VECTOR, "make-i32vector", 1, 2, 0, NULL, NULL,
+     do_make_i32vector_prim},
+    {P_I32VECTOR_REF, "i32vector-ref", 2, 2, F, NULL, prim_i32vector_ref2,
+     do_i32vector_ref_prim},
+    {P_I32VECTOR_SET, "i32vector-set!", 3, 3, 0, NULL, NULL,
+     do_i32vector_set_prim},
+    {P_I32VECTOR_LENGTH, "i32vector-length", 1, 1, PF, prim_i32vector_length1,
+     NULL, do_i32vector_length_prim},
+    {P_I32VECTOR_TO_LIST, "i32vector->list", 1, 1, 0, NULL, NULL,
+     do_i32vector_to_list_prim},
+    {P_LIST_TO_I32VECTOR, "list->i32vector", 1, 1, 0, NULL, NULL,
+     do_list_to_i32vector_prim},
+    {P_I32VECTOR_SUM, "i32vector-sum", 1, 1, F, NULL, NULL,
+     do_i32vector_bulk_prim},
+    {P_I32VECTOR_DOT, "i32vector-dot", 2, 2, F, NULL, NULL,
+     do_i32vector_bulk_prim},
+    {P_I32VECTOR_ADD, "i32vector-add!", 2, 2, 0, NULL, NULL,
+     do_i32vector_bulk_prim},
+    {P_I32VECTOR_SCALE, "i32vector-scale!", 2, 2, 0, NULL, NULL,
+     do_i32vector_bulk_prim},
+    {P_I32VECTOR_FOLD_MIN, "i32vector-fold-min", 1, 1, F, NULL, NULL,
+     do_i32vector_bulk_prim},
+
+    // chaînes et symboles
+    {P_STRING_LENGTH, "string-length", 1, 1, PF, prim_string_length1, NULL,
+     do_string_length_prim},
+    {P_STRING_REF, "string-ref", 2, 2, PF, NULL, NULL, do_string_ref_prim},
+    {P_STRING_APPEND, "string-append", 0, V, 0, NULL, NULL,
+     do_string_append_prim},
+    {P_SYMBOL_TO_STRING, "symbol->string", 1, 1, PF, NULL, NULL,
+     do_symbol_prim},
+    {P_STRING_TO_SYMBOL, "string->symbol", 1, 1, PF, NULL, NULL,
+     do_symbol_prim},
+
+    // tables de hachage
+    {P_MAKE_HASH_TABLE, "make-hash-table", 0, 1, 0, NULL, NULL,
+     do_make_hash_table_prim},
+    {P_HASH_REF, "hash-ref", 2, 3, 0, NULL, NULL, do_hash_prim},
+    {P_HASH_SET, "hash-set!", 3, 3, 0, NULL, NULL, do_hash_prim},
+    {P_HASH_REMOVE, "hash-remove!", 2, 2, 0, NULL, NULL, do_hash_prim},
+    {P_HASH_COUNT, "hash-count", 1, 1, 0, NULL, NULL, do_hash_prim},
+    {P_HASH_FOLD, "hash-fold", 3, 3, 0, NULL, NULL, do_hash_fold_prim},
+
+    // mutation des paires
+    {P_SET_CAR, "set-car!", 2, 2, 0, NULL, NULL, do_set_pair_prim},
+    {P_SET_CDR, "set-cdr!", 2, 2, 0, NULL, NULL, do_set_pair_prim},
+
+    // bibliothèque de listes
+    {P_LENGTH, "length", 1, 1, F, NULL, NULL, do_length_prim},
+    {P_APPEND, "append", 0, V, 0, NULL, NULL, do_append_prim},
+    {P_REVERSE, "reverse", 1, 1, 0, NULL, NULL, do_reverse_prim},
+    {P_LIST_TAIL, "list-tail", 2, 2, F, NULL, NULL, do_list_tail_prim},
+    {P_LIST_REF, "list-ref", 2, 2, F, NULL, NULL, do_list_tail_prim},
+    {P_MAP, "map", 2, V, 0, NULL, NULL, do_map_prim},
+    {P_FOR_EACH, "for-each", 2, V, 0, NULL, NULL, do_map_prim},
+    {P_ASSQ, "assq", 2, 2, F, NULL, NULL, do_assoc_prim},
+    {P_ASSV, "assv", 2, 2, F, NULL, NULL, do_assoc_prim},
+    {P_MEMBER, "member", 2, 2, F, NULL, NULL, do_member_prim},
+    {P_NULLP, "null?", 1, 1, PF, prim_nullp1, NULL, do_list_pred_prim},
+    {P_PAIRP, "pair?", 1, 1, PF, prim_pairp1, NULL, do_list_pred_prim},
+
+    // mémoire
+    {P_HEAP_SNAPSHOT, "heap-snapshot", 1, 1, 0, NULL, NULL,
+     do_heap_snapshot_prim},
+};
+
+#undef V
+#undef F
+#undef PF
+
+/** Table des primitives enregistrées, indexée par numéro (une entrée
+ * dont le point d'entrée général est NULL est libre). */
+static prim_desc_t *prim_table = NULL;
+
+/** Taille de la table des primitives. */
+static int prim_table_size = 0;
+
+/** Initialisation de la table avec les primitives de base. */
+void prim_init(void) {
+  unsigned int i;
+  for (i = 0; i < sizeof(prim_descs) / sizeof(prim_descs[0]); i++) {
+    prim_register(&prim_descs[i]);
+  }
+}
+
+/** Libération de la table des primitives. */
+void prim_destroy(void) {
+  free(prim_table);
+  prim_table = NULL;
+  prim_table_size = 0;
+}
+
+/** Enregistrement d'une primitive.
+ * Le descripteur est recopié dans la table : il n'a pas besoin de rester
+ * valide après l'appel (mais le nom, si).
+ * \param[in] desc le descripteur de la primitive.
+ */
+void prim_register(const prim_desc_t *desc) {
+  if (desc->number < 0 || desc->fun == NULL || desc->min_args < 0 ||
+      (desc->max_args != PRIM_VARIADIC && desc->max_args < desc->min_args)) {
+    fprintf(stderr, "Invalid primitive descriptor: %s\n", desc->name);
+    exit(EXIT_FAILURE);
+  }
+  if (prim_get(desc->number) != NULL) {
+    fprintf(stderr, "Primitive %d already registered (%s)\n", desc->number,
+            desc->name);
+    exit(EXIT_FAILURE);
+  }
+
+  if (desc->number >= prim_table_size) {
+    int size = (prim_table_size == 0) ? 2 * P_NATIVE_BASE : prim_table_size;
+    while (size <= desc->number) size = size * 2;
+    prim_table =
+        (prim_desc_t *)realloc(prim_table, sizeof(prim_desc_t) * size);
+    assert(prim_table != NULL);
+    memset(prim_table + prim_table_size, 0,
+           sizeof(prim_desc_t) * (size - prim_table_size));
+    prim_table_size = size;
+  }
+  prim_table[desc->number] = *desc;
+}
+
+/** Descripteur d'une primitive.
+ * \param prim le numéro de la primitive.
+ * \return le descripteur, ou NULL si la primitive est inconnue.
+ */
+const prim_desc_t *prim_get(int prim) {
+  if (prim < 0 || prim >= prim_table_size || prim_table[prim].fun == NULL) {
+    return NULL;
+  }
+  return &prim_table[prim];
+}
+
+/** Recherche d'une primitive par son nom (pour l'assembleur, cf.
+ * assembler.h).
+ * \param[in] name le nom de la primitive.
+ * \return le numéro de la primitive, ou -1 si elle est inconnue.
+ */
+int prim_lookup(const char *name) {
+  int i;
+  for (i = 0; i < prim_table_size; i++) {
+    if (prim_table[i].fun != NULL && strcmp(prim_table[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/** Exécution d'une primitive.
+ * Les arguments sont sur la pile du cadre d'appel (frame) courant
+ * (premier argument au sommet, etc.). L'arité est vérifiée d'après le
+ * descripteur, puis on essaie le point d'entrée rapide correspondant au
+ * nombre d'arguments avant le point d'entrée général.
+ * \param[in,out] stack la zone de pile.
+ * \param prim le numéro de la primitive à invoquer.
+ * \param n le nombre d'arguments à dépiler.
+ */
+void execute_prim(vm_t *vm, varray_t *stack, int prim, int n) {
+  const prim_desc_t *desc = prim_get(prim);
+  value_t res;
+
+  if (desc == NULL) {
+    printf("unknow primitive: %d with %d args\n", prim, n);
+    abort();
+  }
+  check_arity(desc->name, n, desc->min_args, desc->max_args);
+  SVM_PROBE_PRIM_ENTRY(prim, n, desc->name);
+  vm->stats.prim_calls = vm->stats.prim_calls + 1;
+
+  if (n == 1 && desc->prim1 != NULL &&
+      desc->prim1(vm, varray_top(stack), &res)) {
+    varray_set_top(stack, &res);
+  } else if (n == 2 && desc->prim2 != NULL &&
+             desc->prim2(vm, varray_top(stack), varray_top_at(stack, 1),
+                         &res)) {
+    varray_popn(stack, 1);
+    varray_set_top(stack, &res);
+  } else {
+    desc->fun(vm, stack, prim, n);
   }
 }
@@ -4,6 +4,131 @@
 #include "varray.h"
 #include "vm.h"
 
+/* Primitives natives de la VM.
+ * Elles ne font pas partie des constantes générées par le compilateur
+ * (cf. constants.h) : elles sont numérotées à partir de P_NATIVE_BASE. */
+#define P_NATIVE_BASE 100
+#define P_MAKE_VECTOR (P_NATIVE_BASE + 0)   /*!< (make-vector n [fill]) */
+#define P_VECTOR_REF (P_NATIVE_BASE + 1)    /*!< (vector-ref v k) */
+#define P_VECTOR_SET (P_NATIVE_BASE + 2)    /*!< (vector-set! v k x) */
+#define P_VECTOR_LENGTH (P_NATIVE_BASE + 3) /*!< (vector-length v) */
+#define P_VECTOR_TO_LIST (P_NATIVE_BASE + 4) /*!< (vector->list v) */
+#define P_LIST_TO_VECTOR (P_NATIVE_BASE + 5) /*!< (list->vector l) */
+
+/* vecteurs d'entiers (cf. i32vector.h) */
+#define P_MAKE_I32VECTOR (P_NATIVE_BASE + 6) /*!< (make-i32vector n [fill]) */
+#define P_I32VECTOR_REF (P_NATIVE_BASE + 7)  /*!< (i32vector-ref v k) */
+#define P_I32VECTOR_SET (P_NATIVE_BASE + 8)  /*!< (i32vector-set! v k x) */
+#define P_I32VECTOR_LENGTH (P_NATIVE_BASE + 9) /*!< (i32vector-length v) */
+#define P_I32VECTOR_TO_LIST (P_NATIVE_BASE + 10) /*!< (i32vector->list v) */
+#define P_LIST_TO_I32VECTOR (P_NATIVE_BASE + 11) /*!< (list->i32vector l) */
+#define P_I32VECTOR_SUM (P_NATIVE_BASE + 12)     /*!< (i32vector-sum v) */
+#define P_I32VECTOR_DOT (P_NATIVE_BASE + 13)     /*!< (i32vector-dot v w) */
+#define P_I32VECTOR_ADD (P_NATIVE_BASE + 14)     /*!< (i32vector-add! v w) */
+#define P_I32VECTOR_SCALE (P_NATIVE_BASE + 15)   /*!< (i32vector-scale! v k) */
+#define P_I32VECTOR_FOLD_MIN (P_NATIVE_BASE + 16) /*!< (i32vector-fold-min v) */
+
+/* chaînes et symboles (cf. symtab.h) */
+#define P_STRING_LENGTH (P_NATIVE_BASE + 17)  /*!< (string-length s) */
+#define P_STRING_REF (P_NATIVE_BASE + 18)     /*!< (string-ref s k) */
+#define P_STRING_APPEND (P_NATIVE_BASE + 19)  /*!< (string-append s ...) */
+#define P_SYMBOL_TO_STRING (P_NATIVE_BASE + 20) /*!< (symbol->string x) */
+#define P_STRING_TO_SYMBOL (P_NATIVE_BASE + 21) /*!< (string->symbol s) */
+
+/* tables de hachage (cf. hashtable.h) */
+#define P_MAKE_HASH_TABLE (P_NATIVE_BASE + 22) /*!< (make-hash-table [n]) */
+#define P_HASH_REF (P_NATIVE_BASE + 23)    /*!< (hash-ref t k [default]) */
+#define P_HASH_SET (P_NATIVE_BASE + 24)    /*!< (hash-set! t k v) */
+#define P_HASH_REMOVE (P_NATIVE_BASE + 25) /*!< (hash-remove! t k) */
+#define P_HASH_COUNT (P_NATIVE_BASE + 26)  /*!< (hash-count t) */
+#define P_HASH_FOLD (P_NATIVE_BASE + 27)   /*!< (hash-fold t f init) */
+
+/* mutation des paires */
+#define P_SET_CAR (P_NATIVE_BASE + 28) /*!< (set-car! p x) */
+#define P_SET_CDR (P_NATIVE_BASE + 29) /*!< (set-cdr! p x) */
+
+/* bibliothèque de listes */
+#define P_LENGTH (P_NATIVE_BASE + 30)    /*!< (length l) */
+#define P_APPEND (P_NATIVE_BASE + 31)    /*!< (append l ...) */
+#define P_REVERSE (P_NATIVE_BASE + 32)   /*!< (reverse l) */
+#define P_LIST_TAIL (P_NATIVE_BASE + 33) /*!< (list-tail l k) */
+#define P_LIST_REF (P_NATIVE_BASE + 34)  /*!< (list-ref l k) */
+#define P_MAP (P_NATIVE_BASE + 35)       /*!< (map f l ...) */
+#define P_FOR_EACH (P_NATIVE_BASE + 36)  /*!< (for-each f l ...) */
+#define P_ASSQ (P_NATIVE_BASE + 37)      /*!< (assq x alist) */
+#define P_ASSV (P_NATIVE_BASE + 38)      /*!< (assv x alist) */
+#define P_MEMBER (P_NATIVE_BASE + 39)    /*!< (member x l) */
+#define P_NULLP (P_NATIVE_BASE + 40)     /*!< (null? x) */
+#define P_PAIRP (P_NATIVE_BASE + 41)     /*!< (pair? x) */
+
+/* égalités */
+#define P_EQP (P_NATIVE_BASE + 42)    /*!< (eq? x y) : identité */
+#define P_EQUALP (P_NATIVE_BASE + 43) /*!< (equal? x y) : structurelle */
+
+/* mémoire (cf. heap_snapshot.h) */
+#define P_HEAP_SNAPSHOT (P_NATIVE_BASE + 44) /*!< (heap-snapshot file) */
+
+/* Primitives d'extension (cf. extension.h) : numérotées au chargement des
+ * modules à partir de P_EXTENSION_BASE, le bytecode les désigne par leur
+ * nom. */
+#define P_EXTENSION_BASE 1000
+
+/** Point d'entrée général d'une primitive.
+ * Les arguments sont sur la pile (premier argument au sommet) et la
+ * primitive les remplace par son résultat.
+ * \param[in,out] vm l'état de la machine.
+ * \param[in,out] stack la zone de pile.
+ * \param prim le numéro de la primitive (une même fonction peut servir
+ * à plusieurs primitives).
+ * \param n le nombre d'arguments (dans les bornes du descripteur).
+ */
+typedef void (*prim_fun_t)(vm_t *vm, varray_t *stack, int prim, int n);
+
+/** Points d'entrée rapides à un et deux arguments.
+ * Les arguments sont passés directement (sans passer par la pile) et le
+ * résultat est écrit dans res. Ces fonctions ne traitent que les cas
+ * simples : elles retournent 0, sans rien modifier, si le calcul doit
+ * passer par le point d'entrée général (types inattendus, erreurs).
+ * Pour les primitives "pliables" (PRIM_FOLDABLE), vm vaut NULL lors du
+ * calcul au chargement (cf. loader.h).
+ */
+typedef int (*prim1_fun_t)(vm_t *vm, value_t *a, value_t *res);
+typedef int (*prim2_fun_t)(vm_t *vm, value_t *a, value_t *b, value_t *res);
+
+/** Nombre d'arguments non borné (cf. prim_desc_t). */
+#define PRIM_VARIADIC (-1)
+
+/* Propriétés des primitives (cf. prim_desc_t).
+ * Une primitive qui alloue (cons, make-vector, ...) n'est pas pure : deux
+ * appels retournent des objets distincts. Les accesseurs (car,
+ * vector-ref, ...) ne le sont pas non plus : leur résultat dépend du
+ * contenu courant des objets désignés par les arguments (cf. set-car!,
+ * vector-set!). Ils restent pliables : les constantes du programme sont
+ * immortelles et les primitives de modification les refusent. */
+#define PRIM_PURE 1 /*!< sans effet de bord ni allocation, résultat fonction
+                       des seules valeurs des arguments */
+#define PRIM_FOLDABLE 2 /*!< sans effet de bord ni allocation : calculable
+                           au chargement sur des arguments constants */
+
+/** Descripteur d'une primitive. */
+typedef struct {
+  int number;       /*!< le numéro de la primitive */
+  const char *name; /*!< son nom */
+  int min_args;     /*!< le nombre minimal d'arguments */
+  int max_args;     /*!< le nombre maximal d'arguments (ou PRIM_VARIADIC) */
+  int flags;        /*!< les propriétés (PRIM_xxx) */
+  prim1_fun_t prim1; /*!< le point d'entrée rapide à un argument (ou NULL) */
+  prim2_fun_t prim2; /*!< le point d'entrée rapide à deux arguments
+                        (ou NULL) */
+  prim_fun_t fun;    /*!< le point d'entrée général */
+} prim_desc_t;
+
+void prim_init(void);
+void prim_destroy(void);
+void prim_register(const prim_desc_t *desc);
+const prim_desc_t *prim_get(int prim);
+int prim_lookup(const char *name);
+
 /** Exécution d'une primitive.
  * Les arguments sont sur la pile du cadre d'appel (frame) courant
  * (premier argument au sommet, etc.).
@@ -13,4 +138,4 @@
  */
 void execute_prim(vm_t *vm, varray_t *stack, int prim, int n);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,77 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _PROBES_H_
+#define _PROBES_H_
+
+/** \file probes.h
+ * Points de trace statiques (USDT) du fournisseur `svm`.
+ *
+ * Avec l'entête <sys/sdt.h> de SystemTap (paquet systemtap-sdt-dev), chaque
+ * point est une instruction NOP décrite dans la section ELF .note.stapsdt :
+ * bpftrace, perf ou SystemTap peuvent s'y attacher sans recompiler, et il ne
+ * coûte rien (hors calcul des arguments) tant qu'il n'est pas activé. Sans
+ * l'entête, ou compilés avec -DSVM_NO_PROBES, les points disparaissent.
+ *
+ * Les points (et leurs arguments) :
+ *  - function__entry (pc d'entrée de la fermeture, nombre d'arguments) :
+ *    appel d'une fermeture, tous moteurs confondus (et vm_apply) ;
+ *  - function__return (pc d'entrée de la fonction) : retour de fermeture ;
+ *  - prim__entry (numéro, nombre d'arguments, nom) : appel d'une primitive
+ *    par execute_prim (les cas rapides des moteurs tos et reg n'y passent
+ *    pas) ;
+ *  - gc__start (objets alloués) et gc__done (objets vivants) : début et fin
+ *    d'une récupération mémoire ;
+ *  - alloc (type T_xxx, taille en octets) : allocation d'une paire ou d'un
+ *    environnement.
+ *
+ * Des scripts bpftrace d'exemple se trouvent dans le répertoire `trace/`.
+ */
+
+#if !defined(SVM_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SVM_PROBES 1
+#endif
+#endif
+
+#ifdef SVM_PROBES
+
+#define SVM_PROBE_FUNCTION_ENTRY(fun_pc, nb_args) \
+  DTRACE_PROBE2(svm, function__entry, fun_pc, nb_args)
+#define SVM_PROBE_FUNCTION_RETURN(fun_pc) \
+  DTRACE_PROBE1(svm, function__return, fun_pc)
+#define SVM_PROBE_PRIM_ENTRY(prim, nb_args, name) \
+  DTRACE_PROBE3(svm, prim__entry, prim, nb_args, name)
+#define SVM_PROBE_GC_START(nb_objects) DTRACE_PROBE1(svm, gc__start, nb_objects)
+#define SVM_PROBE_GC_DONE(nb_objects) DTRACE_PROBE1(svm, gc__done, nb_objects)
+#define SVM_PROBE_ALLOC(type, size) DTRACE_PROBE2(svm, alloc, type, size)
+
+#else
+
+#define SVM_PROBE_FUNCTION_ENTRY(fun_pc, nb_args) \
+  do {                                            \
+  } while (0)
+#define SVM_PROBE_FUNCTION_RETURN(fun_pc) \
+  do {                                    \
+  } while (0)
+#define SVM_PROBE_PRIM_ENTRY(prim, nb_args, name) \
+  do {                                            \
+  } while (0)
+#define SVM_PROBE_GC_START(nb_objects) \
+  do {                                 \
+  } while (0)
+#define SVM_PROBE_GC_DONE(nb_objects) \
+  do {                                \
+  } while (0)
+#define SVM_PROBE_ALLOC(type, size) \
+  do {                              \
+  } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "profile.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** \file profile.c
+ * Comptages du profileur et rapport de fin d'exécution.
+ ******/
+
+/** Le nombre d'instructions les plus exécutées affichées dans le rapport. */
+#define PROFILE_HOT_INSTRS 20
+
+/** Le nombre maximal d'opcodes distincts (cf. constants.h et bytecode.h). */
+#define PROFILE_MAX_OPCODES 64
+
+/** Entrée d'un classement (fonction, opcode ou pc). */
+typedef struct {
+  int key;                  /*!< la fonction, l'opcode ou le pc */
+  unsigned long long count; /*!< le coût */
+} profile_entry_t;
+
+/** Date courante (horloge monotone, en nanosecondes). */
+static unsigned long long profile_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull +
+         (unsigned long long)ts.tv_nsec;
+}
+
+/** Création d'un profileur.
+ * \param[in] program le programme à profiler.
+ * \return le profileur (sans appel en cours).
+ */
+profile_t *profile_create(program_t *program) {
+  profile_t *profile = (profile_t *)malloc(sizeof(profile_t));
+  assert(profile != NULL);
+
+  profile->program = program;
+  profile->pc_counts =
+      (unsigned long long *)calloc(program->size, sizeof(unsigned long long));
+  profile->funs = (profile_fun_t *)calloc(program->size, sizeof(profile_fun_t));
+  assert(profile->pc_counts != NULL && profile->funs != NULL);
+  profile->calls_capacity = 64;
+  profile->calls = (profile_call_t *)malloc(sizeof(profile_call_t) *
+                                            profile->calls_capacity);
+  assert(profile->calls != NULL);
+  profile->nb_calls = 0;
+  profile->total_instrs = 0;
+
+  return profile;
+}
+
+/** Libération d'un profileur. */
+void profile_destroy(profile_t *profile) {
+  free(profile->pc_counts);
+  free(profile->funs);
+  free(profile->calls);
+  free(profile);
+}
+
+/** Comptage d'une instruction exécutée (dans la fonction courante).
+ * \param[in,out] profile le profileur.
+ * \param pc le pc de l'instruction.
+ */
+void profile_instr(profile_t *profile, unsigned int pc) {
+  profile_call_t *call = &profile->calls[profile->nb_calls - 1];
+  profile->pc_counts[pc] = profile->pc_counts[pc] + 1;
+  profile->funs[call->fun_pc].self_instrs =
+      profile->funs[call->fun_pc].self_instrs + 1;
+  profile->total_instrs = profile->total_instrs + 1;
+}
+
+/** Entrée dans une fonction.
+ * \param[in,out] profile le profileur.
+ * \param fun_pc le pc d'entrée de la fonction (0 pour le top-niveau).
+ */
+void profile_call(profile_t *profile, unsigned int fun_pc) {
+  profile_call_t *call;
+
+  if (profile->nb_calls == profile->calls_capacity) {
+    profile->calls_capacity = 2 * profile->calls_capacity;
+    profile->calls = (profile_call_t *)realloc(
+        profile->calls, sizeof(profile_call_t) * profile->calls_capacity);
+    assert(profile->calls != NULL);
+  }
+  call = &profile->calls[profile->nb_calls];
+  profile->nb_calls = profile->nb_calls + 1;
+
+  call->fun_pc = fun_pc;
+  call->start_instrs = profile->total_instrs;
+  call->child_ns = 0;
+  profile->funs[fun_pc].calls = profile->funs[fun_pc].calls + 1;
+  profile->funs[fun_pc].active = profile->funs[fun_pc].active + 1;
+  call->start_ns = profile_now();
+}
+
+/** Sortie de la fonction courante.
+ * Les coûts inclusifs d'une fonction récursive ne sont comptés que pour
+ * son activation la plus externe.
+ * \param[in,out] profile le profileur.
+ */
+void profile_return(profile_t *profile) {
+  unsigned long long elapsed;
+  profile_call_t *call;
+  profile_fun_t *fun;
+
+  assert(profile->nb_calls > 0);
+  profile->nb_calls = profile->nb_calls - 1;
+  call = &profile->calls[profile->nb_calls];
+  fun = &profile->funs[call->fun_pc];
+
+  elapsed = profile_now() - call->start_ns;
+  fun->self_ns = fun->self_ns + (elapsed - call->child_ns);
+  fun->active = fun->active - 1;
+  if (fun->active == 0) {
+    fun->incl_instrs =
+        fun->incl_instrs + (profile->total_instrs - call->start_instrs);
+    fun->incl_ns = fun->incl_ns + elapsed;
+  }
+  if (profile->nb_calls > 0) {
+    profile_call_t *caller = &profile->calls[profile->nb_calls - 1];
+    caller->child_ns = caller->child_ns + elapsed;
+  }
+}
+
+/** Comparaison des entrées d'un classement (par coût décroissant). */
+static int profile_compare(const void *a, const void *b) {
+  const profile_entry_t *ea = (const profile_entry_t *)a;
+  const profile_entry_t *eb = (const profile_entry_t *)b;
+  if (ea->count != eb->count) {
+    return (ea->count > eb->count) ? -1 : 1;
+  }
+  return ea->key - eb->key;
+}
+
+/** Pourcentage du nombre total d'instructions. */
+static double profile_percent(profile_t *profile, unsigned long long count) {
+  if (profile->total_instrs == 0) return 0.0;
+  return 100.0 * (double)count / (double)profile->total_instrs;
+}
+
+/** Rapport du profileur (sur la sortie standard), trié par coût.
+ * \param[in] profile le profileur (sans appel en cours).
+ */
+void profile_report(profile_t *profile) {
+  program_t *program = profile->program;
+  profile_entry_t *entries = (profile_entry_t *)malloc(
+      sizeof(profile_entry_t) * (program->size + 1));
+  profile_entry_t opcodes[PROFILE_MAX_OPCODES];
+  int nb_entries = 0, nb_opcodes = 0, i, j;
+  unsigned int pc;
+
+  assert(entries != NULL);
+
+  printf("=== Profile: %llu instructions, %.3f ms\n", profile->total_instrs,
+         profile->funs[0].incl_ns / 1e6);
+
+  // les fonctions, par instructions exclusives
+  for (pc = 0; pc < program->size; pc++) {
+    if (profile->funs[pc].calls > 0) {
+      entries[nb_entries].key = pc;
+      entries[nb_entries].count = profile->funs[pc].self_instrs;
+      nb_entries = nb_entries + 1;
+    }
+  }
+  qsort(entries, nb_entries, sizeof(profile_entry_t), profile_compare);
+  printf("--- Functions (by exclusive instructions)\n");
+  printf("%12s %14s %6s %14s %10s %10s  %s\n", "calls", "self-instrs", "%",
+         "incl-instrs", "self-ms", "incl-ms", "function");
+  for (i = 0; i < nb_entries; i++) {
+    profile_fun_t *fun = &profile->funs[entries[i].key];
+    printf("%12llu %14llu %5.1f%% %14llu %10.3f %10.3f  ", fun->calls,
+           fun->self_instrs, profile_percent(profile, fun->self_instrs),
+           fun->incl_instrs, fun->self_ns / 1e6, fun->incl_ns / 1e6);
+    if (entries[i].key == 0) {
+      printf("<toplevel>\n");
+    } else {
+      printf("fun@%d\n", entries[i].key);
+    }
+  }
+
+  // les opcodes
+  for (pc = 0; pc < program->size; pc++) {
+    int opcode = program->bytecode[pc];
+    if (profile->pc_counts[pc] == 0) continue;
+    for (j = 0; j < nb_opcodes && opcodes[j].key != opcode; j++) {
+    }
+    if (j == nb_opcodes) {
+      assert(nb_opcodes < PROFILE_MAX_OPCODES);
+      opcodes[j].key = opcode;
+      opcodes[j].count = 0;
+      nb_opcodes = nb_opcodes + 1;
+    }
+    opcodes[j].count = opcodes[j].count + profile->pc_counts[pc];
+  }
+  qsort(opcodes, nb_opcodes, sizeof(profile_entry_t), profile_compare);
+  printf("--- Opcodes\n");
+  printf("%14s %6s  %s\n", "count", "%", "opcode");
+  for (i = 0; i < nb_opcodes; i++) {
+    printf("%14llu %5.1f%%  %s\n", opcodes[i].count,
+           profile_percent(profile, opcodes[i].count),
+           bytecode_instr_name(opcodes[i].key));
+  }
+
+  // les instructions les plus exécutées
+  nb_entries = 0;
+  for (pc = 0; pc < program->size; pc++) {
+    if (profile->pc_counts[pc] > 0) {
+      entries[nb_entries].key = pc;
+      entries[nb_entries].count = profile->pc_counts[pc];
+      nb_entries = nb_entries + 1;
+    }
+  }
+  qsort(entries, nb_entries, sizeof(profile_entry_t), profile_compare);
+  printf("--- Hottest instructions\n");
+  printf("%14s %6s  %s\n", "count", "%", "pc: instruction");
+  for (i = 0; i < nb_entries && i < PROFILE_HOT_INSTRS; i++) {
+    printf("%14llu %5.1f%%  %d: ", entries[i].count,
+           profile_percent(profile, entries[i].count), entries[i].key);
+    bytecode_print_instr(program, entries[i].key);
+  }
+  printf("===================\n");
+
+  free(entries);
+}
@@ -0,0 +1,66 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/** \file profile.h
+ * Profileur d'instructions (option `--profile`).
+ *
+ * Le profileur compte les exécutions de chaque instruction (par pc, et
+ * donc par opcode) et, pour chaque fonction (identifiée par le pc
+ * d'entrée de ses fermetures), le nombre d'appels, les instructions
+ * exécutées dans la fonction elle-même (exclusives) ou dans ses appels
+ * (inclusives), ainsi que le temps correspondant (clock_gettime à chaque
+ * appel et retour). Le code du top-niveau est compté comme une fonction
+ * d'entrée 0.
+ *
+ * Le profilage passe par une boucle d'exécution instrumentée du moteur
+ * standard (cf. vm_execute) : la boucle normale et les autres moteurs
+ * n'en paient pas le coût.
+ */
+
+#include "bytecode.h"
+
+/** Statistiques d'une fonction. */
+typedef struct {
+  unsigned long long calls;       /*!< le nombre d'appels */
+  unsigned long long self_instrs; /*!< les instructions exclusives */
+  unsigned long long incl_instrs; /*!< les instructions inclusives */
+  unsigned long long self_ns;     /*!< le temps exclusif (ns) */
+  unsigned long long incl_ns;     /*!< le temps inclusif (ns) */
+  unsigned int active; /*!< le nombre d'activations en cours (récursion) */
+} profile_fun_t;
+
+/** Appel en cours (pile d'appels du profileur). */
+typedef struct {
+  unsigned int fun_pc;             /*!< le pc d'entrée de la fonction */
+  unsigned long long start_instrs; /*!< les instructions avant l'appel */
+  unsigned long long start_ns;     /*!< la date de l'appel (ns) */
+  unsigned long long child_ns;     /*!< le temps passé dans les appels */
+} profile_call_t;
+
+/** État du profileur. */
+typedef struct _profile {
+  program_t *program;              /*!< le programme profilé */
+  unsigned long long *pc_counts;   /*!< les exécutions par pc */
+  profile_fun_t *funs;             /*!< les fonctions, par pc d'entrée */
+  profile_call_t *calls;           /*!< la pile des appels en cours */
+  unsigned int nb_calls;           /*!< la hauteur de la pile d'appels */
+  unsigned int calls_capacity;     /*!< la taille de la pile d'appels */
+  unsigned long long total_instrs; /*!< le nombre total d'instructions */
+} profile_t;
+
+profile_t *profile_create(program_t *program);
+void profile_destroy(profile_t *profile);
+
+void profile_instr(profile_t *profile, unsigned int pc);
+void profile_call(profile_t *profile, unsigned int fun_pc);
+void profile_return(profile_t *profile);
+void profile_report(profile_t *profile);
+
+#endif
@@ -0,0 +1,239 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "regvm.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "output.h"
+#include "prim.h"
+#include "probes.h"
+#include "vm.h"
+
+/** \file regvm.c
+ * Moteur d'exécution du code registre (cf. regvm.h).
+ *
+ * Chaque instruction fixe la hauteur de la pile de la VM à la base du
+ * cadre d'appel plus le nombre de registres utilisés (champ depth). Les
+ * registres qui n'ont pas encore été écrits contiennent la valeur unit,
+ * ce qui permet au GC de tracer la pile comme avec le moteur à pile.
+ ******/
+
+/** Fixer la hauteur de la pile de la VM.
+ * Les nouvelles cases sont initialisées à unit.
+ */
+static void reg_set_top(varray_t *stack, unsigned int top) {
+  if (top > stack->top) {
+    unsigned int i = stack->top;
+    varray_expandn(stack, top - stack->top);
+    for (; i < top; i++) {
+      value_fill_unit(&stack->content[i]);
+    }
+  } else {
+    stack->top = top;
+  }
+}
+
+/** Lecture d'un opérande.
+ * \param[in] vm l'état de la machine virtuelle.
+ * \param base la base du cadre d'appel (registre 0).
+ * \param[in] op l'opérande.
+ * \return un pointeur sur la valeur de l'opérande (à recopier avant de
+ * modifier la pile).
+ */
+static value_t *reg_read(vm_t *vm, unsigned int base, roperand_t *op) {
+  switch (op->kind) {
+    case RK_REG:
+      return &vm->stack->content[base + op->index];
+    case RK_CONST:
+      return &vm->program->consts[op->index];
+    case RK_ENV:
+      return env_fetch(vm->frame->env, op->index);
+    default:
+      return varray_at(vm->globs, op->index);
+  }
+}
+
+/** Moteur d'exécution du code registre.
+ * \param[in,out] vm l'état de la machine virtuelle (vm->rprogram doit
+ * contenir le programme traduit).
+ */
+void vm_execute_reg(vm_t *vm) {
+  rprogram_t *rp = vm->rprogram;
+  varray_t *stack = vm->stack;
+  unsigned int rpc = rp->pc_map[vm->frame->pc];
+  unsigned int instr_counter = 0;
+
+  while (rpc < rp->size) {
+    rinstr_t *ri = &rp->code[rpc];
+    unsigned int base = vm->frame->sp;
+    value_t a, b;
+
+    rpc = rpc + 1;
+
+    switch (ri->op) {
+      case R_MOVE:
+        a = *reg_read(vm, base, &ri->a);
+        reg_set_top(stack, base + ri->depth);
+        stack->content[base + ri->dst] = a;
+        break;
+
+      case R_CLOSURE: {
+        closure_t closure;
+        closure.env = vm->frame->env;
+        closure.pc = ri->arg;
+        reg_set_top(stack, base + ri->depth);
+        value_fill_closure(&stack->content[base + ri->dst], closure);
+      } break;
+
+      case R_PRIM: {
+        // point d'entrée rapide du descripteur (cf. prim.h)
+        const prim_desc_t *desc = prim_get(ri->arg);
+        value_t res;
+        int done;
+        a = *reg_read(vm, base, &ri->a);
+        if (ri->nargs == 2) {
+          b = *reg_read(vm, base, &ri->b);
+          done = desc->prim2(vm, &a, &b, &res);
+        } else {
+          done = desc->prim1(vm, &a, &res);
+        }
+        if (done) {
+          reg_set_top(stack, base + ri->depth);
+          stack->content[base + ri->dst] = res;
+          SVM_PROBE_PRIM_ENTRY(ri->arg, ri->nargs, desc->name);
+          vm->stats.prim_calls = vm->stats.prim_calls + 1;
+        } else {
+          // cas général : on repasse par la pile
+          reg_set_top(stack, base + ri->dst);
+          if (ri->nargs == 2) varray_push(stack, &b);
+          varray_push(stack, &a);
+          execute_prim(vm, stack, ri->arg, ri->nargs);
+        }
+      } break;
+
+      case R_CALLP:
+        reg_set_top(stack, base + ri->depth + ri->nargs - 1);
+        execute_prim(vm, stack, ri->arg, ri->nargs);
+        break;
+
+      case R_CALL: {
+        value_t fun = *reg_read(vm, base, &ri->a);
+        reg_set_top(stack, base + ri->depth + ri->nargs - 1);
+
+        switch (fun.type) {
+          case T_FUN: {
+            int i;
+            closure_t closure = value_closure_get(&fun);
+            env_t *env = gc_alloc_env(vm->gc, ri->nargs, closure.env);
+
+            for (i = 0; i < ri->nargs; i++) {
+              varray_set_at(env->content, i, varray_top_at(stack, i));
+            }
+            varray_popn(stack, ri->nargs);
+
+            vm->frame->pc = rpc;
+            vm->frame = frame_push(vm->frame, env, stack->top, rpc);
+            rpc = rp->pc_map[closure.pc];
+            vm->frame->pc = rpc;
+            vm->frame->fun_pc = closure.pc;
+            SVM_PROBE_FUNCTION_ENTRY(closure.pc, ri->nargs);
+            VM_STATS_CALL(vm);
+          } break;
+
+          case T_PRIM:
+            execute_prim(vm, stack, value_prim_get(&fun), ri->nargs);
+            break;
+
+          default:
+            output_flush();
+            printf("Unable to call: %d\n", fun.type);
+            exit(EXIT_FAILURE);
+        }
+      } break;
+
+      case R_RETURN:
+        a = *reg_read(vm, base, &ri->a);
+        stack->top = vm->frame->sp;
+        varray_push(stack, &a);
+        SVM_PROBE_FUNCTION_RETURN(vm->frame->fun_pc);
+        vm->frame = frame_pop(vm->frame);
+        rpc = vm->frame->pc;
+        break;
+
+      case R_JUMP:
+        rpc = ri->arg;
+        break;
+
+      case R_JFALSE:
+        a = *reg_read(vm, base, &ri->a);
+        reg_set_top(stack, base + ri->depth);
+        if (value_is_false(&a)) {
+          rpc = ri->arg;
+        }
+        break;
+
+      case R_STORE:
+        a = *reg_read(vm, base, &ri->a);
+        env_store(vm->frame->env, ri->arg, &a);
+        reg_set_top(stack, base + ri->depth);
+        break;
+
+      case R_GSTORE:
+        a = *reg_read(vm, base, &ri->a);
+        varray_set_at(vm->globs, ri->arg, &a);
+        reg_set_top(stack, base + ri->depth);
+        break;
+
+      case R_POP:
+        a = *reg_read(vm, base, &ri->a);
+        reg_set_top(stack, base + ri->depth);
+        if (varray_empty(stack) && vm->frame->caller_frame == NULL) {
+          // on affiche les valeurs <<popée>> au top-niveau
+          value_print(&a);
+          output_char('\n');
+        }
+        break;
+
+      case R_GALLOC:
+        varray_expandn(vm->globs, 1);
+        break;
+
+      case R_ALLOC:
+        vm->frame->env = gc_alloc_env(vm->gc, ri->arg, vm->frame->env);
+        break;
+
+      case R_DELETE:
+        // l'environnement sera récupéré par le GC
+        vm->frame->env = vm->frame->env->next;
+        break;
+
+      case R_ERROR:
+        a = *reg_read(vm, base, &ri->a);
+        output_flush();
+        printf("Exit with Error number %d\n", value_int_get(&a));
+        exit(EXIT_FAILURE);
+
+      default:
+        output_flush();
+        printf("Unknow register instruction: %d\n", ri->op);
+        exit(EXIT_FAILURE);
+    }
+
+    instr_counter = instr_counter + 1;
+
+    if (instr_counter == vm->gc->collection_frequency) {
+      // on force le GC
+      gc_collect(vm);
+      instr_counter = 0;
+    }
+  }
+  vm->stats.instructions = vm->stats.instructions + instr_counter;
+}
@@ -0,0 +1,95 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _REGVM_H_
+#define _REGVM_H_
+
+/** \file regvm.h
+ * Représentation du code "registre" et moteur d'exécution associé.
+ *
+ * Au chargement, le bytecode à pile est traduit (cf. regvm_translate.c)
+ * en instructions à trois adresses dont les opérandes désignent
+ * directement :
+ *  - un registre, c'est-à-dire une case de la zone de pile du cadre
+ *    d'appel courant (le registre i est la i-ème valeur au-dessus de
+ *    frame->sp);
+ *  - une constante (table des constantes du programme);
+ *  - une variable locale (environnement) ou globale.
+ *
+ * Ainsi, la séquence `FETCH 0; FETCH 1; PUSH PRIM +; CALL 2` devient
+ * l'unique instruction `PRIM + r0, E1, E0`.
+ *
+ * Les cadres d'appel, les environnements et les fermetures sont ceux du
+ * moteur à pile : seuls les compteurs de programme des cadres sont
+ * exprimés dans le code registre (les fermetures gardent le pc du
+ * bytecode, traduit à chaque appel).
+ */
+
+#include "bytecode.h"
+
+struct _vm;
+
+/* Sortes d'opérandes */
+#define RK_REG 0   /*!< registre (case de pile relative au cadre) */
+#define RK_CONST 1 /*!< constante du programme */
+#define RK_ENV 2   /*!< variable locale */
+#define RK_GLOB 3  /*!< variable globale */
+
+/** Opérande d'une instruction registre. */
+typedef struct {
+  int kind;  /*!< la sorte d'opérande (RK_xxx) */
+  int index; /*!< le numéro de registre, de constante ou de variable */
+} roperand_t;
+
+/* Instructions registre */
+#define R_MOVE 0     /*!< dst <- a */
+#define R_CLOSURE 1  /*!< dst <- fermeture (pc bytecode arg) */
+#define R_PRIM 2     /*!< dst <- prim arg (a, b) (1 ou 2 arguments) */
+#define R_CALLP 3    /*!< appel de la primitive arg (arguments en registres) */
+#define R_CALL 4     /*!< appel de a (nargs arguments en registres) */
+#define R_RETURN 5   /*!< retour de fonction avec la valeur a */
+#define R_JUMP 6     /*!< saut vers arg */
+#define R_JFALSE 7   /*!< saut vers arg si a est faux */
+#define R_STORE 8    /*!< variable locale arg <- a */
+#define R_GSTORE 9   /*!< variable globale arg <- a */
+#define R_POP 10     /*!< oubli (ou affichage au top-niveau) de a */
+#define R_GALLOC 11  /*!< allocation d'une variable globale */
+#define R_ALLOC 12   /*!< allocation d'un environnement de taille arg */
+#define R_DELETE 13  /*!< suppression de l'environnement courant */
+#define R_ERROR 14   /*!< erreur de numéro a */
+
+/** Instruction registre. */
+typedef struct {
+  int op;       /*!< l'instruction (R_xxx) */
+  int arg;      /*!< argument entier (primitive, variable, cible, etc.) */
+  int nargs;    /*!< le nombre d'arguments (appels) */
+  int dst;      /*!< le registre destination */
+  int depth;    /*!< le nombre de registres utilisés après l'instruction */
+  roperand_t a; /*!< premier opérande (sommet de pile) */
+  roperand_t b; /*!< second opérande */
+} rinstr_t;
+
+/** Programme traduit en code registre. */
+typedef struct _rprogram {
+  rinstr_t *code;     /*!< les instructions */
+  unsigned int size;  /*!< le nombre d'instructions */
+  unsigned int capacity; /*!< la taille allouée */
+  int *pc_map; /*!< pc du bytecode -> pc registre (-1 si non traduit) */
+  unsigned int nb_stack_instrs; /*!< le nombre d'instructions traduites */
+} rprogram_t;
+
+/* Traduction (cf. regvm_translate.c) */
+
+rprogram_t *regvm_translate(program_t *program);
+void regvm_destroy(rprogram_t *rprogram);
+void regvm_print(rprogram_t *rprogram);
+
+/* Exécution (cf. regvm.c) */
+
+void vm_execute_reg(struct _vm *vm);
+
+#endif
@@ -0,0 +1,606 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "prim.h"
+#include "regvm.h"
+
+/** \file regvm_translate.c
+ * Traduction du bytecode à pile en code registre.
+ *
+ * La traduction simule la pile du bytecode avec une pile "symbolique" :
+ * chaque case contient l'opérande qui donne sa valeur (constante,
+ * variable, ou registre). Les instructions PUSH, FETCH, GFETCH, CONST et
+ * SFETCH ne produisent donc pas de code ; la valeur n'est recopiée dans
+ * son registre (matérialisée) que lorsque c'est nécessaire :
+ *  - avant les sauts et aux cibles de sauts, où toutes les cases de la
+ *    pile sont dans leur registre;
+ *  - avant les appels (les fonctions peuvent modifier les variables);
+ *  - avant une écriture dans une variable lue par une case de la pile.
+ *
+ * La hauteur de pile doit être connue en tout point du programme (ce qui
+ * est le cas du code produit par le compilateur), sinon la traduction
+ * échoue.
+ ******/
+
+/** L'état de la traduction. */
+typedef struct {
+  program_t *program; /*!< le programme à traduire */
+  rprogram_t *rp;     /*!< le programme traduit */
+  int *depth;         /*!< la hauteur de pile avant chaque pc (ou -1) */
+  unsigned char *target; /*!< 1 si le pc est une cible de saut ou d'appel */
+  roperand_t *sym;    /*!< la pile symbolique */
+  int sp;             /*!< la hauteur de la pile symbolique */
+  int *fixups;        /*!< instructions dont la cible est un pc du bytecode */
+  int nb_fixups;      /*!< le nombre d'instructions à reloger */
+} translator_t;
+
+/** Effet d'une instruction sur la hauteur de pile.
+ * \param[in] program le programme.
+ * \param pc le pc de l'instruction.
+ * \param[out] delta la variation de la hauteur de pile.
+ * \return le nombre de valeurs nécessaires sur la pile, ou -1 si
+ * l'instruction n'est pas connue.
+ */
+static int reg_stack_effect(program_t *program, int pc, int *delta) {
+  int arg =
+      (bytecode_instr_size(program, pc) > 1) ? program->bytecode[pc + 1] : 0;
+  switch (program->bytecode[pc]) {
+    case I_PUSH:
+    case I_CONST:
+    case I_FETCH:
+    case I_GFETCH:
+      *delta = 1;
+      return 0;
+    case I_SFETCH:
+      *delta = 1;
+      return arg + 1;
+    case I_STORE:
+    case I_GSTORE:
+    case I_POP:
+    case I_JFALSE:
+    case I_ERROR:
+      *delta = -1;
+      return 1;
+    case I_SSTORE:
+      *delta = -1;
+      return arg + 2;
+    case I_SLIDE:
+      *delta = -arg;
+      return arg + 1;
+    case I_CALL:
+      *delta = -arg;
+      return arg + 1;
+    case I_RETURN:
+      *delta = 0;
+      return 1;
+    case I_GALLOC:
+    case I_ALLOC:
+    case I_DELETE:
+    case I_JUMP:
+      *delta = 0;
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+/** Calcul des hauteurs de pile depuis le top-niveau et depuis les points
+ * d'entrée des fonctions.
+ * \return 1 si les hauteurs sont cohérentes, 0 sinon.
+ */
+static int reg_analyze(translator_t *tr, int *max_depth) {
+  program_t *program = tr->program;
+  int *worklist = (int *)malloc(sizeof(int) * program->size);
+  unsigned int pc;
+  int top = 0, ok = 1;
+  int succ[2];
+
+  assert(worklist != NULL);
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    tr->depth[pc] = -1;
+  }
+  tr->target[0] = 1;
+  tr->depth[0] = 0;
+  worklist[top++] = 0;
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    int op = program->bytecode[pc];
+    if (op == I_PUSH && program->bytecode[pc + 1] == T_FUN) {
+      int entry = program->bytecode[pc + 2];
+      tr->target[entry] = 1;
+      if (tr->depth[entry] == -1) {
+        tr->depth[entry] = 0;
+        worklist[top++] = entry;
+      }
+    } else if ((op == I_JUMP || op == I_JFALSE) &&
+               program->bytecode[pc + 1] < program->size) {
+      tr->target[program->bytecode[pc + 1]] = 1;
+    }
+  }
+
+  *max_depth = 0;
+  while (ok && top > 0) {
+    int delta, need, d, nb, i;
+    pc = worklist[--top];
+    need = reg_stack_effect(program, pc, &delta);
+    if (need < 0 || tr->depth[pc] < need) {
+      ok = 0;
+      break;
+    }
+    d = tr->depth[pc] + delta;
+    if (d + 1 > *max_depth) *max_depth = d + 1;
+
+    nb = bytecode_successors(program, pc, succ);
+    for (i = 0; i < nb; i++) {
+      if (tr->depth[succ[i]] == -1) {
+        tr->depth[succ[i]] = d;
+        worklist[top++] = succ[i];
+      } else if (tr->depth[succ[i]] != d) {
+        ok = 0;
+      }
+    }
+  }
+
+  free(worklist);
+  return ok;
+}
+
+/** Ajout d'une instruction registre (la hauteur courante est notée). */
+static rinstr_t *reg_emit(translator_t *tr, int op) {
+  rprogram_t *rp = tr->rp;
+  rinstr_t *ri;
+  if (rp->size == rp->capacity) {
+    rp->capacity = (rp->capacity == 0) ? 64 : rp->capacity * 2;
+    rp->code = (rinstr_t *)realloc(rp->code, sizeof(rinstr_t) * rp->capacity);
+    assert(rp->code != NULL);
+  }
+  ri = &rp->code[rp->size];
+  rp->size = rp->size + 1;
+  ri->op = op;
+  ri->arg = 0;
+  ri->nargs = 0;
+  ri->dst = 0;
+  ri->depth = tr->sp;
+  ri->a.kind = RK_REG;
+  ri->a.index = 0;
+  ri->b = ri->a;
+  return ri;
+}
+
+/** Un opérande registre. */
+static roperand_t reg_operand(int kind, int index) {
+  roperand_t op;
+  op.kind = kind;
+  op.index = index;
+  return op;
+}
+
+/** Matérialiser la case j de la pile symbolique dans son registre. */
+static void reg_materialize(translator_t *tr, int j) {
+  if (tr->sym[j].kind != RK_REG || tr->sym[j].index != j) {
+    rinstr_t *ri = reg_emit(tr, R_MOVE);
+    ri->dst = j;
+    ri->a = tr->sym[j];
+    tr->sym[j] = reg_operand(RK_REG, j);
+  }
+}
+
+/** Matérialiser la pile symbolique, sauf les n cases du sommet (qui
+ * restent comptées dans la hauteur de pile, et donc visibles du GC). */
+static void reg_materialize_below(translator_t *tr, int n) {
+  int j;
+  for (j = 0; j < tr->sp - n; j++) {
+    reg_materialize(tr, j);
+  }
+}
+
+/** Matérialiser toute la pile symbolique. */
+static void reg_materialize_all(translator_t *tr) { reg_materialize_below(tr, 0); }
+
+/** Matérialiser les cases qui lisent un opérande donné (avant son
+ * écriture). Si index vaut -1, toutes les opérandes de la sorte sont
+ * concernées. */
+static void reg_materialize_readers(translator_t *tr, int kind, int index) {
+  int j;
+  for (j = 0; j < tr->sp; j++) {
+    if (tr->sym[j].kind == kind &&
+        (index == -1 || tr->sym[j].index == index) &&
+        !(kind == RK_REG && tr->sym[j].index == j)) {
+      reg_materialize(tr, j);
+    }
+  }
+}
+
+/** Réinitialiser la pile symbolique (toutes les cases en registre). */
+static void reg_reset(translator_t *tr, int depth) {
+  int j;
+  tr->sp = depth;
+  for (j = 0; j < depth; j++) {
+    tr->sym[j] = reg_operand(RK_REG, j);
+  }
+}
+
+/** Empiler une constante sur la pile symbolique. */
+static void reg_push_const(translator_t *tr, value_t *value) {
+  tr->sym[tr->sp] =
+      reg_operand(RK_CONST, bytecode_add_const(tr->program, value));
+  tr->sp = tr->sp + 1;
+}
+
+/** Primitive calculée directement par l'instruction PRIM : celles qui
+ * ont un point d'entrée rapide pour ce nombre d'arguments (cf. prim.h). */
+static int reg_simple_prim(int prim, int nargs) {
+  const prim_desc_t *desc = prim_get(prim);
+  if (desc == NULL) return 0;
+  return (nargs == 1 && desc->prim1 != NULL) ||
+         (nargs == 2 && desc->prim2 != NULL);
+}
+
+/** Traduction d'un appel (CALL nargs). */
+static void reg_translate_call(translator_t *tr, int nargs) {
+  roperand_t fun = tr->sym[tr->sp - 1];
+  value_t *value = NULL;
+  rinstr_t *ri;
+
+  if (fun.kind == RK_CONST) {
+    value = &tr->program->consts[fun.index];
+  }
+
+  if (value != NULL && value_is_prim(value) &&
+      reg_simple_prim(value->data.as_int, nargs)) {
+    // instruction à trois adresses
+    tr->sp = tr->sp - 1;
+    ri = reg_emit(tr, R_PRIM);
+    ri->arg = value->data.as_int;
+    ri->nargs = nargs;
+    ri->a = tr->sym[tr->sp - 1];
+    if (nargs == 2) ri->b = tr->sym[tr->sp - 2];
+    tr->sp = tr->sp - nargs;
+    ri->dst = tr->sp;
+  } else {
+    // les arguments sont passés dans les registres au sommet
+    reg_materialize_below(tr, 1);
+    tr->sp = tr->sp - 1;
+    if (value != NULL && value_is_prim(value)) {
+      ri = reg_emit(tr, R_CALLP);
+      ri->arg = value->data.as_int;
+    } else {
+      ri = reg_emit(tr, R_CALL);
+      ri->a = fun;
+    }
+    ri->nargs = nargs;
+    tr->sp = tr->sp - nargs;
+    ri->dst = tr->sp;
+  }
+
+  tr->sym[tr->sp] = reg_operand(RK_REG, tr->sp);
+  tr->sp = tr->sp + 1;
+  ri->depth = tr->sp;
+}
+
+/** Traduction d'une instruction du bytecode.
+ * \return 1 si l'instruction termine le bloc (pas de successeur direct).
+ */
+static int reg_translate_instr(translator_t *tr, unsigned int pc) {
+  program_t *program = tr->program;
+  int op = program->bytecode[pc];
+  int arg =
+      (bytecode_instr_size(program, pc) > 1) ? program->bytecode[pc + 1] : 0;
+  rinstr_t *ri;
+  value_t value;
+
+  switch (op) {
+    case I_PUSH:
+      switch (arg) {
+        case T_INT:
+          value_fill_int(&value, program->bytecode[pc + 2]);
+          break;
+        case T_BOOL:
+          value_fill_bool(&value, program->bytecode[pc + 2]);
+          break;
+        case T_UNIT:
+          value_fill_unit(&value);
+          break;
+        case T_PRIM:
+          value_fill_prim(&value, program->bytecode[pc + 2]);
+          break;
+        case T_STRING:
+          value = program->strings[program->bytecode[pc + 2]];
+          break;
+        case T_SYMBOL:
+          value = program->symbols[program->bytecode[pc + 2]];
+          break;
+        case T_CONST:
+          // déjà dans la table des constantes
+          tr->sym[tr->sp++] = reg_operand(RK_CONST, program->bytecode[pc + 2]);
+          return 0;
+        case T_FUN:
+          // la fermeture capture l'environnement à l'exécution
+          ri = reg_emit(tr, R_CLOSURE);
+          ri->arg = program->bytecode[pc + 2];
+          ri->dst = tr->sp;
+          tr->sym[tr->sp] = reg_operand(RK_REG, tr->sp);
+          tr->sp = tr->sp + 1;
+          ri->depth = tr->sp;
+          return 0;
+        default:
+          printf("Unknow type: %d (in push)\n", arg);
+          exit(EXIT_FAILURE);
+      }
+      reg_push_const(tr, &value);
+      return 0;
+
+    case I_CONST:
+      tr->sym[tr->sp++] = reg_operand(RK_CONST, arg);
+      return 0;
+
+    case I_FETCH:
+      tr->sym[tr->sp++] = reg_operand(RK_ENV, arg);
+      return 0;
+
+    case I_GFETCH:
+      tr->sym[tr->sp++] = reg_operand(RK_GLOB, arg);
+      return 0;
+
+    case I_SFETCH:
+      tr->sym[tr->sp] = tr->sym[tr->sp - 1 - arg];
+      tr->sp = tr->sp + 1;
+      return 0;
+
+    case I_STORE:
+      reg_materialize_readers(tr, RK_ENV, arg);
+      ri = reg_emit(tr, R_STORE);
+      ri->arg = arg;
+      ri->a = tr->sym[--tr->sp];
+      ri->depth = tr->sp;
+      return 0;
+
+    case I_GSTORE:
+      reg_materialize_readers(tr, RK_GLOB, arg);
+      ri = reg_emit(tr, R_GSTORE);
+      ri->arg = arg;
+      ri->a = tr->sym[--tr->sp];
+      ri->depth = tr->sp;
+      return 0;
+
+    case I_SSTORE: {
+      int dst = tr->sp - 2 - arg;
+      reg_materialize_readers(tr, RK_REG, dst);
+      ri = reg_emit(tr, R_MOVE);
+      ri->dst = dst;
+      ri->a = tr->sym[--tr->sp];
+      tr->sym[dst] = reg_operand(RK_REG, dst);
+      ri->depth = tr->sp;
+    }
+      return 0;
+
+    case I_SLIDE: {
+      roperand_t res = tr->sym[tr->sp - 1];
+      tr->sp = tr->sp - arg - 1;
+      if (res.kind == RK_REG && res.index > tr->sp) {
+        ri = reg_emit(tr, R_MOVE);
+        ri->dst = tr->sp;
+        ri->a = res;
+        res = reg_operand(RK_REG, tr->sp);
+        ri->depth = tr->sp + 1;
+      }
+      tr->sym[tr->sp++] = res;
+    }
+      return 0;
+
+    case I_POP:
+      ri = reg_emit(tr, R_POP);
+      ri->a = tr->sym[--tr->sp];
+      ri->depth = tr->sp;
+      return 0;
+
+    case I_CALL:
+      reg_translate_call(tr, arg);
+      return 0;
+
+    case I_RETURN:
+      ri = reg_emit(tr, R_RETURN);
+      ri->a = tr->sym[tr->sp - 1];
+      return 1;
+
+    case I_ERROR:
+      ri = reg_emit(tr, R_ERROR);
+      ri->a = tr->sym[--tr->sp];
+      ri->depth = tr->sp;
+      return 1;
+
+    case I_JUMP:
+      reg_materialize_all(tr);
+      ri = reg_emit(tr, R_JUMP);
+      ri->arg = arg;
+      tr->fixups[tr->nb_fixups++] = tr->rp->size - 1;
+      return 1;
+
+    case I_JFALSE: {
+      roperand_t cond = tr->sym[tr->sp - 1];
+      reg_materialize_below(tr, 1);
+      tr->sp = tr->sp - 1;
+      ri = reg_emit(tr, R_JFALSE);
+      ri->arg = arg;
+      ri->a = cond;
+      tr->fixups[tr->nb_fixups++] = tr->rp->size - 1;
+    }
+      return 0;
+
+    case I_GALLOC:
+      reg_emit(tr, R_GALLOC);
+      return 0;
+
+    case I_ALLOC:
+    case I_DELETE:
+      // les index des variables locales changent
+      reg_materialize_readers(tr, RK_ENV, -1);
+      ri = reg_emit(tr, (op == I_ALLOC) ? R_ALLOC : R_DELETE);
+      ri->arg = arg;
+      return 0;
+
+    default:
+      printf("Unknow opcode: %d (in register translation)\n", op);
+      exit(EXIT_FAILURE);
+  }
+}
+
+/** Traduction d'un programme en code registre.
+ * \param[in,out] program le programme (sa table des constantes est
+ * complétée).
+ * \return le programme traduit, ou NULL si la traduction est impossible.
+ */
+rprogram_t *regvm_translate(program_t *program) {
+  translator_t tr;
+  unsigned int pc;
+  int max_depth, live = 0, i;
+
+  tr.program = program;
+  tr.depth = (int *)malloc(sizeof(int) * program->size);
+  tr.target = (unsigned char *)calloc(program->size, sizeof(unsigned char));
+  assert(tr.depth != NULL && tr.target != NULL);
+
+  if (!reg_analyze(&tr, &max_depth)) {
+    free(tr.depth);
+    free(tr.target);
+    return NULL;
+  }
+
+  tr.rp = (rprogram_t *)malloc(sizeof(rprogram_t));
+  assert(tr.rp != NULL);
+  tr.rp->code = NULL;
+  tr.rp->size = 0;
+  tr.rp->capacity = 0;
+  tr.rp->nb_stack_instrs = 0;
+  tr.rp->pc_map = (int *)malloc(sizeof(int) * (program->size + 1));
+  tr.sym = (roperand_t *)malloc(sizeof(roperand_t) * (max_depth + 2));
+  tr.fixups = (int *)malloc(sizeof(int) * program->size);
+  tr.nb_fixups = 0;
+  tr.sp = 0;
+  assert(tr.rp->pc_map != NULL && tr.sym != NULL && tr.fixups != NULL);
+
+  for (pc = 0; pc <= program->size; pc++) {
+    tr.rp->pc_map[pc] = -1;
+  }
+
+  for (pc = 0; pc < program->size; pc += bytecode_instr_size(program, pc)) {
+    if (tr.depth[pc] == -1) {
+      // code inaccessible
+      live = 0;
+      continue;
+    }
+    if (tr.target[pc] || !live) {
+      if (live) reg_materialize_all(&tr);
+      reg_reset(&tr, tr.depth[pc]);
+    }
+    tr.rp->pc_map[pc] = tr.rp->size;
+    tr.rp->nb_stack_instrs = tr.rp->nb_stack_instrs + 1;
+    live = !reg_translate_instr(&tr, pc);
+  }
+  if (live) reg_materialize_all(&tr);
+  tr.rp->pc_map[program->size] = tr.rp->size;
+
+  for (i = 0; i < tr.nb_fixups; i++) {
+    rinstr_t *ri = &tr.rp->code[tr.fixups[i]];
+    ri->arg = tr.rp->pc_map[ri->arg];
+    assert(ri->arg >= 0);
+  }
+
+  free(tr.depth);
+  free(tr.target);
+  free(tr.sym);
+  free(tr.fixups);
+  return tr.rp;
+}
+
+/** Libération d'un programme traduit. */
+void regvm_destroy(rprogram_t *rprogram) {
+  free(rprogram->code);
+  free(rprogram->pc_map);
+  free(rprogram);
+}
+
+/** Affichage d'un opérande registre. */
+static void regvm_print_operand(roperand_t *op) {
+  switch (op->kind) {
+    case RK_REG:
+      printf("r%d", op->index);
+      break;
+    case RK_CONST:
+      printf("K%d", op->index);
+      break;
+    case RK_ENV:
+      printf("E%d", op->index);
+      break;
+    case RK_GLOB:
+      printf("G%d", op->index);
+      break;
+  }
+}
+
+/** Affichage d'un programme traduit (pour déboguage). */
+void regvm_print(rprogram_t *rprogram) {
+  static const char *names[] = {"MOVE",   "CLOSURE", "PRIM",  "CALLP",
+                                "CALL",   "RETURN",  "JUMP",  "JFALSE",
+                                "STORE",  "GSTORE",  "POP",   "GALLOC",
+                                "ALLOC",  "DELETE",  "ERROR"};
+  unsigned int pc;
+  for (pc = 0; pc < rprogram->size; pc++) {
+    rinstr_t *ri = &rprogram->code[pc];
+    printf("%d: %s", pc, names[ri->op]);
+    switch (ri->op) {
+      case R_MOVE:
+        printf(" r%d, ", ri->dst);
+        regvm_print_operand(&ri->a);
+        break;
+      case R_CLOSURE:
+        printf(" r%d, @%d", ri->dst, ri->arg);
+        break;
+      case R_PRIM:
+        printf(" %d r%d, ", ri->arg, ri->dst);
+        regvm_print_operand(&ri->a);
+        if (ri->nargs == 2) {
+          printf(", ");
+          regvm_print_operand(&ri->b);
+        }
+        break;
+      case R_CALLP:
+        printf(" %d/%d r%d", ri->arg, ri->nargs, ri->dst);
+        break;
+      case R_CALL:
+        printf(" ");
+        regvm_print_operand(&ri->a);
+        printf("/%d r%d", ri->nargs, ri->dst);
+        break;
+      case R_JUMP:
+      case R_ALLOC:
+      case R_DELETE:
+        printf(" %d", ri->arg);
+        break;
+      case R_JFALSE:
+      case R_STORE:
+      case R_GSTORE:
+        printf(" %d, ", ri->arg);
+        regvm_print_operand(&ri->a);
+        break;
+      case R_RETURN:
+      case R_POP:
+      case R_ERROR:
+        printf(" ");
+        regvm_print_operand(&ri->a);
+        break;
+      default:
+        break;
+    }
+    printf("  [depth=%d]\n", ri->depth);
+  }
+}
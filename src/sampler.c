@@ -0,0 +1,180 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "sampler.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/** \file sampler.c
+ * Gestionnaire de SIGPROF et écriture des piles.
+ *
+ * Le gestionnaire peut interrompre la VM au milieu d'un appel ou d'un
+ * retour : la pile relevée est alors celle d'avant ou d'après. Les cadres
+ * dépilés sont recyclés et jamais libérés pendant l'exécution (cf.
+ * frame.c), et le parcours est borné par SAMPLER_MAX_DEPTH : un cadre
+ * périmé ne peut fausser qu'un échantillon.
+ ******/
+
+/** Pile d'appels échantillonnée. */
+typedef struct {
+  unsigned int hash;   /*!< le code de hachage de la pile */
+  unsigned int depth;  /*!< le nombre de cadres (0 si la case est libre) */
+  int truncated;       /*!< 1 (true) si la pile dépasse la profondeur */
+  unsigned long count; /*!< le nombre d'échantillons */
+  /** les fonctions (pc d'entrée), de la feuille vers la racine */
+  unsigned int fun_pcs[SAMPLER_MAX_DEPTH];
+} sampler_stack_t;
+
+/** La VM échantillonnée. */
+static vm_t *sampler_vm = NULL;
+
+/** La table des piles (préallouée, remplie par le gestionnaire). */
+static sampler_stack_t *stacks = NULL;
+
+/** Le nombre total d'échantillons. */
+static volatile unsigned long nb_samples = 0;
+
+/** Le nombre d'échantillons perdus (table pleine). */
+static volatile unsigned long nb_dropped = 0;
+
+/** Gestionnaire de SIGPROF : comptage de la pile d'appels courante.
+ * Pas d'allocation, pas de verrou, pas d'appel à stdio.
+ */
+static void sampler_handler(int sig) {
+  unsigned int fun_pcs[SAMPLER_MAX_DEPTH];
+  unsigned int depth = 0, hash = 2166136261u, i, j, slot;
+  frame_t *frame = sampler_vm->frame;
+  int truncated;
+
+  while (frame != NULL && depth < SAMPLER_MAX_DEPTH) {
+    fun_pcs[depth] = frame->fun_pc;
+    hash = (hash ^ frame->fun_pc) * 16777619u;
+    depth = depth + 1;
+    frame = frame->caller_frame;
+  }
+  truncated = (frame != NULL);
+  nb_samples = nb_samples + 1;
+
+  // recherche de la pile (sondage linéaire)
+  for (i = 0; i < SAMPLER_MAX_STACKS; i++) {
+    sampler_stack_t *stack;
+    slot = (hash + i) & (SAMPLER_MAX_STACKS - 1);
+    stack = &stacks[slot];
+    if (stack->depth == 0) {
+      stack->hash = hash;
+      stack->truncated = truncated;
+      for (j = 0; j < depth; j++) {
+        stack->fun_pcs[j] = fun_pcs[j];
+      }
+      stack->count = 1;
+      stack->depth = depth;
+      return;
+    }
+    if (stack->hash == hash && stack->depth == depth &&
+        stack->truncated == truncated) {
+      for (j = 0; j < depth && stack->fun_pcs[j] == fun_pcs[j]; j++) {
+      }
+      if (j == depth) {
+        stack->count = stack->count + 1;
+        return;
+      }
+    }
+  }
+  nb_dropped = nb_dropped + 1;
+}
+
+/** Démarrage de l'échantillonnage.
+ * \param[in] vm la VM à échantillonner (son cadre initial est créé).
+ * \param hz la fréquence d'échantillonnage (en Hz de temps CPU).
+ */
+void sampler_start(vm_t *vm, int hz) {
+  struct sigaction action;
+  struct itimerval timer;
+  long period;
+
+  stacks = (sampler_stack_t *)calloc(SAMPLER_MAX_STACKS,
+                                     sizeof(sampler_stack_t));
+  assert(stacks != NULL);
+  sampler_vm = vm;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sampler_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, NULL) != 0) {
+    perror("sigaction");
+    exit(EXIT_FAILURE);
+  }
+
+  period = (hz >= 1000000) ? 1 : 1000000 / hz;  // en microsecondes
+  timer.it_interval.tv_sec = period / 1000000;
+  timer.it_interval.tv_usec = period % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+    perror("setitimer");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/** Arrêt de l'échantillonnage (avant de lire la table des piles). */
+void sampler_stop(void) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+  signal(SIGPROF, SIG_DFL);
+}
+
+/** Écriture d'un nom de fonction (format folded). */
+static void sampler_write_fun(FILE *file, unsigned int fun_pc) {
+  if (fun_pc == 0) {
+    fprintf(file, "<toplevel>");
+  } else {
+    fprintf(file, "fun@%u", fun_pc);
+  }
+}
+
+/** Écriture des piles échantillonnées (format folded) et libération de
+ * la table.
+ * \param[in] filename le fichier à écrire.
+ */
+void sampler_write(const char *filename) {
+  FILE *file = fopen(filename, "w");
+  unsigned int i;
+  int j;
+
+  if (file == NULL) {
+    fprintf(stderr, "cannot write sampling profile: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < SAMPLER_MAX_STACKS; i++) {
+    sampler_stack_t *stack = &stacks[i];
+    if (stack->depth == 0) continue;
+    if (stack->truncated) {
+      fprintf(file, "[truncated];");
+    }
+    // de la racine vers la feuille
+    for (j = stack->depth - 1; j >= 0; j--) {
+      sampler_write_fun(file, stack->fun_pcs[j]);
+      fputc((j > 0) ? ';' : ' ', file);
+    }
+    fprintf(file, "%lu\n", stack->count);
+  }
+  fclose(file);
+
+  printf("sampling profile: %lu samples (%lu dropped) written to %s\n",
+         nb_samples, nb_dropped, filename);
+
+  free(stacks);
+  stacks = NULL;
+  sampler_vm = NULL;
+}
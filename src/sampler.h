@@ -0,0 +1,42 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+/** \file sampler.h
+ * Profileur par échantillonnage (option `--sample=FILE`).
+ *
+ * Un minuteur (setitimer, temps CPU) envoie périodiquement SIGPROF. Le
+ * gestionnaire du signal relève la pile d'appels de la VM, c'est-à-dire
+ * les pc d'entrée des fonctions (champ fun_pc) des cadres d'appel depuis
+ * vm->frame, et la compte dans une table préallouée : il n'alloue pas et
+ * ne prend aucun verrou. Tous les moteurs d'exécution sont échantillonnés
+ * sans instrumentation de leur boucle.
+ *
+ * En fin d'exécution, les piles sont écrites au format "folded" de
+ * flamegraph.pl (une ligne `<toplevel>;fun@8;fun@8 42` par pile, de la
+ * racine vers la feuille).
+ */
+
+#include "vm.h"
+
+/** Fréquence d'échantillonnage par défaut (en Hz, temps CPU). */
+#define SAMPLER_DEFAULT_HZ 997
+
+/** Profondeur maximale des piles relevées (les cadres plus profonds sont
+ * résumés par `[truncated]`). */
+#define SAMPLER_MAX_DEPTH 64
+
+/** Nombre maximal de piles distinctes (puissance de 2). */
+#define SAMPLER_MAX_STACKS 8192
+
+void sampler_start(vm_t *vm, int hz);
+void sampler_stop(void);
+void sampler_write(const char *filename);
+
+#endif
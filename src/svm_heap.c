@@ -0,0 +1,527 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+/** \file svm_heap.c
+ * Analyseur hors ligne des instantanés du tas (programme `svm-heap`).
+ *
+ * L'analyseur lit un instantané (cf. heap_snapshot.h) et affiche :
+ *  - le nombre d'objets et d'octets par type, accessibles ou non depuis
+ *    les racines ;
+ *  - les objets qui retiennent le plus de mémoire : la taille retenue d'un
+ *    objet est celle de tous les objets qu'il domine (ceux qui seraient
+ *    récupérés s'il l'était), calculée sur l'arbre des dominateurs ;
+ *  - avec `--path=ID`, le plus court chemin depuis une racine jusqu'à
+ *    l'objet ID.
+ *
+ * Le graphe reçoit un sommet supplémentaire, la racine virtuelle, dont
+ * les successeurs sont les objets désignés par les racines. L'arbre des
+ * dominateurs est calculé par l'algorithme itératif de Cooper, Harvey et
+ * Kennedy ("A Simple, Fast Dominance Algorithm") sur l'ordre postfixe
+ * d'un parcours en profondeur.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap_snapshot.h"
+
+/** Nombre d'objets affichés par défaut dans le classement des tailles
+ * retenues. */
+#define HEAP_DEFAULT_TOP 20
+
+/** Marque d'un sommet non visité (ou sans dominateur). */
+#define HEAP_NONE UINT32_MAX
+
+/** Racine d'un instantané. */
+typedef struct {
+  int kind;        /*!< la sorte de racine (HEAP_ROOT_xxx) */
+  uint32_t index;  /*!< la variable, la case de pile ou le cadre */
+  uint32_t object; /*!< l'objet désigné */
+} heap_root_t;
+
+/** Graphe d'un instantané (références au format CSR). */
+typedef struct {
+  uint32_t nb_objects;   /*!< le nombre d'objets (la racine virtuelle
+                            porte le numéro nb_objects) */
+  unsigned char *types;  /*!< les types des objets */
+  uint32_t *sizes;       /*!< les tailles des objets */
+  uint32_t *ref_starts;  /*!< le début des références de chaque objet */
+  uint32_t *refs;        /*!< les références */
+  uint32_t nb_roots;     /*!< le nombre de racines */
+  heap_root_t *roots;    /*!< les racines */
+} heap_graph_t;
+
+/** Lecture d'un entier (u32, petit-boutiste). */
+static uint32_t heap_get_u32(FILE *file, const char *filename) {
+  unsigned char bytes[4];
+  if (fread(bytes, 1, 4, file) != 4) {
+    fprintf(stderr, "truncated heap snapshot: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+         ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/** Lecture d'un octet. */
+static int heap_get_u8(FILE *file, const char *filename) {
+  int c = fgetc(file);
+  if (c == EOF) {
+    fprintf(stderr, "truncated heap snapshot: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  return c;
+}
+
+/** Lecture d'un instantané.
+ * \param[out] graph le graphe lu.
+ * \param[in] filename le fichier de l'instantané.
+ */
+static void heap_read(heap_graph_t *graph, const char *filename) {
+  char magic[sizeof(HEAP_SNAPSHOT_MAGIC)];
+  uint32_t i, j, nb_refs = 0, capacity = 1024;
+  FILE *file = fopen(filename, "rb");
+
+  if (file == NULL) {
+    fprintf(stderr, "cannot open heap snapshot: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, HEAP_SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "not a heap snapshot: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  if (heap_get_u32(file, filename) != HEAP_SNAPSHOT_VERSION) {
+    fprintf(stderr, "unsupported heap snapshot version: %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  graph->nb_objects = heap_get_u32(file, filename);
+  graph->nb_roots = heap_get_u32(file, filename);
+
+  graph->types = (unsigned char *)malloc(graph->nb_objects + 1);
+  graph->sizes = (uint32_t *)malloc(sizeof(uint32_t) * (graph->nb_objects + 1));
+  graph->ref_starts =
+      (uint32_t *)malloc(sizeof(uint32_t) * (graph->nb_objects + 2));
+  graph->refs = (uint32_t *)malloc(sizeof(uint32_t) * capacity);
+  graph->roots = (heap_root_t *)malloc(sizeof(heap_root_t) *
+                                       (graph->nb_roots + 1));
+  assert(graph->types != NULL && graph->sizes != NULL &&
+         graph->ref_starts != NULL && graph->refs != NULL &&
+         graph->roots != NULL);
+
+  for (i = 0; i < graph->nb_objects; i++) {
+    uint32_t count;
+    graph->types[i] = heap_get_u8(file, filename);
+    graph->sizes[i] = heap_get_u32(file, filename);
+    count = heap_get_u32(file, filename);
+    graph->ref_starts[i] = nb_refs;
+    for (j = 0; j < count; j++) {
+      uint32_t ref = heap_get_u32(file, filename);
+      if (ref >= graph->nb_objects) {
+        fprintf(stderr, "incorrect reference %u in heap snapshot: %s\n", ref,
+                filename);
+        exit(EXIT_FAILURE);
+      }
+      if (nb_refs == capacity) {
+        capacity = 2 * capacity;
+        graph->refs =
+            (uint32_t *)realloc(graph->refs, sizeof(uint32_t) * capacity);
+        assert(graph->refs != NULL);
+      }
+      graph->refs[nb_refs] = ref;
+      nb_refs = nb_refs + 1;
+    }
+  }
+
+  for (i = 0; i < graph->nb_roots; i++) {
+    heap_root_t *root = &graph->roots[i];
+    root->kind = heap_get_u8(file, filename);
+    root->index = heap_get_u32(file, filename);
+    root->object = heap_get_u32(file, filename);
+    if (root->object >= graph->nb_objects) {
+      fprintf(stderr, "incorrect root %u in heap snapshot: %s\n", root->object,
+              filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+  fclose(file);
+
+  // la racine virtuelle : ses références sont les objets des racines
+  graph->types[graph->nb_objects] = 0;
+  graph->sizes[graph->nb_objects] = 0;
+  graph->ref_starts[graph->nb_objects] = nb_refs;
+  graph->refs = (uint32_t *)realloc(
+      graph->refs, sizeof(uint32_t) * (nb_refs + graph->nb_roots + 1));
+  assert(graph->refs != NULL);
+  for (i = 0; i < graph->nb_roots; i++) {
+    graph->refs[nb_refs + i] = graph->roots[i].object;
+  }
+  graph->ref_starts[graph->nb_objects + 1] = nb_refs + graph->nb_roots;
+}
+
+/** Nom d'un type d'objet. */
+static const char *heap_type_name(int type) {
+  switch (type) {
+    case HEAP_PAIR:
+      return "pair";
+    case HEAP_CLIST:
+      return "list-block";
+    case HEAP_VECTOR:
+      return "vector";
+    case HEAP_I32VECTOR:
+      return "i32vector";
+    case HEAP_STRING:
+      return "string";
+    case HEAP_HASHTABLE:
+      return "hashtable";
+    case HEAP_ENV:
+      return "env";
+    default:
+      return "?";
+  }
+}
+
+/** Affichage d'une racine. */
+static void heap_print_root(heap_root_t *root) {
+  switch (root->kind) {
+    case HEAP_ROOT_GLOBAL:
+      printf("global %u\n", root->index);
+      break;
+    case HEAP_ROOT_STACK:
+      printf("stack slot %u\n", root->index);
+      break;
+    default:
+      printf("frame %u (env)\n", root->index);
+      break;
+  }
+}
+
+/** Parcours en profondeur depuis la racine virtuelle.
+ * \param[in] graph le graphe.
+ * \param[out] postorder les sommets accessibles, dans l'ordre postfixe.
+ * \param[out] numbers le numéro postfixe de chaque sommet (HEAP_NONE s'il
+ * n'est pas accessible).
+ * \return le nombre de sommets accessibles (racine virtuelle comprise).
+ */
+static uint32_t heap_postorder(heap_graph_t *graph, uint32_t *postorder,
+                               uint32_t *numbers) {
+  uint32_t nb_nodes = graph->nb_objects + 1;
+  uint32_t *stack = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  uint32_t *next = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  uint32_t top = 0, count = 0, i;
+
+  assert(stack != NULL && next != NULL);
+  for (i = 0; i < nb_nodes; i++) {
+    numbers[i] = HEAP_NONE;
+    next[i] = HEAP_NONE;  // non visité
+  }
+
+  stack[top++] = graph->nb_objects;
+  next[graph->nb_objects] = graph->ref_starts[graph->nb_objects];
+  while (top > 0) {
+    uint32_t node = stack[top - 1];
+    if (next[node] < graph->ref_starts[node + 1]) {
+      uint32_t succ = graph->refs[next[node]];
+      next[node] = next[node] + 1;
+      if (next[succ] == HEAP_NONE) {
+        next[succ] = graph->ref_starts[succ];
+        stack[top++] = succ;
+      }
+    } else {
+      top = top - 1;
+      numbers[node] = count;
+      postorder[count] = node;
+      count = count + 1;
+    }
+  }
+
+  free(stack);
+  free(next);
+  return count;
+}
+
+/** Calcul de l'arbre des dominateurs (Cooper, Harvey et Kennedy).
+ * \param[in] graph le graphe.
+ * \param[in] postorder les sommets accessibles dans l'ordre postfixe.
+ * \param[in] numbers les numéros postfixes.
+ * \param nb_reachable le nombre de sommets accessibles.
+ * \param[out] idoms le dominateur immédiat de chaque sommet (HEAP_NONE
+ * pour un sommet inaccessible, la racine virtuelle pour elle-même).
+ */
+static void heap_dominators(heap_graph_t *graph, uint32_t *postorder,
+                            uint32_t *numbers, uint32_t nb_reachable,
+                            uint32_t *idoms) {
+  uint32_t nb_nodes = graph->nb_objects + 1, root = graph->nb_objects;
+  uint32_t *pred_starts = (uint32_t *)calloc(nb_nodes + 1, sizeof(uint32_t));
+  uint32_t *preds;
+  uint32_t i, k;
+  int changed = 1;
+
+  assert(pred_starts != NULL);
+
+  // prédécesseurs (accessibles) de chaque sommet
+  for (i = 0; i < nb_nodes; i++) {
+    if (numbers[i] == HEAP_NONE) continue;
+    for (k = graph->ref_starts[i]; k < graph->ref_starts[i + 1]; k++) {
+      pred_starts[graph->refs[k] + 1] = pred_starts[graph->refs[k] + 1] + 1;
+    }
+  }
+  for (i = 0; i < nb_nodes; i++) {
+    pred_starts[i + 1] = pred_starts[i + 1] + pred_starts[i];
+  }
+  preds = (uint32_t *)malloc(sizeof(uint32_t) * (pred_starts[nb_nodes] + 1));
+  assert(preds != NULL);
+  for (i = 0; i < nb_nodes; i++) {
+    if (numbers[i] == HEAP_NONE) continue;
+    for (k = graph->ref_starts[i]; k < graph->ref_starts[i + 1]; k++) {
+      uint32_t succ = graph->refs[k];
+      preds[pred_starts[succ]] = i;
+      pred_starts[succ] = pred_starts[succ] + 1;
+    }
+  }
+  // pred_starts[i] désigne maintenant la fin des prédécesseurs de i
+  for (i = nb_nodes; i > 0; i--) {
+    pred_starts[i] = pred_starts[i - 1];
+  }
+  pred_starts[0] = 0;
+
+  for (i = 0; i < nb_nodes; i++) {
+    idoms[i] = HEAP_NONE;
+  }
+  idoms[root] = root;
+
+  while (changed) {
+    changed = 0;
+    // ordre postfixe inverse, sans la racine (numérotée en dernier)
+    for (i = nb_reachable - 1; i > 0; i--) {
+      uint32_t node = postorder[i - 1], new_idom = HEAP_NONE;
+      for (k = pred_starts[node]; k < pred_starts[node + 1]; k++) {
+        uint32_t pred = preds[k];
+        if (idoms[pred] == HEAP_NONE) continue;
+        if (new_idom == HEAP_NONE) {
+          new_idom = pred;
+        } else {
+          // intersection des deux chemins dans l'arbre courant
+          uint32_t a = pred, b = new_idom;
+          while (a != b) {
+            while (numbers[a] < numbers[b]) a = idoms[a];
+            while (numbers[b] < numbers[a]) b = idoms[b];
+          }
+          new_idom = a;
+        }
+      }
+      if (idoms[node] != new_idom) {
+        idoms[node] = new_idom;
+        changed = 1;
+      }
+    }
+  }
+
+  free(pred_starts);
+  free(preds);
+}
+
+/** Affichage du plus court chemin depuis une racine jusqu'à un objet
+ * (parcours en largeur depuis la racine virtuelle).
+ * \param[in] graph le graphe.
+ * \param target l'objet.
+ */
+static void heap_print_path(heap_graph_t *graph, uint32_t target) {
+  uint32_t nb_nodes = graph->nb_objects + 1, root = graph->nb_objects;
+  uint32_t *parents = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  uint32_t *queue = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  uint32_t head = 0, tail = 0, i, k, length = 0;
+
+  assert(parents != NULL && queue != NULL);
+  for (i = 0; i < nb_nodes; i++) {
+    parents[i] = HEAP_NONE;
+  }
+
+  parents[root] = root;
+  queue[tail++] = root;
+  while (head < tail && parents[target] == HEAP_NONE) {
+    uint32_t node = queue[head++];
+    for (k = graph->ref_starts[node]; k < graph->ref_starts[node + 1]; k++) {
+      uint32_t succ = graph->refs[k];
+      if (parents[succ] == HEAP_NONE) {
+        parents[succ] = node;
+        queue[tail++] = succ;
+      }
+    }
+  }
+
+  printf("--- Shortest path from a root to #%u\n", target);
+  if (parents[target] == HEAP_NONE) {
+    printf("object #%u is not reachable from the roots\n", target);
+  } else {
+    // le chemin est remonté dans la file (qui ne sert plus)
+    for (i = target; i != root; i = parents[i]) {
+      queue[length++] = i;
+    }
+    for (k = 0; k < graph->nb_roots; k++) {
+      if (graph->roots[k].object == queue[length - 1]) {
+        heap_print_root(&graph->roots[k]);
+        break;
+      }
+    }
+    while (length > 0) {
+      length = length - 1;
+      printf("  -> #%u %s (%u bytes)\n", queue[length],
+             heap_type_name(graph->types[queue[length]]),
+             graph->sizes[queue[length]]);
+    }
+  }
+
+  free(parents);
+  free(queue);
+}
+
+/** Comparaison des objets par taille retenue décroissante. */
+static const unsigned long long *sort_retained = NULL;
+
+static int heap_compare_retained(const void *a, const void *b) {
+  uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+  if (sort_retained[ia] != sort_retained[ib]) {
+    return (sort_retained[ia] > sort_retained[ib]) ? -1 : 1;
+  }
+  return (ia > ib) - (ia < ib);
+}
+
+/** Petit mode d'emploi */
+static void heap_help(void) {
+  printf("Usage: svm-heap [--top=N] [--path=ID] snapshot.heap\n");
+  printf("   ==> analyze a heap snapshot written by svm\n");
+  printf("Options:\n");
+  printf("   --top=N   : show the N objects retaining the most memory "
+         "(default: %d)\n",
+         HEAP_DEFAULT_TOP);
+  printf("   --path=ID : show the shortest path from a root to object ID\n");
+}
+
+/** Point d'entrée de l'analyseur. */
+int main(int argc, char *argv[]) {
+  heap_graph_t graph;
+  const char *filename = NULL;
+  uint32_t path = HEAP_NONE, top = HEAP_DEFAULT_TOP;
+  uint32_t nb_nodes, nb_reachable, i;
+  uint32_t *postorder, *numbers, *idoms, *order;
+  unsigned long long *retained;
+  unsigned long type_counts[2][HEAP_ENV + 1];
+  unsigned long long type_bytes[2][HEAP_ENV + 1];
+  int t;
+
+  for (i = 1; i < (uint32_t)argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      heap_help();
+      exit(EXIT_SUCCESS);
+    } else if (strncmp(argv[i], "--top=", 6) == 0) {
+      top = (uint32_t)strtoul(&argv[i][6], NULL, 10);
+    } else if (strncmp(argv[i], "--path=", 7) == 0) {
+      path = (uint32_t)strtoul(&argv[i][7], NULL, 10);
+    } else if (filename == NULL) {
+      filename = argv[i];
+    } else {
+      fprintf(stderr, "too many arguments\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (filename == NULL) {
+    fprintf(stderr, "Error: missing heap snapshot\n");
+    heap_help();
+    exit(EXIT_FAILURE);
+  }
+
+  heap_read(&graph, filename);
+  if (path != HEAP_NONE && path >= graph.nb_objects) {
+    fprintf(stderr, "no object #%u in heap snapshot\n", path);
+    exit(EXIT_FAILURE);
+  }
+  nb_nodes = graph.nb_objects + 1;
+
+  postorder = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  numbers = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  idoms = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  retained = (unsigned long long *)calloc(nb_nodes, sizeof(unsigned long long));
+  assert(postorder != NULL && numbers != NULL && idoms != NULL &&
+         retained != NULL);
+
+  nb_reachable = heap_postorder(&graph, postorder, numbers);
+  heap_dominators(&graph, postorder, numbers, nb_reachable, idoms);
+
+  // tailles retenues : un sommet est numéroté avant son dominateur
+  for (i = 0; i < nb_reachable; i++) {
+    uint32_t node = postorder[i];
+    retained[node] = retained[node] + graph.sizes[node];
+    if (idoms[node] != node) {
+      retained[idoms[node]] = retained[idoms[node]] + retained[node];
+    }
+  }
+
+  // comptages par type (0 : accessibles, 1 : inaccessibles)
+  memset(type_counts, 0, sizeof(type_counts));
+  memset(type_bytes, 0, sizeof(type_bytes));
+  for (i = 0; i < graph.nb_objects; i++) {
+    int unreachable = (numbers[i] == HEAP_NONE);
+    t = (graph.types[i] <= HEAP_ENV) ? graph.types[i] : 0;
+    type_counts[unreachable][t] = type_counts[unreachable][t] + 1;
+    type_bytes[unreachable][t] = type_bytes[unreachable][t] + graph.sizes[i];
+  }
+
+  printf("=== Heap snapshot: %s\n", filename);
+  printf("%u objects, %u roots, %llu bytes reachable\n", graph.nb_objects,
+         graph.nb_roots, retained[graph.nb_objects]);
+  printf("--- Objects by type\n");
+  printf("%-12s %12s %14s %12s %14s\n", "type", "reachable", "bytes",
+         "unreachable", "bytes");
+  for (t = 1; t <= HEAP_ENV; t++) {
+    if (type_counts[0][t] == 0 && type_counts[1][t] == 0) continue;
+    printf("%-12s %12lu %14llu %12lu %14llu\n", heap_type_name(t),
+           type_counts[0][t], type_bytes[0][t], type_counts[1][t],
+           type_bytes[1][t]);
+  }
+
+  // classement des objets accessibles par taille retenue
+  order = (uint32_t *)malloc(sizeof(uint32_t) * nb_nodes);
+  assert(order != NULL);
+  for (i = 0; i + 1 < nb_reachable; i++) {
+    order[i] = postorder[i];  // sans la racine virtuelle (la dernière)
+  }
+  sort_retained = retained;
+  qsort(order, nb_reachable - 1, sizeof(uint32_t), heap_compare_retained);
+  printf("--- Largest retained sizes (dominator tree)\n");
+  printf("%10s %-12s %10s %14s %10s\n", "object", "type", "size", "retained",
+         "dominator");
+  for (i = 0; i + 1 < nb_reachable && i < top; i++) {
+    uint32_t node = order[i];
+    printf("%10u %-12s %10u %14llu ", node, heap_type_name(graph.types[node]),
+           graph.sizes[node], retained[node]);
+    if (idoms[node] == graph.nb_objects) {
+      printf("%10s\n", "<roots>");
+    } else {
+      printf("%10u\n", idoms[node]);
+    }
+  }
+
+  if (path != HEAP_NONE) {
+    heap_print_path(&graph, path);
+  }
+  printf("===================\n");
+
+  free(order);
+  free(postorder);
+  free(numbers);
+  free(idoms);
+  free(retained);
+  free(graph.types);
+  free(graph.sizes);
+  free(graph.ref_starts);
+  free(graph.refs);
+  free(graph.roots);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "symtab.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+
+/** \file symtab.c
+ * Chaînes constantes et table globale des symboles (implantation).
+ *
+ * La table contient des pointeurs vers les symboles (NULL pour une case
+ * libre). Sa capacité est une puissance de deux, doublée dès qu'elle est
+ * remplie à moitié : les sondages restent donc courts.
+ ******/
+
+/** La capacité initiale de la table des symboles. */
+#define SYMTAB_INITIAL_CAPACITY 64
+
+/** La table globale des symboles. */
+static struct {
+  symbol_t **slots;      /*!< les cases de la table */
+  unsigned int capacity; /*!< le nombre de cases (puissance de 2) */
+  unsigned int count;    /*!< le nombre de symboles */
+} symtab = {NULL, 0, 0};
+
+/** Allocation d'une chaîne constante (non gérée par le GC).
+ * \param[in] chars les caractères.
+ * \param length le nombre de caractères.
+ * \return la chaîne allouée.
+ */
+string_t *string_make(const char *chars, unsigned int length) {
+  string_t *string = (string_t *)malloc(sizeof(string_t) + length + 1);
+  assert(string != NULL);
+  string->gc_mark = GC_IMMORTAL;  // jamais récupérée (hors du tas du GC)
+  string->length = length;
+  memcpy(string->chars, chars, length);
+  string->chars[length] = '\0';
+  return string;
+}
+
+/** Affichage d'une chaîne entre guillemets (avec échappements). */
+void string_print(string_t *string) {
+  unsigned int i;
+  output_char('"');
+  for (i = 0; i < string->length; i++) {
+    char ch = string->chars[i];
+    if (ch == '"' || ch == '\\') {
+      output_char('\\');
+      output_char(ch);
+    } else if (ch == '\n') {
+      output_string("\\n");
+    } else {
+      output_char(ch);
+    }
+  }
+  output_char('"');
+}
+
+/** Fonction de hachage des noms (FNV-1a). */
+static unsigned int symtab_hash(const char *chars, unsigned int length) {
+  unsigned int i, hash = 2166136261u;
+  for (i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)chars[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/** Agrandissement (ou création) de la table des symboles. */
+static void symtab_grow(void) {
+  unsigned int i, capacity = (symtab.capacity == 0)
+                                 ? SYMTAB_INITIAL_CAPACITY
+                                 : symtab.capacity * 2;
+  symbol_t **slots = (symbol_t **)calloc(capacity, sizeof(symbol_t *));
+  assert(slots != NULL);
+
+  // on réinsère les symboles existants
+  for (i = 0; i < symtab.capacity; i++) {
+    if (symtab.slots[i] != NULL) {
+      unsigned int pos = symtab.slots[i]->hash & (capacity - 1);
+      while (slots[pos] != NULL) {
+        pos = (pos + 1) & (capacity - 1);
+      }
+      slots[pos] = symtab.slots[i];
+    }
+  }
+
+  free(symtab.slots);
+  symtab.slots = slots;
+  symtab.capacity = capacity;
+}
+
+/** Internement d'un symbole.
+ * \param[in] chars les caractères du nom.
+ * \param length la longueur du nom.
+ * \return l'unique symbole portant ce nom (créé au besoin).
+ */
+symbol_t *symtab_intern(const char *chars, unsigned int length) {
+  unsigned int hash = symtab_hash(chars, length);
+  unsigned int pos;
+  symbol_t *symbol;
+
+  if (2 * (symtab.count + 1) > symtab.capacity) {
+    symtab_grow();
+  }
+
+  pos = hash & (symtab.capacity - 1);
+  while (symtab.slots[pos] != NULL) {
+    symbol = symtab.slots[pos];
+    if (symbol->hash == hash && symbol->name->length == length &&
+        memcmp(symbol->name->chars, chars, length) == 0) {
+      return symbol;  // déjà interné
+    }
+    pos = (pos + 1) & (symtab.capacity - 1);
+  }
+
+  symbol = (symbol_t *)malloc(sizeof(symbol_t));
+  assert(symbol != NULL);
+  symbol->hash = hash;
+  symbol->name = string_make(chars, length);
+  symtab.slots[pos] = symbol;
+  symtab.count = symtab.count + 1;
+  return symbol;
+}
+
+/** Libération de la table des symboles (et des symboles). */
+void symtab_destroy(void) {
+  unsigned int i;
+  for (i = 0; i < symtab.capacity; i++) {
+    if (symtab.slots[i] != NULL) {
+      free(symtab.slots[i]->name);
+      free(symtab.slots[i]);
+    }
+  }
+  free(symtab.slots);
+  symtab.slots = NULL;
+  symtab.capacity = 0;
+  symtab.count = 0;
+}
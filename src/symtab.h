@@ -0,0 +1,39 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _SYMTAB_H_
+#define _SYMTAB_H_
+
+#include "value.h"
+
+/** \file symtab.h
+ * Chaînes constantes et table globale des symboles.
+ *
+ * Les symboles sont internés : deux symboles de même nom sont représentés
+ * par le même objet, donc l'égalité de symboles est une simple
+ * comparaison de pointeurs. La table d'internement est une table de
+ * hachage à adressage ouvert (sondage linéaire) globale à la VM. Les
+ * symboles ne sont jamais récupérés par le GC.
+ */
+
+/** Représentation des symboles. */
+typedef struct _symbol {
+  unsigned int hash; /*!< le code de hachage du nom */
+  string_t *name;    /*!< le nom du symbole (chaîne constante) */
+} symbol_t;
+
+/* Chaînes constantes (non gérées par le GC) */
+
+string_t *string_make(const char *chars, unsigned int length);
+void string_print(string_t *string);
+
+/* Table des symboles */
+
+symbol_t *symtab_intern(const char *chars, unsigned int length);
+void symtab_destroy(void);
+
+#endif
@@ -8,11 +8,16 @@
 #include "value.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "constants.h"
 #include "env.h"
+#include "hashtable.h"
+#include "output.h"
+#include "symtab.h"
 
 /** Préparation d'une valeur Unit.
  * \param[in,out] value la valeur à préparer.
@@ -74,8 +79,58 @@ void value_fill_nil(value_t *value) {
   value->data.as_pair = NULL;
 }
 
-/** Tester si la valeur est de type paire. */
-int value_is_pair(value_t *value) { return value->type == T_PAIR; }
+/** Préparation d'une valeur désignant un élément d'un bloc de liste
+ * compact.
+ * \param[in,out] value la valeur à préparer
+ * \param[in] block le bloc (alloué par le GC)
+ * \param index le numéro de l'élément
+ */
+void value_fill_clist(value_t *value, clist_t *block, unsigned int index) {
+  value->type = T_CLIST;
+  value->data.as_clist.block = block;
+  value->data.as_clist.index = index;
+}
+
+/** Préparation d'une valeur de type vecteur.
+ * \param[in,out] value la valeur à préparer
+ * \param[in] vector le vecteur (alloué par le GC) à associer à la valeur
+ */
+void value_fill_vector(value_t *value, vector_t *vector) {
+  value->type = T_VECTOR;
+  value->data.as_vector = vector;
+}
+
+/** Préparation d'une valeur de type vecteur d'entiers.
+ * \param[in,out] value la valeur à préparer
+ * \param[in] vector le vecteur (alloué par le GC) à associer à la valeur
+ */
+void value_fill_i32vector(value_t *value, i32vector_t *vector) {
+  value->type = T_I32VECTOR;
+  value->data.as_i32vector = vector;
+}
+
+/** Préparation d'une valeur de type chaîne.
+ * \param[in,out] value la valeur à préparer
+ * \param[in] string la chaîne à associer à la valeur
+ */
+void value_fill_string(value_t *value, string_t *string) {
+  value->type = T_STRING;
+  value->data.as_string = string;
+}
+
+/** Préparation d'une valeur de type symbole.
+ * \param[in,out] value la valeur à préparer
+ * \param[in] symbol le symbole (interné) à associer à la valeur
+ */
+void value_fill_symbol(value_t *value, symbol_t *symbol) {
+  value->type = T_SYMBOL;
+  value->data.as_symbol = symbol;
+}
+
+/** Tester si la valeur est de type paire (compacte ou non). */
+int value_is_pair(value_t *value) {
+  return value->type == T_PAIR || value->type == T_CLIST;
+}
 
 /** Tester si la valeur est de type primitive. */
 int value_is_prim(value_t *value) { return value->type == T_PRIM; }
@@ -89,10 +144,40 @@ int value_is_int(value_t *value) { return value->type == T_INT; }
 /** Tester si la valeur est de type booléen. */
 int value_is_bool(value_t *value) { return value->type == T_BOOL; }
 
+/** Tester si la valeur est de type vecteur. */
+int value_is_vector(value_t *value) { return value->type == T_VECTOR; }
+
+/** Tester si la valeur est de type vecteur d'entiers. */
+int value_is_i32vector(value_t *value) { return value->type == T_I32VECTOR; }
+
+/** Tester si la valeur est de type chaîne. */
+int value_is_string(value_t *value) { return value->type == T_STRING; }
+
+/** Tester si la valeur est de type symbole. */
+int value_is_symbol(value_t *value) { return value->type == T_SYMBOL; }
+
+/** Tester si la valeur est une donnée immortelle (constante du programme,
+ * cf. GC_IMMORTAL). Les valeurs immédiates ne sont pas concernées. */
+int value_is_immortal(value_t *value) {
+  switch (value->type) {
+    case T_PAIR:
+      return value->data.as_pair != NULL &&
+             value->data.as_pair->gc_mark == GC_IMMORTAL;
+    case T_CLIST:
+      return value->data.as_clist.block->gc_mark == GC_IMMORTAL;
+    case T_VECTOR:
+      return value->data.as_vector->gc_mark == GC_IMMORTAL;
+    case T_STRING:
+      return value->data.as_string->gc_mark == GC_IMMORTAL;
+    default:
+      return 0;
+  }
+}
+
 /** Tester si la valeur est la paire vide */
 int value_is_nil(value_t *value) {
-  assert(value->type == T_PAIR);
-  return value->data.as_pair == NULL;
+  assert(value_is_pair(value));
+  return value->type == T_PAIR && value->data.as_pair == NULL;
 }
 
 /** Tester si la valeur est #t */
@@ -131,24 +216,102 @@ pair_t *value_pair_get(value_t *value) {
   return value->data.as_pair;
 }
 
+/** Récupérer le vecteur */
+vector_t *value_vector_get(value_t *value) {
+  assert(value->type == T_VECTOR);
+  return value->data.as_vector;
+}
+
+/** Récupérer le vecteur d'entiers */
+i32vector_t *value_i32vector_get(value_t *value) {
+  assert(value->type == T_I32VECTOR);
+  return value->data.as_i32vector;
+}
+
+/** Récupérer la chaîne */
+string_t *value_string_get(value_t *value) {
+  assert(value->type == T_STRING);
+  return value->data.as_string;
+}
+
+/** Récupérer le symbole */
+symbol_t *value_symbol_get(value_t *value) {
+  assert(value->type == T_SYMBOL);
+  return value->data.as_symbol;
+}
+
+/** Représentant d'une paire.
+ * Un élément de bloc de liste remplacé par une vraie paire (CDR_FORWARD)
+ * est représenté par celle-ci. Deux valeurs désignent la même paire si et
+ * seulement si leurs représentants sont identiques.
+ * \param[in] value la valeur (de type paire).
+ * \return le représentant (la valeur elle-même en général).
+ */
+value_t *value_pair_canonical(value_t *value) {
+  if (value->type == T_CLIST) {
+    clist_t *block = value->data.as_clist.block;
+    unsigned int index = value->data.as_clist.index;
+    if (block->codes[index] == CDR_FORWARD) {
+      return &block->cars[index];
+    }
+  }
+  return value;
+}
+
+/** Identité d'un objet du tas (paire ou vecteur).
+ * \param[in] value la valeur.
+ * \return l'adresse de la paire, de l'élément de bloc de liste ou du
+ * vecteur, NULL pour les autres valeurs (et pour la liste vide).
+ */
+const void *value_node(value_t *value) {
+  if (value_is_pair(value)) {
+    if (value_is_nil(value)) return NULL;
+    value = value_pair_canonical(value);
+    if (value->type == T_CLIST) {
+      return &value->data.as_clist.block->cars[value->data.as_clist.index];
+    }
+    return value->data.as_pair;
+  }
+  if (value->type == T_VECTOR) return value->data.as_vector;
+  return NULL;
+}
+
 /** Récupérer le car (premier élément) d'une valeur de type paire.
  * \return un pointeur sur la valeur du car.
  */
 value_t *value_get_car(value_t *value) {
   // Précondition: la valeur est une paire, et elle n'est pas vide.
-  assert(value_is_pair(value) && value->data.as_pair);
+  assert(value_is_pair(value) && !value_is_nil(value));
 
+  value = value_pair_canonical(value);
+  if (value->type == T_CLIST) {
+    return &value->data.as_clist.block->cars[value->data.as_clist.index];
+  }
   return &(value->data.as_pair->car);
 }
 
 /** Récupérer le cdr (second élément) d'une valeur de type paire.
- * \return un pointeur sur la valeur du cdr.
+ * Remarque : dans un bloc de liste, le cdr n'est pas stocké (il est
+ * implicite), il est donc retourné par valeur.
+ * \return la valeur du cdr.
  */
-value_t *value_get_cdr(value_t *value) {
+value_t value_get_cdr(value_t *value) {
   // Précondition: la valeur est une paire, et elle n'est pas vide
-  assert(value_is_pair(value) && value->data.as_pair);
-
-  return &(value->data.as_pair->cdr);
+  assert(value_is_pair(value) && !value_is_nil(value));
+
+  value = value_pair_canonical(value);
+  if (value->type == T_CLIST) {
+    clist_t *block = value->data.as_clist.block;
+    unsigned int index = value->data.as_clist.index;
+    value_t cdr;
+    if (index + 1 < block->length) {
+      value_fill_clist(&cdr, block, index + 1);
+    } else {
+      cdr = block->tail;
+    }
+    return cdr;
+  }
+  return value->data.as_pair->cdr;
 }
 
 extern pair_t *gc_alloc_pair(struct _vm *vm);
@@ -160,6 +323,12 @@ extern pair_t *gc_alloc_pair(struct _vm *vm);
 void value_set_car(struct _vm *vm, value_t *value, value_t *car) {
   // Précondition: la valeur est une paire
   assert(value_is_pair(value));
+  value = value_pair_canonical(value);
+  if (value->type == T_CLIST) {
+    // le car est stocké dans le bloc
+    value->data.as_clist.block->cars[value->data.as_clist.index] = *car;
+    return;
+  }
   pair_t *pair = value->data.as_pair;
 
   // si on n'a pas encore alloué de couple, on le fait maintenant
@@ -177,6 +346,24 @@ void value_set_car(struct _vm *vm, value_t *value, value_t *car) {
  */
 void value_set_cdr(struct _vm *vm, value_t *value, value_t *cdr) {
   assert(value_is_pair(value));
+  value = value_pair_canonical(value);
+  if (value->type == T_CLIST) {
+    clist_t *block = value->data.as_clist.block;
+    unsigned int index = value->data.as_clist.index;
+    value_t forward;
+    if (index + 1 == block->length) {
+      // dernier élément : son cdr est stocké dans le bloc
+      block->tail = *cdr;
+      return;
+    }
+    // la contiguïté est rompue : l'élément devient une vraie paire
+    value_fill_nil(&forward);
+    value_set_car(vm, &forward, &block->cars[index]);
+    value_set_cdr(vm, &forward, cdr);
+    block->cars[index] = forward;
+    block->codes[index] = CDR_FORWARD;
+    return;
+  }
   pair_t *pair = value->data.as_pair;
 
   // si on n'a pas encore alloué de couple, on le fait maintenant
@@ -188,53 +375,387 @@ void value_set_cdr(struct _vm *vm, value_t *value, value_t *cdr) {
   pair->cdr = *cdr;
 }
 
-/** Fonction interne d'affichage de valeur.
- * \param[in] value la valeur à afficher.
- * \param[in] in_cdr si 1 (true) alors on est dans un cdr, 0 (false) sinon
+/*
+ * Fonction d'affichage
+ */
+
+/** Profondeur maximale d'affichage (0 : pas de limite). */
+static unsigned int print_max_depth = 0;
+
+/** Nombre maximal d'éléments affichés par liste ou vecteur (0 : pas de
+ * limite). */
+static unsigned int print_max_length = 0;
+
+/** Si 1 (true) les objets partagés (et donc les cycles) sont affichés avec
+ * des étiquettes `#n=` et `#n#`. */
+static int print_shared = 0;
+
+/** Réglage de l'affichage des valeurs.
+ * Sans étiquettes, les cycles sur les cdr sont détectés (algorithme du
+ * lièvre et de la tortue) et la liste est tronquée par `...`. Les cycles
+ * par les car et les éléments de vecteurs sont détectés sur la pile des
+ * conteneurs en cours d'affichage (algorithme de Brent) : le conteneur qui
+ * se contient est affiché `...`, au plus quelques tours de cycle plus bas.
+ * \param depth la profondeur maximale (0 : pas de limite).
+ * \param length le nombre maximal d'éléments par liste ou vecteur
+ * (0 : pas de limite).
+ * \param shared si 1 (true) les objets partagés sont étiquetés (parcours
+ * préalable complet de la valeur).
  */
-static void value_print_intern(value_t *value, int in_cdr) {
-  if (value->type == T_PAIR) {
-    if (!in_cdr) printf("(");
+void value_print_limits(unsigned int depth, unsigned int length, int shared) {
+  print_max_depth = depth;
+  print_max_length = length;
+  print_shared = shared;
+}
 
-    if (value->data.as_pair) {
-      if (in_cdr) printf(" ");
-      value_print_intern(&(value->data.as_pair->car), 0);
-      value_print_intern(&(value->data.as_pair->cdr), 1);  // dans un cdr
+/** Taille de la pile d'affichage locale (au-delà elle est allouée). */
+#define PRINT_STACK_SIZE 32
+
+/** Étapes de l'affichage d'un conteneur. */
+typedef enum {
+  PRINT_LIST,   /*!< éléments suivants d'une liste */
+  PRINT_VECTOR, /*!< éléments suivants d'un vecteur */
+  PRINT_CLOSE   /*!< parenthèse fermante (après un cdr pointé) */
+} print_kind_t;
+
+/** Conteneur en cours d'affichage (pile explicite de l'afficheur). */
+typedef struct {
+  print_kind_t kind;  /*!< l'étape */
+  value_t value;      /*!< la dernière paire affichée, ou le vecteur */
+  value_t slow;       /*!< la tortue (détection des cycles de cdr) */
+  unsigned int count; /*!< le nombre d'éléments affichés */
+  const void *node;   /*!< le conteneur (première paire, ou le vecteur) */
+} print_frame_t;
+
+/** Objet du tas rencontré par le parcours préalable. */
+typedef struct {
+  const void *node; /*!< l'objet (NULL si la case est libre) */
+  int shared;       /*!< 1 (true) si l'objet est atteint plusieurs fois */
+  int label;        /*!< l'étiquette (-1 si pas encore affichée) */
+} print_label_t;
+
+/** Table des objets rencontrés (adressage ouvert). */
+typedef struct {
+  print_label_t *labels;  /*!< les cases */
+  unsigned int capacity;  /*!< le nombre de cases (puissance de 2) */
+  unsigned int count;     /*!< le nombre d'objets */
+  int next_label;         /*!< la prochaine étiquette */
+} print_labels_t;
+
+/** Recherche (ou ajout) d'un objet dans la table des étiquettes.
+ * \param create si 1 (true) l'objet est ajouté s'il est absent.
+ * \return l'entrée de l'objet, ou NULL s'il est absent (et non ajouté).
+ */
+static print_label_t *print_label(print_labels_t *labels, const void *node,
+                                  int create) {
+  unsigned int i, mask;
+
+  if (create && 2 * (labels->count + 1) > labels->capacity) {
+    print_labels_t bigger;
+    bigger.capacity = (labels->capacity == 0) ? 64 : 2 * labels->capacity;
+    bigger.count = 0;
+    bigger.next_label = 0;
+    bigger.labels =
+        (print_label_t *)calloc(bigger.capacity, sizeof(print_label_t));
+    assert(bigger.labels != NULL);
+    for (i = 0; i < labels->capacity; i++) {
+      if (labels->labels[i].node != NULL) {
+        *print_label(&bigger, labels->labels[i].node, 1) = labels->labels[i];
+      }
     }
+    free(labels->labels);
+    *labels = bigger;
+  }
+  if (labels->capacity == 0) return NULL;
 
-    if (!in_cdr) printf(")");
+  mask = labels->capacity - 1;
+  i = (unsigned int)(((uintptr_t)node >> 4) * 2654435761u) & mask;
+  while (labels->labels[i].node != NULL) {
+    if (labels->labels[i].node == node) return &labels->labels[i];
+    i = (i + 1) & mask;
+  }
+  if (!create) return NULL;
+  labels->labels[i].node = node;
+  labels->labels[i].shared = 0;
+  labels->labels[i].label = -1;
+  labels->count = labels->count + 1;
+  return &labels->labels[i];
+}
 
-  } else {
-    if (in_cdr) printf(". ");
+/** Recherche des objets partagés d'une valeur (parcours préalable). */
+static void print_scan(print_labels_t *labels, value_t *root) {
+  value_t *todo = NULL;
+  unsigned int nb_todo = 0, capacity = 0, i;
+  value_t value = *root;
+
+  for (;;) {
+    const void *node = value_node(&value);
+    print_label_t *label;
+
+    if (node == NULL || (label = print_label(labels, node, 0)) != NULL) {
+      if (node != NULL) label->shared = 1;
+      // objet déjà vu (ou atome) : on passe à la valeur suivante
+      if (nb_todo == 0) break;
+      nb_todo = nb_todo - 1;
+      value = todo[nb_todo];
+      continue;
+    }
+    print_label(labels, node, 1);
+
+    if (value_is_pair(&value)) {
+      // le car est mis de côté, le parcours continue sur le cdr
+      if (nb_todo == capacity) {
+        capacity = (capacity == 0) ? 64 : 2 * capacity;
+        todo = (value_t *)realloc(todo, sizeof(value_t) * capacity);
+        assert(todo != NULL);
+      }
+      todo[nb_todo] = *value_get_car(&value);
+      nb_todo = nb_todo + 1;
+      value = value_get_cdr(&value);
+    } else {
+      vector_t *vector = value.data.as_vector;
+      if (nb_todo + vector->size > capacity) {
+        capacity = 2 * (nb_todo + vector->size);
+        todo = (value_t *)realloc(todo, sizeof(value_t) * capacity);
+        assert(todo != NULL);
+      }
+      for (i = 0; i < vector->size; i++) {
+        todo[nb_todo] = vector->content[i];
+        nb_todo = nb_todo + 1;
+      }
+      value_fill_unit(&value);
+    }
+  }
+  free(todo);
+}
 
-    switch (value->type) {
-      case T_UNIT:
-        printf("<unit>");
-        break;
-      case T_PRIM:
-        printf("Primitive[%d]", value->data.as_int);
-        break;
-      case T_FUN:
-        printf("Closure@%d", value->data.as_closure.pc);
-        printf(" - ");
-        env_print(value->data.as_closure.env);
-        printf(">");
-        break;
-      case T_INT:
-        printf("%d", value->data.as_int);
-        break;
-      case T_BOOL:
-        printf(value->data.as_int ? "#t" : "#f");
-        break;
-      case T_PAIR:  // déjà traité
+/** Affichage d'une valeur qui n'est ni une paire ni un vecteur non vides.
+ * \return 1 (true) si la valeur a été affichée, 0 (false) sinon.
+ */
+static int print_atom(value_t *value, int display) {
+  if (value_is_pair(value)) {
+    if (!value_is_nil(value)) return 0;
+    output_string("()");
+    return 1;
+  }
+
+  switch (value->type) {
+    case T_UNIT:
+      output_string("<unit>");
+      break;
+    case T_PRIM:
+      output_string("Primitive[");
+      output_int(value->data.as_int);
+      output_char(']');
+      break;
+    case T_FUN:
+      output_string("Closure@");
+      output_int(value->data.as_closure.pc);
+      output_string(" - ");
+      env_print(value->data.as_closure.env);
+      output_char('>');
+      break;
+    case T_INT:
+      output_int(value->data.as_int);
+      break;
+    case T_BOOL:
+      output_string(value->data.as_int ? "#t" : "#f");
+      break;
+    case T_VECTOR:
+      if (value->data.as_vector->size > 0) return 0;
+      output_string("#()");
+      break;
+    case T_I32VECTOR: {
+      unsigned int i;
+      output_string("#i32(");
+      for (i = 0; i < value->data.as_i32vector->size; i++) {
+        if (i > 0) output_char(' ');
+        output_int(value->data.as_i32vector->data[i]);
+      }
+      output_char(')');
+    } break;
+    case T_STRING:
+      if (display) {
+        output_chars(value->data.as_string->chars,
+                     value->data.as_string->length);
+      } else {
+        string_print(value->data.as_string);
+      }
+      break;
+    case T_SYMBOL:
+      output_chars(value->data.as_symbol->name->chars,
+                   value->data.as_symbol->name->length);
+      break;
+    case T_HASHTABLE:
+      // le contenu n'est pas affiché, seulement le nombre d'associations
+      output_string("#<hash-table ");
+      output_int(hashtable_count(value->data.as_hashtable));
+      output_char('>');
+      break;
+  }
+  return 1;
+}
+
+/** Fonction interne d'affichage de valeur.
+ * L'affichage est itératif : les listes sont parcourues en boucle sur les
+ * cdr et les conteneurs imbriqués sont empilés sur une pile explicite
+ * (locale, allouée seulement au-delà de PRINT_STACK_SIZE niveaux).
+ * \param[in] root la valeur à afficher.
+ * \param[in] display si 1 (true) les chaînes sont affichées telles quelles
+ * (primitive display), sinon entre guillemets.
+ */
+static void value_print_intern(value_t *root, int display) {
+  print_frame_t local[PRINT_STACK_SIZE];
+  print_frame_t *frames = local, *frame;
+  unsigned int nb_frames = 0, capacity = PRINT_STACK_SIZE;
+  print_labels_t labels = {NULL, 0, 0, 0};
+  value_t value = *root;
+  int pending = 1;  // 1 (true) si value reste à afficher
+
+  if (print_shared) {
+    print_scan(&labels, root);
+  }
+
+  for (;;) {
+    if (pending) {
+      pending = 0;
+      if (print_atom(&value, display)) continue;
+
+      // paire ou vecteur non vide
+      if (print_shared) {
+        print_label_t *label = print_label(&labels, value_node(&value), 0);
+        if (label->shared) {
+          output_char('#');
+          if (label->label >= 0) {
+            output_int(label->label);
+            output_char('#');
+            continue;
+          }
+          label->label = labels.next_label;
+          labels.next_label = labels.next_label + 1;
+          output_int(label->label);
+          output_char('=');
+        }
+      }
+      if (print_max_depth > 0 && nb_frames >= print_max_depth) {
+        output_string("...");
+        continue;
+      }
+      if (!print_shared && nb_frames > 0) {
+        // cycle par un car ou un élément de vecteur : la suite des
+        // conteneurs empilés devient périodique, on la compare (Brent) à
+        // l'ancêtre de profondeur 2^k immédiatement inférieure
+        unsigned int k = 1;
+        while (2 * k <= nb_frames) k = 2 * k;
+        if (frames[k - 1].node == value_node(&value)) {
+          output_string("...");
+          continue;
+        }
+      }
+
+      if (nb_frames == capacity) {
+        print_frame_t *bigger =
+            (print_frame_t *)malloc(sizeof(print_frame_t) * 2 * capacity);
+        assert(bigger != NULL);
+        memcpy(bigger, frames, sizeof(print_frame_t) * capacity);
+        if (frames != local) free(frames);
+        frames = bigger;
+        capacity = 2 * capacity;
+      }
+      frame = &frames[nb_frames];
+      nb_frames = nb_frames + 1;
+      frame->value = value;
+      frame->slow = value;
+      frame->count = 1;
+      frame->node = value_node(&value);
+      if (value_is_pair(&value)) {
+        frame->kind = PRINT_LIST;
+        output_char('(');
+        value = *value_get_car(&value);
+      } else {
+        frame->kind = PRINT_VECTOR;
+        output_string("#(");
+        value = value.data.as_vector->content[0];
+      }
+      pending = 1;
+      continue;
+    }
+
+    if (nb_frames == 0) break;
+    frame = &frames[nb_frames - 1];
+
+    switch (frame->kind) {
+      case PRINT_LIST: {
+        value_t cdr = value_get_cdr(&frame->value);
+        if (!value_is_pair(&cdr) ||
+            (print_shared && !value_is_nil(&cdr) &&
+             print_label(&labels, value_node(&cdr), 0)->shared)) {
+          // cdr pointé (ou partagé, pour afficher son étiquette)
+          output_string(". ");
+          frame->kind = PRINT_CLOSE;
+          value = cdr;
+          pending = 1;
+        } else if (value_is_nil(&cdr)) {
+          output_char(')');
+          nb_frames = nb_frames - 1;
+        } else if (print_max_length > 0 &&
+                   frame->count >= print_max_length) {
+          output_string(" ...)");
+          nb_frames = nb_frames - 1;
+        } else {
+          frame->value = cdr;
+          frame->count = frame->count + 1;
+          if (!print_shared) {
+            // la tortue avance d'une paire quand le lièvre en fait deux
+            if (frame->count % 2 == 1) {
+              frame->slow = value_get_cdr(&frame->slow);
+            }
+            if (value_node(&frame->slow) == value_node(&cdr)) {
+              output_string(" ...)");  // cycle
+              nb_frames = nb_frames - 1;
+              break;
+            }
+          }
+          output_char(' ');
+          value = *value_get_car(&cdr);
+          pending = 1;
+        }
+      } break;
+
+      case PRINT_VECTOR: {
+        vector_t *vector = frame->value.data.as_vector;
+        if (frame->count == vector->size) {
+          output_char(')');
+          nb_frames = nb_frames - 1;
+        } else if (print_max_length > 0 &&
+                   frame->count >= print_max_length) {
+          output_string(" ...)");
+          nb_frames = nb_frames - 1;
+        } else {
+          output_char(' ');
+          value = vector->content[frame->count];
+          frame->count = frame->count + 1;
+          pending = 1;
+        }
+      } break;
+
+      case PRINT_CLOSE:
+        output_char(')');
+        nb_frames = nb_frames - 1;
         break;
     }
   }
+
+  if (frames != local) free(frames);
+  free(labels.labels);
 }
 
 /** Affichage d'une valeur (pour débogage).
  * \param[in] value la valeur à afficher.
  */
-void value_print(value_t *value) {
-  value_print_intern(value, 0);  // pas dans un cdr au début
-}
+void value_print(value_t *value) { value_print_intern(value, 0); }
+
+/** Affichage d'une valeur par la primitive display.
+ * \param[in] value la valeur à afficher.
+ */
+void value_display(value_t *value) { value_print_intern(value, 1); }
@@ -16,7 +16,13 @@
  * également pour la liste vide).
  *  - un entier
  *  - un booléen #t ou #f
- *  - une paire (car,cdr)
+ *  - une paire (car,cdr), éventuellement codée de façon compacte dans un
+ *    bloc de liste (cf. clist_t)
+ *  - un vecteur (tableau de valeurs)
+ *  - un vecteur d'entiers 32 bits non-encapsulés (i32vector)
+ *  - une chaîne de caractères (immuable)
+ *  - un symbole (interné, cf. symtab.h)
+ *  - une table de hachage (cf. hashtable.h)
  *  - un numéro de primitive
  *  - une fermeture
  */
@@ -24,8 +30,47 @@
 /* références en avant */
 struct _vm;
 struct _pair;
+struct _vector;
+struct _i32vector;
+struct _string;
+struct _symbol;
+struct _hashtable;
+struct _clist;
 struct _env;
 
+/** Type des vecteurs.
+ * Ce type est interne à la VM (il n'est pas connu du compilateur) : on le
+ * numérote donc en dehors des constantes générées (cf. T_ENV). */
+#define T_VECTOR 1000
+
+/** Type des vecteurs d'entiers (i32vector), également interne à la VM. */
+#define T_I32VECTOR 1001
+
+/** Types des chaînes et des symboles, internes à la VM.
+ * Ces numéros servent aussi de type dans les instructions PUSH qui font
+ * référence à la table des chaînes du programme (cf. bytecode.h). */
+#define T_STRING 1002
+#define T_SYMBOL 1003
+
+/** Type des tables de hachage, interne à la VM. */
+#define T_HASHTABLE 1004
+
+/** Type des paires codées dans un bloc de liste compact (cf. clist_t),
+ * interne à la VM : pour les primitives, ce sont des paires comme les
+ * autres (cf. value_is_pair). */
+#define T_CLIST 1005
+
+/** Marque des données immortelles (constantes du programme, chaînes et
+ * noms de symboles) : allouées hors du tas, elles ne sont jamais parcourues
+ * ni récupérées par le GC, et les primitives refusent de les modifier. */
+#define GC_IMMORTAL (-1)
+
+/** Référence à un élément d'un bloc de liste compact. */
+typedef struct {
+  struct _clist *block; /*!< le bloc */
+  unsigned int index;   /*!< le numéro de l'élément dans le bloc */
+} clist_ref_t;
+
 /** Structure pour les fermetures.
  */
 typedef struct {
@@ -38,7 +83,15 @@ union _value_data {
   int as_int; /*!< si entier (T_INT), No de primitive (T_PRIM), ou booléen
                  (T_BOOL) */
   struct _pair *as_pair; /*!< si c'est une paire (T_PAIR) */
+  struct _vector *as_vector; /*!< si c'est un vecteur (T_VECTOR) */
+  struct _i32vector
+      *as_i32vector; /*!< si c'est un vecteur d'entiers (T_I32VECTOR) */
+  struct _string *as_string; /*!< si c'est une chaîne (T_STRING) */
+  struct _symbol *as_symbol; /*!< si c'est un symbole (T_SYMBOL) */
+  struct _hashtable
+      *as_hashtable; /*!< si c'est une table de hachage (T_HASHTABLE) */
   closure_t as_closure;  /*!< si c'est une fermeture (T_CLOSURE) */
+  clist_ref_t as_clist;  /*!< si c'est une paire compacte (T_CLIST) */
 };
 
 /** Représentation d'une valeur.
@@ -59,6 +112,60 @@ typedef struct _pair {
   int gc_mark; /*!< la valeur de la marque (0 ou 1). */
 } pair_t;
 
+/** Codes cdr des éléments d'un bloc de liste compact. */
+#define CDR_NEXT 0    /*!< le cdr est l'élément suivant (ou tail) */
+#define CDR_FORWARD 1 /*!< l'élément a été remplacé par une vraie paire */
+
+/** Représentation compacte des listes ("cdr-coding").
+Un bloc contient les car de length paires consécutives : le cdr de
+l'élément i est implicitement l'élément i+1, et celui du dernier élément
+est tail. Lorsqu'un set-cdr! rompt cette contiguïté, l'élément est
+remplacé par une vraie paire : son code devient CDR_FORWARD et son car
+contient la paire (les références à l'élément la désignent désormais).
+Un bloc est géré par le GC comme un tout.
+ */
+typedef struct _clist {
+  int gc_mark;          /*!< la valeur de la marque (0 ou 1). */
+  unsigned int length;  /*!< le nombre d'éléments. */
+  value_t tail;         /*!< le cdr du dernier élément. */
+  unsigned char *codes; /*!< les codes cdr (à la suite des car). */
+  value_t cars[];       /*!< les car des éléments. */
+} clist_t;
+
+/** Représentation des vecteurs.
+Les éléments sont rangés de façon contiguë à la suite de l'entête, ce qui
+permet un accès indexé en temps constant. Comme les paires, les vecteurs
+sont gérés par le GC.
+ */
+typedef struct _vector {
+  int gc_mark;       /*!< la valeur de la marque (0 ou 1). */
+  unsigned int size; /*!< le nombre d'éléments. */
+  value_t content[]; /*!< les éléments. */
+} vector_t;
+
+/** Représentation des vecteurs d'entiers (i32vector).
+Les éléments sont des entiers bruts (non-encapsulés dans des value_t)
+rangés dans un tampon aligné pour les noyaux SIMD (cf. i32vector.h) :
+le GC ne les parcourt jamais.
+ */
+typedef struct _i32vector {
+  int gc_mark;       /*!< la valeur de la marque (0 ou 1). */
+  unsigned int size; /*!< le nombre d'éléments. */
+  int *data;         /*!< les éléments (tampon aligné). */
+} i32vector_t;
+
+/** Représentation des chaînes de caractères.
+Une chaîne est un unique bloc contenant sa longueur puis ses caractères
+(suivis d'un zéro terminal pour l'affichage). Les chaînes sont immuables :
+celles du programme (et les noms des symboles) sont allouées une fois pour
+toutes, les autres (construites par les primitives) sont gérées par le GC.
+ */
+typedef struct _string {
+  int gc_mark;         /*!< la valeur de la marque (0 ou 1). */
+  unsigned int length; /*!< le nombre de caractères. */
+  char chars[];        /*!< les caractères. */
+} string_t;
+
 /*
  * Initialiseurs
  */
@@ -71,16 +178,27 @@ void value_fill_bool(value_t *value, int flag);
 void value_fill_true(value_t *value);
 void value_fill_false(value_t *value);
 void value_fill_nil(value_t *value);
+void value_fill_clist(value_t *value, clist_t *block, unsigned int index);
+void value_fill_vector(value_t *value, vector_t *vector);
+void value_fill_i32vector(value_t *value, i32vector_t *vector);
+void value_fill_string(value_t *value, string_t *string);
+void value_fill_symbol(value_t *value, struct _symbol *symbol);
 
 /*
  * Reconnaisseurs
  */
 
 int value_is_pair(value_t *value);
+int value_is_nil(value_t *value);
 int value_is_prim(value_t *value);
 int value_is_closure(value_t *value);
 int value_is_int(value_t *value);
 int value_is_bool(value_t *value);
+int value_is_vector(value_t *value);
+int value_is_i32vector(value_t *value);
+int value_is_string(value_t *value);
+int value_is_symbol(value_t *value);
+int value_is_immortal(value_t *value);
 
 /*
  * Accesseurs
@@ -92,13 +210,19 @@ int value_is_true(value_t *value);
 int value_is_false(value_t *value);
 closure_t value_closure_get(value_t *value);
 pair_t *value_pair_get(value_t *value);
+vector_t *value_vector_get(value_t *value);
+i32vector_t *value_i32vector_get(value_t *value);
+string_t *value_string_get(value_t *value);
+struct _symbol *value_symbol_get(value_t *value);
 
 /*
  * Manipulation des paires.
  */
 
+value_t *value_pair_canonical(value_t *value);
+const void *value_node(value_t *value);
 value_t *value_get_car(value_t *value);
-value_t *value_get_cdr(value_t *value);
+value_t value_get_cdr(value_t *value);
 void value_set_car(struct _vm *vm, value_t *value, value_t *car);
 void value_set_cdr(struct _vm *vm, value_t *value, value_t *cdr);
 
@@ -106,6 +230,8 @@ void value_set_cdr(struct _vm *vm, value_t *value, value_t *cdr);
  * Fonction d'affichage
  */
 
+void value_print_limits(unsigned int depth, unsigned int length, int shared);
 void value_print(value_t *value);
+void value_display(value_t *value);
 
 #endif
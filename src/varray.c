@@ -11,6 +11,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "output.h"
+
 /** Allocation d'un tableau de valeurs.
  * Remarque : les tableaux de valeurs ne sont pas directement gérés
  * par le GC, donc on trouve l'allocateur ici.
@@ -176,14 +178,14 @@ void varray_destroy(varray_t *varray) {
  */
 void varray_print(varray_t *varray) {
   int i;
-  printf("[");
+  output_char('[');
   for (i = 0; i < varray_size(varray); i++) {
     if ((i > 0) && i < varray_size(varray)) {
-      printf(" ");
+      output_char(' ');
     }
     value_print(varray_at(varray, i));
   }
-  printf("]");
+  output_char(']');
 }
 
 /** Affichage d'un tableau de valeurs sur la sortie standard (pour débogage).
@@ -192,16 +194,16 @@ void varray_print(varray_t *varray) {
  */
 void varray_stack_print(varray_t *varray) {
   int i;
-  printf("[");
+  output_char('[');
   if (!varray_empty(varray)) {
     value_print(varray_top(varray));
-    printf("|");
+    output_char('|');
   }
   for (i = 1; i < varray_size(varray); i++) {
     if ((i > 1) && i < varray_size(varray)) {
-      printf(" ");
+      output_char(' ');
     }
     value_print(varray_top_at(varray, i));
   }
-  printf("]");
+  output_char(']');
 }
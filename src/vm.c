@@ -14,8 +14,14 @@
 #include "constants.h"
 #include "env.h"
 #include "gc.h"
+#include "output.h"
+#include "perfctr.h"
 #include "prim.h"
+#include "probes.h"
+#include "profile.h"
+#include "regvm.h"
 #include "varray.h"
+#include "vm_stats.h"
 
 /** Initialisation de la machine virtuelle.
  * \param[in] program le programme en bytecode à exécuter.
@@ -31,7 +37,11 @@ vm_t *init_vm(program_t *program, int debug_vm, int debug_gc,
   assert(vm != NULL);
 
   vm->debug_vm = debug_vm;
+  vm->engine = VM_ENGINE_STACK;
   vm->program = program;
+  vm->rprogram = NULL;
+  vm->profile = NULL;
+  vm->perfctr = NULL;
   // initialize globals
   vm->globs = varray_allocate(GLOBS_SIZE);
   varray_expandn(vm->globs, 1);
@@ -50,6 +60,8 @@ vm_t *init_vm(program_t *program, int debug_vm, int debug_gc,
 
   // initialize GC
   vm->gc = init_gc(debug_gc, collection_frequency);
+  vm_stats_init(&vm->stats);
+  vm->gc->vm_stats = &vm->stats;
 
   return vm;
 }
@@ -99,13 +111,14 @@ void vm_execute_instr(vm_t *vm, int instr) {
       vm->frame->env = env;
     } break;
 
-    case I_DELETE: {
-      env_t *env = vm->frame->env;
-      vm->frame->env = env->next;
+    case I_DELETE:
+      // l'environnement est alloué par le GC (cf. I_ALLOC) et peut être
+      // capturé par une fermeture : le libérer ici provoquerait un accès
+      // après libération, puis une double libération au balayage. C'est
+      // le GC qui le récupérera (de même pour R_DELETE, cf. regvm.c).
+      vm->frame->env = vm->frame->env->next;
       vm_next(vm);
-      varray_destroy(env->content);
-      free(env);
-    } break;
+      break;
 
       // dépiler le sommet de pile et le sauvegarder dans l'environnement local
     case I_STORE:
@@ -142,11 +155,22 @@ void vm_execute_instr(vm_t *vm, int instr) {
         case T_BOOL:  // place un booléen
           value_fill_bool(&value, vm_next(vm));
           break;
+        case T_STRING:  // placer une chaîne de la table du programme
+          value = vm->program->strings[vm_next(vm)];
+          break;
+        case T_SYMBOL:  // placer un symbole (interné au chargement)
+          value = vm->program->symbols[vm_next(vm)];
+          break;
+        case T_CONST:  // placer une constante (immortelle) du programme
+          value = vm->program->consts[vm_next(vm)];
+          break;
         case T_PAIR:  // placer une paire (on ne devrait pas avoir ce cas)
+          output_flush();
           printf("No immediate pair ! (please report)");
           exit(EXIT_FAILURE);
           break;
         default:
+          output_flush();
           printf("Unknow type: %d (in push)\n",
                  vm->program->bytecode[vm->frame->pc - 1]);
           exit(EXIT_FAILURE);
@@ -156,6 +180,33 @@ void vm_execute_instr(vm_t *vm, int instr) {
       varray_push(vm->stack, &value);
     } break;
 
+      // empiler une constante calculée par le chargeur
+    case I_CONST:
+      varray_push(vm->stack, &vm->program->consts[vm_next(vm)]);
+      break;
+
+      // empiler une copie d'une valeur de la pile
+    case I_SFETCH: {
+      // copie préalable : varray_push peut réallouer la pile
+      value_t val = *varray_top_at(vm->stack, vm_next(vm));
+      varray_push(vm->stack, &val);
+    } break;
+
+      // dépiler le sommet et le ranger plus bas dans la pile
+    case I_SSTORE: {
+      value_t *val = varray_pop(vm->stack);
+      varray_set_top_at(vm->stack, vm_next(vm), val);
+    } break;
+
+      // retirer les valeurs situées sous le sommet de pile
+      // (comme RETURN mais sans changer de cadre d'appel)
+    case I_SLIDE: {
+      int n = vm_next(vm);
+      value_t *res = varray_pop(vm->stack);
+      varray_popn(vm->stack, n);
+      varray_push(vm->stack, res);
+    } break;
+
       // dépiler
     case I_POP: {
       value_t *val = varray_pop(vm->stack);
@@ -165,7 +216,7 @@ void vm_execute_instr(vm_t *vm, int instr) {
           printf("DISPLAY> ");
         }
         value_print(val);
-        printf("\n");
+        output_char('\n');
       }
     } break;
 
@@ -192,6 +243,9 @@ void vm_execute_instr(vm_t *vm, int instr) {
           // empiler une nouvelle call frame.
           vm->frame = frame_push(vm->frame, env, vm->stack->top, vm->frame->pc);
           vm->frame->pc = closure.pc;
+          vm->frame->fun_pc = closure.pc;
+          SVM_PROBE_FUNCTION_ENTRY(closure.pc, nb_args);
+          VM_STATS_CALL(vm);
           break;
         }
 
@@ -205,6 +259,7 @@ void vm_execute_instr(vm_t *vm, int instr) {
         }
 
         default:
+          output_flush();
           printf("Unable to call: %d\n", fun->type);
           exit(EXIT_FAILURE);
       }
@@ -220,6 +275,7 @@ void vm_execute_instr(vm_t *vm, int instr) {
 
       vm->stack->top = vm->frame->sp;
       varray_push(vm->stack, res);
+      SVM_PROBE_FUNCTION_RETURN(vm->frame->fun_pc);
       vm->frame = frame_pop(vm->frame);
     } break;
 
@@ -227,6 +283,7 @@ void vm_execute_instr(vm_t *vm, int instr) {
     case I_ERROR: {
       value_t *val = varray_pop(vm->stack);
 
+      output_flush();
       printf("Exit with Error number %d\n", value_int_get(val));
       exit(EXIT_FAILURE);
     } break;
@@ -247,6 +304,7 @@ void vm_execute_instr(vm_t *vm, int instr) {
       break;
 
     default:
+      output_flush();
       printf("Unknow opcode: %d\n", vm->program->bytecode[vm->frame->pc - 1]);
       exit(EXIT_FAILURE);
   }
@@ -266,12 +324,192 @@ void vm_execute_instr(vm_t *vm, int instr) {
   }
 }
 
+/** Exécution d'une instruction avec comptage par le profileur.
+ * Les appels et retours de fermetures sont repérés par le changement de
+ * cadre d'appel (l'appel d'une primitive ne change pas de cadre).
+ * \param[in,out] vm l'état de la machine virtuelle (avec profileur).
+ */
+static void vm_execute_instr_profile(vm_t *vm) {
+  frame_t *frame = vm->frame;
+  int instr;
+
+  profile_instr(vm->profile, frame->pc);
+  instr = vm_next(vm);
+  vm_execute_instr(vm, instr);
+
+  if (instr == I_CALL && vm->frame != frame) {
+    // le pc du nouveau cadre est l'entrée de la fermeture
+    profile_call(vm->profile, vm->frame->pc);
+  } else if (instr == I_RETURN) {
+    profile_return(vm->profile);
+  }
+}
+
+/** Exécution d'une instruction avec publication de l'opcode en cours pour
+ * les compteurs matériels (cf. perfctr.h).
+ * \param[in,out] vm l'état de la machine virtuelle (avec compteurs).
+ */
+static void vm_execute_instr_perfctr(vm_t *vm) {
+  perfctr_t *perfctr = vm->perfctr;
+  int instr = vm_next(vm);
+
+  perfctr->opcode = instr;
+  perfctr->executions[instr] = perfctr->executions[instr] + 1;
+  vm_execute_instr(vm, instr);
+}
+
+/** Récupération mémoire, comptée à part par les compteurs matériels. */
+static void vm_collect_perfctr(vm_t *vm) {
+  int opcode = vm->perfctr->opcode;
+  vm->perfctr->opcode = PERFCTR_GC;
+  gc_collect(vm);
+  vm->perfctr->opcode = opcode;
+}
+
+/** Appel d'une fonction depuis une primitive.
+ * La fonction est au sommet de la pile, suivie de ses nb_args arguments
+ * (premier argument juste en-dessous), comme pour l'instruction CALL. Une
+ * fermeture est exécutée par le moteur standard jusqu'à son retour (quel
+ * que soit le moteur de l'appelant) : au retour, son résultat remplace la
+ * fonction et les arguments au sommet de la pile.
+ *
+ * Remarque : le GC peut être déclenché pendant l'appel, les valeurs
+ * utilisées par la primitive appelante doivent donc rester sur la pile.
+ * \param[in,out] vm l'état de la machine virtuelle
+ * \param nb_args le nombre d'arguments.
+ */
+void vm_apply(vm_t *vm, int nb_args) {
+  value_t fun = *varray_pop(vm->stack);
+  frame_t *caller_frame = vm->frame;
+  unsigned int instr_counter = 0;
+  closure_t closure;
+  env_t *env;
+  int perfctr, i;
+
+  if (fun.type == T_PRIM) {
+    execute_prim(vm, vm->stack, value_prim_get(&fun), nb_args);
+    return;
+  } else if (fun.type != T_FUN) {
+    output_flush();
+    printf("Unable to call: %d\n", fun.type);
+    exit(EXIT_FAILURE);
+  }
+
+  closure = value_closure_get(&fun);
+  env = gc_alloc_env(vm->gc, nb_args, closure.env);
+  for (i = 0; i < nb_args; i++) {
+    varray_set_at(env->content, i, varray_top_at(vm->stack, i));
+  }
+  varray_popn(vm->stack, nb_args);
+
+  vm->frame = frame_push(caller_frame, env, vm->stack->top, caller_frame->pc);
+  vm->frame->pc = closure.pc;
+  vm->frame->fun_pc = closure.pc;
+  SVM_PROBE_FUNCTION_ENTRY(closure.pc, nb_args);
+  VM_STATS_CALL(vm);
+  if (vm->profile != NULL) {
+    profile_call(vm->profile, closure.pc);
+  }
+  // les compteurs matériels ne suivent que le moteur standard instrumenté
+  perfctr = (vm->perfctr != NULL && vm->perfctr->opcode != PERFCTR_NONE);
+
+  // on exécute jusqu'au retour dans le cadre de l'appelant (le RETURN
+  // final est compté par le profileur comme un retour de fermeture)
+  while (vm->frame != caller_frame) {
+    if (vm->profile != NULL) {
+      vm_execute_instr_profile(vm);
+    } else if (perfctr) {
+      vm_execute_instr_perfctr(vm);
+    } else {
+      vm_execute_instr(vm, vm_next(vm));
+    }
+
+    instr_counter = instr_counter + 1;
+
+    if (instr_counter == vm->gc->collection_frequency) {
+      if (perfctr) {
+        vm_collect_perfctr(vm);
+      } else {
+        gc_collect(vm);
+      }
+      instr_counter = 0;
+    }
+  }
+  vm->stats.instructions = vm->stats.instructions + instr_counter;
+}
+
+/** Moteur d'exécution instrumenté (option --profile).
+ * Il s'agit de la boucle du moteur standard, dupliquée pour que la boucle
+ * normale ne teste pas la présence du profileur à chaque instruction.
+ * \param[in,out] vm l'état de la machine virtuelle (avec profileur).
+ */
+static void vm_execute_profile(vm_t *vm) {
+  unsigned int instr_counter = 0;
+
+  profile_call(vm->profile, 0);  // le top-niveau
+  while (vm->frame->pc < vm->program->size) {
+    vm_execute_instr_profile(vm);
+
+    instr_counter = instr_counter + 1;
+
+    if (instr_counter == vm->gc->collection_frequency) {
+      gc_collect(vm);
+      instr_counter = 0;
+    }
+  }
+  vm->stats.instructions = vm->stats.instructions + instr_counter;
+  profile_return(vm->profile);
+}
+
+/** Moteur d'exécution instrumenté pour les compteurs matériels (option
+ * --perf-counters), sur le modèle de vm_execute_profile.
+ * \param[in,out] vm l'état de la machine virtuelle (avec compteurs).
+ */
+static void vm_execute_perfctr(vm_t *vm) {
+  unsigned int instr_counter = 0;
+
+  while (vm->frame->pc < vm->program->size) {
+    vm_execute_instr_perfctr(vm);
+
+    instr_counter = instr_counter + 1;
+
+    if (instr_counter == vm->gc->collection_frequency) {
+      vm_collect_perfctr(vm);
+      instr_counter = 0;
+    }
+  }
+  vm->stats.instructions = vm->stats.instructions + instr_counter;
+  vm->perfctr->opcode = PERFCTR_NONE;
+}
+
 /** Moteur d'exécution de la machine virtuelle.
  * \param[in,out] vm l'état de la machine virtuelle
  */
 void vm_execute(vm_t *vm) {
   unsigned int instr_counter = 0;
 
+  // le profileur n'instrumente que le moteur standard
+  if (vm->profile != NULL) {
+    vm_execute_profile(vm);
+    return;
+  }
+
+  // les compteurs ne sont attribués aux opcodes que par le moteur standard
+  if (vm->perfctr != NULL && vm->engine == VM_ENGINE_STACK && !vm->debug_vm) {
+    vm_execute_perfctr(vm);
+    return;
+  }
+
+  // les autres moteurs n'ont pas de mode debug
+  if (vm->engine == VM_ENGINE_TOS && !vm->debug_vm) {
+    vm_execute_tos(vm);
+    return;
+  }
+  if (vm->engine == VM_ENGINE_REG && !vm->debug_vm) {
+    vm_execute_reg(vm);
+    return;
+  }
+
   if (vm->debug_vm) {
     printf("Initial state:\n");
     printf("  PC = %d\n", vm->frame->pc);
@@ -297,6 +535,7 @@ void vm_execute(vm_t *vm) {
       instr_counter = 0;
     }
   }
+  vm->stats.instructions = vm->stats.instructions + instr_counter;
 
   // c'est fini
 }
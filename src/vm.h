@@ -26,23 +26,51 @@
 #include "frame.h"
 #include "gc.h"
 #include "value.h"
+#include "vm_stats.h"
 
 /** La représentation de la machine virtuelle. */
 typedef struct _vm {
   int debug_vm;    /*!< VM en mode debug (1) ou non (0) */
+  int engine;      /*!< le moteur d'exécution (VM_ENGINE_xxx) */
   varray_t *globs; /*!< l'environnement global (variables globales) */
   varray_t *stack; /*!< la pile */
   frame_t *frame;  /*!< la fenêtre d'entrée */
   program_t *program;
+  struct _rprogram *rprogram; /*!< le code registre (cf. regvm.h) */
+  struct _profile *profile;   /*!< le profileur (NULL si désactivé) */
+  struct _perfctr *perfctr;   /*!< les compteurs matériels (ou NULL) */
   gc_t *gc;
+  vm_stats_t stats; /*!< les compteurs d'exécution (cf. vm_stats.h) */
 } vm_t;
 
+/** Comptage d'un appel de fermeture (après l'empilement de son cadre) et
+ * relevé des profondeurs maximales (cf. vm_stats.h). */
+#define VM_STATS_CALL(vm)                                       \
+  do {                                                          \
+    (vm)->stats.closure_calls = (vm)->stats.closure_calls + 1;  \
+    if ((vm)->frame->depth > (vm)->stats.max_frame_depth) {     \
+      (vm)->stats.max_frame_depth = (vm)->frame->depth;         \
+    }                                                           \
+    if ((vm)->stack->top > (vm)->stats.max_stack_depth) {       \
+      (vm)->stats.max_stack_depth = (vm)->stack->top;           \
+    }                                                           \
+  } while (0)
+
 /** La taille allouée pour la pile */
 #define STACK_SIZE 256
 
 /** La taille allouée pour les variables globales */
 #define GLOBS_SIZE 256
 
+/** Moteur d'exécution standard (une pile en mémoire) */
+#define VM_ENGINE_STACK 0
+
+/** Moteur d'exécution avec cache du sommet de pile (cf. vm_tos.c) */
+#define VM_ENGINE_TOS 1
+
+/** Moteur d'exécution du code registre (cf. regvm.h) */
+#define VM_ENGINE_REG 2
+
 /** La fréquence de GC par défaut (en nombre d'instructions exécutées) */
 #define DEFAULT_GC_FREQUENCY 10000
 
@@ -51,8 +79,11 @@ typedef struct _vm {
 vm_t *init_vm(program_t *program, int debug_vm, int debug_gc,
               int collection_frequency);
 
-/* Exécution du bytecode (cf. vm_execute.c) */
+/* Exécution du bytecode (cf. vm.c et vm_tos.c) */
 
 void vm_execute(vm_t *vm);
+void vm_execute_instr(vm_t *vm, int instr);
+void vm_execute_tos(vm_t *vm);
+void vm_apply(vm_t *vm, int nb_args);
 
 #endif
@@ -0,0 +1,131 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include "vm_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc_stats.h"
+
+/** \file vm_stats.c
+ * Compteurs d'exécution et écriture au format texte de Prometheus.
+ ******/
+
+/** Les noms des types d'objets (étiquette `type` des allocations). */
+static const char *vm_stats_type_names[VM_STATS_NB_TYPES] = {
+    "pair", "clist", "vector", "i32vector", "string", "hashtable", "env"};
+
+/** Initialisation des compteurs (à zéro, sans fichier des métriques). */
+void vm_stats_init(vm_stats_t *stats) { memset(stats, 0, sizeof(*stats)); }
+
+/** Écriture des compteurs au format texte de Prometheus.
+ * \param[in] stats les compteurs.
+ * \param[in,out] file le fichier de sortie.
+ */
+void vm_stats_print_prometheus(vm_stats_t *stats, FILE *file) {
+  int i;
+
+  fprintf(file, "# HELP svm_instructions_total Instructions executed.\n");
+  fprintf(file, "# TYPE svm_instructions_total counter\n");
+  fprintf(file, "svm_instructions_total %llu\n", stats->instructions);
+
+  fprintf(file, "# HELP svm_calls_total Calls, by kind of function.\n");
+  fprintf(file, "# TYPE svm_calls_total counter\n");
+  fprintf(file, "svm_calls_total{kind=\"closure\"} %llu\n",
+          stats->closure_calls);
+  fprintf(file, "svm_calls_total{kind=\"prim\"} %llu\n", stats->prim_calls);
+
+  fprintf(file, "# HELP svm_allocations_total Heap objects allocated.\n");
+  fprintf(file, "# TYPE svm_allocations_total counter\n");
+  for (i = 0; i < VM_STATS_NB_TYPES; i++) {
+    fprintf(file, "svm_allocations_total{type=\"%s\"} %llu\n",
+            vm_stats_type_names[i], stats->allocations[i]);
+  }
+
+  fprintf(file, "# HELP svm_gc_cycles_total Garbage collections.\n");
+  fprintf(file, "# TYPE svm_gc_cycles_total counter\n");
+  fprintf(file, "svm_gc_cycles_total %llu\n", stats->gc_cycles);
+
+  fprintf(file,
+          "# HELP svm_gc_pause_seconds_total Time spent in garbage "
+          "collections.\n");
+  fprintf(file, "# TYPE svm_gc_pause_seconds_total counter\n");
+  fprintf(file, "svm_gc_pause_seconds_total %.9f\n",
+          (double)stats->gc_pause_ns / 1e9);
+
+  fprintf(file,
+          "# HELP svm_stack_depth_max Highest value stack depth observed.\n");
+  fprintf(file, "# TYPE svm_stack_depth_max gauge\n");
+  fprintf(file, "svm_stack_depth_max %u\n", stats->max_stack_depth);
+
+  fprintf(file,
+          "# HELP svm_frame_depth_max Deepest call frame nesting observed.\n");
+  fprintf(file, "# TYPE svm_frame_depth_max gauge\n");
+  fprintf(file, "svm_frame_depth_max %u\n", stats->max_frame_depth);
+
+  fprintf(file, "# HELP svm_heap_bytes Bytes in use by heap objects.\n");
+  fprintf(file, "# TYPE svm_heap_bytes gauge\n");
+  fprintf(file, "svm_heap_bytes %llu\n", stats->heap_bytes);
+}
+
+/** Écriture des compteurs dans un fichier.
+ * Le fichier est écrit sous un nom temporaire puis renommé : un lecteur ne
+ * voit jamais un fichier incomplet.
+ * \param[in] stats les compteurs.
+ * \param[in] filename le fichier.
+ */
+void vm_stats_write(vm_stats_t *stats, const char *filename) {
+  size_t length = strlen(filename);
+  char *tmp = (char *)malloc(length + 5);
+  FILE *file;
+
+  if (tmp == NULL) return;
+  memcpy(tmp, filename, length);
+  memcpy(tmp + length, ".tmp", 5);
+
+  file = fopen(tmp, "w");
+  if (file == NULL) {
+    fprintf(stderr, "cannot write metrics file: %s\n", tmp);
+    free(tmp);
+    return;
+  }
+  vm_stats_print_prometheus(stats, file);
+  if (fclose(file) != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "cannot write metrics file: %s\n", filename);
+    remove(tmp);
+  }
+  free(tmp);
+}
+
+/** Écriture périodique des compteurs (option --metrics).
+ * \param[in,out] stats les compteurs.
+ * \param[in] filename le fichier des métriques.
+ * \param period_ms la période d'écriture (en ms).
+ */
+void vm_stats_set_metrics(vm_stats_t *stats, const char *filename,
+                          unsigned int period_ms) {
+  stats->metrics_file = filename;
+  stats->metrics_period_ns = (unsigned long long)period_ms * 1000000ull;
+  stats->metrics_last_ns = gc_stats_now();
+}
+
+/** Écriture du fichier des métriques si la période est écoulée (appelée à
+ * chaque récupération mémoire).
+ * \param[in,out] stats les compteurs.
+ */
+void vm_stats_poll(vm_stats_t *stats) {
+  unsigned long long now;
+
+  if (stats->metrics_file == NULL) return;
+  now = gc_stats_now();
+  if (now - stats->metrics_last_ns >= stats->metrics_period_ns) {
+    vm_stats_write(stats, stats->metrics_file);
+    stats->metrics_last_ns = now;
+  }
+}
@@ -0,0 +1,74 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#ifndef _VM_STATS_H_
+#define _VM_STATS_H_
+
+/** \file vm_stats.h
+ * Compteurs d'exécution de la VM (toujours actifs), exportés au format
+ * texte de Prometheus (option `--metrics=FILE`).
+ *
+ * Les compteurs sont de simples incréments sur les chemins rapides, ou
+ * sont déduits à moindre coût :
+ *  - les instructions sont comptées par paquets de collection_frequency à
+ *    chaque récupération (elles la déclenchent), plus le reste en sortie
+ *    des boucles d'exécution (le moteur reg compte ses instructions
+ *    registre) ;
+ *  - les profondeurs maximales de la pile et des cadres d'appel sont
+ *    relevées aux appels de fermetures et aux récupérations ;
+ *  - la taille du tas est recalculée par le balayage, puis augmentée à
+ *    chaque allocation.
+ *
+ * Avec `--metrics=FILE`, le fichier est réécrit (fichier temporaire puis
+ * renommage, comme l'attend le collecteur "textfile" de node_exporter) à
+ * la première récupération qui suit la fin de chaque période, et en fin
+ * d'exécution.
+ */
+
+#include <stdio.h>
+
+/* Types d'objets comptés par les allocations. */
+#define VM_STATS_PAIR 0      /*!< paires */
+#define VM_STATS_CLIST 1     /*!< blocs de liste compacts */
+#define VM_STATS_VECTOR 2    /*!< vecteurs */
+#define VM_STATS_I32VECTOR 3 /*!< vecteurs d'entiers */
+#define VM_STATS_STRING 4    /*!< chaînes */
+#define VM_STATS_HASHTABLE 5 /*!< tables de hachage */
+#define VM_STATS_ENV 6       /*!< environnements */
+#define VM_STATS_NB_TYPES 7
+
+/** Période d'écriture par défaut du fichier des métriques (en ms). */
+#define VM_STATS_DEFAULT_PERIOD 1000
+
+/** Les compteurs d'une VM. */
+typedef struct _vm_stats {
+  unsigned long long instructions;  /*!< les instructions exécutées */
+  unsigned long long closure_calls; /*!< les appels de fermetures */
+  unsigned long long prim_calls;    /*!< les appels de primitives */
+  /** les allocations, par type d'objet */
+  unsigned long long allocations[VM_STATS_NB_TYPES];
+  unsigned long long gc_cycles;   /*!< les récupérations mémoire */
+  unsigned long long gc_pause_ns; /*!< leur durée totale (ns) */
+  unsigned int max_stack_depth;   /*!< la hauteur maximale de la pile */
+  unsigned int max_frame_depth;   /*!< la profondeur maximale des appels */
+  unsigned long long heap_bytes;  /*!< la taille courante du tas */
+
+  const char *metrics_file; /*!< le fichier des métriques (ou NULL) */
+  unsigned long long metrics_period_ns; /*!< la période d'écriture */
+  unsigned long long metrics_last_ns;   /*!< la dernière écriture */
+} vm_stats_t;
+
+void vm_stats_init(vm_stats_t *stats);
+
+void vm_stats_print_prometheus(vm_stats_t *stats, FILE *file);
+void vm_stats_write(vm_stats_t *stats, const char *filename);
+
+void vm_stats_set_metrics(vm_stats_t *stats, const char *filename,
+                          unsigned int period_ms);
+void vm_stats_poll(vm_stats_t *stats);
+
+#endif
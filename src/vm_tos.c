@@ -0,0 +1,316 @@
+/* UPMC -- licence informatique
+ * (C) 2009-2011 Equipe enseignante
+ * LI223: Initiation à la Compilation et aux Machines Virtuelles
+ *
+ * Redistribution possible sous licence GPL v2.0 ou ultérieure
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "output.h"
+#include "prim.h"
+#include "probes.h"
+#include "vm.h"
+
+/** \file vm_tos.c
+ * Moteur d'exécution avec cache du sommet de pile (top-of-stack caching).
+ *
+ * Les une ou deux valeurs au sommet de la pile "virtuelle" sont conservées
+ * dans des variables locales (r0 pour le sommet, r1 pour la valeur
+ * en-dessous) et le compteur de programme dans une variable locale. Le
+ * nombre de valeurs en cache (0, 1 ou 2) fait partie de l'état de
+ * l'interpréteur : chaque instruction fréquente a une variante par état.
+ *
+ * Le cache est vidé (spill) sur la pile de la VM lorsque celle-ci doit être
+ * cohérente : avant le GC, aux appels de fonctions et de primitives (hors
+ * cas rapides) et pour les instructions rares, qui sont déléguées au
+ * moteur standard (cf. vm_execute_instr).
+ ******/
+
+/** L'état du moteur : instruction et nombre de valeurs en cache. */
+#define TOS_STATE(op, cached) ((op)*3 + (cached))
+
+/** Empiler une valeur sur la pile de la VM (sans vérification). */
+static void tos_push(varray_t *stack, value_t *value) {
+  if (stack->top < stack->capacity) {
+    stack->content[stack->top] = *value;
+    stack->top = stack->top + 1;
+  } else {
+    varray_push(stack, value);
+  }
+}
+
+/** Vider le cache sur la pile de la VM. */
+#define TOS_SPILL()                          \
+  do {                                       \
+    if (cached == 2) tos_push(stack, &r1);   \
+    if (cached >= 1) tos_push(stack, &r0);   \
+    cached = 0;                              \
+  } while (0)
+
+/** Placer la valeur v au sommet de la pile virtuelle. */
+#define TOS_PRODUCE(v)                       \
+  do {                                       \
+    if (cached == 2) tos_push(stack, &r1);   \
+    if (cached >= 1) r1 = r0;                \
+    r0 = (v);                                \
+    if (cached < 2) cached = cached + 1;     \
+  } while (0)
+
+/** Retirer le sommet de la pile virtuelle et le placer dans v. */
+#define TOS_CONSUME(v)                       \
+  do {                                       \
+    if (cached == 0) {                       \
+      stack->top = stack->top - 1;           \
+      (v) = stack->content[stack->top];      \
+    } else {                                 \
+      (v) = r0;                              \
+      r0 = r1;                               \
+      cached = cached - 1;                   \
+    }                                        \
+  } while (0)
+
+/** Les trois variantes d'une instruction qui empile la valeur v
+ * (calculée dans la variable locale `v` par `compute`). */
+#define TOS_PRODUCE_CASES(op, compute) \
+  case TOS_STATE(op, 0):               \
+    compute;                           \
+    r0 = v;                            \
+    cached = 1;                        \
+    break;                             \
+  case TOS_STATE(op, 1):               \
+    compute;                           \
+    r1 = r0;                           \
+    r0 = v;                            \
+    cached = 2;                        \
+    break;                             \
+  case TOS_STATE(op, 2):               \
+    compute;                           \
+    tos_push(stack, &r1);              \
+    r1 = r0;                           \
+    r0 = v;                            \
+    break;
+
+/** Les trois variantes d'une instruction qui dépile une valeur dans la
+ * variable locale `v` avant d'exécuter `body`. */
+#define TOS_CONSUME_CASES(op, body)       \
+  case TOS_STATE(op, 0):                  \
+    stack->top = stack->top - 1;          \
+    v = stack->content[stack->top];       \
+    body;                                 \
+    break;                                \
+  case TOS_STATE(op, 1):                  \
+    v = r0;                               \
+    cached = 0;                           \
+    body;                                 \
+    break;                                \
+  case TOS_STATE(op, 2):                  \
+    v = r0;                               \
+    r0 = r1;                              \
+    cached = 1;                           \
+    body;                                 \
+    break;
+
+/** Calcul de la valeur immédiate d'un PUSH.
+ * \param[in] vm l'état de la machine virtuelle.
+ * \param[in] code le bytecode.
+ * \param[in,out] pc le compteur de programme (après l'opcode).
+ * \param[out] value la valeur à empiler.
+ */
+static void tos_push_value(vm_t *vm, int *code, unsigned int *pc,
+                           value_t *value) {
+  int type = code[(*pc)++];
+  switch (type) {
+    case T_INT:
+      value_fill_int(value, code[(*pc)++]);
+      break;
+    case T_UNIT:
+      value_fill_unit(value);
+      break;
+    case T_FUN: {
+      closure_t closure;
+      closure.env = vm->frame->env;
+      closure.pc = code[(*pc)++];
+      value_fill_closure(value, closure);
+    } break;
+    case T_PRIM:
+      value_fill_prim(value, code[(*pc)++]);
+      break;
+    case T_BOOL:
+      value_fill_bool(value, code[(*pc)++]);
+      break;
+    case T_STRING:
+      *value = vm->program->strings[code[(*pc)++]];
+      break;
+    case T_SYMBOL:
+      *value = vm->program->symbols[code[(*pc)++]];
+      break;
+    case T_CONST:
+      *value = vm->program->consts[code[(*pc)++]];
+      break;
+    default:
+      output_flush();
+      printf("Unknow type: %d (in push)\n", type);
+      exit(EXIT_FAILURE);
+  }
+}
+
+/** Moteur d'exécution avec cache du sommet de pile.
+ * \param[in,out] vm l'état de la machine virtuelle
+ */
+void vm_execute_tos(vm_t *vm) {
+  varray_t *stack = vm->stack;
+  int *code = vm->program->bytecode;
+  unsigned int pc = vm->frame->pc;
+  unsigned int instr_counter = 0;
+  value_t r0, r1, v;
+  int cached = 0;
+
+/** Accès à la n-ième valeur depuis le sommet de la pile virtuelle. */
+#define TOS_AT(n)                                       \
+  (((n) < cached) ? (((n) == 0) ? &r0 : &r1)            \
+                  : &stack->content[stack->top - 1 - ((n)-cached)])
+
+  while (pc < vm->program->size) {
+    int op = code[pc++];
+
+    switch (TOS_STATE(op, cached)) {
+      TOS_PRODUCE_CASES(I_PUSH, tos_push_value(vm, code, &pc, &v))
+      TOS_PRODUCE_CASES(I_CONST, v = vm->program->consts[code[pc++]])
+      TOS_PRODUCE_CASES(I_FETCH, v = *env_fetch(vm->frame->env, code[pc++]))
+      TOS_PRODUCE_CASES(I_GFETCH, v = *varray_at(vm->globs, code[pc++]))
+      TOS_PRODUCE_CASES(I_SFETCH, v = *TOS_AT(code[pc]); pc++)
+
+      TOS_CONSUME_CASES(I_STORE, env_store(vm->frame->env, code[pc++], &v))
+      TOS_CONSUME_CASES(I_GSTORE, varray_set_at(vm->globs, code[pc++], &v))
+      TOS_CONSUME_CASES(I_SSTORE, *TOS_AT(code[pc]) = v; pc++)
+      TOS_CONSUME_CASES(I_JFALSE, pc = value_is_false(&v) ? code[pc] : pc + 1)
+      TOS_CONSUME_CASES(I_POP, {
+        if (stack->top + cached == 0 && vm->frame->caller_frame == NULL) {
+          // on affiche les valeurs <<popée>> au top-niveau
+          value_print(&v);
+          output_char('\n');
+        }
+      })
+
+      case TOS_STATE(I_JUMP, 0):
+      case TOS_STATE(I_JUMP, 1):
+      case TOS_STATE(I_JUMP, 2):
+        pc = code[pc];
+        break;
+
+      case TOS_STATE(I_SLIDE, 0):
+      case TOS_STATE(I_SLIDE, 1):
+      case TOS_STATE(I_SLIDE, 2): {
+        int n = code[pc++];
+        value_t res;
+        TOS_CONSUME(res);
+        while (n > 0 && cached > 0) {
+          r0 = r1;
+          cached = cached - 1;
+          n = n - 1;
+        }
+        stack->top = stack->top - n;
+        TOS_PRODUCE(res);
+      } break;
+
+      case TOS_STATE(I_CALL, 0):
+      case TOS_STATE(I_CALL, 1):
+      case TOS_STATE(I_CALL, 2): {
+        value_t fun;
+        int nb_args = code[pc++];
+        TOS_CONSUME(fun);
+
+        if (fun.type == T_PRIM) {
+          int prim = fun.data.as_int;
+          const prim_desc_t *desc = prim_get(prim);
+          value_t res;
+          // cas rapides : arguments en cache et point d'entrée rapide du
+          // descripteur (cf. prim.h), le premier argument est dans r0
+          if (desc != NULL && nb_args == 2 && cached == 2 &&
+              desc->prim2 != NULL && desc->prim2(vm, &r0, &r1, &res)) {
+            r0 = res;
+            cached = 1;
+            SVM_PROBE_PRIM_ENTRY(prim, nb_args, desc->name);
+            vm->stats.prim_calls = vm->stats.prim_calls + 1;
+          } else if (desc != NULL && nb_args == 1 && cached >= 1 &&
+                     desc->prim1 != NULL && desc->prim1(vm, &r0, &res)) {
+            r0 = res;
+            SVM_PROBE_PRIM_ENTRY(prim, nb_args, desc->name);
+            vm->stats.prim_calls = vm->stats.prim_calls + 1;
+          } else {
+            TOS_SPILL();
+            vm->frame->pc = pc;
+            execute_prim(vm, stack, prim, nb_args);
+          }
+        } else if (fun.type == T_FUN) {
+          int i;
+          closure_t closure = fun.data.as_closure;
+          env_t *env;
+
+          TOS_SPILL();
+          env = gc_alloc_env(vm->gc, nb_args, closure.env);
+          for (i = 0; i < nb_args; i++) {
+            varray_set_at(env->content, i, varray_top_at(stack, i));
+          }
+          varray_popn(stack, nb_args);
+
+          vm->frame->pc = pc;
+          vm->frame = frame_push(vm->frame, env, stack->top, pc);
+          vm->frame->pc = closure.pc;
+          vm->frame->fun_pc = closure.pc;
+          SVM_PROBE_FUNCTION_ENTRY(closure.pc, nb_args);
+          VM_STATS_CALL(vm);
+          pc = closure.pc;
+        } else {
+          output_flush();
+          printf("Unable to call: %d\n", fun.type);
+          exit(EXIT_FAILURE);
+        }
+      } break;
+
+      case TOS_STATE(I_RETURN, 0):
+      case TOS_STATE(I_RETURN, 1):
+      case TOS_STATE(I_RETURN, 2): {
+        value_t res;
+        TOS_CONSUME(res);
+        // il faut se déplacer dans le bon sens
+        assert(stack->top + cached >= vm->frame->sp);
+        // les valeurs en cache appartiennent au cadre qui se termine
+        cached = 0;
+        stack->top = vm->frame->sp;
+        SVM_PROBE_FUNCTION_RETURN(vm->frame->fun_pc);
+        vm->frame = frame_pop(vm->frame);
+        pc = vm->frame->pc;
+        r0 = res;
+        cached = 1;
+      } break;
+
+      default:
+        // instructions rares : on délègue au moteur standard
+        TOS_SPILL();
+        vm->frame->pc = pc;
+        vm_execute_instr(vm, op);
+        pc = vm->frame->pc;
+    }
+
+    instr_counter = instr_counter + 1;
+
+    if (instr_counter == vm->gc->collection_frequency) {
+      // le GC doit voir toutes les valeurs sur la pile
+      TOS_SPILL();
+      vm->frame->pc = pc;
+      gc_collect(vm);
+      instr_counter = 0;
+    }
+  }
+  vm->stats.instructions = vm->stats.instructions + instr_counter;
+
+  TOS_SPILL();
+  vm->frame->pc = pc;
+
+#undef TOS_AT
+}